@@ -30,7 +30,7 @@ import java.nio.ByteBuffer;
  */
 public interface IFrameCallback {
 	/**
-	 * This method is called from native library via JNI on the same thread as UVCCamera#startCapture.
+	 * This method is called from native library via JNI on the dedicated thread of each callback.
 	 * You can use both UVCCamera#startCapture and #setFrameCallback
 	 * but it is better to use either for better performance.
 	 * You can also pass pixel format type to UVCCamera#setFrameCallback for this method.
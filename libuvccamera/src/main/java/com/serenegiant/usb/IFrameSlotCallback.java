@@ -0,0 +1,45 @@
+/*
+ *  UVCCamera
+ *  library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ *  All files in the folder are under this Apache License, Version 2.0.
+ *  Files in the libjpeg-turbo, libusb, libuvc, rapidjson folder
+ *  may have a different license, see the respective files.
+ */
+
+package com.serenegiant.usb;
+
+/**
+ * Callback interface for UVCCamera class that receives frames via pre-registered buffers.
+ * UVCCamera#setFrameCallback(IFrameSlotCallback, int, int) returns fixed number of direct ByteBuffers,
+ * each frame is written into one of them and only its index is passed to this callback,
+ * so no Java object is created for each frame.
+ * The slot is not overwritten until you call UVCCamera#releaseFrameSlot,
+ * so you can keep several frames at once and release them on other thread.
+ * Frames are dropped while all slots are held.
+ * The slots are allocated for the preview size at registration and never resized,
+ * so UVCCamera#switchFormat fails if frames of new size do not fit into them.
+ */
+public interface IFrameSlotCallback {
+	/**
+	 * This method is called from native library via JNI on the thread of this callback.
+	 * @param slot index of ByteBuffer array that was returned by UVCCamera#setFrameCallback
+	 * @param length number of valid bytes from the beginning of the buffer
+	 * @param timestampUs capture time of the frame in microseconds(CLOCK_MONOTONIC)
+	 */
+	public void onFrame(int slot, int length, long timestampUs);
+}
@@ -23,6 +23,7 @@
 
 package com.serenegiant.usb;
 
+import java.nio.ByteBuffer;
 import java.util.ArrayList;
 import java.util.List;
 
@@ -54,6 +55,8 @@ public class UVCCamera {
 	public static final int FRAME_FORMAT_YUYV = 0;
 	public static final int FRAME_FORMAT_MJPEG = 1;
 
+	// PIXEL_FORMAT_RAW and PIXEL_FORMAT_YUV without callback size receive frames as they came from the camera,
+	// that are MJPEG frames when the frame format is FRAME_FORMAT_MJPEG
 	public static final int PIXEL_FORMAT_RAW = 0;
 	public static final int PIXEL_FORMAT_YUV = 1;
 	public static final int PIXEL_FORMAT_RGB565 = 2;
@@ -61,6 +64,17 @@ public class UVCCamera {
 	public static final int PIXEL_FORMAT_YUV420SP = 4;
 	public static final int PIXEL_FORMAT_NV21 = 5;		// = YVU420SemiPlanar
 
+	public static final int DECODE_SKIP_NONE = 0;
+	public static final int DECODE_SKIP_EXACT = 1;
+	public static final int DECODE_SKIP_SAMPLED = 2;	// compare only sampled part of MJPEG payload
+
+	public static final int DECODE_PROFILE_FASTEST = 0;		// fast DCT, no fancy upsampling
+	public static final int DECODE_PROFILE_BALANCED = 1;	// fast DCT, fancy upsampling(default)
+	public static final int DECODE_PROFILE_ACCURATE = 2;	// accurate DCT, fancy upsampling
+
+	public static final int PREVIEW_STAGE_DECODE = 0;		// decode/convert on the preview thread
+	public static final int PREVIEW_STAGE_PRESENT = 1;		// lock, write and post the Surface
+
 	//--------------------------------------------------------------------------------
     public static final int	CTRL_SCANNING		= 0x00000001;	// D0:  Scanning Mode
     public static final int CTRL_AE				= 0x00000002;	// D1:  Auto-Exposure Mode
@@ -380,6 +394,63 @@ private static String[] librarySo={"jpeg-turbo1500","usb100","uvc","UVCCamera"};
 		}
 	}
 
+	/**
+	 * Switch preview size and/or frame format while previewing
+	 * without tearing down preview threads, surfaces and frame callbacks.
+	 * This is same as #setPreviewSize if preview is not running.
+	 * @param width
+	 * @param height
+	 * @param frameFormat either FRAME_FORMAT_YUYV(0) or FRAME_FORMAT_MJPEG(1)
+	 */
+	public void switchFormat(final int width, final int height, final int frameFormat) {
+		switchFormat(width, height, DEFAULT_PREVIEW_MIN_FPS, DEFAULT_PREVIEW_MAX_FPS, frameFormat, mCurrentBandwidthFactor);
+	}
+
+	/**
+	 * Switch preview size and/or frame format while previewing
+	 * without tearing down preview threads, surfaces and frame callbacks.
+	 * If the camera does not accept new format, previous one is restored and IllegalArgumentException is thrown.
+	 * Same applies when frames of new format do not fit into the slots of a registered IFrameSlotCallback,
+	 * because its ByteBuffers can not be resized. Remove it, switch and add it again in that case.
+	 * @param width
+	 * @param height
+	 * @param min_fps
+	 * @param max_fps
+	 * @param frameFormat either FRAME_FORMAT_YUYV(0) or FRAME_FORMAT_MJPEG(1)
+	 * @param bandwidthFactor
+	 */
+	public synchronized void switchFormat(final int width, final int height, final int min_fps, final int max_fps, final int frameFormat, final float bandwidthFactor) {
+		if ((width == 0) || (height == 0))
+			throw new IllegalArgumentException("invalid preview size");
+		if (mNativePtr != 0) {
+			final int result = nativeSwitchFormat(mNativePtr, width, height, min_fps, max_fps, frameFormat, bandwidthFactor);
+			if (result != 0)
+				throw new IllegalArgumentException("Failed to switch format");
+			mCurrentFrameFormat = frameFormat;
+			mCurrentWidth = width;
+			mCurrentHeight = height;
+			mCurrentBandwidthFactor = bandwidthFactor;
+		}
+	}
+
+	/**
+	 * get time from the last #switchFormat request to the first frame with new format
+	 * @return time in microseconds, -1 if the first frame has not arrived yet or not available
+	 */
+	public synchronized int getSwitchTime() {
+		return mNativePtr != 0 ? nativeGetSwitchTime(mNativePtr) : -1;
+	}
+
+	/**
+	 * free idle frame buffers that are kept in the native frame pool shared by all cameras.
+	 * buffers are not freed on stopping preview or switching format because other cameras
+	 * and pipelines may reuse them, call this from ComponentCallbacks2#onTrimMemory
+	 * or #onLowMemory when the process is under memory pressure
+	 */
+	public static void trimFramePool() {
+		nativeTrimFramePool();
+	}
+
 	public List<Size> getSupportedSizeList() {
 		final int type = (mCurrentFrameFormat > 0) ? 6 : 4;
 		return getSupportedSize(type, mSupportedSize);
@@ -453,8 +524,132 @@ private static String[] librarySo={"jpeg-turbo1500","usb100","uvc","UVCCamera"};
      * @param pixelFormat
      */
     public void setFrameCallback(final IFrameCallback callback, final int pixelFormat) {
+    	setFrameCallback(callback, pixelFormat, 0, 0, 0.0f);
+    }
+
+    /**
+     * set frame callback with its own size and frame rate.
+     * frames that exceed maxFps are skipped before any conversion,
+     * so low rate/small size consumer does not force full rate/full size conversion.
+     * @param callback
+     * @param pixelFormat
+     * @param width width of frames for callback, 0 for same as preview, ignored for PIXEL_FORMAT_RAW
+     * @param height height of frames for callback, 0 for same as preview, ignored for PIXEL_FORMAT_RAW
+     * @param maxFps maximum frame rate of callback, 0 for every frame
+     */
+    public void setFrameCallback(final IFrameCallback callback, final int pixelFormat,
+    	final int width, final int height, final float maxFps) {
+
+    	if (mNativePtr != 0) {
+        	nativeSetFrameCallback(mNativePtr, callback, pixelFormat, width, height, maxFps);
+    	}
+    }
+
+    /**
+     * set frame callback that receives frames via fixed number of pre-registered buffers.
+     * the buffers depend on current preview size, so call this after #setPreviewSize.
+     * the returned buffers must not be accessed after the callback is changed/cleared,
+     * preview is stopped or camera is destroyed.
+     * @param callback
+     * @param pixelFormat
+     * @param numSlots number of buffers, 1 to 16
+     * @return direct ByteBuffers indexed by slot, null if failed
+     */
+    public ByteBuffer[] setFrameCallback(final IFrameSlotCallback callback, final int pixelFormat, final int numSlots) {
+    	return setFrameCallback(callback, pixelFormat, numSlots, 0, 0, 0.0f);
+    }
+
+    /**
+     * set slot frame callback with its own size and frame rate
+     * @param callback
+     * @param pixelFormat
+     * @param numSlots number of buffers, 1 to 16
+     * @param width same as #setFrameCallback(IFrameCallback, int, int, int, float)
+     * @param height same as #setFrameCallback(IFrameCallback, int, int, int, float)
+     * @param maxFps same as #setFrameCallback(IFrameCallback, int, int, int, float)
+     * @return direct ByteBuffers indexed by slot, null if failed
+     */
+    public ByteBuffer[] setFrameCallback(final IFrameSlotCallback callback, final int pixelFormat, final int numSlots,
+    	final int width, final int height, final float maxFps) {
+
+    	if (mNativePtr != 0) {
+        	return nativeSetFrameSlotCallback(mNativePtr, callback, pixelFormat, numSlots, width, height, maxFps);
+    	}
+    	return null;
+    }
+
+    /**
+     * return the slot that was passed to IFrameSlotCallback#onFrame so that it can be reused
+     * @param slot
+     */
+    public void releaseFrameSlot(final int slot) {
+    	if (mNativePtr != 0) {
+    		nativeReleaseFrameSlot(mNativePtr, null, slot);
+    	}
+    }
+
+    /**
+     * return the slot that was passed to IFrameSlotCallback#onFrame of the callback
+     * that was added by #addFrameCallback(IFrameSlotCallback, int, int, int, int, float)
+     * @param callback
+     * @param slot
+     */
+    public void releaseFrameSlot(final IFrameSlotCallback callback, final int slot) {
     	if (mNativePtr != 0) {
-        	nativeSetFrameCallback(mNativePtr, callback, pixelFormat);
+    		nativeReleaseFrameSlot(mNativePtr, callback, slot);
+    	}
+    }
+
+    /**
+     * add frame callback in addition to the callback set by #setFrameCallback.
+     * each callback has its own pixel format, size, frame rate and thread,
+     * so slow callback does not stall others. same conversion is executed only once
+     * even if several callbacks request it. if the callback is already added, its parameters are updated.
+     * @param callback
+     * @param pixelFormat
+     * @param width width of frames for callback, 0 for same as preview, ignored for PIXEL_FORMAT_RAW
+     * @param height height of frames for callback, 0 for same as preview, ignored for PIXEL_FORMAT_RAW
+     * @param maxFps maximum frame rate of callback, 0 for every frame
+     * @return true if success
+     */
+    public boolean addFrameCallback(final IFrameCallback callback, final int pixelFormat,
+    	final int width, final int height, final float maxFps) {
+
+    	if ((mNativePtr != 0) && (callback != null)) {
+    		return nativeAddFrameCallback(mNativePtr, callback, pixelFormat, width, height, maxFps) == 0;
+    	}
+    	return false;
+    }
+
+    /**
+     * add slot frame callback in addition to the callback set by #setFrameCallback.
+     * use #releaseFrameSlot(IFrameSlotCallback, int) to return the slots.
+     * @param callback
+     * @param pixelFormat
+     * @param numSlots number of buffers, 1 to 16
+     * @param width same as #addFrameCallback(IFrameCallback, int, int, int, float)
+     * @param height same as #addFrameCallback(IFrameCallback, int, int, int, float)
+     * @param maxFps same as #addFrameCallback(IFrameCallback, int, int, int, float)
+     * @return direct ByteBuffers indexed by slot, null if failed
+     */
+    public ByteBuffer[] addFrameCallback(final IFrameSlotCallback callback, final int pixelFormat, final int numSlots,
+    	final int width, final int height, final float maxFps) {
+
+    	if ((mNativePtr != 0) && (callback != null)) {
+    		return nativeAddFrameSlotCallback(mNativePtr, callback, pixelFormat, numSlots, width, height, maxFps);
+    	}
+    	return null;
+    }
+
+    /**
+     * remove the callback that was added by #addFrameCallback or set by #setFrameCallback.
+     * this should not be called from the callback itself.
+     * buffers of IFrameSlotCallback must not be accessed after this.
+     * @param callback IFrameCallback or IFrameSlotCallback
+     */
+    public void removeFrameCallback(final Object callback) {
+    	if ((mNativePtr != 0) && (callback != null)) {
+    		nativeRemoveFrameCallback(mNativePtr, callback);
     	}
     }
 
@@ -1087,11 +1282,23 @@ private static String[] librarySo={"jpeg-turbo1500","usb100","uvc","UVCCamera"};
 	private static final native int nativeSetButtonCallback(final long mNativePtr, final IButtonCallback callback);
 
     private static final native int nativeSetPreviewSize(final long id_camera, final int width, final int height, final int min_fps, final int max_fps, final int mode, final float bandwidth);
+    private static final native int nativeSwitchFormat(final long id_camera, final int width, final int height, final int min_fps, final int max_fps, final int mode, final float bandwidth);
+    private static final native int nativeGetSwitchTime(final long id_camera);
+    private static final native void nativeTrimFramePool();
     private static final native String nativeGetSupportedSize(final long id_camera);
     private static final native int nativeStartPreview(final long id_camera);
     private static final native int nativeStopPreview(final long id_camera);
     private static final native int nativeSetPreviewDisplay(final long id_camera, final Surface surface);
-    private static final native int nativeSetFrameCallback(final long mNativePtr, final IFrameCallback callback, final int pixelFormat);
+    private static final native int nativeSetFrameCallback(final long mNativePtr, final IFrameCallback callback, final int pixelFormat,
+    	final int width, final int height, final float maxFps);
+    private static final native ByteBuffer[] nativeSetFrameSlotCallback(final long mNativePtr, final IFrameSlotCallback callback, final int pixelFormat, final int numSlots,
+    	final int width, final int height, final float maxFps);
+    private static final native int nativeAddFrameCallback(final long mNativePtr, final IFrameCallback callback, final int pixelFormat,
+    	final int width, final int height, final float maxFps);
+    private static final native ByteBuffer[] nativeAddFrameSlotCallback(final long mNativePtr, final IFrameSlotCallback callback, final int pixelFormat, final int numSlots,
+    	final int width, final int height, final float maxFps);
+    private static final native int nativeRemoveFrameCallback(final long mNativePtr, final Object callback);
+    private static final native int nativeReleaseFrameSlot(final long mNativePtr, final IFrameSlotCallback callback, final int slot);
 
 //**********************************************************************
     /**
@@ -1115,6 +1322,112 @@ private static String[] librarySo={"jpeg-turbo1500","usb100","uvc","UVCCamera"};
     }
     private static final native int nativeSetCaptureDisplay(final long id_camera, final Surface surface);
 
+    /**
+     * capture still image(s) as JPEG on native side(this should call while previewing)
+     * MJPEG frames are written without re-compression.
+     * @param path file path to write, if numFrames is more than 1,
+     * 		each frame is written to path + "_%03d.jpg"(trailing ".jpg" of path is removed)
+     * @param numFrames number of consecutive frames to capture
+     * @param quality JPEG quality(1-100)
+     * @return 0 if capturing started, otherwise error (already capturing or not previewing)
+     */
+    public synchronized int captureStill(final String path, final int numFrames, final int quality) {
+    	if ((mCtrlBlock != null) && (path != null)) {
+    		return nativeCaptureStill(mNativePtr, path, numFrames, quality);
+    	}
+    	return -1;
+    }
+    private static final native int nativeCaptureStill(final long id_camera, final String path, final int numFrames, final int quality);
+
+    /**
+     * set whether decoding of MJPEG frames that are same as previous one is skipped,
+     * previous decoded result is reused for them and the preview Surface keeps showing
+     * the previous frame. this is useful for static scenes.
+     * @param mode DECODE_SKIP_NONE, DECODE_SKIP_EXACT or DECODE_SKIP_SAMPLED
+     */
+    public synchronized void setDecodeSkipMode(final int mode) {
+    	if (mNativePtr != 0) {
+    		nativeSetDecodeSkipMode(mNativePtr, mode);
+    	}
+    }
+
+    /**
+     * get number of MJPEG decodes that were skipped since preview started
+     * @return
+     */
+    public synchronized int getSkippedDecodeCount() {
+    	return mNativePtr != 0 ? nativeGetSkippedDecodeCount(mNativePtr) : 0;
+    }
+    private static final native int nativeSetDecodeSkipMode(final long id_camera, final int mode);
+
+    /**
+     * set MJPEG decoder profile of preview, this trades image quality for decoding speed
+     * @param profile DECODE_PROFILE_FASTEST, DECODE_PROFILE_BALANCED or DECODE_PROFILE_ACCURATE
+     */
+    public synchronized void setDecodeProfile(final int profile) {
+    	if (mNativePtr != 0) {
+    		nativeSetDecodeProfile(mNativePtr, profile);
+    	}
+    }
+    private static final native int nativeSetDecodeProfile(final long id_camera, final int profile);
+
+    /**
+     * set low latency preview mode. if this is enabled, preview always renders newest frame
+     * and stale frames are dropped instead of rendering every frame.
+     * @param enable
+     */
+    public synchronized void setLowLatencyMode(final boolean enable) {
+    	if (mNativePtr != 0) {
+    		nativeSetLowLatencyMode(mNativePtr, enable);
+    	}
+    }
+
+    /**
+     * get latency from capture on the camera to posting the frame on the preview Surface
+     * over recent frames
+     * @param percentile 0-100, 50 for median
+     * @return latency in microseconds, -1 if not available
+     */
+    public synchronized int getPreviewLatency(final int percentile) {
+    	return mNativePtr != 0 ? nativeGetPreviewLatency(mNativePtr, percentile) : -1;
+    }
+
+    /**
+     * get number of frames that were dropped by low latency mode since preview started
+     * @return
+     */
+    public synchronized int getStaleDropCount() {
+    	return mNativePtr != 0 ? nativeGetStaleDropCount(mNativePtr) : 0;
+    }
+    private static final native int nativeSetLowLatencyMode(final long id_camera, final boolean enable);
+    private static final native int nativeGetPreviewLatency(final long id_camera, final int percentile);
+    private static final native int nativeGetStaleDropCount(final long id_camera);
+
+    /**
+     * set whether preview runs as two-stage pipeline, decoding/converting and posting the Surface
+     * run on separate threads so that next frame can be decoded while current frame is posted.
+     * this is applied when preview starts next time.
+     * @param enable
+     */
+    public synchronized void setPipelinedPreview(final boolean enable) {
+    	if (mNativePtr != 0) {
+    		nativeSetPipelinedPreview(mNativePtr, enable);
+    	}
+    }
+
+    /**
+     * get time spent in the stage of preview per frame since preview started
+     * @param stage PREVIEW_STAGE_DECODE or PREVIEW_STAGE_PRESENT
+     * @param max if true, return maximum time instead of average
+     * @return time in microseconds, -1 if not available
+     */
+    public synchronized int getPreviewStageTime(final int stage, final boolean max) {
+    	return mNativePtr != 0 ? nativeGetPreviewStageTime(mNativePtr, stage, max) : -1;
+    }
+    private static final native int nativeSetPipelinedPreview(final long id_camera, final boolean enable);
+    private static final native int nativeGetPreviewStageTime(final long id_camera, final int stage, final boolean max);
+    private static final native int nativeGetSkippedDecodeCount(final long id_camera);
+
     private static final native long nativeGetCtrlSupports(final long id_camera);
     private static final native long nativeGetProcSupports(final long id_camera);
 
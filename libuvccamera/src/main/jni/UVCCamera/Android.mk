@@ -57,6 +57,11 @@ LOCAL_SRC_FILES := \
 		utilbase.cpp \
 		UVCCamera.cpp \
 		UVCPreview.cpp \
+		FramePool.cpp \
+		SharedFrame.cpp \
+		FrameSlotRing.cpp \
+		FrameCallback.cpp \
+		RenderTarget.cpp \
 		UVCButtonCallback.cpp \
 		UVCStatusCallback.cpp \
 		Parameters.cpp \
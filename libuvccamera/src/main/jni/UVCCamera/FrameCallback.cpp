@@ -0,0 +1,376 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: FrameCallback.cpp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if 1	// set 1 if you don't need debug log
+	#ifndef LOG_NDEBUG
+		#define	LOG_NDEBUG		// w/o LOGV/LOGD/MARK
+	#endif
+	#undef USE_LOGALL
+#else
+	#define USE_LOGALL
+	#undef LOG_NDEBUG
+//	#undef NDEBUG
+#endif
+
+#pragma implementation "FrameCallback.h"
+#include "utilbase.h"
+#include "FrameCallback.h"
+
+static inline int64_t monotonic_us() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/*private*/
+FrameCallback::FrameCallback(jobject callback_obj, int pixel_format, int width, int height, float max_fps)
+:	mCallbackObj(callback_obj),
+	onFrame(NULL),
+	onFrameSlot(NULL),
+	mPixelFormat(pixel_format),
+	mConvertFunc(NULL),
+	mPixelBytes(0),
+	mOversizeLogged(false),
+	mWidth((width > 0) && (height > 0) && (pixel_format != PIXEL_FORMAT_RAW) ? width & ~1 : 0),	// YUYV needs even width
+	mHeight((width > 0) && (height > 0) && (pixel_format != PIXEL_FORMAT_RAW) ? height : 0),
+	mIntervalUs(max_fps > 0.0f ? (int64_t)(1000000.0f / max_fps) : 0),
+	nextFrameTime(0),
+	mFrameSlots(NULL),
+	mIsRunning(false),
+	frames(MAX_CALLBACK_FRAMES),
+	mDropCount(0) {
+
+	pthread_mutex_init(&callback_mutex, NULL);
+	pthread_cond_init(&callback_sync, NULL);
+}
+
+/*private*/
+FrameCallback::~FrameCallback() {
+	clearFrames();
+	SAFE_DELETE(mFrameSlots);
+	pthread_mutex_destroy(&callback_mutex);
+	pthread_cond_destroy(&callback_sync);
+}
+
+/**
+ * create consumer and start its thread
+ * @param callback_obj global reference of IFrameCallback/IFrameSlotCallback, this is deleted if failed
+ * @param width, height size of frames, 0 for same size as the source. ignored for PIXEL_FORMAT_RAW
+ * @param max_fps maximum frame rate, 0 for every frame
+ * @param num_slots 0 for IFrameCallback, otherwise number of slots for IFrameSlotCallback.
+ *        the slots are allocated for current source size
+ * @return NULL if failed
+ */
+/*static, public*/
+FrameCallback *FrameCallback::create(JNIEnv *env, jobject callback_obj, int pixel_format,
+	int width, int height, float max_fps, int num_slots, int source_width, int source_height) {
+
+	ENTER();
+	FrameCallback *result = NULL;
+	if (LIKELY(callback_obj)) {
+		result = new FrameCallback(callback_obj, pixel_format, width, height, max_fps);
+		// get method IDs of Java object for callback
+		jclass clazz = env->GetObjectClass(callback_obj);
+		if (LIKELY(clazz)) {
+			if (num_slots > 0) {
+				result->onFrameSlot = env->GetMethodID(clazz,
+					"onFrame",	"(IIJ)V");
+			} else {
+				result->onFrame = env->GetMethodID(clazz,
+					"onFrame",	"(Ljava/nio/ByteBuffer;)V");
+			}
+			env->DeleteLocalRef(clazz);
+		} else {
+			LOGW("failed to get object class");
+		}
+		env->ExceptionClear();
+		if (UNLIKELY(!result->onFrame && !result->onFrameSlot)) {
+			LOGE("Can't find IFrameCallback#onFrame");
+			SAFE_DELETE(result);
+		} else {
+			result->setSourceSize(source_width, source_height);
+			if (num_slots > 0) {
+				result->mFrameSlots = new FrameSlotRing(num_slots, result->mPixelBytes);
+			}
+			result->mIsRunning = true;
+			if (UNLIKELY(pthread_create(&result->callback_thread, NULL, callback_thread_func, (void *)result))) {
+				LOGE("failed to create callback thread");
+				SAFE_DELETE(result);
+			}
+		}
+		if (!result) {
+			env->DeleteGlobalRef(callback_obj);
+		}
+	}
+	RET(result);
+}
+
+/**
+ * stop the thread and delete this instance with the global reference of the callback.
+ * this should not be called on the callback thread.
+ */
+/*public*/
+void FrameCallback::release(JNIEnv *env) {
+	ENTER();
+	pthread_mutex_lock(&callback_mutex);
+	{
+		mIsRunning = false;
+		pthread_cond_signal(&callback_sync);
+	}
+	pthread_mutex_unlock(&callback_mutex);
+	if (pthread_join(callback_thread, NULL) != EXIT_SUCCESS) {
+		LOGW("FrameCallback::release:pthread_join failed");
+	}
+	LOGI("frame callback:drop count=%u,slot drop count=%u",
+		mDropCount, mFrameSlots ? mFrameSlots->getDropCount() : 0);
+	if (LIKELY(env)) {
+		env->DeleteGlobalRef(mCallbackObj);
+	}
+	mCallbackObj = NULL;
+	delete this;
+	EXIT();
+}
+
+/**
+ * size of delivered frame when source frames have specific size
+ */
+/*private*/
+size_t FrameCallback::pixel_bytes_for(const int &source_width, const int &source_height) const {
+	const size_t sz = mWidth && mHeight ? mWidth * mHeight : source_width * source_height;
+
+	switch (mPixelFormat) {
+	  case PIXEL_FORMAT_RGBX:
+		return sz * 4;
+	  case PIXEL_FORMAT_YUV20SP:
+	  case PIXEL_FORMAT_NV21:
+		return (sz * 3) / 2;
+	  default:	// PIXEL_FORMAT_RAW, PIXEL_FORMAT_YUV, PIXEL_FORMAT_RGB565
+		return sz * 2;
+	}
+}
+
+/**
+ * update conversion for the size of source frames,
+ * this can be called while the callback thread is delivering frames
+ */
+/*public*/
+void FrameCallback::setSourceSize(const int &width, const int &height) {
+	convFunc_t func = NULL;
+	switch (mPixelFormat) {
+	  case PIXEL_FORMAT_RGB565:
+		func = uvc_any2rgb565;
+		break;
+	  case PIXEL_FORMAT_RGBX:
+		func = uvc_any2rgbx;
+		break;
+	  case PIXEL_FORMAT_YUV20SP:
+		func = uvc_yuyv2iyuv420SP;
+		break;
+	  case PIXEL_FORMAT_NV21:
+		func = uvc_yuyv2yuv420SP;
+		break;
+	}
+	const size_t pixel_bytes = pixel_bytes_for(width, height);
+	if (UNLIKELY(!canDeliver(width, height))) {
+		LOGE("frame callback:frames of %dx%d(%u bytes) do not fit into slots(%u bytes)",
+			width, height, (uint32_t)pixel_bytes, (uint32_t)mFrameSlots->getSlotBytes());
+	}
+	pthread_mutex_lock(&callback_mutex);
+	{
+		mConvertFunc = func;
+		mPixelBytes = pixel_bytes;
+		mOversizeLogged = false;
+	}
+	pthread_mutex_unlock(&callback_mutex);
+}
+
+/*public*/
+bool FrameCallback::canDeliver(const int &source_width, const int &source_height) const {
+	return !mFrameSlots || (pixel_bytes_for(source_width, source_height) <= mFrameSlots->getSlotBytes());
+}
+
+/**
+ * queue the frame if it is not skipped by frame rate, this never blocks.
+ * skipped frames are never converted because conversion runs on the callback thread.
+ * @return true if the frame was queued
+ */
+/*public*/
+bool FrameCallback::offer(SharedFrame *frame) {
+	if (mIntervalUs) {
+		const struct timeval &capture_time = frame->get()->capture_time;
+		const int64_t pts_us = capture_time.tv_sec
+			? (int64_t)capture_time.tv_sec * 1000000LL + capture_time.tv_usec
+			: monotonic_us();
+		if (pts_us < nextFrameTime) {
+			return false;
+		}
+		// keep average rate even if the frame comes bit late
+		nextFrameTime = nextFrameTime + mIntervalUs > pts_us
+			? nextFrameTime + mIntervalUs : pts_us + mIntervalUs;
+	}
+	pthread_mutex_lock(&callback_mutex);
+	{
+		if (frames.isFull()) {
+			// the consumer is slow, drop the oldest frame to keep latency
+			SharedFrame *old = frames.get();
+			if (old) {
+				old->release();
+			}
+			mDropCount++;
+		}
+		frames.put(frame->addRef());
+		pthread_cond_signal(&callback_sync);
+	}
+	pthread_mutex_unlock(&callback_mutex);
+	return true;
+}
+
+/*private*/
+SharedFrame *FrameCallback::waitFrame() {
+	SharedFrame *frame = NULL;
+	pthread_mutex_lock(&callback_mutex);
+	{
+		while (mIsRunning && frames.isEmpty()) {
+			pthread_cond_wait(&callback_sync, &callback_mutex);
+		}
+		if (LIKELY(mIsRunning)) {
+			frame = frames.get();
+		}
+	}
+	pthread_mutex_unlock(&callback_mutex);
+	return frame;
+}
+
+/*private*/
+void FrameCallback::clearFrames() {
+	pthread_mutex_lock(&callback_mutex);
+	{
+		for (SharedFrame *frame = frames.get(); frame; frame = frames.get()) {
+			frame->release();
+		}
+	}
+	pthread_mutex_unlock(&callback_mutex);
+}
+
+/*static, private*/
+void *FrameCallback::callback_thread_func(void *vptr_args) {
+	ENTER();
+	FrameCallback *callback = reinterpret_cast<FrameCallback *>(vptr_args);
+	if (LIKELY(callback)) {
+		JavaVM *vm = getVM();
+		JNIEnv *env;
+		// attach to JavaVM
+		vm->AttachCurrentThread(&env, NULL);
+		callback->do_callback(env);
+		// detach from JavaVM
+		vm->DetachCurrentThread();
+		MARK("DetachCurrentThread");
+	}
+	PRE_EXIT();
+	pthread_exit(NULL);
+}
+
+/*private*/
+void FrameCallback::do_callback(JNIEnv *env) {
+	ENTER();
+	for ( ; mIsRunning ; ) {
+		SharedFrame *frame = waitFrame();
+		if (LIKELY(frame)) {
+			deliver(env, frame);
+			frame->release();
+		}
+	}
+	EXIT();
+}
+
+/**
+ * convert(if needs) and call Java callback
+ */
+/*private*/
+void FrameCallback::deliver(JNIEnv *env, SharedFrame *frame) {
+	convFunc_t func;
+	size_t pixel_bytes;
+	pthread_mutex_lock(&callback_mutex);
+	{
+		func = mConvertFunc;
+		pixel_bytes = mPixelBytes;
+	}
+	pthread_mutex_unlock(&callback_mutex);
+	uvc_frame_t *callback_frame = frame->get();
+	if (func || mWidth) {
+		// converted once and shared with other consumers that request same format and size
+		callback_frame = frame->getDerived(func, pixel_bytes, mWidth, mHeight);
+		if (UNLIKELY(!callback_frame)) {
+			return;
+		}
+	}
+	if (mFrameSlots) {
+		// deliver via pre-registered ByteBuffer without creating any JNI object
+		const int slot = mFrameSlots->acquire();
+		if (UNLIKELY(slot < 0)) {
+			return;	// all slots are held by Java
+		}
+		const size_t bytes = callback_frame->actual_bytes;
+		if (UNLIKELY(bytes > mFrameSlots->getSlotBytes())) {
+			// counted as dropped frame of the slots, logged once for each source size
+			pthread_mutex_lock(&callback_mutex);
+			const bool logged = mOversizeLogged;
+			mOversizeLogged = true;
+			pthread_mutex_unlock(&callback_mutex);
+			if (!logged) {
+				LOGE("frame callback:frame(%u bytes) is larger than slot(%u bytes), dropped",
+					(uint32_t)bytes, (uint32_t)mFrameSlots->getSlotBytes());
+			}
+			mFrameSlots->cancel(slot);
+			return;
+		}
+		memcpy(mFrameSlots->getSlotData(slot), callback_frame->data, bytes);
+		const struct timeval &capture_time = frame->get()->capture_time;
+		const jlong pts_us = (jlong)capture_time.tv_sec * 1000000LL + capture_time.tv_usec;
+		env->CallVoidMethod(mCallbackObj, onFrameSlot, slot, (jint)bytes, pts_us);
+		env->ExceptionClear();
+	} else {
+		jobject buf = env->NewDirectByteBuffer(callback_frame->data, callback_frame->actual_bytes);
+		env->CallVoidMethod(mCallbackObj, onFrame, buf);
+		env->ExceptionClear();
+		env->DeleteLocalRef(buf);
+	}
+}
+
+/**
+ * @return array of direct ByteBuffer for IFrameSlotCallback, NULL for IFrameCallback
+ */
+/*public*/
+jobjectArray FrameCallback::createBuffers(JNIEnv *env) {
+	return mFrameSlots ? mFrameSlots->createBuffers(env) : NULL;
+}
+
+/*public*/
+int FrameCallback::releaseSlot(const int &slot) {
+	return mFrameSlots ? mFrameSlots->release(slot) : -1;
+}
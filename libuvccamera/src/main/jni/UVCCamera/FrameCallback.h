@@ -0,0 +1,101 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: FrameCallback.h
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#ifndef FRAMECALLBACK_H_
+#define FRAMECALLBACK_H_
+
+#include <jni.h>
+#include <pthread.h>
+#include "libUVCCamera.h"
+#include "ringbuffer.h"
+#include "SharedFrame.h"
+#include "FrameSlotRing.h"
+
+#pragma interface
+
+#define PIXEL_FORMAT_RAW 0		// same as PIXEL_FORMAT_YUV
+#define PIXEL_FORMAT_YUV 1
+#define PIXEL_FORMAT_RGB565 2
+#define PIXEL_FORMAT_RGBX 3
+#define PIXEL_FORMAT_YUV20SP 4
+#define PIXEL_FORMAT_NV21 5		// YVU420SemiPlanar
+
+// number of frames that can be queued for one callback, older frame is dropped when full
+#define MAX_CALLBACK_FRAMES 2
+
+/**
+ * one consumer of frames, IFrameCallback or IFrameSlotCallback with its own
+ * pixel format, size and frame rate. each instance has its own thread to call Java,
+ * so slow consumer never stalls preview, capture and other consumers.
+ * conversions are shared with other consumers via SharedFrame#getDerived.
+ */
+class FrameCallback {
+private:
+	jobject mCallbackObj;				// global reference
+	jmethodID onFrame;					// IFrameCallback#onFrame
+	jmethodID onFrameSlot;				// IFrameSlotCallback#onFrame
+	const int mPixelFormat;
+	// these are updated by setSourceSize on the preview/capture thread
+	// and read on the callback thread, both with callback_mutex locked
+	convFunc_t mConvertFunc;
+	size_t mPixelBytes;
+	bool mOversizeLogged;				// whether dropping of frames larger than the slots was logged
+	const int mWidth, mHeight;			// 0 if same as the source
+	const int64_t mIntervalUs;			// 0 if every frame is delivered
+	int64_t nextFrameTime;				// only accessed by producer
+	FrameSlotRing *mFrameSlots;			// not NULL for IFrameSlotCallback
+	volatile bool mIsRunning;
+	pthread_t callback_thread;
+	pthread_mutex_t callback_mutex;
+	pthread_cond_t callback_sync;
+	RingBuffer<SharedFrame *> frames;
+	volatile uint32_t mDropCount;
+
+	FrameCallback(jobject callback_obj, int pixel_format, int width, int height, float max_fps);
+	~FrameCallback();
+	SharedFrame *waitFrame();
+	void clearFrames();
+	static void *callback_thread_func(void *vptr_args);
+	void do_callback(JNIEnv *env);
+	void deliver(JNIEnv *env, SharedFrame *frame);
+	size_t pixel_bytes_for(const int &source_width, const int &source_height) const;
+public:
+	static FrameCallback *create(JNIEnv *env, jobject callback_obj, int pixel_format,
+		int width, int height, float max_fps, int num_slots, int source_width, int source_height);
+	void release(JNIEnv *env);
+	inline bool isSameObject(JNIEnv *env, jobject obj) const { return env->IsSameObject(mCallbackObj, obj); };
+	/**
+	 * whether this needs YUYV frame instead of MJPEG frame,
+	 * otherwise frames are delivered as they came from the camera even if other callbacks need decoding
+	 */
+	inline bool needsDecode() const { return mConvertFunc || mWidth; };
+	void setSourceSize(const int &width, const int &height);
+	/** whether frames of the source size fit into the slots, always true for IFrameCallback */
+	bool canDeliver(const int &source_width, const int &source_height) const;
+	bool offer(SharedFrame *frame);
+	jobjectArray createBuffers(JNIEnv *env);
+	int releaseSlot(const int &slot);
+};
+
+#endif /* FRAMECALLBACK_H_ */
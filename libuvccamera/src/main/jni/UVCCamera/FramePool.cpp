@@ -0,0 +1,362 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: FramePool.cpp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#if 1	// set 1 if you don't need debug log
+	#ifndef LOG_NDEBUG
+		#define	LOG_NDEBUG		// w/o LOGV/LOGD/MARK
+	#endif
+	#undef USE_LOGALL
+#else
+	#define USE_LOGALL
+	#undef LOG_NDEBUG
+//	#undef NDEBUG
+#endif
+
+#include "utilbase.h"
+#include "FramePool.h"
+
+#define CLASS_BYTES(n) (((size_t)FRAME_POOL_CLASS_STEPS + ((n) % FRAME_POOL_CLASS_STEPS)) \
+	<< (FRAME_POOL_MIN_CLASS_SHIFT - 2 + ((n) / FRAME_POOL_CLASS_STEPS)))
+
+/**
+ * size class whose buffer is bytes rounded down(or up if round_up is true) to the class boundary,
+ * the class may be out of range
+ */
+static inline int size_class_at(const size_t &bytes, const bool &round_up) {
+	const size_t v = round_up ? bytes - 1 : bytes;
+	const int msb = 63 - __builtin_clzll((unsigned long long)v);
+	// top 3 bits of v, 4 - 7
+	const int top = (int)(v >> (msb - 2));
+	return (msb - FRAME_POOL_MIN_CLASS_SHIFT) * FRAME_POOL_CLASS_STEPS
+		+ top - FRAME_POOL_CLASS_STEPS + (round_up ? 1 : 0);
+}
+
+/**
+ * smallest size class that can hold data_bytes
+ * @return -1 if data_bytes is larger than the largest size class
+ */
+static inline int size_class_for(const size_t &data_bytes) {
+	if (data_bytes <= CLASS_BYTES(0)) {
+		return 0;
+	}
+	const int size_class = size_class_at(data_bytes, true);
+	return size_class < FRAME_POOL_NUM_CLASSES ? size_class : -1;
+}
+
+/**
+ * largest size class that fits into the buffer of capacity_bytes
+ * @return -1 if capacity_bytes is smaller than the smallest size class
+ */
+static inline int size_class_of(const size_t &capacity_bytes) {
+	if (capacity_bytes < CLASS_BYTES(0)) {
+		return -1;
+	}
+	const int size_class = size_class_at(capacity_bytes, false);
+	return size_class < FRAME_POOL_NUM_CLASSES ? size_class : FRAME_POOL_NUM_CLASSES - 1;
+}
+
+static FramePool *sInstance = NULL;
+static pthread_once_t sInstanceOnce = PTHREAD_ONCE_INIT;
+
+/*static, private*/
+void FramePool::create_instance() {
+	// this instance is never deleted because thread caches may refer it until each thread terminates
+	sInstance = new FramePool();
+}
+
+/*static, public*/
+FramePool *FramePool::getInstance() {
+	pthread_once(&sInstanceOnce, create_instance);
+	return sInstance;
+}
+
+/*private*/
+FramePool::FramePool()
+:	memory_cap(DEFAULT_FRAME_POOL_MEMORY_CAP),
+	cached_bytes(0),
+	hits(0), misses(0), reallocs(0) {
+
+	ENTER();
+	pthread_key_create(&cache_key, thread_cache_destructor);
+	pthread_mutex_init(&depot_mutex, NULL);
+	for (int i = 0; i < FRAME_POOL_NUM_CLASSES; i++) {
+		depot[i] = new ObjectArray<uvc_frame_t *>(FRAME_POOL_DEPOT_SZ);
+	}
+	EXIT();
+}
+
+/*private*/
+FramePool::~FramePool() {
+	ENTER();
+	trim();
+	for (int i = 0; i < FRAME_POOL_NUM_CLASSES; i++) {
+		SAFE_DELETE(depot[i]);
+	}
+	pthread_mutex_destroy(&depot_mutex);
+	pthread_key_delete(cache_key);
+	EXIT();
+}
+
+/**
+ * return all frames in the cache of terminating thread to the depot
+ */
+/*static, private*/
+void FramePool::thread_cache_destructor(void *vptr_args) {
+	thread_cache_t *cache = reinterpret_cast<thread_cache_t *>(vptr_args);
+	if (LIKELY(cache && sInstance)) {
+		for (int i = 0; i < FRAME_POOL_NUM_CLASSES; i++) {
+			sInstance->flush(cache, i, 0);
+		}
+	}
+	free(cache);
+}
+
+/*private*/
+FramePool::thread_cache_t *FramePool::get_thread_cache() {
+	thread_cache_t *cache = reinterpret_cast<thread_cache_t *>(pthread_getspecific(cache_key));
+	if (UNLIKELY(!cache)) {
+		cache = reinterpret_cast<thread_cache_t *>(calloc(1, sizeof(thread_cache_t)));
+		if (LIKELY(cache) && UNLIKELY(pthread_setspecific(cache_key, cache))) {
+			free(cache);
+			cache = NULL;
+		}
+	}
+	return cache;
+}
+
+/**
+ * add bytes to cached_bytes if it does not exceed memory_cap
+ */
+/*private*/
+bool FramePool::reserve_cache(const size_t &bytes) {
+	size_t current = __atomic_load_n(&cached_bytes, __ATOMIC_RELAXED);
+	do {
+		if (current + bytes > memory_cap) {
+			return false;
+		}
+	} while (!__atomic_compare_exchange_n(&cached_bytes, &current, current + bytes,
+		true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	return true;
+}
+
+/**
+ * free the frame that was counted in cached_bytes
+ */
+/*private*/
+void FramePool::release_frame(uvc_frame_t *frame, const int &size_class) {
+	__atomic_sub_fetch(&cached_bytes, CLASS_BYTES(size_class), __ATOMIC_RELAXED);
+	uvc_free_frame(frame);
+}
+
+/**
+ * move frames of the thread cache to the depot until keep frames remain,
+ * frames that the depot can not accept are freed
+ */
+/*private*/
+void FramePool::flush(thread_cache_t *cache, const int &size_class, const int &keep) {
+	pthread_mutex_lock(&depot_mutex);
+	{
+		ObjectArray<uvc_frame_t *> *d = depot[size_class];
+		for ( ; cache->count[size_class] > keep ; ) {
+			uvc_frame_t *frame = cache->frames[size_class][--cache->count[size_class]];
+			if (d->size() < FRAME_POOL_DEPOT_SZ) {
+				d->put(frame);
+			} else {
+				release_frame(frame, size_class);
+			}
+		}
+	}
+	pthread_mutex_unlock(&depot_mutex);
+}
+
+/**
+ * get frame whose buffer is equal to or larger than data_bytes.
+ * this function does not change data_bytes of the frame,
+ * so you need to call uvc_ensure_frame_size or conversion functions before use
+ * @return NULL if allocation failed
+ */
+/*public*/
+uvc_frame_t *FramePool::obtain(const size_t &data_bytes) {
+	const int size_class = size_class_for(data_bytes);
+	if (UNLIKELY(size_class < 0)) {
+		// too large to keep in the pool
+		__atomic_add_fetch(&misses, 1, __ATOMIC_RELAXED);
+		return uvc_allocate_frame(data_bytes);
+	}
+	uvc_frame_t *frame = NULL;
+	thread_cache_t *cache = get_thread_cache();
+	if (LIKELY(cache)) {
+		if (UNLIKELY(!cache->count[size_class])) {
+			// refill half of the thread cache from the depot
+			pthread_mutex_lock(&depot_mutex);
+			{
+				ObjectArray<uvc_frame_t *> *d = depot[size_class];
+				for ( ; !d->isEmpty() && (cache->count[size_class] < FRAME_POOL_THREAD_CACHE_SZ / 2) ; ) {
+					cache->frames[size_class][cache->count[size_class]++] = d->last();
+				}
+			}
+			pthread_mutex_unlock(&depot_mutex);
+		}
+		if (LIKELY(cache->count[size_class])) {
+			frame = cache->frames[size_class][--cache->count[size_class]];
+			__atomic_sub_fetch(&cached_bytes, CLASS_BYTES(size_class), __ATOMIC_RELAXED);
+			__atomic_add_fetch(&hits, 1, __ATOMIC_RELAXED);
+		}
+	}
+	if (UNLIKELY(!frame)) {
+		__atomic_add_fetch(&misses, 1, __ATOMIC_RELAXED);
+		frame = uvc_allocate_frame(CLASS_BYTES(size_class));
+	}
+	return frame;
+}
+
+/**
+ * return the frame to the pool, the frame is freed
+ * if the pool is full or it exceeds the memory cap
+ */
+/*public*/
+void FramePool::recycle(uvc_frame_t *frame) {
+	if (UNLIKELY(!frame)) return;
+
+	if (UNLIKELY(!frame->library_owns_data || !frame->data)) {
+		uvc_free_frame(frame);
+		return;
+	}
+	const int size_class = size_class_of(frame->capacity_bytes);
+	if (UNLIKELY(size_class < 0)) {
+		uvc_free_frame(frame);
+		return;
+	}
+	const size_t class_bytes = CLASS_BYTES(size_class);
+	if (UNLIKELY(frame->capacity_bytes != class_bytes)) {
+		// frames are handed out with exact class size, so the buffer was reallocated while in use.
+		// shrink it to fit the size class(this usually does not move the buffer).
+		__atomic_add_fetch(&reallocs, 1, __ATOMIC_RELAXED);
+		void *data = realloc(frame->data, class_bytes);
+		if (UNLIKELY(!data)) {
+			uvc_free_frame(frame);
+			return;
+		}
+		frame->data = data;
+		frame->capacity_bytes = class_bytes;
+		if (frame->data_bytes > class_bytes) {
+			frame->actual_bytes = frame->data_bytes = class_bytes;
+		}
+	}
+	if (UNLIKELY(!reserve_cache(class_bytes))) {
+		uvc_free_frame(frame);
+		return;
+	}
+	thread_cache_t *cache = get_thread_cache();
+	if (LIKELY(cache)) {
+		if (UNLIKELY(cache->count[size_class] >= FRAME_POOL_THREAD_CACHE_SZ)) {
+			// move half of the thread cache to the depot
+			flush(cache, size_class, FRAME_POOL_THREAD_CACHE_SZ / 2);
+		}
+		cache->frames[size_class][cache->count[size_class]++] = frame;
+	} else {
+		release_frame(frame, size_class);
+	}
+}
+
+/**
+ * allocate frames into the depot in advance
+ * @param data_bytes
+ * @param num_frames
+ */
+/*public*/
+void FramePool::prealloc(const size_t &data_bytes, const int &num_frames) {
+	ENTER();
+
+	const int size_class = size_class_for(data_bytes);
+	if (LIKELY(size_class >= 0)) {
+		const size_t class_bytes = CLASS_BYTES(size_class);
+		pthread_mutex_lock(&depot_mutex);
+		{
+			ObjectArray<uvc_frame_t *> *d = depot[size_class];
+			for (int i = d->size(); (i < num_frames) && (i < FRAME_POOL_DEPOT_SZ); i++) {
+				if (UNLIKELY(!reserve_cache(class_bytes))) {
+					LOGW("exceeds memory cap");
+					break;
+				}
+				uvc_frame_t *frame = uvc_allocate_frame(class_bytes);
+				if (LIKELY(frame)) {
+					d->put(frame);
+				} else {
+					__atomic_sub_fetch(&cached_bytes, class_bytes, __ATOMIC_RELAXED);
+					LOGW("failed to allocate frame");
+					break;
+				}
+			}
+		}
+		pthread_mutex_unlock(&depot_mutex);
+	}
+
+	EXIT();
+}
+
+/**
+ * free all frames in the depot, frames in the thread caches are kept
+ */
+/*public*/
+void FramePool::trim() {
+	ENTER();
+
+	pthread_mutex_lock(&depot_mutex);
+	{
+		for (int i = 0; i < FRAME_POOL_NUM_CLASSES; i++) {
+			ObjectArray<uvc_frame_t *> *d = depot[i];
+			for ( ; !d->isEmpty() ; ) {
+				release_frame(d->last(), i);
+			}
+			d->clear();
+		}
+	}
+	pthread_mutex_unlock(&depot_mutex);
+
+	EXIT();
+}
+
+/**
+ * set maximum bytes of frames kept in the pool,
+ * this does not free frames that are already in the pool
+ */
+/*public*/
+void FramePool::setMemoryCap(const size_t &bytes) {
+	memory_cap = bytes;
+}
+
+/*public*/
+void FramePool::getStats(frame_pool_stats_t *stats) const {
+	if (LIKELY(stats)) {
+		stats->hits = __atomic_load_n(&hits, __ATOMIC_RELAXED);
+		stats->misses = __atomic_load_n(&misses, __ATOMIC_RELAXED);
+		stats->reallocs = __atomic_load_n(&reallocs, __ATOMIC_RELAXED);
+		stats->cached_bytes = __atomic_load_n(&cached_bytes, __ATOMIC_RELAXED);
+		stats->memory_cap = memory_cap;
+	}
+}
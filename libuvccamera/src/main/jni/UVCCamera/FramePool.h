@@ -0,0 +1,96 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: FramePool.h
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#ifndef FRAMEPOOL_H_
+#define FRAMEPOOL_H_
+
+#include <pthread.h>
+#include "libUVCCamera.h"
+#include "objectarray.h"
+
+#pragma interface
+
+// each power of two is divided into FRAME_POOL_CLASS_STEPS size classes so that a frame wastes
+// at most 25% of its buffer, buffer size of size class n is
+// ((FRAME_POOL_CLASS_STEPS + n % FRAME_POOL_CLASS_STEPS) << (FRAME_POOL_MIN_CLASS_SHIFT - 2 + n / FRAME_POOL_CLASS_STEPS)) bytes
+#define FRAME_POOL_MIN_CLASS_SHIFT 16		// 64KB
+#define FRAME_POOL_CLASS_STEPS 4
+#define FRAME_POOL_NUM_CLASSES 45			// 64KB, 80KB, 96KB, 112KB, 128KB ... 128MB
+// number of frames that each thread can keep for each size class without lock
+#define FRAME_POOL_THREAD_CACHE_SZ 4
+// maximum number of frames in the shared depot for each size class
+#define FRAME_POOL_DEPOT_SZ 32
+// default limit of memory that is kept in the pool(frames in use are not included)
+#define DEFAULT_FRAME_POOL_MEMORY_CAP (128 * 1024 * 1024)
+
+typedef struct frame_pool_stats {
+	uint32_t hits;			// number of frames that were reused
+	uint32_t misses;		// number of frames that were newly allocated
+	uint32_t reallocs;		// number of recycled frames whose buffer was reallocated while in use
+	size_t cached_bytes;	// bytes of frames that are kept in the pool now
+	size_t memory_cap;
+} frame_pool_stats_t;
+
+/**
+ * frame pool shared by UVCPreview and pipelines.
+ * frames are classified by buffer size(quarter steps between powers of two) so that the frame
+ * obtained from the pool is large enough and uvc_ensure_frame_size
+ * does not need to realloc it.
+ * each thread has its own small cache that is accessed without lock,
+ * frames move between the caches through the shared depot in batches.
+ * frames obtained from the pool should be returned with #recycle.
+ */
+class FramePool {
+private:
+	typedef struct thread_cache {
+		uvc_frame_t *frames[FRAME_POOL_NUM_CLASSES][FRAME_POOL_THREAD_CACHE_SZ];
+		int count[FRAME_POOL_NUM_CLASSES];
+	} thread_cache_t;
+
+	pthread_key_t cache_key;
+	pthread_mutex_t depot_mutex;
+	ObjectArray<uvc_frame_t *> *depot[FRAME_POOL_NUM_CLASSES];
+	volatile size_t memory_cap;
+	volatile size_t cached_bytes;
+	volatile uint32_t hits, misses, reallocs;
+
+	FramePool();
+	~FramePool();
+	static void create_instance();
+	static void thread_cache_destructor(void *vptr_args);
+	thread_cache_t *get_thread_cache();
+	bool reserve_cache(const size_t &bytes);
+	void release_frame(uvc_frame_t *frame, const int &size_class);
+	void flush(thread_cache_t *cache, const int &size_class, const int &keep);
+public:
+	static FramePool *getInstance();
+	uvc_frame_t *obtain(const size_t &data_bytes);
+	void recycle(uvc_frame_t *frame);
+	void prealloc(const size_t &data_bytes, const int &num_frames);
+	void trim();
+	void setMemoryCap(const size_t &bytes);
+	void getStats(frame_pool_stats_t *stats) const;
+};
+
+#endif /* FRAMEPOOL_H_ */
@@ -0,0 +1,145 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: FrameSlotRing.cpp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#include <stdlib.h>
+
+#if 1	// set 1 if you don't need debug log
+	#ifndef LOG_NDEBUG
+		#define	LOG_NDEBUG		// w/o LOGV/LOGD/MARK
+	#endif
+	#undef USE_LOGALL
+#else
+	#define USE_LOGALL
+	#undef LOG_NDEBUG
+//	#undef NDEBUG
+#endif
+
+#pragma implementation "FrameSlotRing.h"
+#include "utilbase.h"
+#include "FrameSlotRing.h"
+#include "FramePool.h"
+
+#define SLOT_FREE 0
+#define SLOT_IN_USE 1
+
+/**
+ * @param _num_slots number of slots, clipped to [1, MAX_FRAME_SLOTS]
+ * @param _slot_bytes size of each slot, frames larger than this can't be delivered
+ */
+FrameSlotRing::FrameSlotRing(const int &_num_slots, const size_t &_slot_bytes)
+:	num_slots(_num_slots < 1 ? 1 : (_num_slots > MAX_FRAME_SLOTS ? MAX_FRAME_SLOTS : _num_slots)),
+	slot_bytes(_slot_bytes),
+	next_slot(0),
+	drop_count(0) {
+
+	FramePool *pool = FramePool::getInstance();
+	for (int i = 0; i < num_slots; i++) {
+		// these frames are never resized while the ring is alive
+		// because Java side refers their buffers directly
+		frames[i] = pool->obtain(slot_bytes);
+		in_use[i] = frames[i] ? SLOT_FREE : SLOT_IN_USE;
+	}
+}
+
+/**
+ * the caller should make sure Java side never accesses the buffers after this
+ */
+FrameSlotRing::~FrameSlotRing() {
+	FramePool *pool = FramePool::getInstance();
+	for (int i = 0; i < num_slots; i++) {
+		if (frames[i]) {
+			pool->recycle(frames[i]);
+			frames[i] = NULL;
+		}
+	}
+}
+
+/**
+ * find free slot and mark it as in use, search starts next to the slot that was acquired last time
+ * so slots are used in round robin order while Java releases them in time
+ * @return slot index, -1 if all slots are held by Java, the frame should be dropped
+ */
+/*public*/
+int FrameSlotRing::acquire() {
+	for (int i = 0; i < num_slots; i++) {
+		const int slot = (next_slot + i) % num_slots;
+		int32_t expected = SLOT_FREE;
+		if (__atomic_compare_exchange_n(&in_use[slot], &expected, SLOT_IN_USE,
+			false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+
+			next_slot = (slot + 1) % num_slots;
+			return slot;
+		}
+	}
+	__atomic_add_fetch(&drop_count, 1, __ATOMIC_RELAXED);
+	return -1;
+}
+
+/**
+ * return the slot that was delivered to Java
+ * @return 0 if success, -1 if slot is out of range or was not in use
+ */
+/*public*/
+int FrameSlotRing::release(const int &slot) {
+	if (UNLIKELY((slot < 0) || (slot >= num_slots) || !frames[slot])) {
+		return -1;
+	}
+	int32_t expected = SLOT_IN_USE;
+	return __atomic_compare_exchange_n(&in_use[slot], &expected, SLOT_FREE,
+		false, __ATOMIC_RELEASE, __ATOMIC_RELAXED) ? 0 : -1;
+}
+
+/**
+ * return the slot that was acquired but not delivered(ex. failed to write the frame)
+ */
+/*public*/
+void FrameSlotRing::cancel(const int &slot) {
+	__atomic_add_fetch(&drop_count, 1, __ATOMIC_RELAXED);
+	release(slot);
+}
+
+/**
+ * create direct ByteBuffer for each slot, this should be called only once when the ring is registered
+ * @return array of ByteBuffer as local reference, NULL if failed
+ */
+/*public*/
+jobjectArray FrameSlotRing::createBuffers(JNIEnv *env) {
+	ENTER();
+	jobjectArray result = NULL;
+	jclass clazz = env->FindClass("java/nio/ByteBuffer");
+	if (LIKELY(clazz)) {
+		result = env->NewObjectArray(num_slots, clazz, NULL);
+		for (int i = 0; result && (i < num_slots); i++) {
+			if (UNLIKELY(!frames[i])) continue;	// failed to allocate, this slot is never acquired
+			jobject buf = env->NewDirectByteBuffer(frames[i]->data, slot_bytes);
+			if (LIKELY(buf)) {
+				env->SetObjectArrayElement(result, i, buf);
+				env->DeleteLocalRef(buf);
+			}
+		}
+		env->DeleteLocalRef(clazz);
+	}
+	env->ExceptionClear();
+	RET(result);
+}
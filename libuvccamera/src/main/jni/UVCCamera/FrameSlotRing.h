@@ -0,0 +1,65 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: FrameSlotRing.h
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#ifndef FRAMESLOTRING_H_
+#define FRAMESLOTRING_H_
+
+#include <jni.h>
+#include "libUVCCamera.h"
+
+#pragma interface
+
+// maximum number of slots of one ring
+#define MAX_FRAME_SLOTS 16
+
+/**
+ * fixed number of pooled native buffers that are exposed to Java as direct ByteBuffers.
+ * the ByteBuffers are created only once when the ring is registered,
+ * so frames can be delivered as slot index without creating JNI objects for every frame.
+ * the producer acquires a free slot, writes a frame into it and hands the index to Java,
+ * the slot is not reused until Java releases it, so Java can hold several frames at once.
+ * acquire should be called from single producer thread, release can be called from any thread.
+ */
+class FrameSlotRing {
+private:
+	const int num_slots;
+	const size_t slot_bytes;
+	uvc_frame_t *frames[MAX_FRAME_SLOTS];	// pooled frames that back the slots
+	volatile int32_t in_use[MAX_FRAME_SLOTS];
+	int next_slot;							// only accessed by producer
+	volatile uint32_t drop_count;
+public:
+	FrameSlotRing(const int &num_slots, const size_t &slot_bytes);
+	~FrameSlotRing();
+	inline const int getNumSlots() const { return num_slots; };
+	inline const size_t getSlotBytes() const { return slot_bytes; };
+	inline const uint32_t getDropCount() const { return drop_count; };
+	int acquire();
+	int release(const int &slot);
+	void cancel(const int &slot);
+	inline uint8_t *getSlotData(const int &slot) const { return (uint8_t *)frames[slot]->data; };
+	jobjectArray createBuffers(JNIEnv *env);
+};
+
+#endif /* FRAMESLOTRING_H_ */
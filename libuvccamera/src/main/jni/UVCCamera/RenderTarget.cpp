@@ -0,0 +1,207 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: RenderTarget.cpp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#if 1	// set 1 if you don't need debug log
+	#ifndef LOG_NDEBUG
+		#define	LOG_NDEBUG		// w/o LOGV/LOGD/MARK
+	#endif
+	#undef USE_LOGALL
+#else
+	#define USE_LOGALL
+	#undef LOG_NDEBUG
+//	#undef NDEBUG
+#endif
+
+#pragma implementation "RenderTarget.h"
+#include "utilbase.h"
+#include "RenderTarget.h"
+#include "FramePool.h"
+
+static void setup_dest(uvc_frame_t *dest, void *bits, const int &width, const int &height, const int &stride) {
+	memset(dest, 0, sizeof(uvc_frame_t));
+	dest->data = bits;
+	dest->width = width;
+	dest->height = height;
+	dest->step = stride * RENDER_PIXEL_BYTES;
+	dest->actual_bytes = dest->data_bytes = dest->step * height;
+	dest->frame_format = UVC_FRAME_FORMAT_RGBX;
+	dest->library_owns_data = 0;
+}
+
+#if defined(__ANDROID__)
+//======================================================================
+//
+//======================================================================
+WindowRenderTarget::WindowRenderTarget(ANativeWindow *window)
+:	mWindow(window) {
+}
+
+WindowRenderTarget::~WindowRenderTarget() {
+}
+
+/*public*/
+int WindowRenderTarget::lock(uvc_frame_t *dest) {
+	ANativeWindow_Buffer buffer;
+	if (LIKELY(mWindow && (ANativeWindow_lock(mWindow, &buffer, NULL) == 0))) {
+		if (LIKELY((buffer.format == WINDOW_FORMAT_RGBA_8888) || (buffer.format == WINDOW_FORMAT_RGBX_8888))) {
+			setup_dest(dest, buffer.bits, buffer.width, buffer.height, buffer.stride);
+			return 0;
+		}
+		// this target only supports 32 bit pixel formats
+		ANativeWindow_unlockAndPost(mWindow);
+	}
+	return -1;
+}
+
+/*public*/
+void WindowRenderTarget::unlockAndPost() {
+	ANativeWindow_unlockAndPost(mWindow);
+}
+#endif
+
+//======================================================================
+//
+//======================================================================
+MemoryRenderTarget::MemoryRenderTarget(const int &width, const int &height, const int &stride)
+:	mBuffer(NULL),
+	mWidth(width),
+	mHeight(height),
+	mStride(stride < width ? width : stride),
+	mPostCount(0),
+	mDirectCount(0) {
+
+	mBuffer = (uint8_t *)malloc(mStride * mHeight * RENDER_PIXEL_BYTES);
+}
+
+MemoryRenderTarget::~MemoryRenderTarget() {
+	if (mBuffer) {
+		free(mBuffer);
+		mBuffer = NULL;
+	}
+}
+
+/*public*/
+int MemoryRenderTarget::lock(uvc_frame_t *dest) {
+	if (LIKELY(mBuffer)) {
+		setup_dest(dest, mBuffer, mWidth, mHeight, mStride);
+		return 0;
+	}
+	return -1;
+}
+
+/*public*/
+void MemoryRenderTarget::unlockAndPost() {
+	mPostCount++;
+}
+
+/*public*/
+void MemoryRenderTarget::onDirectRender() {
+	mDirectCount++;
+}
+
+//======================================================================
+//
+//======================================================================
+static void copyFrame(const uint8_t *src, uint8_t *dest, const int width, int height, const int stride_src, const int stride_dest) {
+	const int h8 = height % 8;
+	for (int i = 0; i < h8; i++) {
+		memcpy(dest, src, width);
+		dest += stride_dest; src += stride_src;
+	}
+	for (int i = h8; i < height; i += 8) {
+		memcpy(dest, src, width);
+		dest += stride_dest; src += stride_src;
+		memcpy(dest, src, width);
+		dest += stride_dest; src += stride_src;
+		memcpy(dest, src, width);
+		dest += stride_dest; src += stride_src;
+		memcpy(dest, src, width);
+		dest += stride_dest; src += stride_src;
+		memcpy(dest, src, width);
+		dest += stride_dest; src += stride_src;
+		memcpy(dest, src, width);
+		dest += stride_dest; src += stride_src;
+		memcpy(dest, src, width);
+		dest += stride_dest; src += stride_src;
+		memcpy(dest, src, width);
+		dest += stride_dest; src += stride_src;
+	}
+}
+
+/**
+ * copy RGBX frame into the locked buffer, the area that is out of the buffer is clipped
+ */
+static void copy_to_dest(uvc_frame_t *frame, uvc_frame_t *dest) {
+	// source = frame data
+	const uint8_t *src = (uint8_t *)frame->data;
+	const int src_w = frame->width * RENDER_PIXEL_BYTES;
+	const int src_step = frame->width * RENDER_PIXEL_BYTES;
+	// destination = locked buffer
+	const int dest_w = dest->width * RENDER_PIXEL_BYTES;
+	// use lower transfer bytes
+	const int w = src_w < dest_w ? src_w : dest_w;
+	// use lower height
+	const int h = frame->height < dest->height ? frame->height : dest->height;
+	copyFrame(src, (uint8_t *)dest->data, w, h, src_step, dest->step);
+}
+
+/**
+ * render the frame into the target.
+ * if convert_func is not NULL, the frame is decoded/converted directly into the locked buffer
+ * without intermediate frame as long as the buffer is large enough.
+ * @param frame RGBX frame if convert_func is NULL
+ * @param convert_func function to convert the frame to RGBX, the function should
+ *        keep step of the output frame that does not own its buffer
+ * @return 0 if success
+ */
+int renderFrame(IRenderTarget *target, uvc_frame_t *frame, convFunc_t convert_func) {
+	int result = -1;
+	uvc_frame_t dest;
+	if (LIKELY(target && frame && !target->lock(&dest))) {
+		if (!convert_func) {
+			copy_to_dest(frame, &dest);
+			result = 0;
+		} else if (LIKELY((dest.width >= frame->width) && (dest.height >= frame->height))) {
+			result = convert_func(frame, &dest);
+			if (LIKELY(!result)) {
+				target->onDirectRender();
+			}
+		} else {
+			// the buffer is smaller than the frame, convert into temporary frame and clip it
+			uvc_frame_t *converted = FramePool::getInstance()->obtain(frame->width * frame->height * RENDER_PIXEL_BYTES);
+			if (LIKELY(converted)) {
+				result = convert_func(frame, converted);
+				if (LIKELY(!result)) {
+					copy_to_dest(converted, &dest);
+				}
+				FramePool::getInstance()->recycle(converted);
+			}
+		}
+		target->unlockAndPost();
+	}
+	return result;
+}
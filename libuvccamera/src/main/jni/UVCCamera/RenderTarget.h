@@ -0,0 +1,97 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: RenderTarget.h
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#ifndef RENDERTARGET_H_
+#define RENDERTARGET_H_
+
+#include "libUVCCamera.h"
+#include "SharedFrame.h"
+#if defined(__ANDROID__)
+#include <android/native_window.h>
+#endif
+
+#pragma interface
+
+#define RENDER_PIXEL_BYTES 4	// RGBA/RGBX
+
+/**
+ * destination of rendering.
+ * the buffer is locked while rendering and conversion functions
+ * write into it directly using its stride.
+ */
+class IRenderTarget {
+public:
+	virtual ~IRenderTarget() {};
+	/**
+	 * lock the buffer and set up dest to refer it,
+	 * dest does not own the buffer and its step is the stride of the buffer
+	 * @return 0 if success
+	 */
+	virtual int lock(uvc_frame_t *dest) = 0;
+	virtual void unlockAndPost() = 0;
+	/**
+	 * called before unlockAndPost when the frame was decoded/converted directly into the buffer
+	 */
+	virtual void onDirectRender() {};
+};
+
+#if defined(__ANDROID__)
+/**
+ * render into Surface(ANativeWindow), the caller should keep reference of the window
+ * while this instance is used.
+ */
+class WindowRenderTarget : public IRenderTarget {
+private:
+	ANativeWindow *mWindow;
+public:
+	WindowRenderTarget(ANativeWindow *window);
+	virtual ~WindowRenderTarget();
+	virtual int lock(uvc_frame_t *dest);
+	virtual void unlockAndPost();
+};
+#endif
+
+/**
+ * render into memory, this is mainly for benchmarking render path without Surface
+ */
+class MemoryRenderTarget : public IRenderTarget {
+private:
+	uint8_t *mBuffer;
+	const int mWidth, mHeight, mStride;		// mStride is in pixels like ANativeWindow_Buffer
+	uint32_t mPostCount;
+	uint32_t mDirectCount;				// posts that were rendered without intermediate frame
+public:
+	MemoryRenderTarget(const int &width, const int &height, const int &stride);
+	virtual ~MemoryRenderTarget();
+	virtual int lock(uvc_frame_t *dest);
+	virtual void unlockAndPost();
+	virtual void onDirectRender();
+	inline const uint8_t *getBuffer() const { return mBuffer; };
+	inline const uint32_t getPostCount() const { return mPostCount; };
+	inline const uint32_t getDirectCount() const { return mDirectCount; };
+};
+
+int renderFrame(IRenderTarget *target, uvc_frame_t *frame, convFunc_t convert_func);
+
+#endif /* RENDERTARGET_H_ */
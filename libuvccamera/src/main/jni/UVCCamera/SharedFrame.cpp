@@ -0,0 +1,191 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: SharedFrame.cpp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#include <stdlib.h>
+#include <new>
+
+#if 1	// set 1 if you don't need debug log
+	#ifndef LOG_NDEBUG
+		#define	LOG_NDEBUG		// w/o LOGV/LOGD/MARK
+	#endif
+	#undef USE_LOGALL
+#else
+	#define USE_LOGALL
+	#undef LOG_NDEBUG
+//	#undef NDEBUG
+#endif
+
+#pragma implementation "SharedFrame.h"
+#include "utilbase.h"
+#include "SharedFrame.h"
+#include "FramePool.h"
+
+/*private*/
+SharedFrame::SharedFrame(uvc_frame_t *_frame)
+:	ref_count(1),
+	frame(_frame),
+	num_derived(0) {
+
+	pthread_mutex_init(&derived_mutex, NULL);
+}
+
+/*private*/
+SharedFrame::~SharedFrame() {
+	FramePool *pool = FramePool::getInstance();
+	for (int i = 0; i < num_derived; i++) {
+		pool->recycle(derived[i].frame);
+	}
+	pool->recycle(frame);
+	pthread_mutex_destroy(&derived_mutex);
+}
+
+/**
+ * wrap the frame that was obtained from FramePool,
+ * the returned instance owns the frame and has one reference
+ * @return NULL if frame is NULL or failed to allocate, the frame is recycled in that case
+ */
+/*static, public*/
+SharedFrame *SharedFrame::create(uvc_frame_t *frame) {
+	SharedFrame *result = NULL;
+	if (LIKELY(frame)) {
+		result = new (std::nothrow) SharedFrame(frame);
+		if (UNLIKELY(!result)) {
+			FramePool::getInstance()->recycle(frame);
+		}
+	}
+	return result;
+}
+
+/*public*/
+SharedFrame *SharedFrame::addRef() {
+	__atomic_add_fetch(&ref_count, 1, __ATOMIC_RELAXED);
+	return this;
+}
+
+/**
+ * release one reference, buffers are returned to FramePool
+ * when the last reference is released
+ */
+/*public*/
+void SharedFrame::release() {
+	if (__atomic_sub_fetch(&ref_count, 1, __ATOMIC_ACQ_REL) == 0) {
+		delete this;
+	}
+}
+
+/**
+ * get the representation that was converted with func, convert on the first call.
+ * conversion runs without holding derived_mutex so that other readers are not blocked,
+ * failed conversion is not kept and is retried by the next call.
+ * @param func conversion function, if this is NULL, return source frame or scaled YUYV frame
+ * @param data_bytes expected size of converted frame
+ * @param width, height size of derived frame, 0 for same size as the source.
+ *        the size is applied only when the source is YUYV frame
+ * @return NULL if conversion failed
+ */
+/*public*/
+uvc_frame_t *SharedFrame::getDerived(convFunc_t func, const size_t &data_bytes,
+	const int &width, const int &height) {
+
+	const bool scale = (width > 0) && (height > 0)
+		&& (frame->frame_format == UVC_FRAME_FORMAT_YUYV)
+		&& ((width != (int)frame->width) || (height != (int)frame->height));
+	if (!func && !scale) {
+		return frame;
+	}
+	uvc_frame_t *result = frame;
+	if (scale) {
+		result = derive(NULL, width, height, frame, width * height * 2);
+	}
+	if (result && func) {
+		result = derive(func, scale ? width : 0, scale ? height : 0, result, data_bytes);
+	}
+	return result;
+}
+
+/**
+ * find derived frame, should be called with derived_mutex locked
+ * @return NULL if not found
+ */
+/*private*/
+uvc_frame_t *SharedFrame::find_derived(convFunc_t func, const int &width, const int &height) const {
+	for (int i = 0; i < num_derived; i++) {
+		if ((derived[i].func == func) && (derived[i].width == width) && (derived[i].height == height)) {
+			return derived[i].frame;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * find derived frame, or convert/scale src and keep it if not found.
+ * if other thread kept same representation while converting, that one is used.
+ */
+/*private*/
+uvc_frame_t *SharedFrame::derive(convFunc_t func, const int &width, const int &height,
+	uvc_frame_t *src, const size_t &data_bytes) {
+
+	uvc_frame_t *result;
+	bool full;
+	pthread_mutex_lock(&derived_mutex);
+	{
+		result = find_derived(func, width, height);
+		full = num_derived >= MAX_DERIVED_FRAMES;
+	}
+	pthread_mutex_unlock(&derived_mutex);
+	if (result || UNLIKELY(full)) {
+		return result;
+	}
+	// not converted yet
+	FramePool *pool = FramePool::getInstance();
+	uvc_frame_t *converted = pool->obtain(data_bytes);
+	if (UNLIKELY(!converted)) {
+		return NULL;
+	}
+	const uvc_error_t r = func ? func(src, converted) : uvc_yuyv_scale(src, converted, width, height);
+	if (UNLIKELY(r)) {
+		LOGW("failed to convert:%d", r);
+		pool->recycle(converted);
+		return NULL;
+	}
+	pthread_mutex_lock(&derived_mutex);
+	{
+		result = find_derived(func, width, height);
+		if (!result && LIKELY(num_derived < MAX_DERIVED_FRAMES)) {
+			derived[num_derived].func = func;
+			derived[num_derived].width = width;
+			derived[num_derived].height = height;
+			derived[num_derived].frame = converted;
+			num_derived++;
+			result = converted;
+			converted = NULL;
+		}
+	}
+	pthread_mutex_unlock(&derived_mutex);
+	if (converted) {
+		// other thread already kept same representation or no space to keep it
+		pool->recycle(converted);
+	}
+	return result;
+}
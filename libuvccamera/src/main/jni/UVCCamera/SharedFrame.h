@@ -0,0 +1,75 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: SharedFrame.h
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#ifndef SHAREDFRAME_H_
+#define SHAREDFRAME_H_
+
+#include <pthread.h>
+#include "libUVCCamera.h"
+
+#pragma interface
+
+typedef uvc_error_t (*convFunc_t)(uvc_frame_t *in, uvc_frame_t *out);
+
+// maximum number of derived representations of one frame
+#define MAX_DERIVED_FRAMES 8
+
+/**
+ * reference counted frame that is shared by preview, capture and callback consumers
+ * without copying. the frame and its derived representations are immutable,
+ * consumers must not modify them. derived representations(ex. RGBX, NV21) are
+ * converted lazily on the first request and reused by later requests.
+ * YUYV frames can also be derived at smaller size, then converted from the scaled frame.
+ * all buffers are returned to FramePool when the last reference is released.
+ */
+class SharedFrame {
+private:
+	typedef struct derived_frame {
+		convFunc_t func;		// NULL for scaled YUYV frame
+		int width, height;		// 0 if same size as the source
+		uvc_frame_t *frame;
+	} derived_frame_t;
+
+	volatile int32_t ref_count;
+	uvc_frame_t *frame;
+	pthread_mutex_t derived_mutex;	// guards num_derived and derived, not held while converting
+	int num_derived;
+	derived_frame_t derived[MAX_DERIVED_FRAMES];
+
+	SharedFrame(uvc_frame_t *frame);
+	~SharedFrame();
+	uvc_frame_t *find_derived(convFunc_t func, const int &width, const int &height) const;
+	uvc_frame_t *derive(convFunc_t func, const int &width, const int &height,
+		uvc_frame_t *src, const size_t &data_bytes);
+public:
+	static SharedFrame *create(uvc_frame_t *frame);
+	SharedFrame *addRef();
+	void release();
+	/** source frame, this should not be modified */
+	inline uvc_frame_t *get() const { return frame; };
+	uvc_frame_t *getDerived(convFunc_t func, const size_t &data_bytes,
+		const int &width = 0, const int &height = 0);
+};
+
+#endif /* SHAREDFRAME_H_ */
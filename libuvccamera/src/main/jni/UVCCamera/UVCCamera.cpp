@@ -255,6 +255,24 @@ int UVCCamera::setPreviewSize(int width, int height, int min_fps, int max_fps, i
 	RETURN(result, int);
 }
 
+int UVCCamera::switchFormat(int width, int height, int min_fps, int max_fps, int mode, float bandwidth) {
+	ENTER();
+	int result = EXIT_FAILURE;
+	if (mPreview) {
+		result = mPreview->switchFormat(width, height, min_fps, max_fps, mode, bandwidth);
+	}
+	RETURN(result, int);
+}
+
+int UVCCamera::getSwitchTime() {
+	ENTER();
+	int result = -1;
+	if (mPreview) {
+		result = mPreview->getSwitchTime();
+	}
+	RETURN(result, int);
+}
+
 int UVCCamera::setPreviewDisplay(ANativeWindow *preview_window) {
 	ENTER();
 	int result = EXIT_FAILURE;
@@ -264,15 +282,69 @@ int UVCCamera::setPreviewDisplay(ANativeWindow *preview_window) {
 	RETURN(result, int);
 }
 
-int UVCCamera::setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format) {
+int UVCCamera::setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format,
+	int width, int height, float max_fps) {
 	ENTER();
 	int result = EXIT_FAILURE;
 	if (mPreview) {
-		result = mPreview->setFrameCallback(env, frame_callback_obj, pixel_format);
+		result = mPreview->setFrameCallback(env, frame_callback_obj, pixel_format, width, height, max_fps);
 	}
 	RETURN(result, int);
 }
 
+jobjectArray UVCCamera::setFrameSlotCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format, int num_slots,
+	int width, int height, float max_fps) {
+	ENTER();
+	jobjectArray result = NULL;
+	if (mPreview) {
+		result = mPreview->setFrameSlotCallback(env, frame_callback_obj, pixel_format, num_slots,
+			width, height, max_fps);
+	}
+	RET(result);
+}
+
+int UVCCamera::addFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format,
+	int width, int height, float max_fps) {
+	ENTER();
+	int result = EXIT_FAILURE;
+	if (mPreview) {
+		result = mPreview->addFrameCallback(env, frame_callback_obj, pixel_format, width, height, max_fps);
+	} else if (frame_callback_obj) {
+		env->DeleteGlobalRef(frame_callback_obj);
+	}
+	RETURN(result, int);
+}
+
+jobjectArray UVCCamera::addFrameSlotCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format, int num_slots,
+	int width, int height, float max_fps) {
+	ENTER();
+	jobjectArray result = NULL;
+	if (mPreview) {
+		result = mPreview->addFrameSlotCallback(env, frame_callback_obj, pixel_format, num_slots,
+			width, height, max_fps);
+	} else if (frame_callback_obj) {
+		env->DeleteGlobalRef(frame_callback_obj);
+	}
+	RET(result);
+}
+
+int UVCCamera::removeFrameCallback(JNIEnv *env, jobject frame_callback_obj) {
+	ENTER();
+	int result = EXIT_FAILURE;
+	if (mPreview) {
+		result = mPreview->removeFrameCallback(env, frame_callback_obj);
+	}
+	RETURN(result, int);
+}
+
+int UVCCamera::releaseFrameSlot(JNIEnv *env, jobject frame_callback_obj, int slot) {
+	int result = EXIT_FAILURE;
+	if (LIKELY(mPreview)) {
+		result = mPreview->releaseFrameSlot(env, frame_callback_obj, slot);
+	}
+	return result;
+}
+
 int UVCCamera::startPreview() {
 	ENTER();
 
@@ -300,6 +372,87 @@ int UVCCamera::setCaptureDisplay(ANativeWindow *capture_window) {
 	RETURN(result, int);
 }
 
+int UVCCamera::captureStill(const char *path, int num_frames, int quality) {
+	ENTER();
+	int result = EXIT_FAILURE;
+	if (mPreview) {
+		result = mPreview->captureStill(path, num_frames, quality);
+	}
+	RETURN(result, int);
+}
+
+int UVCCamera::setDecodeSkipMode(int mode) {
+	ENTER();
+	int result = EXIT_FAILURE;
+	if (mPreview) {
+		result = mPreview->setDecodeSkipMode(mode);
+	}
+	RETURN(result, int);
+}
+
+int UVCCamera::setDecodeProfile(int profile) {
+	ENTER();
+	int result = EXIT_FAILURE;
+	if (mPreview) {
+		result = mPreview->setDecodeProfile(profile);
+	}
+	RETURN(result, int);
+}
+
+int UVCCamera::getSkippedDecodeCount() {
+	ENTER();
+	int result = 0;
+	if (mPreview) {
+		result = (int)mPreview->getSkippedDecodeCount();
+	}
+	RETURN(result, int);
+}
+
+int UVCCamera::setLowLatencyMode(bool enable) {
+	ENTER();
+	int result = EXIT_FAILURE;
+	if (mPreview) {
+		result = mPreview->setLowLatencyMode(enable);
+	}
+	RETURN(result, int);
+}
+
+int UVCCamera::getPreviewLatency(int percentile) {
+	ENTER();
+	int result = -1;
+	if (mPreview) {
+		result = mPreview->getPreviewLatency(percentile);
+	}
+	RETURN(result, int);
+}
+
+int UVCCamera::getStaleDropCount() {
+	ENTER();
+	int result = 0;
+	if (mPreview) {
+		result = (int)mPreview->getStaleDropCount();
+	}
+	RETURN(result, int);
+}
+
+int UVCCamera::setPipelinedPreview(bool enable) {
+	ENTER();
+	int result = EXIT_FAILURE;
+	if (mPreview) {
+		result = mPreview->setPipelinedPreview(enable);
+	}
+	RETURN(result, int);
+}
+
+int UVCCamera::getPreviewStageTime(int stage, bool max) {
+	ENTER();
+	int result = -1;
+	if (mPreview) {
+		result = mPreview->getPreviewStageTime(stage, max);
+	}
+	RETURN(result, int);
+}
+
 //======================================================================
 // カメラのサポートしているコントロール機能を取得する
 int UVCCamera::getCtrlSupports(uint64_t *supports) {
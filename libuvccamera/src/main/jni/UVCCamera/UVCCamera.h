@@ -189,11 +189,31 @@ public:
 
 	char *getSupportedSize();
 	int setPreviewSize(int width, int height, int min_fps, int max_fps, int mode, float bandwidth = DEFAULT_BANDWIDTH);
+	int switchFormat(int width, int height, int min_fps, int max_fps, int mode, float bandwidth = DEFAULT_BANDWIDTH);
+	int getSwitchTime();
 	int setPreviewDisplay(ANativeWindow *preview_window);
-	int setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format);
+	int setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format,
+		int width = 0, int height = 0, float max_fps = 0.0f);
+	jobjectArray setFrameSlotCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format, int num_slots,
+		int width = 0, int height = 0, float max_fps = 0.0f);
+	int addFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format,
+		int width, int height, float max_fps);
+	jobjectArray addFrameSlotCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format, int num_slots,
+		int width, int height, float max_fps);
+	int removeFrameCallback(JNIEnv *env, jobject frame_callback_obj);
+	int releaseFrameSlot(JNIEnv *env, jobject frame_callback_obj, int slot);
 	int startPreview();
 	int stopPreview();
 	int setCaptureDisplay(ANativeWindow *capture_window);
+	int captureStill(const char *path, int num_frames, int quality);
+	int setDecodeSkipMode(int mode);
+	int setDecodeProfile(int profile);
+	int getSkippedDecodeCount();
+	int setLowLatencyMode(bool enable);
+	int getPreviewLatency(int percentile);
+	int getStaleDropCount();
+	int setPipelinedPreview(bool enable);
+	int getPreviewStageTime(int stage, bool max);
 
 	int getCtrlSupports(uint64_t *supports);
 	int getProcSupports(uint64_t *supports);
@@ -23,8 +23,14 @@
 */
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <errno.h>
 #include <linux/time.h>
 #include <unistd.h>
+#include <algorithm>
 
 #if 1	// set 1 if you don't need debug log
 	#ifndef LOG_NDEBUG
@@ -37,14 +43,28 @@
 //	#undef NDEBUG
 #endif
 
+#pragma implementation "UVCPreview.h"
 #include "utilbase.h"
 #include "UVCPreview.h"
+#include "RenderTarget.h"
 #include "libuvc_internal.h"
 
 #define	LOCAL_DEBUG 0
 #define MAX_FRAME 4
 #define PREVIEW_PIXEL_BYTES 4	// RGBA/RGBX
 #define FRAME_POOL_SZ MAX_FRAME + 2
+#define DEFAULT_BURST_QUALITY 90
+#define MAX_BURST_FRAME 8
+// number of converted frames that can wait for the present thread
+#define MAX_PRESENT_FRAME 2
+// number of 8-byte words that are hashed in DECODE_SKIP_SAMPLED mode
+#define DECODE_SKIP_SAMPLES 2048
+
+static inline int64_t monotonic_us() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
 
 UVCPreview::UVCPreview(uvc_device_handle_t *devh)
 :	mPreviewWindow(NULL),
@@ -65,9 +85,38 @@ UVCPreview::UVCPreview(uvc_device_handle_t *devh)
 	mIsRunning(false),
 	mIsCapturing(false),
 	captureQueu(NULL),
-	mFrameCallbackObj(NULL),
-	mFrameCallbackFunc(NULL),
-	callbackPixelBytes(2) {
+	captureSource(NULL),
+	mFrameCallback(NULL),
+	mCallbackNeedsDecode(false),
+	previewFrames(MAX_FRAME),
+	burstFrames(MAX_BURST_FRAME),
+	mIsBursting(false),
+	mBurstRunning(false),
+	burstRequests(0),
+	burstNumFrames(0),
+	burstQuality(DEFAULT_BURST_QUALITY),
+	mDecodeSkipMode(DECODE_SKIP_NONE),
+	mDecodeCount(0),
+	mSkippedDecodeCount(0),
+	mDecodeProfile(UVC_MJPEG_PROFILE_BALANCED),
+	mLowLatency(false),
+	mStaleDropCount(0),
+	latencySampleIx(0),
+	latencySampleNum(0),
+	mPipelined(false),
+	mPresentRunning(false),
+	presentFrames(MAX_PRESENT_FRAME),
+	dequeueTime(0),
+	mSwitchRequested(false),
+	switchStarted(false),
+	switchWidth(0), switchHeight(0),
+	switchMinFps(0), switchMaxFps(0),
+	switchMode(0),
+	switchBandwidth(DEFAULT_BANDWIDTH),
+	mSwitchResult(0),
+	switchRequestTime(0),
+	switchStartTime(0),
+	mSwitchTime(-1) {
 
 	ENTER();
 	pthread_cond_init(&preview_sync, NULL);
@@ -75,8 +124,20 @@ UVCPreview::UVCPreview(uvc_device_handle_t *devh)
 //
 	pthread_cond_init(&capture_sync, NULL);
 	pthread_mutex_init(&capture_mutex, NULL);
-//	
-	pthread_mutex_init(&pool_mutex, NULL);
+	pthread_mutex_init(&callback_mutex, NULL);
+//
+	pthread_cond_init(&burst_sync, NULL);
+	pthread_mutex_init(&burst_mutex, NULL);
+	burstPath[0] = '\0';
+//
+	pthread_mutex_init(&latency_mutex, NULL);
+	memset(stageTimes, 0, sizeof(stageTimes));
+//
+	pthread_cond_init(&present_sync, NULL);
+	pthread_mutex_init(&present_mutex, NULL);
+//
+	pthread_cond_init(&switch_sync, NULL);
+	pthread_mutex_init(&switch_mutex, NULL);
 	EXIT();
 }
 
@@ -91,80 +152,58 @@ UVCPreview::~UVCPreview() {
 	mCaptureWindow = NULL;
 	clearPreviewFrame();
 	clearCaptureFrame();
-	clear_pool();
+	stopBurst();
+	JNIEnv *env = getEnv();
+	for (int i = 0; i < mFrameCallbacks.size(); i++) {
+		mFrameCallbacks[i]->release(env);
+	}
+	mFrameCallbacks.clear();
+	mFrameCallback = NULL;
 	pthread_mutex_destroy(&preview_mutex);
 	pthread_cond_destroy(&preview_sync);
 	pthread_mutex_destroy(&capture_mutex);
 	pthread_cond_destroy(&capture_sync);
-	pthread_mutex_destroy(&pool_mutex);
+	pthread_mutex_destroy(&callback_mutex);
+	pthread_mutex_destroy(&burst_mutex);
+	pthread_cond_destroy(&burst_sync);
+	pthread_mutex_destroy(&latency_mutex);
+	pthread_mutex_destroy(&present_mutex);
+	pthread_cond_destroy(&present_sync);
+	pthread_mutex_destroy(&switch_mutex);
+	pthread_cond_destroy(&switch_sync);
 	EXIT();
 }
 
 /**
- * get uvc_frame_t from frame pool
+ * get uvc_frame_t from the shared frame pool
  * if pool is empty, create new frame
- * this function does not confirm the frame size
- * and you may need to confirm the size
+ * the buffer of the frame is equal to or larger than data_bytes
+ * but data_bytes of the frame is not changed and you may need to confirm the size
  */
 uvc_frame_t *UVCPreview::get_frame(size_t data_bytes) {
-	uvc_frame_t *frame = NULL;
-	pthread_mutex_lock(&pool_mutex);
-	{
-		if (!mFramePool.isEmpty()) {
-			frame = mFramePool.last();
-		}
-	}
-	pthread_mutex_unlock(&pool_mutex);
-	if UNLIKELY(!frame) {
-		//LOGW("allocate new frame");
-		frame = uvc_allocate_frame(data_bytes);
-	}
-	return frame;
+	return FramePool::getInstance()->obtain(data_bytes);
 }
 
 void UVCPreview::recycle_frame(uvc_frame_t *frame) {
-	pthread_mutex_lock(&pool_mutex);
-	if (LIKELY(mFramePool.size() < FRAME_POOL_SZ)) {
-		mFramePool.put(frame);
-		frame = NULL;
-	}
-	pthread_mutex_unlock(&pool_mutex);
-	if (UNLIKELY(frame)) {
-		uvc_free_frame(frame);
-	}
+	FramePool::getInstance()->recycle(frame);
 }
 
-
+/**
+ * allocate frames for the negotiated format in advance
+ * so that allocation does not occur while starting streaming
+ */
 void UVCPreview::init_pool(size_t data_bytes) {
 	ENTER();
 
-	clear_pool();
-	pthread_mutex_lock(&pool_mutex);
-	{
-		for (int i = 0; i < FRAME_POOL_SZ; i++) {
-			mFramePool.put(uvc_allocate_frame(data_bytes));
-		}
-	}
-	pthread_mutex_unlock(&pool_mutex);
+	FramePool *pool = FramePool::getInstance();
+	// raw(YUYV) frames or decoded frames from MJPEG
+	pool->prealloc(data_bytes, FRAME_POOL_SZ);
+	// frames to draw preview/capture surface
+	pool->prealloc(previewBytes, 2);
 
 	EXIT();
 }
 
-void UVCPreview::clear_pool() {
-	ENTER();
-
-	pthread_mutex_lock(&pool_mutex);
-	{
-		const int n = mFramePool.size();
-		for (int i = 0; i < n; i++) {
-			uvc_free_frame(mFramePool[i]);
-		}
-		mFramePool.clear();
-	}
-	pthread_mutex_unlock(&pool_mutex);
-	EXIT();
-}
-
 inline const bool UVCPreview::isRunning() const {return mIsRunning; }
 
 int UVCPreview::setPreviewSize(int width, int height, int min_fps, int max_fps, int mode, float bandwidth) {
@@ -206,84 +245,186 @@ int UVCPreview::setPreviewDisplay(ANativeWindow *preview_window) {
 	RETURN(0, int);
 }
 
-int UVCPreview::setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format) {
+/**
+ * set IFrameCallback, this replaces the callback that was set by previous call.
+ * callbacks that were added by addFrameCallback are kept.
+ * @param frame_callback_obj global reference, NULL to remove current callback
+ * @param width, height size of frames for callback, 0 for same size as the preview.
+ *        this is applied only when frames are YUYV(or decoded from MJPEG) and pixel_format is not PIXEL_FORMAT_RAW
+ * @param max_fps maximum frame rate of callback, 0 for every frame.
+ *        frames that exceed this are skipped before any conversion
+ */
+int UVCPreview::setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format,
+	int width, int height, float max_fps) {
 
 	ENTER();
-	pthread_mutex_lock(&capture_mutex);
+	registerFrameCallback(env, frame_callback_obj, pixel_format, width, height, max_fps, 0, true);
+	RETURN(0, int);
+}
+
+/**
+ * set IFrameSlotCallback, frames are written into fixed number of pooled buffers
+ * and delivered as slot index, the slot is not reused until releaseFrameSlot is called.
+ * the buffers depend on current preview size, so this should be called after setPreviewSize.
+ * @param num_slots number of slots, 1 to MAX_FRAME_SLOTS
+ * @param width, height, max_fps same as setFrameCallback
+ * @return array of direct ByteBuffer that refer each slot, NULL if failed or frame_callback_obj is NULL
+ */
+jobjectArray UVCPreview::setFrameSlotCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format, int num_slots,
+	int width, int height, float max_fps) {
+
+	ENTER();
+	jobjectArray result = NULL;
+	registerFrameCallback(env, frame_callback_obj, pixel_format,
+		width, height, max_fps, num_slots > 0 ? num_slots : 1, true, &result);
+	RET(result);
+}
+
+/**
+ * add IFrameCallback in addition to the callback that was set by setFrameCallback,
+ * if the callback object is already registered, it is replaced with new parameters.
+ * each callback has its own thread, pixel format, size and frame rate.
+ * @param frame_callback_obj global reference
+ */
+int UVCPreview::addFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format,
+	int width, int height, float max_fps) {
+
+	ENTER();
+	FrameCallback *callback = registerFrameCallback(env, frame_callback_obj, pixel_format,
+		width, height, max_fps, 0, false);
+	RETURN(callback ? 0 : -1, int);
+}
+
+/**
+ * add IFrameSlotCallback, same as addFrameCallback except frames are delivered via slots
+ * @return array of direct ByteBuffer that refer each slot, NULL if failed
+ */
+jobjectArray UVCPreview::addFrameSlotCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format, int num_slots,
+	int width, int height, float max_fps) {
+
+	ENTER();
+	jobjectArray result = NULL;
+	registerFrameCallback(env, frame_callback_obj, pixel_format,
+		width, height, max_fps, num_slots > 0 ? num_slots : 1, false, &result);
+	RET(result);
+}
+
+/**
+ * remove the callback that was set by setFrameCallback or added by addFrameCallback.
+ * this should not be called from the callback itself.
+ * @param frame_callback_obj local reference is enough
+ */
+int UVCPreview::removeFrameCallback(JNIEnv *env, jobject frame_callback_obj) {
+
+	ENTER();
+	ObjectArray<FrameCallback *> removed;
+	pthread_mutex_lock(&callback_mutex);
 	{
-		if (isRunning() && isCapturing()) {
-			mIsCapturing = false;
-			if (mFrameCallbackObj) {
-				pthread_cond_signal(&capture_sync);
-				pthread_cond_wait(&capture_sync, &capture_mutex);	// wait finishing capturing
+		for (int i = mFrameCallbacks.size() - 1; i >= 0; i--) {
+			FrameCallback *callback = mFrameCallbacks[i];
+			if (callback->isSameObject(env, frame_callback_obj)) {
+				removed.put(mFrameCallbacks.remove(i));
+				if (callback == mFrameCallback) {
+					mFrameCallback = NULL;
+				}
 			}
 		}
-		if (!env->IsSameObject(mFrameCallbackObj, frame_callback_obj))	{
-			iframecallback_fields.onFrame = NULL;
-			if (mFrameCallbackObj) {
-				env->DeleteGlobalRef(mFrameCallbackObj);
+		frameCallbacksChanged();
+	}
+	pthread_mutex_unlock(&callback_mutex);
+	// stop callback threads without lock because they may call releaseFrameSlot
+	for (int i = 0; i < removed.size(); i++) {
+		removed[i]->release(env);
+	}
+	RETURN(removed.isEmpty() ? -1 : 0, int);
+}
+
+/**
+ * return the slot that was delivered via IFrameSlotCallback#onFrame
+ * @param frame_callback_obj callback that received the slot, NULL for the callback set by setFrameSlotCallback
+ * @return 0 if success
+ */
+int UVCPreview::releaseFrameSlot(JNIEnv *env, jobject frame_callback_obj, int slot) {
+	int result = -1;
+	pthread_mutex_lock(&callback_mutex);
+	{
+		if (!frame_callback_obj) {
+			if (LIKELY(mFrameCallback)) {
+				result = mFrameCallback->releaseSlot(slot);
 			}
-			mFrameCallbackObj = frame_callback_obj;
-			if (frame_callback_obj) {
-				// get method IDs of Java object for callback
-				jclass clazz = env->GetObjectClass(frame_callback_obj);
-				if (LIKELY(clazz)) {
-					iframecallback_fields.onFrame = env->GetMethodID(clazz,
-						"onFrame",	"(Ljava/nio/ByteBuffer;)V");
-				} else {
-					LOGW("failed to get object class");
+		} else {
+			for (int i = 0; i < mFrameCallbacks.size(); i++) {
+				if (mFrameCallbacks[i]->isSameObject(env, frame_callback_obj)) {
+					result = mFrameCallbacks[i]->releaseSlot(slot);
+					break;
 				}
-				env->ExceptionClear();
-				if (!iframecallback_fields.onFrame) {
-					LOGE("Can't find IFrameCallback#onFrame");
-					env->DeleteGlobalRef(frame_callback_obj);
-					mFrameCallbackObj = frame_callback_obj = NULL;
+			}
+		}
+	}
+	pthread_mutex_unlock(&callback_mutex);
+	return result;
+}
+
+/**
+ * create and register new callback, previous one for the same object is removed.
+ * @param primary if true, replace the callback that was set by setFrameCallback
+ * @param buffers if not NULL, ByteBuffers of the slots are set before any frame is delivered
+ * @return NULL if frame_callback_obj is NULL or failed
+ */
+/*private*/
+FrameCallback *UVCPreview::registerFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format,
+	int width, int height, float max_fps, int num_slots, bool primary, jobjectArray *buffers) {
+
+	ENTER();
+	// frame_callback_obj is deleted if this fails, so never use it when result is NULL
+	FrameCallback *result = frame_callback_obj
+		? FrameCallback::create(env, frame_callback_obj, pixel_format,
+			width, height, max_fps, num_slots,
+			isRunning() ? frameWidth : requestWidth, isRunning() ? frameHeight : requestHeight)
+		: NULL;
+	if (result && buffers) {
+		*buffers = result->createBuffers(env);
+	}
+	ObjectArray<FrameCallback *> removed;
+	pthread_mutex_lock(&callback_mutex);
+	{
+		for (int i = mFrameCallbacks.size() - 1; i >= 0; i--) {
+			FrameCallback *callback = mFrameCallbacks[i];
+			if ((primary && (callback == mFrameCallback))
+				|| (result && callback->isSameObject(env, frame_callback_obj))) {
+
+				removed.put(mFrameCallbacks.remove(i));
+				if (callback == mFrameCallback) {
+					mFrameCallback = NULL;
 				}
 			}
 		}
-		if (frame_callback_obj) {
-			mPixelFormat = pixel_format;
-			callbackPixelFormatChanged();
+		if (result) {
+			mFrameCallbacks.put(result);
+			if (primary) {
+				mFrameCallback = result;
+			}
 		}
+		frameCallbacksChanged();
 	}
-	pthread_mutex_unlock(&capture_mutex);
-	RETURN(0, int);
+	pthread_mutex_unlock(&callback_mutex);
+	// stop callback threads without lock because they may call releaseFrameSlot
+	for (int i = 0; i < removed.size(); i++) {
+		removed[i]->release(env);
+	}
+	RET(result);
 }
 
-void UVCPreview::callbackPixelFormatChanged() {
-	mFrameCallbackFunc = NULL;
-	const size_t sz = requestWidth * requestHeight;
-
-	switch (mPixelFormat) {
-	  case PIXEL_FORMAT_RAW:
-		LOGI("PIXEL_FORMAT_RAW:");
-		callbackPixelBytes = sz * 2;
-		break;
-	  case PIXEL_FORMAT_YUV:
-		LOGI("PIXEL_FORMAT_YUV:");
-		callbackPixelBytes = sz * 2;
-		break;
-	  case PIXEL_FORMAT_RGB565:
-		LOGI("PIXEL_FORMAT_RGB565:");
-		mFrameCallbackFunc = uvc_any2rgb565;
-		callbackPixelBytes = sz * 2;
-		break;
-	  case PIXEL_FORMAT_RGBX:
-		LOGI("PIXEL_FORMAT_RGBX:");
-		mFrameCallbackFunc = uvc_any2rgbx;
-		callbackPixelBytes = sz * 4;
-		break;
-	  case PIXEL_FORMAT_YUV20SP:
-		LOGI("PIXEL_FORMAT_YUV20SP:");
-		mFrameCallbackFunc = uvc_yuyv2iyuv420SP;
-		callbackPixelBytes = (sz * 3) / 2;
-		break;
-	  case PIXEL_FORMAT_NV21:
-		LOGI("PIXEL_FORMAT_NV21:");
-		mFrameCallbackFunc = uvc_yuyv2yuv420SP;
-		callbackPixelBytes = (sz * 3) / 2;
-		break;
+/**
+ * should be called with callback_mutex locked
+ */
+/*private*/
+void UVCPreview::frameCallbacksChanged() {
+	bool needs_decode = false;
+	for (int i = 0; i < mFrameCallbacks.size(); i++) {
+		needs_decode |= mFrameCallbacks[i]->needsDecode();
 	}
+	mCallbackNeedsDecode = needs_decode;
 }
 
 void UVCPreview::clearDisplay() {
@@ -332,6 +473,15 @@ int UVCPreview::startPreview() {
 	int result = EXIT_FAILURE;
 	if (!isRunning()) {
 		mIsRunning = true;
+#if LOCAL_DEBUG
+		check_direct_render();
+#endif
+		mDecodeCount = mSkippedDecodeCount = 0;
+		mStaleDropCount = 0;
+		pthread_mutex_lock(&latency_mutex);
+		latencySampleIx = latencySampleNum = 0;
+		memset(stageTimes, 0, sizeof(stageTimes));
+		pthread_mutex_unlock(&latency_mutex);
 		pthread_mutex_lock(&preview_mutex);
 		{
 			if (LIKELY(mPreviewWindow)) {
@@ -359,6 +509,11 @@ int UVCPreview::stopPreview() {
 		mIsRunning = false;
 		pthread_cond_signal(&preview_sync);
 		pthread_cond_signal(&capture_sync);
+		pthread_mutex_lock(&present_mutex);
+		{
+			pthread_cond_broadcast(&present_sync);
+		}
+		pthread_mutex_unlock(&present_mutex);
 		if (pthread_join(capture_thread, NULL) != EXIT_SUCCESS) {
 			LOGW("UVCPreview::terminate capture thread: pthread_join failed");
 		}
@@ -367,6 +522,7 @@ int UVCPreview::stopPreview() {
 		}
 		clearDisplay();
 	}
+	stopBurst();
 	clearPreviewFrame();
 	clearCaptureFrame();
 	pthread_mutex_lock(&preview_mutex);
@@ -415,45 +571,76 @@ void UVCPreview::uvc_preview_frame_callback(uvc_frame_t *frame, void *vptr_args)
 			preview->recycle_frame(copy);
 			return;
 		}
-		preview->addPreviewFrame(copy);
+		// preview, capture, callback and burst share this copy
+		SharedFrame *shared = SharedFrame::create(copy);
+		if (UNLIKELY(!shared)) return;
+		if (UNLIKELY(__atomic_load_n(&preview->burstRequests, __ATOMIC_RELAXED) > 0)) {
+			preview->addBurstFrame(shared);
+		}
+		preview->addPreviewFrame(shared);
 	}
 }
 
-void UVCPreview::addPreviewFrame(uvc_frame_t *frame) {
+void UVCPreview::addPreviewFrame(SharedFrame *frame) {
 //LOGE("mIFrameCallback......addPreviewFrame");
+	SharedFrame *stale = NULL;
 	pthread_mutex_lock(&preview_mutex);
-	if (isRunning() && (previewFrames.size() < MAX_FRAME)) {
-		previewFrames.put(frame);
-		frame = NULL;
-		pthread_cond_signal(&preview_sync);
+	if (isRunning()) {
+		if (UNLIKELY(mLowLatency && previewFrames.isFull())) {
+			// latest frame wins, drop oldest one instead of this frame
+			stale = previewFrames.get();
+			mStaleDropCount++;
+		}
+		if (previewFrames.put(frame)) {
+			frame = NULL;
+			pthread_cond_signal(&preview_sync);
+		}
 	}
 	pthread_mutex_unlock(&preview_mutex);
+	if (stale) {
+		stale->release();
+	}
 	if (frame) {
-		recycle_frame(frame);
+		frame->release();
 	}
 }
 
-uvc_frame_t *UVCPreview::waitPreviewFrame() {
-	uvc_frame_t *frame = NULL;
+SharedFrame *UVCPreview::waitPreviewFrame() {
+	SharedFrame *frame = NULL;
 	pthread_mutex_lock(&preview_mutex);
 	{
-		if (!previewFrames.size()) {
+		if (previewFrames.isEmpty() && !mSwitchRequested) {
 			pthread_cond_wait(&preview_sync, &preview_mutex);
 		}
-		if (LIKELY(isRunning() && previewFrames.size() > 0)) {
-			frame = previewFrames.remove(0);
+		if (LIKELY(isRunning() && !mSwitchRequested)) {
+			frame = previewFrames.get();
+			if (mLowLatency) {
+				// drop stale frames and render newest one
+				for (SharedFrame *next = previewFrames.get(); next; next = previewFrames.get()) {
+					frame->release();
+					frame = next;
+					mStaleDropCount++;
+				}
+			}
 		}
 	}
 	pthread_mutex_unlock(&preview_mutex);
+	dequeueTime = monotonic_us();
+	if (UNLIKELY(frame && switchStartTime)) {
+		// first frame after switching format
+		mSwitchTime = (int32_t)(dequeueTime - switchStartTime);
+		switchStartTime = 0;
+		LOGI("switch format:time to first frame=%dus", mSwitchTime);
+	}
 	return frame;
 }
 
 void UVCPreview::clearPreviewFrame() {
 	pthread_mutex_lock(&preview_mutex);
 	{
-		for (int i = 0; i < previewFrames.size(); i++)
-			recycle_frame(previewFrames[i]);
-		previewFrames.clear();
+		for (SharedFrame *frame = previewFrames.get(); frame; frame = previewFrames.get())
+			frame->release();
+		previewFrames.resetHighWaterMark();
 	}
 	pthread_mutex_unlock(&preview_mutex);
 }
@@ -505,186 +692,772 @@ int UVCPreview::prepare_preview(uvc_stream_ctrl_t *ctrl) {
 		frameMode = requestMode;
 		frameBytes = frameWidth * frameHeight * (!requestMode ? 2 : 4);
 		previewBytes = frameWidth * frameHeight * PREVIEW_PIXEL_BYTES;
+		// MJPEG frames are decoded into YUYV, size of raw MJPEG frames is unknown here
+		init_pool(frameWidth * frameHeight * 2);
 	} else {
 		LOGE("could not negotiate with camera:err=%d", result);
 	}
 	RETURN(result, int);
 }
 
-void UVCPreview::do_preview(uvc_stream_ctrl_t *ctrl) {
-
+/**
+ * set whether decoding of MJPEG frames that are same as previous one is skipped,
+ * decoded frame is reused for callbacks and the preview Surface keeps showing the previous frame
+ * @param mode DECODE_SKIP_NONE/DECODE_SKIP_EXACT/DECODE_SKIP_SAMPLED
+ */
+int UVCPreview::setDecodeSkipMode(int mode) {
 	ENTER();
-	uvc_frame_t *frame = NULL;
-	uvc_frame_t *frame_mjpeg = NULL;
-	uvc_error_t result = uvc_start_streaming_bandwidth(
-		mDeviceHandle, ctrl, uvc_preview_frame_callback, (void *)this, requestBandwidth, 0);
 
-	if (LIKELY(!result)) {
-		clearPreviewFrame();
-		pthread_create(&capture_thread, NULL, capture_thread_func, (void *)this);
+	int result = EXIT_SUCCESS;
+	switch (mode) {
+	case DECODE_SKIP_NONE:
+	case DECODE_SKIP_EXACT:
+	case DECODE_SKIP_SAMPLED:
+		mDecodeSkipMode = mode;
+		break;
+	default:
+		result = EXIT_FAILURE;
+		break;
+	}
 
+	RETURN(result, int);
+}
 
+/**
+ * set MJPEG decoder profile of this camera, this is applied to the preview thread
+ * @param profile UVC_MJPEG_PROFILE_FASTEST/BALANCED/ACCURATE
+ */
+int UVCPreview::setDecodeProfile(int profile) {
+	ENTER();
 
-		if (frameMode) {
-			// MJPEG mode
+	int result = EXIT_FAILURE;
+	if ((profile >= UVC_MJPEG_PROFILE_FASTEST) && (profile <= UVC_MJPEG_PROFILE_ACCURATE)) {
+		mDecodeProfile = profile;
+		result = EXIT_SUCCESS;
+	}
+
+	RETURN(result, int);
+}
+
+/**
+ * set low latency preview mode, preview always renders newest frame
+ * and drops stale frames instead of rendering every frame
+ */
+int UVCPreview::setLowLatencyMode(bool enable) {
+	ENTER();
 
-			for ( ; LIKELY(isRunning()) ; ) {
-				frame_mjpeg = waitPreviewFrame();
-				if (LIKELY(frame_mjpeg)) {
+	pthread_mutex_lock(&preview_mutex);
+	{
+		mLowLatency = enable;
+	}
+	pthread_mutex_unlock(&preview_mutex);
 
-                    //bycui_test
-                    if (mFrameCallbackFunc){
+	RETURN(EXIT_SUCCESS, int);
+}
 
+/**
+ * enable/disable two-stage preview, decode/convert and posting the Surface run on
+ * separate threads so that next frame can be decoded while current frame is posted.
+ * this is applied when preview starts next time.
+ */
+int UVCPreview::setPipelinedPreview(bool enable) {
+	ENTER();
 
-                            frame = get_frame(frame_mjpeg->width * frame_mjpeg->height * 2);
+	mPipelined = enable;
 
+	RETURN(EXIT_SUCCESS, int);
+}
 
+void UVCPreview::addStageTime(const int &stage, const int64_t &us) {
+	if (UNLIKELY(us < 0)) return;
 
-                            result = uvc_mjpeg2yuyv(frame_mjpeg, frame);   // MJPEG => yuyv
-                            //LOGE("frame_mjpeg==mFrameCallbackFunc=====");
-                            recycle_frame(frame_mjpeg);
+	pthread_mutex_lock(&latency_mutex);
+	{
+		stage_time_t &t = stageTimes[stage];
+		t.total_us += us;
+		t.count++;
+		if (us > t.max_us) {
+			t.max_us = (uint32_t)us;
+		}
+	}
+	pthread_mutex_unlock(&latency_mutex);
+}
 
-                            if (LIKELY(!result)) {
-                                //LOGE("frame_mjpeg==mFrameCallbackFunc=====本地预览...");
-                                frame = draw_preview_one(frame, &mPreviewWindow, uvc_any2rgbx, 4);
-                                addCaptureFrame(frame);
-                            } else {
-                            // LOGE("frame_mjpeg==mFrameCallbackFunc=====");
-                                recycle_frame(frame);
-                            }
-                    }else{
-                        addCaptureFrame(frame_mjpeg);
-                       // LOGE("frame_mjpeg==mFrameCallbackFunc=====do_preview=%d", frame_mjpeg->width * frame_mjpeg->height );
-                    }
+/**
+ * get time spent in the stage of preview per frame since preview started
+ * @param stage PREVIEW_STAGE_DECODE or PREVIEW_STAGE_PRESENT
+ * @param max if true, return maximum time instead of average
+ * @return time in microseconds, -1 if no frame passed the stage
+ */
+int UVCPreview::getPreviewStageTime(int stage, bool max) {
+	ENTER();
 
-				}
+	int result = -1;
+	if ((stage >= 0) && (stage < PREVIEW_STAGE_NUM)) {
+		pthread_mutex_lock(&latency_mutex);
+		{
+			const stage_time_t &t = stageTimes[stage];
+			if (t.count) {
+				result = max ? (int)t.max_us : (int)(t.total_us / t.count);
 			}
-		} else {
-			// yuvyv mode
-			for ( ; LIKELY(isRunning()) ; ) {
-				frame = waitPreviewFrame();
-				if (LIKELY(frame)) {
-					frame = draw_preview_one(frame, &mPreviewWindow, uvc_any2rgbx, 4);
-					addCaptureFrame(frame);
-				}
+		}
+		pthread_mutex_unlock(&latency_mutex);
+	}
+
+	RETURN(result, int);
+}
+
+/**
+ * record latency from capture to posting the frame on the preview Surface
+ */
+void UVCPreview::addLatencySample(const struct timeval &capture_time) {
+	if (UNLIKELY(!capture_time.tv_sec && !capture_time.tv_usec)) return;
+
+	// capture_time of libuvc is also based on CLOCK_MONOTONIC
+	const int64_t latency = monotonic_us()
+		- ((int64_t)capture_time.tv_sec * 1000000 + capture_time.tv_usec);
+	if (LIKELY(latency >= 0)) {
+		pthread_mutex_lock(&latency_mutex);
+		{
+			latencySamples[latencySampleIx] = (uint32_t)(latency < 0xffffffffLL ? latency : 0xffffffffLL);
+			latencySampleIx = (latencySampleIx + 1) % LATENCY_SAMPLES;
+			if (latencySampleNum < LATENCY_SAMPLES) {
+				latencySampleNum++;
 			}
 		}
+		pthread_mutex_unlock(&latency_mutex);
+	}
+}
+
+/**
+ * get percentile of preview latency over recent LATENCY_SAMPLES frames
+ * @param percentile 0-100, 50 for median
+ * @return latency in microseconds, -1 if no sample
+ */
+int UVCPreview::getPreviewLatency(int percentile) {
+	ENTER();
+
+	uint32_t samples[LATENCY_SAMPLES];
+	int num;
+	pthread_mutex_lock(&latency_mutex);
+	{
+		num = latencySampleNum;
+		memcpy(samples, latencySamples, sizeof(uint32_t) * num);
+	}
+	pthread_mutex_unlock(&latency_mutex);
+	int result = -1;
+	if (num > 0) {
+		if (percentile < 0) percentile = 0;
+		if (percentile > 100) percentile = 100;
+		const int ix = (num - 1) * percentile / 100;
+		std::nth_element(samples, samples + ix, samples + num);
+		result = (int)samples[ix];
+	}
 
+	RETURN(result, int);
+}
 
+/**
+ * hash entropy coded data of MJPEG frame(data after SOS marker),
+ * quantization/huffman tables are excluded because they rarely change
+ * @param sampled if true, only DECODE_SKIP_SAMPLES words evenly spaced in the payload are hashed
+ */
+static uint64_t mjpeg_payload_hash(const uvc_frame_t *frame, const bool sampled) {
+	const uint8_t *data = (const uint8_t *)frame->data;
+	const size_t bytes = frame->actual_bytes;
+	size_t offset = 0;
+	// search SOS marker
+	for (size_t i = 2; i + 1 < bytes; i++) {
+		if ((data[i] == 0xff) && (data[i + 1] == 0xda)) {
+			offset = i;
+			break;
+		}
+	}
+	// FNV-1a on 8-byte words
+	uint64_t hash = 0xcbf29ce484222325ULL ^ (bytes - offset);
+	const size_t words = (bytes - offset) / sizeof(uint64_t);
+	const size_t step = (sampled && (words > DECODE_SKIP_SAMPLES)) ? words / DECODE_SKIP_SAMPLES : 1;
+	uint64_t w;
+	for (size_t i = 0; i < words; i += step) {
+		memcpy(&w, data + offset + i * sizeof(uint64_t), sizeof(uint64_t));
+		hash = (hash ^ w) * 0x100000001b3ULL;
+	}
+	// remaining bytes at the tail are always hashed
+	for (size_t i = offset + words * sizeof(uint64_t); i < bytes; i++) {
+		hash = (hash ^ data[i]) * 0x100000001b3ULL;
+	}
+	return hash;
+}
 
+void UVCPreview::do_preview(uvc_stream_ctrl_t *ctrl) {
+
+	ENTER();
+	SharedFrame *frame = NULL;
+	SharedFrame *frame_mjpeg = NULL;
+	// keep reference of last decoded frame to skip decoding of unchanged MJPEG frames
+	SharedFrame *last_decoded = NULL;
+	uint64_t last_hash = 0;
+	// the Surface that shows the last MJPEG frame rendered without decoding to YUYV
+	ANativeWindow *rendered_window = NULL;
+	uint64_t rendered_hash = 0;
+	uint32_t rendered_width = 0, rendered_height = 0;
+	int decode_profile = -1;
+	uvc_error_t result = uvc_start_streaming_bandwidth(
+		mDeviceHandle, ctrl, uvc_preview_frame_callback, (void *)this, requestBandwidth, 0);
+
+	if (LIKELY(!result)) {
+		clearPreviewFrame();
+		pthread_create(&capture_thread, NULL, capture_thread_func, (void *)this);
+		if (mPipelined) {
+			mPresentRunning = !pthread_create(&present_thread, NULL, present_thread_func, (void *)this);
+		}
+
+
+		for ( ; ; ) {
+			if (frameMode) {
+				// MJPEG mode
+
+				for ( ; LIKELY(isRunning() && !mSwitchRequested) ; ) {
+					frame_mjpeg = waitPreviewFrame();
+					if (LIKELY(frame_mjpeg)) {
+						if (UNLIKELY(decode_profile != mDecodeProfile)) {
+							// decoder profile is kept for each thread in libuvc
+							decode_profile = mDecodeProfile;
+							uvc_mjpeg_set_profile((enum uvc_mjpeg_profile)decode_profile);
+						}
+
+	                    //bycui_test
+	                    if (mCallbackNeedsDecode){
+
+
+	                            uvc_frame_t *mjpeg = frame_mjpeg->get();
+	                            // decoded frame may be shared with previous one, keep capture time of this frame
+	                            const struct timeval capture_time = mjpeg->capture_time;
+	                            frame = NULL;
+	                            const int skip_mode = mDecodeSkipMode;
+	                            uint64_t hash = 0;
+	                            if (skip_mode != DECODE_SKIP_NONE) {
+	                                hash = mjpeg_payload_hash(mjpeg, skip_mode == DECODE_SKIP_SAMPLED);
+	                                if (last_decoded && (hash == last_hash)
+	                                    && (last_decoded->get()->width == mjpeg->width)
+	                                    && (last_decoded->get()->height == mjpeg->height)) {
+	                                    // same as previous frame, share previous decoded frame and its converted frames
+	                                    frame = last_decoded->addRef();
+	                                    mSkippedDecodeCount++;
+	                                }
+	                            }
+	                            if (!frame) {
+	                                uvc_frame_t *decoded = get_frame(mjpeg->width * mjpeg->height * 2);
+	                                result = decoded ? uvc_mjpeg2yuyv(mjpeg, decoded) : UVC_ERROR_NO_MEM;   // MJPEG => yuyv
+	                                mDecodeCount++;
+	                                if (LIKELY(!result)) {
+	                                    frame = SharedFrame::create(decoded);
+	                                } else {
+	                                    recycle_frame(decoded);
+	                                }
+	                                if (last_decoded) {
+	                                    last_decoded->release();
+	                                    last_decoded = NULL;
+	                                }
+	                                if (frame && (skip_mode != DECODE_SKIP_NONE)) {
+	                                    last_decoded = frame->addRef();
+	                                    last_hash = hash;
+	                                }
+	                            }
+	                            //LOGE("frame_mjpeg==mFrameCallbackFunc=====");
+	                            if (LIKELY(frame)) {
+	                                //LOGE("frame_mjpeg==mFrameCallbackFunc=====本地预览...");
+	                                frame = draw_preview_one(frame, &mPreviewWindow, uvc_any2rgbx, 4, capture_time);
+	                                // callbacks that do not convert frames still receive the MJPEG frame
+	                                addCaptureFrame(frame, frame_mjpeg);
+	                            } else {
+	                                frame_mjpeg->release();
+	                            }
+	                            rendered_window = NULL;
+	                    }else{
+	                        // MJPEG => RGBX directly into the Surface without decoding to YUYV
+	                        uvc_frame_t *mjpeg = frame_mjpeg->get();
+	                        const int skip_mode = mDecodeSkipMode;
+	                        bool skip = false;
+	                        pthread_mutex_lock(&preview_mutex);
+	                        ANativeWindow *window = mPreviewWindow;
+	                        pthread_mutex_unlock(&preview_mutex);
+	                        if (skip_mode != DECODE_SKIP_NONE) {
+	                            const uint64_t hash = mjpeg_payload_hash(mjpeg, skip_mode == DECODE_SKIP_SAMPLED);
+	                            // the Surface keeps showing the previous frame, decoding same payload again is not necessary
+	                            skip = window && (window == rendered_window) && (hash == rendered_hash)
+	                                && (mjpeg->width == rendered_width) && (mjpeg->height == rendered_height);
+	                            rendered_hash = hash;
+	                            rendered_width = mjpeg->width;
+	                            rendered_height = mjpeg->height;
+	                        }
+	                        if (skip) {
+	                            mSkippedDecodeCount++;
+	                        } else {
+	                            frame_mjpeg = draw_preview_one(frame_mjpeg, &mPreviewWindow, uvc_any2rgbx, 4, mjpeg->capture_time);
+	                            if (window) {
+	                                mDecodeCount++;
+	                            }
+	                            rendered_window = (skip_mode != DECODE_SKIP_NONE) ? window : NULL;
+	                        }
+	                        addCaptureFrame(frame_mjpeg);
+	                       // LOGE("frame_mjpeg==mFrameCallbackFunc=====do_preview=%d", frame_mjpeg->width * frame_mjpeg->height );
+	                    }
+
+					}
+				}
+			} else {
+				// yuvyv mode
+				for ( ; LIKELY(isRunning() && !mSwitchRequested) ; ) {
+					frame = waitPreviewFrame();
+					if (LIKELY(frame)) {
+						frame = draw_preview_one(frame, &mPreviewWindow, uvc_any2rgbx, 4, frame->get()->capture_time);
+						addCaptureFrame(frame);
+					}
+				}
+			}
+			if (!isRunning()) break;
+			// switch size/format, threads, surfaces and callbacks are kept,
+			// switch_format keeps current format if switchFormat cancelled the request
+			if (last_decoded) {
+				last_decoded->release();
+				last_decoded = NULL;
+			}
+			rendered_window = NULL;
+			result = (uvc_error_t)switch_format(ctrl);
+			if (UNLIKELY(result)) {
+				LOGE("failed to restart streaming after switching format:err=%d", result);
+				break;
+			}
+		}
+
+		if (last_decoded) {
+			last_decoded->release();
+			last_decoded = NULL;
+		}
+		if (mPresentRunning) {
+			pthread_mutex_lock(&present_mutex);
+			{
+				pthread_cond_broadcast(&present_sync);
+			}
+			pthread_mutex_unlock(&present_mutex);
+			if (pthread_join(present_thread, NULL) != EXIT_SUCCESS) {
+				LOGW("UVCPreview::terminate present thread: pthread_join failed");
+			}
+			mPresentRunning = false;
+			clearPresentFrame();
+		}
 		pthread_cond_signal(&capture_sync);
 #if LOCAL_DEBUG
 		LOGI("preview_thread_func:wait for all callbacks complete");
 #endif
 		uvc_stop_streaming(mDeviceHandle);
+		LOGI("preview queue:high water mark=%d/%d", previewFrames.highWaterMark(), previewFrames.capacity());
+		LOGI("preview latency:p50=%dus,p99=%dus,stale frames dropped=%u",
+			getPreviewLatency(50), getPreviewLatency(99), mStaleDropCount);
+		LOGI("preview stage:decode=%d/%dus,present=%d/%dus(avg/max)",
+			getPreviewStageTime(PREVIEW_STAGE_DECODE), getPreviewStageTime(PREVIEW_STAGE_DECODE, true),
+			getPreviewStageTime(PREVIEW_STAGE_PRESENT), getPreviewStageTime(PREVIEW_STAGE_PRESENT, true));
+		frame_pool_stats_t stats;
+		FramePool::getInstance()->getStats(&stats);
+		LOGI("frame pool:hits=%u,misses=%u,reallocs=%u,cached=%u/%u", stats.hits, stats.misses,
+			stats.reallocs, (uint32_t)stats.cached_bytes, (uint32_t)stats.memory_cap);
 #if LOCAL_DEBUG
 		LOGI("Streaming finished");
 #endif
 	} else {
 		uvc_perror(result, "failed start_streaming");
 	}
+	// wake up the caller of switchFormat if preview finished while switching
+	finishSwitch(UVC_ERROR_OTHER);
 
 	EXIT();
 
 }
 
-static void copyFrame(const uint8_t *src, uint8_t *dest, const int width, int height, const int stride_src, const int stride_dest) {
-//LOGE("mIFrameCallback......copyFrame...copyFrame...");
-	const int h8 = height % 8;
-	for (int i = 0; i < h8; i++) {
-		memcpy(dest, src, width);
-		dest += stride_dest; src += stride_src;
+/**
+ * change size/format of running preview without stopping the preview, capture and present threads.
+ * the stream is renegotiated on the preview thread and this waits until streaming restarts.
+ * if the camera rejects new format, previous format is restored and error is returned.
+ * if preview is not running, this is same as setPreviewSize.
+ * time to the first frame with new format can be read with getSwitchTime after that.
+ * @return 0 if success
+ */
+int UVCPreview::switchFormat(int width, int height, int min_fps, int max_fps, int mode, float bandwidth) {
+	ENTER();
+
+	int result = EXIT_FAILURE;
+	if (!isRunning()) {
+		result = setPreviewSize(width, height, min_fps, max_fps, mode, bandwidth);
+		RETURN(result, int);
 	}
-	for (int i = 0; i < height; i += 8) {
-		memcpy(dest, src, width);
-		dest += stride_dest; src += stride_src;
-		memcpy(dest, src, width);
-		dest += stride_dest; src += stride_src;
-		memcpy(dest, src, width);
-		dest += stride_dest; src += stride_src;
-		memcpy(dest, src, width);
-		dest += stride_dest; src += stride_src;
-		memcpy(dest, src, width);
-		dest += stride_dest; src += stride_src;
-		memcpy(dest, src, width);
-		dest += stride_dest; src += stride_src;
-		memcpy(dest, src, width);
-		dest += stride_dest; src += stride_src;
-		memcpy(dest, src, width);
-		dest += stride_dest; src += stride_src;
+	pthread_mutex_lock(&switch_mutex);
+	{
+		// latest request wins if previous one is not handled yet
+		switchWidth = width;
+		switchHeight = height;
+		switchMinFps = min_fps;
+		switchMaxFps = max_fps;
+		switchMode = mode;
+		switchBandwidth = bandwidth;
+		mSwitchTime = -1;
+		switchRequestTime = monotonic_us();
+		mSwitchRequested = true;
+		// wake up the preview thread if it is waiting for next frame
+		pthread_mutex_lock(&preview_mutex);
+		{
+			pthread_cond_signal(&preview_sync);
+		}
+		pthread_mutex_unlock(&preview_mutex);
+		// never wait forever even if the preview thread finished unexpectedly
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += MAX_SWITCH_WAIT_SEC;
+		bool cancelled = false;
+		while (mSwitchRequested && isRunning()) {
+			if (pthread_cond_timedwait(&switch_sync, &switch_mutex, &ts) == ETIMEDOUT) {
+				if (!switchStarted) {
+					// cancel the request so that the preview thread never switches after this returned failure
+					LOGW("switchFormat:timeout");
+					mSwitchRequested = false;
+					cancelled = true;
+					break;
+				}
+				// the preview thread is already switching, the result should reflect it
+				ts.tv_sec += MAX_SWITCH_WAIT_SEC;
+			}
+		}
+		result = cancelled || mSwitchRequested ? EXIT_FAILURE : mSwitchResult;
 	}
+	pthread_mutex_unlock(&switch_mutex);
+	RETURN(result, int);
+}
 
+/**
+ * stop streaming, renegotiate with requested format and restart streaming,
+ * this is called on the preview thread.
+ * @return error of restarting stream, 0 if streaming restarted even if new format was rejected
+ */
+/*private*/
+int UVCPreview::switch_format(uvc_stream_ctrl_t *ctrl) {
+	ENTER();
 
+	const int prevWidth = requestWidth, prevHeight = requestHeight;
+	const int prevMinFps = requestMinFps, prevMaxFps = requestMaxFps;
+	const int prevMode = requestMode;
+	const float prevBandwidth = requestBandwidth;
+	bool requested;
+	pthread_mutex_lock(&switch_mutex);
+	{
+		// switchFormat cancels the request on timeout unless this already took it
+		requested = mSwitchRequested;
+		if (LIKELY(requested)) {
+			switchStarted = true;
+			switchStartTime = switchRequestTime;
+			requestWidth = switchWidth;
+			requestHeight = switchHeight;
+			requestMinFps = switchMinFps;
+			requestMaxFps = switchMaxFps;
+			requestMode = switchMode;
+			requestBandwidth = switchBandwidth;
+		}
+	}
+	pthread_mutex_unlock(&switch_mutex);
+	if (UNLIKELY(!requested)) {
+		// keep streaming with current format
+		RETURN(0, int);
+	}
+	uvc_stop_streaming(mDeviceHandle);
+	// frames of previous format are not necessary any more
+	clearPreviewFrame();
+	clearPresentFrame();
+	clearCaptureFrame();
+	// buffers of previous size are kept in the shared frame pool(bounded by its memory cap)
+	// because other cameras and pipelines may use them, see UVCCamera#trimFramePool
+	int switch_result = prepare_preview(ctrl);
+	if (LIKELY(!switch_result)) {
+		// slots of IFrameSlotCallback are shared with Java and can not be resized,
+		// reject the format whose frames do not fit into them
+		pthread_mutex_lock(&callback_mutex);
+		{
+			for (int i = 0; i < mFrameCallbacks.size(); i++) {
+				if (UNLIKELY(!mFrameCallbacks[i]->canDeliver(frameWidth, frameHeight))) {
+					LOGE("switchFormat:frame slots are too small for %dx%d, register IFrameSlotCallback again after switching",
+						frameWidth, frameHeight);
+					switch_result = UVC_ERROR_INVALID_MODE;
+					break;
+				}
+			}
+		}
+		pthread_mutex_unlock(&callback_mutex);
+	}
+	if (UNLIKELY(switch_result)) {
+		// keep previous format
+		requestWidth = prevWidth;
+		requestHeight = prevHeight;
+		requestMinFps = prevMinFps;
+		requestMaxFps = prevMaxFps;
+		requestMode = prevMode;
+		requestBandwidth = prevBandwidth;
+		prepare_preview(ctrl);
+	}
+	// callbacks convert frames with new(negotiated) size
+	pthread_mutex_lock(&callback_mutex);
+	{
+		for (int i = 0; i < mFrameCallbacks.size(); i++) {
+			mFrameCallbacks[i]->setSourceSize(frameWidth, frameHeight);
+		}
+		frameCallbacksChanged();
+	}
+	pthread_mutex_unlock(&callback_mutex);
+	const int result = uvc_start_streaming_bandwidth(
+		mDeviceHandle, ctrl, uvc_preview_frame_callback, (void *)this, requestBandwidth, 0);
+	finishSwitch(result ? result : switch_result);
+	RETURN(result, int);
 }
 
+/*private*/
+void UVCPreview::finishSwitch(const int &result) {
+	pthread_mutex_lock(&switch_mutex);
+	{
+		if (mSwitchRequested) {
+			mSwitchResult = result;
+			mSwitchRequested = false;
+			if (UNLIKELY(result)) {
+				switchStartTime = 0;
+			}
+		}
+		switchStarted = false;
+		pthread_cond_broadcast(&switch_sync);
+	}
+	pthread_mutex_unlock(&switch_mutex);
+}
 
 // transfer specific frame data to the Surface(ANativeWindow)
 int copyToSurface(uvc_frame_t *frame, ANativeWindow **window) {
 	// ENTER();
 
-	int result = 0;
+	int result = -1;
 	if (LIKELY(*window)) {
-		ANativeWindow_Buffer buffer;
-		if (LIKELY(ANativeWindow_lock(*window, &buffer, NULL) == 0)) {
-			// source = frame data
-			const uint8_t *src = (uint8_t *)frame->data;
-			const int src_w = frame->width * PREVIEW_PIXEL_BYTES;
-			const int src_step = frame->width * PREVIEW_PIXEL_BYTES;
-			// destination = Surface(ANativeWindow)
-			uint8_t *dest = (uint8_t *)buffer.bits;
-			const int dest_w = buffer.width * PREVIEW_PIXEL_BYTES;
-			const int dest_step = buffer.stride * PREVIEW_PIXEL_BYTES;
-			// use lower transfer bytes
-			const int w = src_w < dest_w ? src_w : dest_w;
-			// use lower height
-			const int h = frame->height < buffer.height ? frame->height : buffer.height;
-			// transfer from frame data to the Surface
-			copyFrame(src, dest, w, h, src_step, dest_step);
-			ANativeWindow_unlockAndPost(*window);
-		} else {
-			result = -1;
-		}
-	} else {
-		result = -1;
+		WindowRenderTarget target(*window);
+		result = renderFrame(&target, frame, NULL);
 	}
 	return result; //RETURN(result, int);
 }
 
 // changed to return original frame instead of returning converted frame even if convert_func is not null.
-uvc_frame_t *UVCPreview::draw_preview_one(uvc_frame_t *frame, ANativeWindow **window, convFunc_t convert_func, int pixcelBytes) {
+// while capturing, converted frame is attached to the shared frame so that capture surface can reuse it.
+SharedFrame *UVCPreview::draw_preview_one(SharedFrame *frame, ANativeWindow **window, convFunc_t convert_func, int pixcelBytes,
+	const struct timeval &capture_time) {
 	// ENTER();
 
 
-	int b = 0;
+	// keep reference of the window so that rendering does not block frame callback with preview_mutex
+	ANativeWindow *target_window = NULL;
 	pthread_mutex_lock(&preview_mutex);
 	{
-		b = *window != NULL;
+		if (*window) {
+			target_window = *window;
+			ANativeWindow_acquire(target_window);
+		}
 	}
 	pthread_mutex_unlock(&preview_mutex);
-	if (LIKELY(b)) {
-		uvc_frame_t *converted;
-		if (convert_func) {
-			converted = get_frame(frame->width * frame->height * pixcelBytes);
-			if LIKELY(converted) {
-				b = convert_func(frame, converted);
-				if (!b) {
-					pthread_mutex_lock(&preview_mutex);
-					copyToSurface(converted, window);
-					pthread_mutex_unlock(&preview_mutex);
-				} else {
-					LOGE("failed converting");
-				}
-				recycle_frame(converted);
+	if (LIKELY(target_window) && mPresentRunning) {
+		// two-stage preview, convert on this thread and the present thread posts it
+		ANativeWindow_release(target_window);
+		uvc_frame_t *src = frame->get();
+		uvc_frame_t *converted = frame->getDerived(convert_func, src->width * src->height * pixcelBytes);
+		addStageTime(PREVIEW_STAGE_DECODE, monotonic_us() - dequeueTime);
+		if (LIKELY(converted)) {
+			addPresentFrame(frame, converted, capture_time);
+		} else {
+			LOGE("failed converting");
+		}
+	} else if (LIKELY(target_window)) {
+		WindowRenderTarget target(target_window);
+		const int64_t start = monotonic_us();
+		addStageTime(PREVIEW_STAGE_DECODE, start - dequeueTime);
+		const int b = render_preview(&target, frame, convert_func, pixcelBytes);
+		if (LIKELY(!b)) {
+			addStageTime(PREVIEW_STAGE_PRESENT, monotonic_us() - start);
+			addLatencySample(capture_time);
+		} else {
+			LOGE("failed converting");
+		}
+		ANativeWindow_release(target_window);
+	}
+
+
+	return frame; //RETURN(frame, SharedFrame *);
+}
+
+/**
+ * render the frame into the target on the preview thread.
+ * the frame is decoded/converted directly into the locked buffer unless the capture Surface
+ * also needs the converted frame, mIsCapturing can not be used here because it is
+ * set while the capture thread is running even without capture Surface.
+ * @return 0 if success
+ */
+/*private*/
+int UVCPreview::render_preview(IRenderTarget *target, SharedFrame *frame, convFunc_t convert_func, const int &pixelBytes) {
+	int result;
+	if (has_capture_window() || !convert_func) {
+		// converted frame is also used for capture surface, convert once and copy it
+		uvc_frame_t *src = frame->get();
+		uvc_frame_t *converted = frame->getDerived(convert_func, src->width * src->height * pixelBytes);
+		result = converted ? renderFrame(target, converted, NULL) : -1;
+	} else {
+		// decode/convert directly into the locked buffer of the Surface
+		result = renderFrame(target, frame->get(), convert_func);
+	}
+	return result;
+}
+
+/**
+ * render small YUYV frame into memory and check whether the direct path is taken,
+ * this is only called on debug build
+ */
+/*private*/
+void UVCPreview::check_direct_render() {
+	uvc_frame_t *yuyv = get_frame(16 * 16 * 2);
+	if (LIKELY(yuyv)) {
+		yuyv->width = yuyv->height = 16;
+		yuyv->step = 16 * 2;
+		yuyv->actual_bytes = 16 * 16 * 2;
+		yuyv->frame_format = UVC_FRAME_FORMAT_YUYV;
+		memset(yuyv->data, 0x80, yuyv->actual_bytes);
+		SharedFrame *frame = SharedFrame::create(yuyv);
+		if (LIKELY(frame)) {
+			MemoryRenderTarget target(16, 16, 16);
+			const bool capture = has_capture_window();
+			const int result = render_preview(&target, frame, uvc_any2rgbx, PREVIEW_PIXEL_BYTES);
+			if (UNLIKELY(result || (target.getDirectCount() != (capture ? 0 : 1)))) {
+				LOGW("check_direct_render:unexpected render path,err=%d,capture=%d,direct=%u",
+					result, capture, target.getDirectCount());
 			}
+			frame->release();
 		} else {
+			recycle_frame(yuyv);
+		}
+	}
+}
+
+//======================================================================
+// present stage of two-stage preview
+//======================================================================
+/**
+ * hand converted frame to the present thread,
+ * wait while the handoff is full unless low latency mode is enabled
+ */
+void UVCPreview::addPresentFrame(SharedFrame *frame, uvc_frame_t *converted, const struct timeval &capture_time) {
+	present_frame_t present, stale;
+	present.frame = frame->addRef();
+	present.converted = converted;
+	present.capture_time = capture_time;
+	stale.frame = NULL;
+	pthread_mutex_lock(&present_mutex);
+	{
+		for ( ; isRunning() && presentFrames.isFull() ; ) {
+			if (mLowLatency) {
+				// latest frame wins
+				presentFrames.get(stale);
+				mStaleDropCount++;
+				break;
+			}
+			pthread_cond_wait(&present_sync, &present_mutex);
+		}
+		if (isRunning() && presentFrames.put(present)) {
+			present.frame = NULL;
+			pthread_cond_broadcast(&present_sync);
+		}
+	}
+	pthread_mutex_unlock(&present_mutex);
+	if (stale.frame) {
+		stale.frame->release();
+	}
+	if (present.frame) {
+		present.frame->release();
+	}
+}
+
+/**
+ * wait for converted frame from the preview thread
+ * @return false if preview is stopping
+ */
+bool UVCPreview::waitPresentFrame(present_frame_t &present) {
+	bool result = false;
+	pthread_mutex_lock(&present_mutex);
+	{
+		for ( ; isRunning() && presentFrames.isEmpty() ; ) {
+			pthread_cond_wait(&present_sync, &present_mutex);
+		}
+		if (LIKELY(isRunning())) {
+			result = presentFrames.get(present);
+			// wake up the preview thread that is waiting for free space
+			pthread_cond_broadcast(&present_sync);
+		}
+	}
+	pthread_mutex_unlock(&present_mutex);
+	return result;
+}
+
+void UVCPreview::clearPresentFrame() {
+	present_frame_t present;
+	pthread_mutex_lock(&present_mutex);
+	{
+		for ( ; presentFrames.get(present) ; ) {
+			present.frame->release();
+		}
+	}
+	pthread_mutex_unlock(&present_mutex);
+}
+
+/*static*/
+void *UVCPreview::present_thread_func(void *vptr_args) {
+	ENTER();
+	UVCPreview *preview = reinterpret_cast<UVCPreview *>(vptr_args);
+	if (LIKELY(preview)) {
+		preview->do_present();
+	}
+	PRE_EXIT();
+	pthread_exit(NULL);
+}
+
+void UVCPreview::do_present() {
+	ENTER();
+
+	present_frame_t present;
+	for ( ; LIKELY(isRunning()) ; ) {
+		if (LIKELY(waitPresentFrame(present))) {
+			ANativeWindow *target_window = NULL;
 			pthread_mutex_lock(&preview_mutex);
-			copyToSurface(frame, window);
+			{
+				if (mPreviewWindow) {
+					target_window = mPreviewWindow;
+					ANativeWindow_acquire(target_window);
+				}
+			}
 			pthread_mutex_unlock(&preview_mutex);
+			if (LIKELY(target_window)) {
+				WindowRenderTarget target(target_window);
+				const int64_t start = monotonic_us();
+				if (LIKELY(!renderFrame(&target, present.converted, NULL))) {
+					addStageTime(PREVIEW_STAGE_PRESENT, monotonic_us() - start);
+					addLatencySample(present.capture_time);
+				}
+				ANativeWindow_release(target_window);
+			}
+			present.frame->release();
 		}
 	}
+	// wake up the preview thread if it is waiting for free space
+	pthread_mutex_lock(&present_mutex);
+	{
+		pthread_cond_broadcast(&present_sync);
+	}
+	pthread_mutex_unlock(&present_mutex);
 
-
-	return frame; //RETURN(frame, uvc_frame_t *);
+	EXIT();
 }
 
 //======================================================================
@@ -692,6 +1465,14 @@ uvc_frame_t *UVCPreview::draw_preview_one(uvc_frame_t *frame, ANativeWindow **wi
 //======================================================================
 inline const bool UVCPreview::isCapturing() const { return mIsCapturing; }
 
+/*private*/
+bool UVCPreview::has_capture_window() {
+	pthread_mutex_lock(&capture_mutex);
+	const bool result = mCaptureWindow != NULL;
+	pthread_mutex_unlock(&capture_mutex);
+	return result;
+}
+
 int UVCPreview::setCaptureDisplay(ANativeWindow *capture_window) {
 	ENTER();
 	pthread_mutex_lock(&capture_mutex);
@@ -728,24 +1509,40 @@ int UVCPreview::setCaptureDisplay(ANativeWindow *capture_window) {
 	RETURN(0, int);
 }
 
-void UVCPreview::addCaptureFrame(uvc_frame_t *frame) {
+/**
+ * @param source MJPEG frame that the frame was decoded from, NULL if the frame was not decoded.
+ *        references of both frames are taken by this function
+ */
+void UVCPreview::addCaptureFrame(SharedFrame *frame, SharedFrame *source) {
 	pthread_mutex_lock(&capture_mutex);
 	if (LIKELY(isRunning())) {
 		// keep only latest one
 		if (captureQueu) {
-			recycle_frame(captureQueu);
+			captureQueu->release();
+		}
+		if (captureSource) {
+			captureSource->release();
 		}
 		captureQueu = frame;
+		captureSource = source;
+		frame = source = NULL;
 		pthread_cond_broadcast(&capture_sync);
 	}
 	pthread_mutex_unlock(&capture_mutex);
+	if (frame) {
+		frame->release();
+	}
+	if (source) {
+		source->release();
+	}
 }
 
 /**
  * get frame data for capturing, if not exist, block and wait
  */
-uvc_frame_t *UVCPreview::waitCaptureFrame() {
-	uvc_frame_t *frame = NULL;
+SharedFrame *UVCPreview::waitCaptureFrame(SharedFrame **source) {
+	SharedFrame *frame = NULL;
+	*source = NULL;
 	pthread_mutex_lock(&capture_mutex);
 	{
 		if (!captureQueu) {
@@ -754,6 +1551,8 @@ uvc_frame_t *UVCPreview::waitCaptureFrame() {
 		if (LIKELY(isRunning() && captureQueu)) {
 			frame = captureQueu;
 			captureQueu = NULL;
+			*source = captureSource;
+			captureSource = NULL;
 		}
 	}
 	pthread_mutex_unlock(&capture_mutex);
@@ -767,8 +1566,11 @@ void UVCPreview::clearCaptureFrame() {
 	pthread_mutex_lock(&capture_mutex);
 	{
 		if (captureQueu)
-			recycle_frame(captureQueu);
+			captureQueu->release();
 		captureQueu = NULL;
+		if (captureSource)
+			captureSource->release();
+		captureSource = NULL;
 	}
 	pthread_mutex_unlock(&capture_mutex);
 }
@@ -806,7 +1608,15 @@ void UVCPreview::do_capture(JNIEnv *env) {
 	ENTER();
 
 	clearCaptureFrame();
-	callbackPixelFormatChanged();
+	// preview size may be changed after the callbacks were registered,
+	// frameWidth/frameHeight are already negotiated before this thread starts
+	pthread_mutex_lock(&callback_mutex);
+	{
+		for (int i = 0; i < mFrameCallbacks.size(); i++) {
+			mFrameCallbacks[i]->setSourceSize(frameWidth, frameHeight);
+		}
+	}
+	pthread_mutex_unlock(&callback_mutex);
 	for (; isRunning() ;) {
 		mIsCapturing = true;
 		if (mCaptureWindow) {
@@ -823,7 +1633,9 @@ void UVCPreview::do_capture_idle_loop(JNIEnv *env) {
 	ENTER();
 
 	for (; isRunning() && isCapturing() ;) {
-		do_capture_callback(env, waitCaptureFrame());
+		SharedFrame *source;
+		SharedFrame *frame = waitCaptureFrame(&source);
+		do_capture_callback(env, frame, source);
 	}
 	
 	EXIT();
@@ -834,35 +1646,26 @@ void UVCPreview::do_capture_idle_loop(JNIEnv *env) {
  */
 void UVCPreview::do_capture_surface(JNIEnv *env) {
 	ENTER();
-	uvc_frame_t *frame = NULL;
-	uvc_frame_t *converted = NULL;
+	SharedFrame *frame = NULL;
+	SharedFrame *source;
 	char *local_picture_path;
 
 	for (; isRunning() && isCapturing() ;) {
-		frame = waitCaptureFrame();
+		frame = waitCaptureFrame(&source);
 		if (LIKELY(frame)) {
 			// frame data is always YUYV format.
 
 			if LIKELY(isCapturing()) {
-				if (UNLIKELY(!converted)) {
-					converted = get_frame(previewBytes);
-				}
-				if (LIKELY(converted)) {
-					int b = uvc_any2rgbx(frame, converted);
-					if (!b) {
-						if (LIKELY(mCaptureWindow)) {
-							copyToSurface(converted, &mCaptureWindow);
-						}
-					}
+				// RGBX frame that was converted for preview is reused here
+				uvc_frame_t *converted = frame->getDerived(uvc_any2rgbx, previewBytes);
+				if (LIKELY(converted && mCaptureWindow)) {
+					copyToSurface(converted, &mCaptureWindow);
 				}
 			}
 
-			do_capture_callback(env, frame);
+			do_capture_callback(env, frame, source);
 		}
 	}
-	if (converted) {
-		recycle_frame(converted);
-	}
 	if (mCaptureWindow) {
 		ANativeWindow_release(mCaptureWindow);
 		mCaptureWindow = NULL;
@@ -872,59 +1675,218 @@ void UVCPreview::do_capture_surface(JNIEnv *env) {
 }
 
 /**
-* call IFrameCallback#onFrame if needs
+ * hand the frame to all registered callbacks, they convert and call Java on their own threads
+ * @param source MJPEG frame that the frame was decoded from, NULL if the frame was not decoded
  */
-void UVCPreview::do_capture_callback(JNIEnv *env, uvc_frame_t *frame) {
+void UVCPreview::do_capture_callback(JNIEnv *env, SharedFrame *frame, SharedFrame *source) {
 
 	ENTER();
 
 	if (LIKELY(frame)) {
+		pthread_mutex_lock(&callback_mutex);
+		{
+			for (int i = 0; i < mFrameCallbacks.size(); i++) {
+				FrameCallback *callback = mFrameCallbacks[i];
+				// callbacks that do not convert frames always receive frames as they came from the camera,
+				// whether other callbacks need decoded frames or not
+				callback->offer(source && !callback->needsDecode() ? source : frame);
+			}
+		}
+		pthread_mutex_unlock(&callback_mutex);
+		frame->release();
+	}
+	if (source) {
+		source->release();
+	}
 
-		uvc_frame_t *callback_frame = frame;
+	EXIT();
+}
 
+//======================================================================
+// still capture(burst mode)
+//======================================================================
+/**
+ * compress next num_frames frames to JPEG and write them on the burst thread.
+ * frames are taken before converting for preview, so MJPEG frames are written as they are.
+ * @param path file path, if num_frames is more than 1,
+ *        frames are written to path + "_%03d.jpg"(".jpg" of path is removed)
+ * @param num_frames number of consecutive frames to capture
+ * @param quality JPEG quality(1-100), this is ignored for MJPEG frames
+ */
+int UVCPreview::captureStill(const char *path, int num_frames, int quality) {
+	ENTER();
 
-		//bycui_test
+	int result = EXIT_FAILURE;
+	if (UNLIKELY(!path || (num_frames <= 0) || (strlen(path) >= sizeof(burstPath)))) {
+		RETURN(result, int);
+	}
+	pthread_mutex_lock(&burst_mutex);
+	{
+		if (isRunning() && !mIsBursting) {
+			if (UNLIKELY(!mBurstRunning)) {
+				mBurstRunning = !pthread_create(&burst_thread, NULL, burst_thread_func, (void *)this);
+			}
+			if (LIKELY(mBurstRunning)) {
+				strcpy(burstPath, path);
+				burstNumFrames = num_frames;
+				burstQuality = quality;
+				mIsBursting = true;
+				burstRequests = num_frames;
+				pthread_cond_broadcast(&burst_sync);
+				result = EXIT_SUCCESS;
+			} else {
+				LOGW("UVCPreview::could not create burst thread");
+			}
+		} else {
+			LOGW("UVCPreview::not previewing/already capturing still images");
+		}
+	}
+	pthread_mutex_unlock(&burst_mutex);
 
-                if (mFrameCallbackObj) {
+	RETURN(result, int);
+}
 
+/**
+ * cancel still capturing if it is running and join the burst thread,
+ * this should be called after clearing mIsRunning
+ */
+void UVCPreview::stopBurst() {
+	ENTER();
 
-                        if (mFrameCallbackFunc) {
+	bool has_thread;
+	pthread_mutex_lock(&burst_mutex);
+	{
+		has_thread = mBurstRunning;
+		mBurstRunning = false;
+		mIsBursting = false;
+		burstRequests = 0;
+		pthread_cond_broadcast(&burst_sync);
+	}
+	pthread_mutex_unlock(&burst_mutex);
+	if (has_thread) {
+		if (pthread_join(burst_thread, NULL) != EXIT_SUCCESS) {
+			LOGW("UVCPreview::terminate burst thread: pthread_join failed");
+		}
+	}
+	clearBurstFrame();
 
-                            callback_frame = get_frame(callbackPixelBytes);
-                            if (LIKELY(callback_frame)) {
-                                int b = mFrameCallbackFunc(frame, callback_frame);
-                                recycle_frame(frame);
-                                if (UNLIKELY(b)) {
-                                    //LOGW("failed to convert for callback frame");
-                                    goto SKIP;
-                                }
-                            } else {
-                               // LOGW("failed to allocate for callback frame");
-                                callback_frame = frame;
-                                goto SKIP;
-                            }
-                        }else{
-                           /* callbackPixelBytes=callback_frame->actual_bytes;
-                            LOGE("do_capture_callback.......111111  actual_bytes:%d=====data_bytes:%d",callback_frame->actual_bytes,callback_frame->data_bytes);
-                            callback_frame = get_frame(callbackPixelBytes);
-                             LOGE("do_capture_callback.......22222  actual_bytes:%d=====data_bytes:%d",callback_frame->actual_bytes,callback_frame->data_bytes);
-                        */
+	EXIT();
+}
 
-                        }
-                       // LOGE("do_capture_callback.......CallVoidMethod");
-                        jobject buf = env->NewDirectByteBuffer(callback_frame->data, callback_frame->actual_bytes);
-                        env->CallVoidMethod(mFrameCallbackObj, iframecallback_fields.onFrame, buf);
-                        env->ExceptionClear();
-                        env->DeleteLocalRef(buf);
+/**
+ * duplicate frame to burst queue, this is called from uvc_preview_frame_callback
+ */
+void UVCPreview::addBurstFrame(SharedFrame *frame) {
+	pthread_mutex_lock(&burst_mutex);
+	if (mIsBursting && (burstRequests > 0)) {
+		// if the queue is full, this frame is skipped and next frame is used instead
+		if (LIKELY(burstFrames.put(frame->addRef()))) {
+			burstRequests--;
+			pthread_cond_broadcast(&burst_sync);
+		} else {
+			frame->release();
+		}
+	}
+	pthread_mutex_unlock(&burst_mutex);
+}
 
+SharedFrame *UVCPreview::waitBurstFrame() {
+	SharedFrame *frame = NULL;
+	pthread_mutex_lock(&burst_mutex);
+	{
+		if (burstFrames.isEmpty() && isRunning() && mIsBursting) {
+			pthread_cond_wait(&burst_sync, &burst_mutex);
+		}
+		if (LIKELY(isRunning() && mIsBursting)) {
+			frame = burstFrames.get();
+		}
+	}
+	pthread_mutex_unlock(&burst_mutex);
+	return frame;
+}
 
-                }
+void UVCPreview::clearBurstFrame() {
+	pthread_mutex_lock(&burst_mutex);
+	{
+		for (SharedFrame *frame = burstFrames.get(); frame; frame = burstFrames.get())
+			frame->release();
+	}
+	pthread_mutex_unlock(&burst_mutex);
+}
 
+void *UVCPreview::burst_thread_func(void *vptr_args) {
+	ENTER();
+	UVCPreview *preview = reinterpret_cast<UVCPreview *>(vptr_args);
+	if (LIKELY(preview)) {
+		preview->do_burst();
+	}
+	PRE_EXIT();
+	pthread_exit(NULL);
+}
 
- SKIP:
-		recycle_frame(callback_frame);
+/**
+ * wait for still capture requests and write requested frames as JPEG until preview stops,
+ * the compressor of libuvc is kept for each thread, so it is set up only once on this thread
+ */
+void UVCPreview::do_burst() {
+	ENTER();
+
+	char path[PATH_MAX];
+	char base[PATH_MAX];
+	int num_frames, quality;
+	uvc_frame_t *jpeg = uvc_allocate_frame(0);
+	for ( ; LIKELY(jpeg && isRunning()) ; ) {
+		pthread_mutex_lock(&burst_mutex);
+		{
+			for ( ; isRunning() && mBurstRunning && !mIsBursting ; ) {
+				pthread_cond_wait(&burst_sync, &burst_mutex);
+			}
+			strcpy(base, burstPath);
+			num_frames = burstNumFrames;
+			quality = burstQuality;
+		}
+		pthread_mutex_unlock(&burst_mutex);
+		if (UNLIKELY(!isRunning() || !mIsBursting)) break;
+		uvc_jpeg_set_quality(quality);
+		const size_t len = strlen(base);
+		if ((num_frames > 1) && (len > 4) && !strcasecmp(base + len - 4, ".jpg")) {
+			base[len - 4] = '\0';
+		}
+		for (int i = 0; LIKELY(isRunning() && mIsBursting && (i < num_frames)) ; ) {
+			SharedFrame *frame = waitBurstFrame();
+			if (LIKELY(frame)) {
+				int result = uvc_any2jpeg(frame->get(), jpeg);
+				frame->release();
+				if (LIKELY(!result)) {
+					if (num_frames > 1) {
+						snprintf(path, sizeof(path), "%s_%03d.jpg", base, i);
+					} else {
+						strcpy(path, base);
+					}
+					FILE *fp = fopen(path, "wb");
+					if (LIKELY(fp)) {
+						fwrite(jpeg->data, 1, jpeg->actual_bytes, fp);
+						fclose(fp);
+					} else {
+						LOGW("failed to open %s", path);
+					}
+				} else {
+					LOGW("failed to compress:%d", result);
+				}
+				i++;
+			}
+		}
+		pthread_mutex_lock(&burst_mutex);
+		{
+			mIsBursting = false;
+			burstRequests = 0;
+		}
+		pthread_mutex_unlock(&burst_mutex);
+		clearBurstFrame();
+	}
+	if (jpeg) {
+		uvc_free_frame(jpeg);
 	}
 
 	EXIT();
-
 }
@@ -27,11 +27,18 @@
 
 #include "libUVCCamera.h"
 #include <pthread.h>
+#include <limits.h>
 #include <android/native_window.h>
 #include "objectarray.h"
+#include "ringbuffer.h"
+#include "FramePool.h"
+#include "SharedFrame.h"
+#include "FrameCallback.h"
 
 #pragma interface
 
+class IRenderTarget;
+
 #define DEFAULT_PREVIEW_WIDTH 640
 #define DEFAULT_PREVIEW_HEIGHT 480
 #define DEFAULT_PREVIEW_FPS_MIN 1
@@ -39,19 +46,33 @@
 #define DEFAULT_PREVIEW_MODE 0
 #define DEFAULT_BANDWIDTH 1.0f
 
-typedef uvc_error_t (*convFunc_t)(uvc_frame_t *in, uvc_frame_t *out);
+#define DECODE_SKIP_NONE 0		// always decode MJPEG frames
+#define DECODE_SKIP_EXACT 1		// skip decoding when whole payload is same as previous frame
+#define DECODE_SKIP_SAMPLED 2	// same as DECODE_SKIP_EXACT but compare sampled part of payload only
+
+// number of recent frames used for preview latency percentiles
+#define LATENCY_SAMPLES 256
+
+// stages of preview for getPreviewStageTime
+#define PREVIEW_STAGE_DECODE 0		// decode/convert on the preview thread
+#define PREVIEW_STAGE_PRESENT 1		// lock, write and post the Surface
+#define PREVIEW_STAGE_NUM 2
+
+// maximum time to wait for the preview thread to switch format [sec]
+#define MAX_SWITCH_WAIT_SEC 5
 
-#define PIXEL_FORMAT_RAW 0		// same as PIXEL_FORMAT_YUV
-#define PIXEL_FORMAT_YUV 1
-#define PIXEL_FORMAT_RGB565 2
-#define PIXEL_FORMAT_RGBX 3
-#define PIXEL_FORMAT_YUV20SP 4
-#define PIXEL_FORMAT_NV21 5		// YVU420SemiPlanar
+typedef struct stage_time {
+	uint64_t total_us;
+	uint32_t count;
+	uint32_t max_us;
+} stage_time_t;
 
-// for callback to Java object
-typedef struct {
-	jmethodID onFrame;
-} Fields_iframecallback;
+// frame handed from the decode stage to the present stage
+typedef struct present_frame {
+	SharedFrame *frame;
+	uvc_frame_t *converted;				// RGBX frame attached to frame
+	struct timeval capture_time;
+} present_frame_t;
 
 class UVCPreview {
 private:
@@ -67,7 +88,7 @@ private:
 	pthread_t preview_thread;
 	pthread_mutex_t preview_mutex;
 	pthread_cond_t preview_sync;
-	ObjectArray<uvc_frame_t *> previewFrames;
+	RingBuffer<SharedFrame *> previewFrames;
 	int previewFormat;
 	size_t previewBytes;
 //
@@ -76,39 +97,101 @@ private:
 	pthread_t capture_thread;
 	pthread_mutex_t capture_mutex;
 	pthread_cond_t capture_sync;
-	uvc_frame_t *captureQueu;			// keep latest frame
-	jobject mFrameCallbackObj;
-	convFunc_t mFrameCallbackFunc;
-	Fields_iframecallback iframecallback_fields;
-	int mPixelFormat;
-	size_t callbackPixelBytes;
+	SharedFrame *captureQueu;			// keep latest frame
+	SharedFrame *captureSource;			// MJPEG frame that captureQueu was decoded from, NULL if not decoded
+	pthread_mutex_t callback_mutex;
+	ObjectArray<FrameCallback *> mFrameCallbacks;
+	FrameCallback *mFrameCallback;		// set by setFrameCallback, this is also in mFrameCallbacks
+	volatile bool mCallbackNeedsDecode;	// whether any callback needs YUYV frames instead of MJPEG
 // improve performance by reducing memory allocation
-	pthread_mutex_t pool_mutex;
-	ObjectArray<uvc_frame_t *> mFramePool;
 	uvc_frame_t *get_frame(size_t data_bytes);
 	void recycle_frame(uvc_frame_t *frame);
 	void init_pool(size_t data_bytes);
-	void clear_pool();
 //
 	void clearDisplay();
 	static void uvc_preview_frame_callback(uvc_frame_t *frame, void *vptr_args);
-	void addPreviewFrame(uvc_frame_t *frame);
-	uvc_frame_t *waitPreviewFrame();
+	void addPreviewFrame(SharedFrame *frame);
+	SharedFrame *waitPreviewFrame();
 	void clearPreviewFrame();
 	static void *preview_thread_func(void *vptr_args);
 	int prepare_preview(uvc_stream_ctrl_t *ctrl);
 	void do_preview(uvc_stream_ctrl_t *ctrl);
-	uvc_frame_t *draw_preview_one(uvc_frame_t *frame, ANativeWindow **window, convFunc_t func, int pixelBytes);
+	SharedFrame *draw_preview_one(SharedFrame *frame, ANativeWindow **window, convFunc_t func, int pixelBytes,
+		const struct timeval &capture_time);
+	int render_preview(IRenderTarget *target, SharedFrame *frame, convFunc_t func, const int &pixelBytes);
+	void check_direct_render();
 //
-	void addCaptureFrame(uvc_frame_t *frame);
-	uvc_frame_t *waitCaptureFrame();
+	bool has_capture_window();
+	void addCaptureFrame(SharedFrame *frame, SharedFrame *source = NULL);
+	SharedFrame *waitCaptureFrame(SharedFrame **source);
 	void clearCaptureFrame();
 	static void *capture_thread_func(void *vptr_args);
 	void do_capture(JNIEnv *env);
 	void do_capture_surface(JNIEnv *env);
 	void do_capture_idle_loop(JNIEnv *env);
-	void do_capture_callback(JNIEnv *env, uvc_frame_t *frame);
-	void callbackPixelFormatChanged();
+	void do_capture_callback(JNIEnv *env, SharedFrame *frame, SharedFrame *source);
+	FrameCallback *registerFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format,
+		int width, int height, float max_fps, int num_slots, bool primary, jobjectArray *buffers = NULL);
+	void frameCallbacksChanged();
+// still capture(burst mode)
+	volatile bool mIsBursting;
+	// burst thread is created on first captureStill and kept until stopPreview
+	// so that its JPEG compressor is reused for every still image
+	bool mBurstRunning;
+	pthread_t burst_thread;
+	pthread_mutex_t burst_mutex;
+	pthread_cond_t burst_sync;
+	RingBuffer<SharedFrame *> burstFrames;
+	char burstPath[PATH_MAX];
+	volatile int burstRequests;	// number of frames that are not queued yet, guarded by burst_mutex
+	int burstNumFrames;
+	int burstQuality;
+	void addBurstFrame(SharedFrame *frame);
+	SharedFrame *waitBurstFrame();
+	void clearBurstFrame();
+	void stopBurst();
+	static void *burst_thread_func(void *vptr_args);
+	void do_burst();
+// skip decoding of unchanged MJPEG frames
+	volatile int mDecodeSkipMode;
+	volatile uint32_t mDecodeCount;
+	volatile uint32_t mSkippedDecodeCount;
+	volatile int mDecodeProfile;
+// low latency preview
+	volatile bool mLowLatency;
+	volatile uint32_t mStaleDropCount;
+	pthread_mutex_t latency_mutex;
+	uint32_t latencySamples[LATENCY_SAMPLES];	// [usec]
+	int latencySampleIx, latencySampleNum;
+	void addLatencySample(const struct timeval &capture_time);
+// two-stage preview(decode thread and present thread)
+	volatile bool mPipelined;			// requested, applied when preview starts
+	volatile bool mPresentRunning;
+	pthread_t present_thread;
+	pthread_mutex_t present_mutex;
+	pthread_cond_t present_sync;
+	RingBuffer<present_frame_t> presentFrames;
+	int64_t dequeueTime;				// only accessed on the preview thread
+	stage_time_t stageTimes[PREVIEW_STAGE_NUM];	// guarded by latency_mutex
+	void addStageTime(const int &stage, const int64_t &us);
+	void addPresentFrame(SharedFrame *frame, uvc_frame_t *converted, const struct timeval &capture_time);
+	bool waitPresentFrame(present_frame_t &present);
+	void clearPresentFrame();
+	static void *present_thread_func(void *vptr_args);
+	void do_present();
+// switch size/format without stopping preview
+	pthread_mutex_t switch_mutex;
+	pthread_cond_t switch_sync;
+	volatile bool mSwitchRequested;
+	bool switchStarted;					// guarded by switch_mutex, true while the preview thread is switching
+	int switchWidth, switchHeight, switchMinFps, switchMaxFps, switchMode;
+	float switchBandwidth;
+	int mSwitchResult;
+	int64_t switchRequestTime;			// guarded by switch_mutex
+	int64_t switchStartTime;			// only accessed on the preview thread, 0 if the first frame already arrived
+	volatile int32_t mSwitchTime;		// [usec]
+	int switch_format(uvc_stream_ctrl_t *ctrl);
+	void finishSwitch(const int &result);
 public:
 	UVCPreview(uvc_device_handle_t *devh);
 	~UVCPreview();
@@ -116,11 +199,35 @@ public:
 	inline const bool isRunning() const;
 	int setPreviewSize(int width, int height, int min_fps, int max_fps, int mode, float bandwidth = 1.0f);
 	int setPreviewDisplay(ANativeWindow *preview_window);
-	int setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format);
+	int setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format,
+		int width = 0, int height = 0, float max_fps = 0.0f);
+	jobjectArray setFrameSlotCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format, int num_slots,
+		int width = 0, int height = 0, float max_fps = 0.0f);
+	int addFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format,
+		int width, int height, float max_fps);
+	jobjectArray addFrameSlotCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format, int num_slots,
+		int width, int height, float max_fps);
+	int removeFrameCallback(JNIEnv *env, jobject frame_callback_obj);
+	int releaseFrameSlot(JNIEnv *env, jobject frame_callback_obj, int slot);
 	int startPreview();
 	int stopPreview();
 	inline const bool isCapturing() const;
 	int setCaptureDisplay(ANativeWindow *capture_window);
+	int captureStill(const char *path, int num_frames, int quality);
+	int setDecodeSkipMode(int mode);
+	int setDecodeProfile(int profile);
+	int setLowLatencyMode(bool enable);
+	int getPreviewLatency(int percentile);
+	int setPipelinedPreview(bool enable);
+	int getPreviewStageTime(int stage, bool max = false);
+	int switchFormat(int width, int height, int min_fps, int max_fps, int mode, float bandwidth = 1.0f);
+	/** time from switch request to the first frame with new format [usec], -1 if not yet */
+	inline const int getSwitchTime() const { return mSwitchTime; };
+	inline const int getPreviewQueueSize() const { return previewFrames.size(); };
+	inline const int getPreviewQueueHighWaterMark() const { return previewFrames.highWaterMark(); };
+	inline const uint32_t getDecodeCount() const { return mDecodeCount; };
+	inline const uint32_t getSkippedDecodeCount() const { return mSkippedDecodeCount; };
+	inline const uint32_t getStaleDropCount() const { return mStaleDropCount; };
 };
 
 #endif /* UVCPREVIEW_H_ */
@@ -0,0 +1,139 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: mpscringbuffer.h
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#ifndef MPSCRINGBUFFER_H_
+#define MPSCRINGBUFFER_H_
+
+#include "utilbase.h"
+
+/**
+ * fixed capacity lock-free FIFO queue that multiple producer threads can put to.
+ * capacity is rounded up to power of two and put/get never allocate memory.
+ * each cell has its own sequence number, so a producer reserves a cell with CAS
+ * and publishes it by updating the sequence number after writing the element.
+ * get also reserves with CAS, so a producer can remove the oldest element
+ * (e.g. to drop it when the queue overflows) while the consumer is running.
+ * T should be a pointer or a small struct that can be copied.
+ */
+template <class T>
+class MPSCRingBuffer {
+private:
+	typedef struct cell {
+		volatile uint32_t seq;
+		T data;
+	} cell_t;
+
+	cell_t *m_cells;
+	const uint32_t m_capacity;
+	const uint32_t m_mask;
+	// free running counters, (m_tail - m_head) is number of reserved elements
+	volatile uint32_t m_head;
+	volatile uint32_t m_tail;
+
+	static uint32_t round_up(uint32_t capacity) {
+		uint32_t result = 1;
+		for ( ; result < capacity ; result <<= 1) {}
+		return result;
+	}
+	// force inhibiting copy/assignment
+	MPSCRingBuffer(const MPSCRingBuffer &src);
+	void operator =(const MPSCRingBuffer &src);
+public:
+	MPSCRingBuffer(const int capacity = 4)
+		: m_capacity(round_up(capacity > 0 ? capacity : 1)),
+		  m_mask(round_up(capacity > 0 ? capacity : 1) - 1),
+		  m_head(0),
+		  m_tail(0) {
+		m_cells = new cell_t[m_capacity];
+		for (uint32_t i = 0; i < m_capacity; i++) {
+			m_cells[i].seq = i;
+		}
+	}
+
+	~MPSCRingBuffer() { SAFE_DELETE_ARRAY(m_cells); }
+
+	inline int capacity() const { return m_capacity; }
+	/** number of queued elements, this is just a snapshot */
+	inline int size() const {
+		const int n = (int)(__atomic_load_n(&m_tail, __ATOMIC_ACQUIRE) - __atomic_load_n(&m_head, __ATOMIC_ACQUIRE));
+		return n < 0 ? 0 : (n > (int)m_capacity ? m_capacity : n);
+	}
+	inline bool isEmpty() const { return size() <= 0; }
+
+	/**
+	 * append object at the tail, this can be called from any thread
+	 * @return false if the queue is full, object is not queued
+	 */
+	bool put(const T &object) {
+		uint32_t pos = __atomic_load_n(&m_tail, __ATOMIC_RELAXED);
+		cell_t *cell;
+		for ( ; ; ) {
+			cell = &m_cells[pos & m_mask];
+			const uint32_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+			const int32_t diff = (int32_t)(seq - pos);
+			if (diff == 0) {
+				if (__atomic_compare_exchange_n(&m_tail, &pos, pos + 1,
+					true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+					break;
+				}
+			} else if (diff < 0) {
+				return false;	// full
+			} else {
+				pos = __atomic_load_n(&m_tail, __ATOMIC_RELAXED);
+			}
+		}
+		cell->data = object;
+		__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+
+	/**
+	 * remove the object at the head into object
+	 * @return false if the queue is empty(or the oldest element is still being written)
+	 */
+	bool get(T &object) {
+		uint32_t pos = __atomic_load_n(&m_head, __ATOMIC_RELAXED);
+		cell_t *cell;
+		for ( ; ; ) {
+			cell = &m_cells[pos & m_mask];
+			const uint32_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+			const int32_t diff = (int32_t)(seq - (pos + 1));
+			if (diff == 0) {
+				if (__atomic_compare_exchange_n(&m_head, &pos, pos + 1,
+					true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+					break;
+				}
+			} else if (diff < 0) {
+				return false;	// empty
+			} else {
+				pos = __atomic_load_n(&m_head, __ATOMIC_RELAXED);
+			}
+		}
+		object = cell->data;
+		__atomic_store_n(&cell->seq, pos + m_mask + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+};
+
+#endif	// MPSCRINGBUFFER_H_
@@ -0,0 +1,711 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: AVIRecorderPipeline.cpp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#if 1	// set 1 if you don't need debug message
+	#ifndef LOG_NDEBUG
+		#define	LOG_NDEBUG		// ignore LOGV/LOGD/MARK
+	#endif
+	#undef USE_LOGALL
+#else
+	#define USE_LOGALL
+	#undef LOG_NDEBUG
+	#undef NDEBUG		// depends on definition in Android.mk and Application.mk
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <endian.h>
+
+#include "utilbase.h"
+#include "common_utils.h"
+
+#include "libUVCCamera.h"
+#include "pipeline_helper.h"
+#include "AVIRecorderPipeline.h"
+
+#ifndef FALLOC_FL_KEEP_SIZE
+#define FALLOC_FL_KEEP_SIZE 0x01
+#endif
+
+#define INIT_FRAME_POOL_SZ 2
+#define MAX_FRAME_NUM 8
+// header of the first RIFF including 'LIST' 'movi', rest of this is filled with JUNK chunk
+#define AVI_HEADER_SZ 8192
+#define AVI_DEFAULT_FRAME_INTERVALS_US 33333
+
+#define AVIF_HASINDEX		0x00000010
+#define AVIF_ISINTERLEAVED	0x00000100
+#define AVIIF_KEYFRAME		0x00000010
+#define AVI_INDEX_OF_INDEXES	0x00
+#define AVI_INDEX_OF_CHUNKS		0x01
+
+//********************************************************************************
+// helpers to build little endian AVI structures
+//********************************************************************************
+static inline void put_le16(uint8_t *&p, const uint16_t &v) {
+	const uint16_t le = htole16(v);
+	memcpy(p, &le, 2);
+	p += 2;
+}
+
+static inline void put_le32(uint8_t *&p, const uint32_t &v) {
+	const uint32_t le = htole32(v);
+	memcpy(p, &le, 4);
+	p += 4;
+}
+
+static inline void put_le64(uint8_t *&p, const uint64_t &v) {
+	const uint64_t le = htole64(v);
+	memcpy(p, &le, 8);
+	p += 8;
+}
+
+static inline void put_fourcc(uint8_t *&p, const char *fourcc) {
+	memcpy(p, fourcc, 4);
+	p += 4;
+}
+
+static inline void put_zero(uint8_t *&p, const size_t &bytes) {
+	memset(p, 0, bytes);
+	p += bytes;
+}
+
+/** write size of LIST/chunk that starts at start, size field is just after its fourcc */
+static inline void fix_size(uint8_t *start, const uint8_t *end) {
+	uint8_t *p = start + 4;
+	put_le32(p, (uint32_t)(end - start - 8));
+}
+
+static int write_fully(const int &fd, const uint8_t *data, size_t bytes) {
+	for ( ; bytes > 0 ; ) {
+		const ssize_t n = write(fd, data, bytes);
+		if (UNLIKELY(n < 0)) {
+			if (errno == EINTR) continue;
+			return -errno;
+		}
+		data += n;
+		bytes -= n;
+	}
+	return 0;
+}
+
+/* public */
+AVIRecorderPipeline::AVIRecorderPipeline(const char *_file_path, const size_t &_data_bytes)
+:	AbstractBufferedPipeline(MAX_FRAME_NUM, INIT_FRAME_POOL_SZ, _data_bytes),
+	file_path(_file_path),
+	fd(-1),
+	has_error(false),
+	write_buffer(NULL),
+	write_bytes(0),
+	file_pos(0),
+	preallocated_pos(0),
+	width(0), height(0),
+	total_frames(0),
+	max_frame_bytes(0),
+	first_pts_us(0), last_pts_us(0),
+	riff_offset(0),
+	movi_offset(0),
+	first_riff_size(0), first_movi_size(0), first_riff_frames(0)
+{
+	ENTER();
+
+	setState(PIPELINE_STATE_INITIALIZED);
+
+	EXIT();
+}
+
+/* public */
+AVIRecorderPipeline::~AVIRecorderPipeline() {
+	ENTER();
+
+	// stop handler thread here to finalize the file while this instance is still valid
+	release();
+
+	EXIT();
+}
+
+/*public*/
+int AVIRecorderPipeline::queueFrame(uvc_frame_t *frame) {
+//	ENTER();
+
+	int result = UVC_ERROR_NOT_SUPPORTED;
+	// only MJPEG frames are recorded, frames are passed through without any conversion
+	if (LIKELY(frame && (frame->frame_format == UVC_FRAME_FORMAT_MJPEG) && !hasError())) {
+		result = AbstractBufferedPipeline::queueFrame(frame);
+	}
+	chain_frame(frame);
+
+	return result; // 	RETURN(result, int);
+}
+
+/*public*/
+int AVIRecorderPipeline::queueSharedFrame(SharedFrame *frame) {
+//	ENTER();
+
+	int result = UVC_ERROR_NOT_SUPPORTED;
+	if (LIKELY(frame && (frame->get()->frame_format == UVC_FRAME_FORMAT_MJPEG) && !hasError())) {
+		result = AbstractBufferedPipeline::queueSharedFrame(frame);
+	}
+	chain_shared_frame(frame);
+
+	return result; // 	RETURN(result, int);
+}
+
+//********************************************************************************
+//
+//********************************************************************************
+/* override protected */
+void AVIRecorderPipeline::on_start() {
+	ENTER();
+
+	__atomic_store_n(&has_error, false, __ATOMIC_RELEASE);
+	write_bytes = 0;
+	file_pos = preallocated_pos = 0;
+	width = height = 0;
+	total_frames = max_frame_bytes = 0;
+	first_pts_us = last_pts_us = 0;
+	first_riff_size = first_movi_size = first_riff_frames = 0;
+	index_entries.clear();
+	super_index.clear();
+	// 4K30 MJPEG generates around 30 frames/sec, reserve index entries for several minutes at once
+	index_entries.reserve(30 * 60);
+	super_index.reserve(AVI_MAX_RIFF_NUM);
+
+	write_buffer = (uint8_t *)malloc(AVI_WRITE_BUFFER_SZ);
+	fd = open(file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_LARGEFILE, 0644);
+	if (LIKELY(write_buffer && (fd >= 0))) {
+		// write placeholder of the header, this will be overwritten on_stop
+		uint8_t header[AVI_HEADER_SZ];
+		build_header(header);
+		riff_offset = 0;
+		movi_offset = AVI_HEADER_SZ - 4;
+		__atomic_store_n(&has_error, write_data(header, AVI_HEADER_SZ) != 0, __ATOMIC_RELEASE);
+	} else {
+		LOGE("failed to open %s:errno=%d", file_path.c_str(), errno);
+		__atomic_store_n(&has_error, true, __ATOMIC_RELEASE);
+	}
+
+	EXIT();
+}
+
+/* override protected */
+void AVIRecorderPipeline::on_stop() {
+	ENTER();
+
+	if (fd >= 0) {
+		uint8_t header[AVI_HEADER_SZ];
+		finish_riff();
+		flush();
+		build_header(header);
+		write_at(0, header, AVI_HEADER_SZ);
+		if (preallocated_pos > file_pos) {
+			// release space that was reserved but not used
+			ftruncate64(fd, file_pos);
+		}
+		close(fd);
+		fd = -1;
+		LOGI("recorded %d frames(%lld bytes) into %s", total_frames, (long long)file_pos, file_path.c_str());
+	}
+	if (write_buffer) {
+		free(write_buffer);
+		write_buffer = NULL;
+	}
+	index_entries.clear();
+	super_index.clear();
+
+	EXIT();
+}
+
+/* override protected */
+int AVIRecorderPipeline::handle_frame(uvc_frame_t *frame) {
+//	ENTER();
+
+	if (LIKELY(!hasError())) {
+		if (UNLIKELY(write_frame(frame))) {
+			LOGE("failed to write frame, stop recording");
+			__atomic_store_n(&has_error, true, __ATOMIC_RELEASE);
+		}
+	}
+
+	return 1; // RETURN(1, int);	// frames are already chained in queueFrame
+}
+
+//********************************************************************************
+//
+//********************************************************************************
+/*private*/
+int AVIRecorderPipeline::write_frame(uvc_frame_t *frame) {
+	const uint32_t size = (uint32_t)frame->actual_bytes;
+	const size_t chunk_bytes = 8 + size + (size & 1);
+	const size_t n = index_entries.size() + 1;
+	// bytes that will be appended to current RIFF when closing it
+	const size_t index_bytes = 32 + n * 8 + (super_index.empty() ? 8 + n * 16 : 0);
+
+	if (UNLIKELY(file_pos + chunk_bytes + index_bytes - riff_offset > AVI_MAX_RIFF_SZ)) {
+		if (UNLIKELY(super_index.size() + 1 >= AVI_MAX_RIFF_NUM)) {
+			LOGW("file size reached the limit");
+			return -1;
+		}
+		if (UNLIKELY(finish_riff() || start_riff())) {
+			return -1;
+		}
+	}
+
+	const int64_t pts_us = int64_t(frame->capture_time.tv_sec) * 1000000LL + int64_t(frame->capture_time.tv_usec);
+	if (!total_frames) {
+		width = frame->width;
+		height = frame->height;
+		first_pts_us = pts_us;
+	}
+	last_pts_us = pts_us;
+	if (size > max_frame_bytes) {
+		max_frame_bytes = size;
+	}
+
+	avi_index_entry_t entry;
+	entry.offset = file_pos;
+	entry.size = size;
+
+	uint8_t chunk_header[8], *p = chunk_header;
+	put_fourcc(p, "00dc");
+	put_le32(p, size);
+	int result = write_data(chunk_header, 8);
+	if (LIKELY(!result)) {
+		result = write_data(frame->data, size);
+	}
+	if (LIKELY(!result && (size & 1))) {
+		const uint8_t pad = 0;
+		result = write_data(&pad, 1);
+	}
+	if (LIKELY(!result)) {
+		index_entries.push_back(entry);
+		total_frames++;
+	}
+
+	return result;
+}
+
+/**
+ * start new RIFF('AVIX') and 'movi' list for OpenDML extension
+ */
+/*private*/
+int AVIRecorderPipeline::start_riff() {
+	uint8_t buf[24], *p = buf;
+
+	riff_offset = file_pos;
+	put_fourcc(p, "RIFF");
+	put_le32(p, 0);		// will be fixed in finish_riff
+	put_fourcc(p, "AVIX");
+	put_fourcc(p, "LIST");
+	put_le32(p, 0);		// will be fixed in finish_riff
+	put_fourcc(p, "movi");
+	movi_offset = riff_offset + 20;
+
+	return write_data(buf, p - buf);
+}
+
+/**
+ * write standard index(ix00) of current RIFF at the end of its 'movi' list
+ * and legacy index(idx1) if current RIFF is the first one, then fix sizes of RIFF and 'movi'
+ */
+/*private*/
+int AVIRecorderPipeline::finish_riff() {
+	const uint32_t n = index_entries.size();
+	uint8_t buf[32], *p;
+	int result;
+
+	// standard index for this RIFF
+	avi_super_index_entry_t super_entry;
+	super_entry.offset = file_pos;
+	super_entry.size = 32 + n * 8;
+	super_entry.duration = n;
+	p = buf;
+	put_fourcc(p, "ix00");
+	put_le32(p, 24 + n * 8);
+	put_le16(p, 2);						// wLongsPerEntry
+	*p++ = 0;							// bIndexSubType
+	*p++ = AVI_INDEX_OF_CHUNKS;			// bIndexType
+	put_le32(p, n);						// nEntriesInUse
+	put_fourcc(p, "00dc");				// dwChunkId
+	put_le64(p, movi_offset);			// qwBaseOffset
+	put_le32(p, 0);						// dwReserved3
+	result = write_data(buf, p - buf);
+	for (auto iter = index_entries.begin(); !result && (iter != index_entries.end()); iter++) {
+		p = buf;
+		put_le32(p, (uint32_t)((*iter).offset + 8 - movi_offset));	// points to chunk data
+		put_le32(p, (*iter).size);		// all MJPEG frames are key frames
+		result = write_data(buf, p - buf);
+	}
+	if (UNLIKELY(result)) {
+		return result;
+	}
+	super_index.push_back(super_entry);
+	const uint32_t movi_size = (uint32_t)(file_pos - movi_offset);
+
+	if (!riff_offset) {
+		// legacy index for players that does not support OpenDML, this is only for the first RIFF
+		p = buf;
+		put_fourcc(p, "idx1");
+		put_le32(p, n * 16);
+		result = write_data(buf, p - buf);
+		for (auto iter = index_entries.begin(); !result && (iter != index_entries.end()); iter++) {
+			p = buf;
+			put_fourcc(p, "00dc");
+			put_le32(p, AVIIF_KEYFRAME);
+			put_le32(p, (uint32_t)((*iter).offset - movi_offset));
+			put_le32(p, (*iter).size);
+			result = write_data(buf, p - buf);
+		}
+		// sizes of the first RIFF are written with the header
+		first_movi_size = movi_size;
+		first_riff_size = (uint32_t)(file_pos - 8);
+		first_riff_frames = n;
+	} else {
+		p = buf;
+		put_le32(p, (uint32_t)(file_pos - riff_offset - 8));
+		put_le32(p, movi_size);
+		result = flush();
+		if (LIKELY(!result)) {
+			result = write_at(riff_offset + 4, buf, 4);
+		}
+		if (LIKELY(!result)) {
+			result = write_at(movi_offset - 4, buf + 4, 4);
+		}
+	}
+	index_entries.clear();
+
+	return result;
+}
+
+/**
+ * build the header of the first RIFF including main header, stream header,
+ * super index and OpenDML extended header
+ */
+/*private*/
+void AVIRecorderPipeline::build_header(uint8_t *header) {
+	const uint32_t frame_intervals_us = (total_frames > 1) && (last_pts_us > first_pts_us)
+		? (uint32_t)((last_pts_us - first_pts_us) / (total_frames - 1))
+		: AVI_DEFAULT_FRAME_INTERVALS_US;
+	const uint32_t max_bytes_per_sec = (uint32_t)(int64_t(max_frame_bytes) * 1000000LL / frame_intervals_us);
+	uint8_t *p = header, *hdrl, *strl, *indx, *odml, *junk;
+
+	memset(header, 0, AVI_HEADER_SZ);
+	put_fourcc(p, "RIFF");
+	put_le32(p, first_riff_size);
+	put_fourcc(p, "AVI ");
+	// header list
+	hdrl = p;
+	put_fourcc(p, "LIST");
+	put_le32(p, 0);
+	put_fourcc(p, "hdrl");
+	// main AVI header
+	put_fourcc(p, "avih");
+	put_le32(p, 56);
+	put_le32(p, frame_intervals_us);	// dwMicroSecPerFrame
+	put_le32(p, max_bytes_per_sec);		// dwMaxBytesPerSec
+	put_le32(p, 0);						// dwPaddingGranularity
+	put_le32(p, AVIF_HASINDEX | AVIF_ISINTERLEAVED);	// dwFlags
+	put_le32(p, first_riff_frames);		// dwTotalFrames, only frames in the first RIFF
+	put_le32(p, 0);						// dwInitialFrames
+	put_le32(p, 1);						// dwStreams
+	put_le32(p, max_frame_bytes);		// dwSuggestedBufferSize
+	put_le32(p, width);					// dwWidth
+	put_le32(p, height);				// dwHeight
+	put_zero(p, 16);					// dwReserved[4]
+	// stream list
+	strl = p;
+	put_fourcc(p, "LIST");
+	put_le32(p, 0);
+	put_fourcc(p, "strl");
+	// stream header
+	put_fourcc(p, "strh");
+	put_le32(p, 56);
+	put_fourcc(p, "vids");				// fccType
+	put_fourcc(p, "MJPG");				// fccHandler
+	put_le32(p, 0);						// dwFlags
+	put_le16(p, 0);						// wPriority
+	put_le16(p, 0);						// wLanguage
+	put_le32(p, 0);						// dwInitialFrames
+	put_le32(p, frame_intervals_us);	// dwScale
+	put_le32(p, 1000000);				// dwRate
+	put_le32(p, 0);						// dwStart
+	put_le32(p, total_frames);			// dwLength
+	put_le32(p, max_frame_bytes);		// dwSuggestedBufferSize
+	put_le32(p, (uint32_t)-1);			// dwQuality
+	put_le32(p, 0);						// dwSampleSize
+	put_le16(p, 0);						// rcFrame
+	put_le16(p, 0);
+	put_le16(p, width);
+	put_le16(p, height);
+	// stream format(BITMAPINFOHEADER)
+	put_fourcc(p, "strf");
+	put_le32(p, 40);
+	put_le32(p, 40);					// biSize
+	put_le32(p, width);					// biWidth
+	put_le32(p, height);				// biHeight
+	put_le16(p, 1);						// biPlanes
+	put_le16(p, 24);					// biBitCount
+	put_fourcc(p, "MJPG");				// biCompression
+	put_le32(p, width * height * 3);	// biSizeImage
+	put_zero(p, 16);					// biXPelsPerMeter, biYPelsPerMeter, biClrUsed, biClrImportant
+	// super index, unused entries are kept as is to reserve space
+	indx = p;
+	put_fourcc(p, "indx");
+	put_le32(p, 0);
+	put_le16(p, 4);						// wLongsPerEntry
+	*p++ = 0;							// bIndexSubType
+	*p++ = AVI_INDEX_OF_INDEXES;		// bIndexType
+	put_le32(p, super_index.size());	// nEntriesInUse
+	put_fourcc(p, "00dc");				// dwChunkId
+	put_zero(p, 12);					// dwReserved[3]
+	for (auto iter = super_index.begin(); iter != super_index.end(); iter++) {
+		put_le64(p, (*iter).offset);
+		put_le32(p, (*iter).size);
+		put_le32(p, (*iter).duration);
+	}
+	p = indx + 32 + AVI_MAX_RIFF_NUM * 16;
+	fix_size(indx, p);
+	fix_size(strl, p);
+	// OpenDML extended header
+	odml = p;
+	put_fourcc(p, "LIST");
+	put_le32(p, 0);
+	put_fourcc(p, "odml");
+	put_fourcc(p, "dmlh");
+	put_le32(p, 248);
+	put_le32(p, total_frames);			// dwTotalFrames
+	put_zero(p, 244);
+	fix_size(odml, p);
+	fix_size(hdrl, p);
+	// fill the rest with JUNK so that frame data starts at AVI_HEADER_SZ
+	junk = p;
+	put_fourcc(p, "JUNK");
+	p = header + AVI_HEADER_SZ - 12;
+	fix_size(junk, p);
+	put_fourcc(p, "LIST");
+	put_le32(p, first_movi_size);
+	put_fourcc(p, "movi");
+}
+
+//********************************************************************************
+// batched file i/o
+//********************************************************************************
+/**
+ * append data to the write buffer,
+ * data is written to the file when the buffer becomes full
+ */
+/*private*/
+int AVIRecorderPipeline::write_data(const void *data, const size_t &bytes) {
+	int result = 0;
+	if (UNLIKELY(write_bytes + bytes > AVI_WRITE_BUFFER_SZ)) {
+		result = flush();
+	}
+	if (LIKELY(!result)) {
+		if (UNLIKELY(bytes > AVI_WRITE_BUFFER_SZ)) {
+			// too big, write directly
+			preallocate(file_pos + bytes);
+			result = write_fully(fd, (const uint8_t *)data, bytes);
+		} else {
+			memcpy(write_buffer + write_bytes, data, bytes);
+			write_bytes += bytes;
+		}
+		file_pos += bytes;
+	}
+	return result;
+}
+
+/*private*/
+int AVIRecorderPipeline::flush() {
+	int result = 0;
+	if (write_bytes) {
+		preallocate(file_pos);
+		result = write_fully(fd, write_buffer, write_bytes);
+		write_bytes = 0;
+	}
+	if (UNLIKELY(result)) {
+		LOGE("failed to write:%d", result);
+	}
+	return result;
+}
+
+/**
+ * overwrite data at specific position, write buffer should be flushed before calling this
+ */
+/*private*/
+int AVIRecorderPipeline::write_at(const off64_t &offset, const void *data, const size_t &bytes) {
+	const uint8_t *p = (const uint8_t *)data;
+	off64_t pos = offset;
+	size_t n = bytes;
+	for ( ; n > 0 ; ) {
+		const ssize_t w = pwrite64(fd, p, n, pos);
+		if (UNLIKELY(w < 0)) {
+			if (errno == EINTR) continue;
+			LOGE("failed to write at %lld:errno=%d", (long long)offset, errno);
+			return -errno;
+		}
+		p += w;
+		pos += w;
+		n -= w;
+	}
+	return 0;
+}
+
+/**
+ * reserve file space until end with AVI_PREALLOCATE_SZ steps
+ */
+/*private*/
+void AVIRecorderPipeline::preallocate(const off64_t &end) {
+	if (end > preallocated_pos) {
+		const off64_t new_pos = ((end + AVI_PREALLOCATE_SZ - 1) / AVI_PREALLOCATE_SZ) * AVI_PREALLOCATE_SZ;
+#if !defined(__ANDROID__) || (defined(__ANDROID_API__) && (__ANDROID_API__ >= 21))
+		if (UNLIKELY(fallocate64(fd, FALLOC_FL_KEEP_SIZE, preallocated_pos, new_pos - preallocated_pos))) {
+			// this is not fatal, file system may not support fallocate
+			LOGD("fallocate failed:errno=%d", errno);
+		}
+#endif
+		preallocated_pos = new_pos;
+	}
+}
+
+//********************************************************************************
+//
+//********************************************************************************
+static ID_TYPE nativeCreate(JNIEnv *env, jobject thiz,
+	jstring file_path_str) {
+
+	ENTER();
+
+	const char *c_file_path = env->GetStringUTFChars(file_path_str, JNI_FALSE);
+	AVIRecorderPipeline *pipeline = new AVIRecorderPipeline(c_file_path);
+	env->ReleaseStringUTFChars(file_path_str, c_file_path);
+	setField_long(env, thiz, "mNativePtr", reinterpret_cast<ID_TYPE>(pipeline));
+
+	RETURN(reinterpret_cast<ID_TYPE>(pipeline), ID_TYPE);
+}
+
+static void nativeDestroy(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline) {
+
+	ENTER();
+	setField_long(env, thiz, "mNativePtr", 0);
+	AVIRecorderPipeline *pipeline = reinterpret_cast<AVIRecorderPipeline *>(id_pipeline);
+	if (LIKELY(pipeline)) {
+		pipeline->release();
+		SAFE_DELETE(pipeline);
+	}
+	EXIT();
+}
+
+static jint nativeGetState(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline) {
+
+	ENTER();
+	jint result = 0;
+	AVIRecorderPipeline *pipeline = reinterpret_cast<AVIRecorderPipeline *>(id_pipeline);
+	if (LIKELY(pipeline)) {
+		result = pipeline->getState();
+	}
+	RETURN(result, jint);
+}
+
+static jint nativeSetPipeline(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline, jobject pipeline_obj) {
+
+	ENTER();
+	jint result = JNI_ERR;
+	AVIRecorderPipeline *pipeline = reinterpret_cast<AVIRecorderPipeline *>(id_pipeline);
+	if (pipeline) {
+		IPipeline *target_pipeline = getPipeline(env, pipeline_obj);
+		result = pipeline->setPipeline(target_pipeline);
+	}
+
+	RETURN(result, jint);
+}
+
+static jint nativeStart(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline) {
+
+	ENTER();
+
+	int result = JNI_ERR;
+	AVIRecorderPipeline *pipeline = reinterpret_cast<AVIRecorderPipeline *>(id_pipeline);
+	if (LIKELY(pipeline)) {
+		result = pipeline->start();
+	}
+
+	RETURN(result, jint);
+}
+
+static jint nativeStop(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline) {
+
+	ENTER();
+
+	jint result = JNI_ERR;
+	AVIRecorderPipeline *pipeline = reinterpret_cast<AVIRecorderPipeline *>(id_pipeline);
+	if (LIKELY(pipeline)) {
+		result = pipeline->stop();
+	}
+
+	RETURN(result, jint);
+}
+
+static jint nativeGetFrameCount(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline) {
+
+	ENTER();
+
+	jint result = 0;
+	AVIRecorderPipeline *pipeline = reinterpret_cast<AVIRecorderPipeline *>(id_pipeline);
+	if (LIKELY(pipeline)) {
+		result = pipeline->getFrameCount();
+	}
+
+	RETURN(result, jint);
+}
+
+//================================================================================
+static JNINativeMethod methods[] = {
+	{ "nativeCreate", 		"(Ljava/lang/String;)J", (void *) nativeCreate},
+	{ "nativeDestroy",		"(J)V", (void *) nativeDestroy},
+	{ "nativeSetPipeline",	"(JLcom/serenegiant/usb/IPipeline;)I", (void *) nativeSetPipeline },
+
+	{ "nativeGetState",		"(J)I", (void *) nativeGetState },
+	{ "nativeStart",		"(J)I", (void *) nativeStart },
+	{ "nativeStop",			"(J)I", (void *) nativeStop },
+	{ "nativeGetFrameCount",	"(J)I", (void *) nativeGetFrameCount },
+};
+
+int register_avi_recorder_pipeline(JNIEnv *env) {
+	LOGV("register AVIRecorderPipeline:");
+	if (registerNativeMethods(env,
+		"com/serenegiant/usb/AVIRecorderPipeline",
+		methods, NUM_ARRAY_ELEMENTS(methods)) < 0) {
+		return -1;
+	}
+    return 0;
+}
@@ -0,0 +1,113 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: AVIRecorderPipeline.h
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#ifndef PUPILMOBILE_AVIRECORDERPIPELINE_H
+#define PUPILMOBILE_AVIRECORDERPIPELINE_H
+
+#pragma interface
+
+#include <sys/types.h>
+#include <string>
+#include <vector>
+#include "Mutex.h"
+#include "Timers.h"
+
+#include "AbstractBufferedPipeline.h"
+
+using namespace android;
+
+// size of write buffer, frames are written to the file when this buffer becomes full
+#define AVI_WRITE_BUFFER_SZ (4 * 1024 * 1024)
+// file space is reserved by this size to reduce fragmentation and metadata updates
+#define AVI_PREALLOCATE_SZ (64 * 1024 * 1024)
+// OpenDML recommends each RIFF is smaller than 1GB
+#define AVI_MAX_RIFF_SZ (1000 * 1024 * 1024)
+// number of entries of super index, this limits the maximum file size to about 256GB
+#define AVI_MAX_RIFF_NUM 256
+
+typedef struct avi_index_entry {
+	off64_t offset;		// absolute file offset of chunk header
+	uint32_t size;		// chunk data size without header and padding
+} avi_index_entry_t;
+
+typedef struct avi_super_index_entry {
+	off64_t offset;		// absolute file offset of ix00 chunk
+	uint32_t size;		// size of ix00 chunk including its header
+	uint32_t duration;	// number of frames in this RIFF
+} avi_super_index_entry_t;
+
+/**
+ * record MJPEG frames without decoding into AVI(OpenDML) file.
+ * frames are passed through to the next pipeline as is.
+ * frames are dropped(OVERFLOW_DROP_NEWEST) when the storage can not keep up with the camera,
+ * so that slow storage never blocks the thread that queues frames(the camera callback thread).
+ * dropped frames are counted in #getQueueStats and are missing in the file.
+ * call setOverflowPolicy(OVERFLOW_BLOCK, timeout_ns) to record every frame instead,
+ * then queueFrame blocks the caller until frames are written or timeout_ns passed.
+ */
+class AVIRecorderPipeline : virtual public AbstractBufferedPipeline {
+private:
+	const std::string file_path;
+	int fd;
+	volatile bool has_error;	// written by the handler thread, read by any thread through queueFrame/#hasError
+	// write buffer
+	uint8_t *write_buffer;
+	size_t write_bytes;
+	off64_t file_pos;			// file position including data in the write buffer
+	off64_t preallocated_pos;
+	// stream info
+	uint32_t width, height;
+	uint32_t total_frames;
+	uint32_t max_frame_bytes;
+	int64_t first_pts_us, last_pts_us;
+	// current RIFF
+	off64_t riff_offset;
+	off64_t movi_offset;		// position of 'movi' fourcc of current RIFF
+	uint32_t first_riff_size, first_movi_size, first_riff_frames;
+	std::vector<avi_index_entry_t> index_entries;
+	std::vector<avi_super_index_entry_t> super_index;
+
+	int write_data(const void *data, const size_t &bytes);
+	int flush();
+	int write_at(const off64_t &offset, const void *data, const size_t &bytes);
+	void preallocate(const off64_t &end);
+	void build_header(uint8_t *header);
+	int start_riff();
+	int finish_riff();
+	int write_frame(uvc_frame_t *frame);
+protected:
+	virtual void on_start();
+	virtual void on_stop();
+	virtual int handle_frame(uvc_frame_t *frame);
+public:
+	AVIRecorderPipeline(const char *file_path, const size_t &_data_bytes = DEFAULT_FRAME_SZ);
+	virtual ~AVIRecorderPipeline();
+	virtual int queueFrame(uvc_frame_t *frame);
+	virtual int queueSharedFrame(SharedFrame *frame);
+	const uint32_t getFrameCount() const { return total_frames; };
+	/** whether recording stopped because of failure of opening or writing the file */
+	inline const bool hasError() const { return __atomic_load_n(&has_error, __ATOMIC_ACQUIRE); };
+};
+
+#endif //PUPILMOBILE_AVIRECORDERPIPELINE_H
@@ -13,6 +13,9 @@
 	#undef NDEBUG		// depends on definition in Android.mk and Application.mk
 #endif
 
+#include <unistd.h>
+#include <sys/syscall.h>
+
 #include "utilbase.h"
 #include "AbstractBufferedPipeline.h"
 
@@ -21,9 +24,26 @@ AbstractBufferedPipeline::AbstractBufferedPipeline(const int &_max_buffer_num, c
 	const size_t &_default_frame_size, const bool &drop_frames_when_buffer_empty)
 :	IPipeline(_default_frame_size),
 	max_buffer_num(_max_buffer_num),
-	init_pool_num(_init_pool_num),
-	drop_frames(drop_frames_when_buffer_empty),
-	total_frame_num(0)
+	init_pool_num(_init_pool_num < _max_buffer_num ? _init_pool_num : _max_buffer_num),
+	overflow_policy(drop_frames_when_buffer_empty ? OVERFLOW_DROP_NEWEST : OVERFLOW_BLOCK),
+	block_timeout(0),
+	total_frame_num(0),
+	cpu_mask(0),
+	backpressure_policy(BACKPRESSURE_OFF),
+	max_latency_us(0),
+	decimation(1),
+	decimation_count(0),
+	frame_pool(_max_buffer_num),
+	pool_waiters(0),
+	frame_buffers(_max_buffer_num),
+	consumer_waiting(0),
+	high_water(0),
+	enqueue_count(0), enqueue_total_us(0), enqueue_max_us(0),
+	dequeue_count(0), dequeue_total_us(0), dequeue_max_us(0),
+	dropped_newest(0), dropped_oldest(0), block_timeouts(0),
+	skipped(0), expired(0),
+	frame_detached(false),
+	downstream_credits(PIPELINE_CREDITS_UNLIMITED)
 {
 	ENTER();
 
@@ -47,7 +67,7 @@ int AbstractBufferedPipeline::release() {
 	setState(PIPELINE_STATE_RELEASING);
 	stop();
 	clear_frames();
-	clear_pool();
+	release_pool();
 	setState(PIPELINE_STATE_UNINITIALIZED);
 
 	RETURN(0, int);
@@ -89,11 +109,20 @@ int AbstractBufferedPipeline::stop() {
 	if (LIKELY(b)) {
 		setState(PIPELINE_STATE_STOPPING);
 		mIsRunning = false;
-		pool_sync.broadcast();
-		buffer_sync.broadcast();
+		// wake up waiting threads while holding the lock so that they never miss the broadcast
+		pool_mutex.lock();
+		{
+			pool_sync.broadcast();
+		}
+		pool_mutex.unlock();
+		buffer_mutex.lock();
+		{
+			buffer_sync.broadcast();
+		}
+		buffer_mutex.unlock();
 		LOGD("pthread_join:handler_thread");
 		if (pthread_join(handler_thread, NULL) != EXIT_SUCCESS) {
-			LOGW("PublisherPipeline::terminate publisher thread: pthread_join failed");
+			LOGW("AbstractBufferedPipeline::stop:pthread_join failed");
 		}
 		setState(PIPELINE_STATE_INITIALIZED);
 		LOGD("handler_thread finished");
@@ -109,6 +138,7 @@ int AbstractBufferedPipeline::queueFrame(uvc_frame_t *frame) {
 
 	int ret = UVC_ERROR_OTHER;
 	if (LIKELY(frame)) {
+		const nsecs_t start_time = systemTime();
 		// get empty frame from frame pool
 		uvc_frame_t *copy = get_frame(frame->data_bytes);
 		if (UNLIKELY(!copy)) {
@@ -118,7 +148,7 @@ int AbstractBufferedPipeline::queueFrame(uvc_frame_t *frame) {
 		// duplicate frame buffer and pass copy to publisher
 		ret = uvc_duplicate_frame(frame, copy);
 		if (LIKELY(!ret)) {
-			ret = add_frame(copy);
+			ret = add_frame(copy, start_time);
 		} else {
 			LOGW("uvc_duplicate_frame failed:%d", ret);
 			recycle_frame(copy);
@@ -128,108 +158,331 @@ int AbstractBufferedPipeline::queueFrame(uvc_frame_t *frame) {
 	RETURN(ret, int);
 }
 
+/**
+ * queue the reference of read only shared frame without copying,
+ * the frame is copied only when handle_frame of this pipeline modifies frames
+ */
+/*public*/
+int AbstractBufferedPipeline::queueSharedFrame(SharedFrame *frame) {
+	ENTER();
+
+	int ret = UVC_ERROR_OTHER;
+	if (LIKELY(frame)) {
+		if (UNLIKELY(needs_writable_frame())) {
+			ret = queueFrame(frame->get());
+		} else {
+			const nsecs_t start_time = systemTime();
+			const queued_frame_t queued = { NULL, frame->addRef(), start_time };
+			ret = enqueue(queued, start_time);
+		}
+	}
+
+	RETURN(ret, int);
+}
+
+/**
+ * set what to do when all frames of this pipeline are in use
+ * @param policy
+ * @param timeout_ns maximum time to wait for frame recycling on OVERFLOW_BLOCK,
+ * 			<= 0 means waiting until the pipeline stops
+ */
+/*public*/
+void AbstractBufferedPipeline::setOverflowPolicy(const pipeline_overflow_policy_t &policy, const nsecs_t &timeout_ns) {
+	ENTER();
+
+	Mutex::Autolock lock(pool_mutex);
+	overflow_policy = policy;
+	block_timeout = timeout_ns;
+
+	EXIT();
+}
+
+/*public*/
+void AbstractBufferedPipeline::getQueueStats(pipeline_queue_stats_t *stats) const {
+	ENTER();
+
+	if (LIKELY(stats)) {
+		const uint32_t enqueued = __atomic_load_n(&enqueue_count, __ATOMIC_RELAXED);
+		const uint32_t dequeued = __atomic_load_n(&dequeue_count, __ATOMIC_RELAXED);
+		stats->queued = frame_buffers.size();
+		stats->high_water = __atomic_load_n(&high_water, __ATOMIC_RELAXED);
+		stats->enqueued = enqueued;
+		stats->dequeued = dequeued;
+		stats->dropped_newest = __atomic_load_n(&dropped_newest, __ATOMIC_RELAXED);
+		stats->dropped_oldest = __atomic_load_n(&dropped_oldest, __ATOMIC_RELAXED);
+		stats->block_timeouts = __atomic_load_n(&block_timeouts, __ATOMIC_RELAXED);
+		stats->skipped = __atomic_load_n(&skipped, __ATOMIC_RELAXED);
+		stats->expired = __atomic_load_n(&expired, __ATOMIC_RELAXED);
+		stats->decimation = __atomic_load_n(&decimation, __ATOMIC_RELAXED);
+		stats->enqueue_avg_us = enqueued ? __atomic_load_n(&enqueue_total_us, __ATOMIC_RELAXED) / enqueued : 0;
+		stats->enqueue_max_us = __atomic_load_n(&enqueue_max_us, __ATOMIC_RELAXED);
+		stats->dequeue_avg_us = dequeued ? __atomic_load_n(&dequeue_total_us, __ATOMIC_RELAXED) / dequeued : 0;
+		stats->dequeue_max_us = __atomic_load_n(&dequeue_max_us, __ATOMIC_RELAXED);
+	}
+
+	EXIT();
+}
+
+/**
+ * clear statistics, total time counters wrap after about 70 minutes of accumulated time
+ * so call this periodically if you need long term average
+ */
+/*public*/
+void AbstractBufferedPipeline::resetQueueStats() {
+	ENTER();
+
+	__atomic_store_n(&high_water, frame_buffers.size(), __ATOMIC_RELAXED);
+	__atomic_store_n(&enqueue_count, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&enqueue_total_us, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&enqueue_max_us, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&dequeue_count, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&dequeue_total_us, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&dequeue_max_us, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&dropped_newest, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&dropped_oldest, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&block_timeouts, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&skipped, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&expired, 0, __ATOMIC_RELAXED);
+
+	EXIT();
+}
+
+/**
+ * bind handler thread to specific cpus, this is applied when the pipeline starts
+ * @param mask bit n means cpu n, 0 means no restriction
+ */
+/*public*/
+void AbstractBufferedPipeline::setThreadAffinity(const uint32_t &mask) {
+	ENTER();
+
+	cpu_mask = mask;
+
+	EXIT();
+}
+
+/**
+ * set how this pipeline adapts to the credits that the next pipeline grants.
+ * frames are skipped before handle_frame, so the work for frames that
+ * the next pipeline would drop(e.g. conversion) is not done and queues of both pipelines stay short
+ * @param policy
+ * @param max_latency_ns frames that waited longer than this in the queue are skipped, <= 0 means no limit
+ */
+/*public*/
+void AbstractBufferedPipeline::setBackpressure(const pipeline_backpressure_policy_t &policy, const nsecs_t &max_latency_ns) {
+	ENTER();
+
+	backpressure_policy = policy;
+	__atomic_store_n(&decimation, 1, __ATOMIC_RELAXED);
+	max_latency_us = max_latency_ns > 0 ? (uint32_t)(max_latency_ns / 1000) : 0;
+
+	EXIT();
+}
+
+/**
+ * number of frames that can be queued without overflow,
+ * smaller one of free queue entries and frames that are not in use. 0 while the pipeline is not running
+ */
+/*public*/
+int AbstractBufferedPipeline::getCredits() const {
+	const int free_entries = (int)max_buffer_num - frame_buffers.size();
+	const int free_frames = (int)max_buffer_num - (int)__atomic_load_n(&total_frame_num, __ATOMIC_RELAXED)
+		+ frame_pool.size();
+	const int credits = free_entries < free_frames ? free_entries : free_frames;
+	return isRunning() && (credits > 0) ? credits : 0;
+}
+
 //********************************************************************************
 //
 //********************************************************************************
+static inline void update_max(volatile uint32_t *max_value, const uint32_t &value) {
+	uint32_t current = __atomic_load_n(max_value, __ATOMIC_RELAXED);
+	while ((value > current) && !__atomic_compare_exchange_n(max_value, &current, value,
+		true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+void AbstractBufferedPipeline::add_enqueue_time(const nsecs_t &start) {
+	const uint32_t us = (uint32_t)((systemTime() - start) / 1000);
+	__atomic_add_fetch(&enqueue_count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&enqueue_total_us, us, __ATOMIC_RELAXED);
+	update_max(&enqueue_max_us, us);
+}
+
+void AbstractBufferedPipeline::add_dequeue_time(const nsecs_t &enqueue_time) {
+	const uint32_t us = (uint32_t)((systemTime() - enqueue_time) / 1000);
+	__atomic_add_fetch(&dequeue_count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&dequeue_total_us, us, __ATOMIC_RELAXED);
+	update_max(&dequeue_max_us, us);
+}
+
 /**
- * get uvc_frame_t from frame pool
- * if pool is empty, create new frame
- * this function does not confirm the frame size
- * and you may need to confirm the size
+ * increment number of frames in use if it does not exceed max_buffer_num
  */
-uvc_frame_t *AbstractBufferedPipeline::get_frame(const size_t &data_bytes) {
-	uvc_frame_t *frame = NULL;
-	Mutex::Autolock lock(pool_mutex);
+bool AbstractBufferedPipeline::reserve_frame() {
+	uint32_t n = __atomic_load_n(&total_frame_num, __ATOMIC_RELAXED);
+	do {
+		if (n >= max_buffer_num) {
+			return false;
+		}
+	} while (!__atomic_compare_exchange_n(&total_frame_num, &n, n + 1,
+		true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+	return true;
+}
 
-	if (UNLIKELY(frame_pool.empty() && (total_frame_num < max_buffer_num))) {
-		uint32_t n = total_frame_num * 2;
-		if (n > max_buffer_num) {
-			n = max_buffer_num;
+/**
+ * get new frame from shared FramePool if this pipeline does not exceed max_buffer_num
+ */
+uvc_frame_t *AbstractBufferedPipeline::obtain_frame(const size_t &data_bytes) {
+	uvc_frame_t *frame = NULL;
+	if (LIKELY(reserve_frame())) {
+		frame = FramePool::getInstance()->obtain(data_bytes);
+		if (UNLIKELY(!frame)) {
+			__atomic_sub_fetch(&total_frame_num, 1, __ATOMIC_ACQ_REL);
 		}
-		n -= total_frame_num;
-		if (LIKELY(n > 0)) {
-			for (int i = 0; i < n; i++) {
-				frame = uvc_allocate_frame(data_bytes);
-				total_frame_num++;
-			}
-			LOGW("allocate new frame:%d", total_frame_num);
-		} else {
-			LOGW("number of allocated frame exceeds limit");
+	}
+	return frame;
+}
+
+/**
+ * remove the oldest frame from the queue to reuse it
+ * @return NULL if the queue is empty
+ */
+uvc_frame_t *AbstractBufferedPipeline::drop_oldest_frame() {
+	queued_frame_t oldest;
+	for ( ; frame_buffers.get(oldest) ; ) {
+		__atomic_add_fetch(&dropped_oldest, 1, __ATOMIC_RELAXED);
+		if (oldest.frame) {
+			return oldest.frame;
 		}
+		// shared frame does not have a buffer that we can reuse
+		oldest.shared->release();
+	}
+	return NULL;
+}
+
+/**
+ * wake up the thread that is waiting for frame recycling or free space of the queue
+ */
+void AbstractBufferedPipeline::signal_pool() {
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&pool_waiters, __ATOMIC_SEQ_CST)) {
+		Mutex::Autolock lock(pool_mutex);
+		pool_sync.signal();
+	}
+}
+
+/**
+ * wait for frame recycling or free space of the queue on OVERFLOW_BLOCK,
+ * this should be called with pool_mutex locked
+ * @param limit 0 means waiting without timeout
+ * @return false if timed out or the pipeline is stopping
+ */
+bool AbstractBufferedPipeline::wait_pool(const nsecs_t &limit) {
+	if (!mIsRunning) {
+		return false;
 	}
-	if (UNLIKELY(frame_pool.empty() && !drop_frames)) {
-		// if pool is empty and need to block(avoid dropping frames), wait frame recycling.
-		for (; mIsRunning && frame_pool.empty() ; ) {
-			pool_sync.wait(pool_mutex);
+	if (limit) {
+		const nsecs_t remain = limit - systemTime();
+		if (remain <= 0) {
+			__atomic_add_fetch(&block_timeouts, 1, __ATOMIC_RELAXED);
+			return false;
 		}
+		pool_sync.waitRelative(pool_mutex, remain);
+	} else {
+		pool_sync.wait(pool_mutex);
+	}
+	return true;
+}
+
+/**
+ * get uvc_frame_t from the frame pool of this pipeline,
+ * if pool is empty, obtain new frame from shared FramePool
+ * and if this pipeline already has max_buffer_num frames, follow overflow_policy.
+ * this function does not confirm the frame size
+ * and you may need to confirm the size
+ */
+uvc_frame_t *AbstractBufferedPipeline::get_frame(const size_t &data_bytes) {
+	uvc_frame_t *frame = NULL;
+	if (LIKELY(frame_pool.get(frame))) {
+		return frame;
 	}
-	if (!frame_pool.empty()) {
-		frame = frame_pool.front();
-		frame_pool.pop_front();
+	frame = obtain_frame(data_bytes);
+	if (LIKELY(frame)) {
+		return frame;
+	}
+	switch (overflow_policy) {
+	case OVERFLOW_DROP_OLDEST:
+		frame = drop_oldest_frame();
+		break;
+	case OVERFLOW_BLOCK:
+	{
+		// wait frame recycling
+		Mutex::Autolock lock(pool_mutex);
+		const nsecs_t limit = block_timeout > 0 ? systemTime() + block_timeout : 0;
+		__atomic_add_fetch(&pool_waiters, 1, __ATOMIC_SEQ_CST);
+		for ( ; !frame_pool.get(frame) && !(frame = obtain_frame(data_bytes)) && wait_pool(limit) ; ) {}
+		__atomic_sub_fetch(&pool_waiters, 1, __ATOMIC_SEQ_CST);
+		break;
+	}
+	default:
+		break;
+	}
+	if (UNLIKELY(!frame && mIsRunning)) {
+		LOGW("number of allocated frame exceeds limit");
+		__atomic_add_fetch(&dropped_newest, 1, __ATOMIC_RELAXED);
 	}
 
 	return frame;
 }
 
+/**
+ * return the frame to the frame pool of this pipeline
+ */
 void AbstractBufferedPipeline::recycle_frame(uvc_frame_t *frame) {
 	ENTER();
 
 	if (LIKELY(frame)) {
-		Mutex::Autolock lock(pool_mutex);
-		if (LIKELY(frame_pool.size() < max_buffer_num)) {
-			frame_pool.push_back(frame);
-			frame = NULL;
-		}
-		if (UNLIKELY(frame)) {
-			// if pool overflowed
-			total_frame_num--;
-			uvc_free_frame(frame);
+		if (UNLIKELY(!frame_pool.put(frame))) {
+			// never happens because the pool can hold all frames that this pipeline owns
+			FramePool::getInstance()->recycle(frame);
+			__atomic_sub_fetch(&total_frame_num, 1, __ATOMIC_ACQ_REL);
 		}
-		pool_sync.signal();
+		signal_pool();
 	}
 
 	EXIT();
 }
 
+/**
+ * preallocate frames into the frame pool of this pipeline
+ */
 void AbstractBufferedPipeline::init_pool(const size_t &data_bytes) {
 	ENTER();
 
-	uvc_frame_t *frame = NULL;
-
-	clear_pool();
-	pool_mutex.lock();
-	{
-
-		size_t frame_sz = data_bytes / 4;	// expects 25%, this will be able to much lower
-		if (!frame_sz) {
-			frame_sz = DEFAULT_FRAME_SZ;
-		}
-		for (uint32_t i = 0; i < init_pool_num; i++) {
-			frame = uvc_allocate_frame(frame_sz);
-			if (LIKELY(frame)) {
-				frame_pool.push_back(frame);
-				total_frame_num++;
-			} else {
-				LOGW("failed to allocate new frame:%d", total_frame_num);
-				break;
-			}
-		}
+	size_t frame_sz = data_bytes / 4;	// expects 25%, this will be able to much lower
+	if (!frame_sz) {
+		frame_sz = DEFAULT_FRAME_SZ;
+	}
+	for (int i = frame_pool.size(); i < (int)init_pool_num; i++) {
+		uvc_frame_t *frame = obtain_frame(frame_sz);
+		if (UNLIKELY(!frame)) break;
+		recycle_frame(frame);
 	}
-	pool_mutex.unlock();
 
 	EXIT();
 }
 
-void AbstractBufferedPipeline::clear_pool() {
+/**
+ * return all pooled frames to shared FramePool
+ */
+void AbstractBufferedPipeline::release_pool() {
 	ENTER();
 
-	Mutex::Autolock lock(pool_mutex);
-
-	for (auto iter = frame_pool.begin(); iter != frame_pool.end(); iter++) {
-		total_frame_num--;
-		uvc_free_frame(*iter);
+	uvc_frame_t *frame;
+	for ( ; frame_pool.get(frame) ; ) {
+		FramePool::getInstance()->recycle(frame);
+		__atomic_sub_fetch(&total_frame_num, 1, __ATOMIC_ACQ_REL);
 	}
-	frame_pool.clear();
+
 	EXIT();
 }
 
@@ -238,63 +491,121 @@ void AbstractBufferedPipeline::clear_pool() {
 //********************************************************************************
 
 void AbstractBufferedPipeline::clear_frames() {
-	Mutex::Autolock lock(buffer_mutex);
+	queued_frame_t queued;
+	for ( ; frame_buffers.get(queued) ; ) {
+		dispose(queued);
+	}
+}
 
-	for (auto iter = frame_buffers.begin(); iter != frame_buffers.end(); iter++) {
-		recycle_frame(*iter);
+/**
+ * recycle the owned frame or release the reference of shared frame
+ */
+void AbstractBufferedPipeline::dispose(const queued_frame_t &queued) {
+	if (queued.shared) {
+		queued.shared->release();
+	} else {
+		recycle_frame(queued.frame);
 	}
-	frame_buffers.clear();
 }
 
-int AbstractBufferedPipeline::add_frame(uvc_frame_t *frame) {
+/**
+ * append the frame to the queue and wake up the handler thread if it is waiting
+ * @param start_time time when queueing started, used for enqueue latency
+ */
+int AbstractBufferedPipeline::add_frame(uvc_frame_t *frame, const nsecs_t &start_time) {
 	ENTER();
 
-	buffer_mutex.lock();
-	{
-		// FIXME as current implementation, transferring frame data on my device is slower than that coming from UVC camera... just drop them now
-		if (frame_buffers.size() > max_buffer_num) {
-			// erase old frames
-			int cnt = 0;
-			for (auto iter = frame_buffers.begin();
-				 (iter != frame_buffers.end()) && (cnt < 5); iter++, cnt++) {
-				recycle_frame(*iter);
-				iter = frame_buffers.erase(iter);
+	const queued_frame_t queued = { frame, NULL, systemTime() };
+	int result = enqueue(queued, start_time);
+
+	RETURN(result, int);
+}
+
+/**
+ * append the entry to the queue, if the queue is full(only happens with shared frames
+ * because the queue can hold all frames that this pipeline owns), follow overflow_policy.
+ * the entry is disposed if it is dropped
+ */
+int AbstractBufferedPipeline::enqueue(const queued_frame_t &queued, const nsecs_t &start_time) {
+	ENTER();
+
+	if (UNLIKELY(!isRunning())) {
+		dispose(queued);
+		RETURN(0, int);
+	}
+	bool success = frame_buffers.put(queued);
+	if (UNLIKELY(!success)) {
+		switch (overflow_policy) {
+		case OVERFLOW_DROP_OLDEST:
+		{
+			queued_frame_t oldest;
+			for ( ; !(success = frame_buffers.put(queued)) && frame_buffers.get(oldest) ; ) {
+				__atomic_add_fetch(&dropped_oldest, 1, __ATOMIC_RELAXED);
+				dispose(oldest);
 			}
-			LOGW("droped frame data");
+			break;
 		}
-		if (isRunning() && (frame_buffers.size() < max_buffer_num)) {
-			frame_buffers.push_back(frame);
-			frame = NULL;
+		case OVERFLOW_BLOCK:
+		{
+			Mutex::Autolock lock(pool_mutex);
+			const nsecs_t limit = block_timeout > 0 ? systemTime() + block_timeout : 0;
+			__atomic_add_fetch(&pool_waiters, 1, __ATOMIC_SEQ_CST);
+			for ( ; !(success = frame_buffers.put(queued)) && wait_pool(limit) ; ) {}
+			__atomic_sub_fetch(&pool_waiters, 1, __ATOMIC_SEQ_CST);
+			break;
+		}
+		default:
+			break;
 		}
-		buffer_sync.signal();
 	}
-	buffer_mutex.unlock();
-	if (frame) {
-		recycle_frame(frame);
+	if (UNLIKELY(!success)) {
+		__atomic_add_fetch(&dropped_newest, 1, __ATOMIC_RELAXED);
+		dispose(queued);
+		RETURN(UVC_ERROR_NO_MEM, int);
+	}
+	update_max(&high_water, frame_buffers.size());
+	add_enqueue_time(start_time ? start_time : queued.enqueue_time);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&consumer_waiting, __ATOMIC_SEQ_CST)) {
+		Mutex::Autolock lock(buffer_mutex);
+		buffer_sync.signal();
 	}
 
 	RETURN(0, int);
 }
 
-uvc_frame_t *AbstractBufferedPipeline::wait_frame() {
-	uvc_frame_t *frame = NULL;
-
-	Mutex::Autolock lock(buffer_mutex);
-
-	if (!frame_buffers.size()) {
-		buffer_sync.wait(buffer_mutex);
+/**
+ * get the oldest frame from the queue, this blocks until a frame comes or the pipeline stops
+ * this should be called only from the handler thread
+ */
+bool AbstractBufferedPipeline::wait_frame(queued_frame_t &queued) {
+	if (!frame_buffers.get(queued)) {
+		Mutex::Autolock lock(buffer_mutex);
+		__atomic_store_n(&consumer_waiting, 1, __ATOMIC_SEQ_CST);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		bool available = frame_buffers.get(queued);
+		if (!available && isRunning()) {
+			buffer_sync.wait(buffer_mutex);
+			available = frame_buffers.get(queued);
+		}
+		__atomic_store_n(&consumer_waiting, 0, __ATOMIC_SEQ_CST);
+		if (!available) {
+			return false;
+		}
 	}
-	if (LIKELY(isRunning() && frame_buffers.size() > 0)) {
-		frame = frame_buffers.front();
-		frame_buffers.pop_front();
+	// wake up the producer that is waiting for free space of the queue
+	signal_pool();
+	if (UNLIKELY(!isRunning())) {
+		dispose(queued);
+		return false;
 	}
-	return frame;
+	add_dequeue_time(queued.enqueue_time);
+	return true;
 }
 
 uint32_t AbstractBufferedPipeline::get_frame_count() {
 	ENTER();
 
-	Mutex::Autolock lock(buffer_mutex);
 	uint32_t result = frame_buffers.size();
 
 	RETURN(result, uint32_t);
@@ -308,12 +619,58 @@ void *AbstractBufferedPipeline::handler_thread_func(void *vptr_args) {
 	ENTER();
 	AbstractBufferedPipeline *pipeline = reinterpret_cast<AbstractBufferedPipeline *>(vptr_args);
 	if (LIKELY(pipeline)) {
+		if (pipeline->cpu_mask) {
+			// use syscall directly because sched_setaffinity is not available on older API level
+			unsigned long mask = pipeline->cpu_mask;
+			if (syscall(__NR_sched_setaffinity, 0, sizeof(mask), &mask)) {
+				LOGW("failed to set thread affinity:mask=0x%x", pipeline->cpu_mask);
+			}
+		}
 		pipeline->do_loop();
 	}
 	PRE_EXIT();
 	pthread_exit(NULL);
 }
 
+/**
+ * decide whether the dequeued frame should be handled, called only from the handler thread
+ * @return false if the frame should be skipped
+ */
+/*private*/
+bool AbstractBufferedPipeline::accept_frame(const queued_frame_t &queued) {
+	const uint32_t limit_us = max_latency_us;
+	if (limit_us && (systemTime() - queued.enqueue_time > limit_us * 1000LL)) {
+		__atomic_add_fetch(&expired, 1, __ATOMIC_RELAXED);
+		return false;
+	}
+	const pipeline_backpressure_policy_t policy = backpressure_policy;
+	downstream_credits = policy != BACKPRESSURE_OFF ? next_credits() : PIPELINE_CREDITS_UNLIMITED;
+	bool result = true;
+	switch (policy) {
+	case BACKPRESSURE_SKIP:
+		result = downstream_credits > 0;
+		break;
+	case BACKPRESSURE_DECIMATE:
+	{
+		uint32_t n = decimation;
+		if (downstream_credits <= 0) {
+			n = n < MAX_DECIMATION ? n << 1 : MAX_DECIMATION;
+		} else if ((downstream_credits > 1) && (n > 1)) {
+			n--;
+		}
+		__atomic_store_n(&decimation, n, __ATOMIC_RELAXED);
+		result = (downstream_credits > 0) && !(++decimation_count % n);
+		break;
+	}
+	default:
+		break;
+	}
+	if (!result) {
+		__atomic_add_fetch(&skipped, 1, __ATOMIC_RELAXED);
+	}
+	return result;
+}
+
 void AbstractBufferedPipeline::do_loop() {
 	ENTER();
 
@@ -323,21 +680,38 @@ void AbstractBufferedPipeline::do_loop() {
 	on_start();
 	setState(PIPELINE_STATE_RUNNING);
 	for ( ; LIKELY(isRunning()) ; ) {
-		uvc_frame_t *frame = wait_frame();
-		if ((LIKELY(frame))) {
-			try {
-				if (!handle_frame(frame)) {
-					chain_frame(frame);
+		queued_frame_t queued;
+		if ((LIKELY(wait_frame(queued)))) {
+			frame_detached = false;
+			if (LIKELY(accept_frame(queued))) {
+				try {
+					if (queued.shared) {
+						if (!handle_shared_frame(queued.shared)) {
+							chain_shared_frame(queued.shared);
+						}
+					} else if (!handle_frame(queued.frame)) {
+						chain_frame(queued.frame);
+					}
+				} catch (...) {
+					LOGE("exception");
 				}
-			} catch (...) {
-				LOGE("exception");
 			}
-			recycle_frame(frame);
+			if (LIKELY(!frame_detached)) {
+				dispose(queued);
+			}
 		}
 	}
 	setState(PIPELINE_STATE_STOPPING);
 	mIsRunning = false;
 	on_stop();
+	pipeline_queue_stats_t stats;
+	getQueueStats(&stats);
+	LOGI("queue:enqueued=%u,dequeued=%u,high_water=%u,dropped(newest=%u,oldest=%u,timeout=%u),skipped=%u,expired=%u",
+		stats.enqueued, stats.dequeued, stats.high_water,
+		stats.dropped_newest, stats.dropped_oldest, stats.block_timeouts,
+		stats.skipped, stats.expired);
+	LOGI("queue:enqueue=%u/%uus,dequeue=%u/%uus(avg/max)",
+		stats.enqueue_avg_us, stats.enqueue_max_us, stats.dequeue_avg_us, stats.dequeue_max_us);
 	setState(PIPELINE_STATE_INITIALIZED);
 
 	EXIT();
@@ -10,52 +10,148 @@
 #include <list>
 #include "Mutex.h"
 #include "Condition.h"
+#include "Timers.h"
 
 #include "libUVCCamera.h"
 #include "IPipeline.h"
+#include "FramePool.h"
+#include "mpscringbuffer.h"
 
 #pragma interface
 
 #define DEFAULT_INIT_FRAME_POOL_SZ 2
 #define DEFAULT_MAX_FRAME_NUM 8
+#define MAX_DECIMATION 16
 
 using namespace android;
 
+/**
+ * what to do when all frames of the pipeline are in use and a new frame comes
+ */
+typedef enum pipeline_overflow_policy {
+	OVERFLOW_DROP_NEWEST = 0,	// drop the incoming frame
+	OVERFLOW_DROP_OLDEST = 1,	// drop the oldest queued frame and reuse its buffer
+	OVERFLOW_BLOCK = 2,			// wait for frame recycling, drop the incoming frame on timeout
+} pipeline_overflow_policy_t;
+
+/**
+ * what to do when the next pipeline grants no credit(it can not accept frames without dropping or blocking)
+ */
+typedef enum pipeline_backpressure_policy {
+	BACKPRESSURE_OFF = 0,		// always handle frames and pass them to the next pipeline
+	BACKPRESSURE_SKIP = 1,		// skip frames without handling while the next pipeline has no credit
+	BACKPRESSURE_DECIMATE = 2,	// same as BACKPRESSURE_SKIP and handle only every n-th frame,
+								// n doubles each time the next pipeline runs out of credit(up to MAX_DECIMATION)
+								// and decreases one by one while the next pipeline has spare credits
+} pipeline_backpressure_policy_t;
+
+typedef struct pipeline_queue_stats {
+	uint32_t queued;			// number of frames in the queue now
+	uint32_t high_water;		// maximum number of queued frames
+	uint32_t enqueued;
+	uint32_t dequeued;
+	uint32_t dropped_newest;
+	uint32_t dropped_oldest;
+	uint32_t block_timeouts;
+	uint32_t skipped;			// frames that were not handled because of backpressure
+	uint32_t expired;			// frames that were not handled because they waited too long in the queue
+	uint32_t decimation;		// current decimation factor, 1 means no decimation
+	uint32_t enqueue_avg_us;	// time spent in queueFrame
+	uint32_t enqueue_max_us;
+	uint32_t dequeue_avg_us;	// time frames waited in the queue
+	uint32_t dequeue_max_us;
+} pipeline_queue_stats_t;
+
 class AbstractBufferedPipeline;
 
 class AbstractBufferedPipeline : virtual public IPipeline {
+protected:
+	/**
+	 * queued entry, either frame that this pipeline owns
+	 * or reference of read only shared frame
+	 */
+	typedef struct queued_frame {
+		uvc_frame_t *frame;
+		SharedFrame *shared;
+		nsecs_t enqueue_time;
+	} queued_frame_t;
 private:
 	const uint32_t max_buffer_num;
 	const uint32_t init_pool_num;
-	const bool drop_frames;
-	volatile uint32_t total_frame_num;
+	volatile pipeline_overflow_policy_t overflow_policy;
+	nsecs_t block_timeout;				// [nsec] guarded by pool_mutex, <= 0 means waiting until the pipeline stops
+	volatile uint32_t total_frame_num;		// number of frames that this pipeline owns(queued, in use and pooled)
+	volatile uint32_t cpu_mask;			// cpus that handler thread can run on, 0 means no restriction
+	volatile pipeline_backpressure_policy_t backpressure_policy;
+	volatile uint32_t max_latency_us;		// frames that waited longer in the queue are not handled, 0 means no limit
+	volatile uint32_t decimation;			// updated only by the handler thread
+	uint32_t decimation_count;
+	bool accept_frame(const queued_frame_t &queued);
 
-// frame buffer pool to improve performance by reducing memory allocation
+// preallocated frames that are not in use, these are returned to shared FramePool on release
+	MPSCRingBuffer<uvc_frame_t *> frame_pool;
 	mutable Mutex pool_mutex;
 	Condition pool_sync;
-	std::list<uvc_frame_t *> frame_pool;
+	volatile int32_t pool_waiters;
+	bool reserve_frame();
+	uvc_frame_t *obtain_frame(const size_t &data_bytes);
+	uvc_frame_t *drop_oldest_frame();
+	void release_pool();
+	void signal_pool();
+	bool wait_pool(const nsecs_t &limit);
 // frame buffers
 	pthread_t handler_thread;
+	MPSCRingBuffer<queued_frame_t> frame_buffers;
 	mutable Mutex buffer_mutex;
 	Condition buffer_sync;
-	std::list<uvc_frame_t *> frame_buffers;
+	volatile int32_t consumer_waiting;
 	static void *handler_thread_func(void *vptr_args);
+// statistics, enqueue_* are updated by producers, dequeue_* only by the handler thread
+	volatile uint32_t high_water;
+	volatile uint32_t enqueue_count, enqueue_total_us, enqueue_max_us;
+	volatile uint32_t dequeue_count, dequeue_total_us, dequeue_max_us;
+	volatile uint32_t dropped_newest, dropped_oldest, block_timeouts;
+	volatile uint32_t skipped, expired;
+	void add_enqueue_time(const nsecs_t &start);
+	void add_dequeue_time(const nsecs_t &enqueue_time);
+	bool frame_detached;				// set by detach_frame while handling the current frame
 
 protected:
+	/**
+	 * credits of the next pipeline when the current frame was dequeued,
+	 * handle_frame can use this to choose cheaper processing while the next pipeline is busy
+	 */
+	int downstream_credits;
 // frame buffer pool
 	uvc_frame_t *get_frame(const size_t &data_bytes);
 	void recycle_frame(uvc_frame_t *frame);
+	/**
+	 * called from handle_frame to keep the owned frame after returning, handle_frame should return non-zero then.
+	 * the pipeline should return the frame with recycle_frame later, that can be called from any thread
+	 */
+	inline void detach_frame() { frame_detached = true; };
 	void init_pool(const size_t &data_bytes);
-	void clear_pool();
 // frame buffers
 	void clear_frames();
-	int add_frame(uvc_frame_t *frame);
-	uvc_frame_t *wait_frame();
+	int add_frame(uvc_frame_t *frame, const nsecs_t &start_time = 0);
+	int enqueue(const queued_frame_t &queued, const nsecs_t &start_time = 0);
+	void dispose(const queued_frame_t &queued);
+	bool wait_frame(queued_frame_t &queued);
 	uint32_t get_frame_count();
 	virtual void do_loop();
 	virtual void on_start() = 0;
 	virtual void on_stop() = 0;
 	virtual int handle_frame(uvc_frame_t *frame) = 0;
+	/**
+	 * called instead of handle_frame for shared frames, the frame is read only
+	 * and the pipeline should call addRef if it needs the frame after returning
+	 */
+	virtual int handle_shared_frame(SharedFrame *frame) { return handle_frame(frame->get()); };
+	/**
+	 * return true if handle_frame modifies the frame,
+	 * shared frames are copied(copy-on-write) only for such pipeline
+	 */
+	virtual bool needs_writable_frame() const { return false; };
 public:
 	AbstractBufferedPipeline(const int &_max_buffer_num = DEFAULT_MAX_FRAME_NUM, const int &init_pool_num = DEFAULT_INIT_FRAME_POOL_SZ,
 		const size_t &default_frame_size = DEFAULT_FRAME_SZ, const bool &drop_frames_when_buffer_empty = true);
@@ -64,6 +160,15 @@ public:
 	virtual int start();
 	virtual int stop();
 	virtual int queueFrame(uvc_frame_t *frame);
+	virtual int queueSharedFrame(SharedFrame *frame);
+	void setOverflowPolicy(const pipeline_overflow_policy_t &policy, const nsecs_t &timeout_ns = 0);
+	inline const pipeline_overflow_policy_t getOverflowPolicy() const { return overflow_policy; };
+	void getQueueStats(pipeline_queue_stats_t *stats) const;
+	void resetQueueStats();
+	void setThreadAffinity(const uint32_t &mask);
+	void setBackpressure(const pipeline_backpressure_policy_t &policy, const nsecs_t &max_latency_ns = 0);
+	inline const pipeline_backpressure_policy_t getBackpressure() const { return backpressure_policy; };
+	virtual int getCredits() const;
 };
 
 
@@ -112,6 +112,9 @@ int ConvertPipeline::handle_frame(uvc_frame_t *frame) {
 			}
 		}
 		next_pipeline->queueFrame(copy);
+		if (copy != frame) {
+			recycle_frame(copy);
+		}
 	}
 
 	RETURN(1, int);
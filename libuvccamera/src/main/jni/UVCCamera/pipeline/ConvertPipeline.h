@@ -6,6 +6,7 @@
 #define PUPILMOBILE_CONVERTPIPELINE_H
 
 #include "libUVCCamera.h"
+#include "FrameCallback.h"		// PIXEL_FORMAT_XXX
 #include "AbstractBufferedPipeline.h"
 
 class ConvertPipeline : virtual public AbstractBufferedPipeline {
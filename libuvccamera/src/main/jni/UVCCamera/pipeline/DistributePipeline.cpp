@@ -9,10 +9,44 @@
 #include "pipeline_helper.h"
 #include "IPipeline.h"
 #include "DistributePipeline.h"
+#include "FramePool.h"
+
+/**
+ * branch of DistributePipeline, this has own bounded queue and thread
+ * and passes frames to the target pipeline on that thread.
+ * frames are dropped when the target pipeline is slower than others
+ */
+class DistributeBranch : public AbstractBufferedPipeline {
+private:
+	IPipeline *target;
+protected:
+	virtual void on_start() {};
+	virtual void on_stop() {};
+	virtual int handle_frame(uvc_frame_t *frame) {
+		target->queueFrame(frame);
+		return 1;
+	};
+	virtual int handle_shared_frame(SharedFrame *frame) {
+		target->queueSharedFrame(frame);
+		return 1;
+	};
+public:
+	DistributeBranch(IPipeline *_target, const int &max_frame_num)
+	:	AbstractBufferedPipeline(max_frame_num, 0, DEFAULT_FRAME_SZ, true),
+		target(_target) {
+		setState(PIPELINE_STATE_INITIALIZED);
+	};
+	virtual ~DistributeBranch() {
+		release();
+	};
+	inline IPipeline *getTarget() const { return target; };
+};
 
 DistributePipeline::DistributePipeline(const int &_max_buffer_num, const int &init_pool_num,
-		const size_t &default_frame_size, const bool &drop_frames_when_buffer_empty)
-:	AbstractBufferedPipeline(_max_buffer_num, init_pool_num, default_frame_size, drop_frames_when_buffer_empty)
+		const size_t &default_frame_size, const bool &drop_frames_when_buffer_empty,
+		const int &_branch_frame_num)
+:	AbstractBufferedPipeline(_max_buffer_num, init_pool_num, default_frame_size, drop_frames_when_buffer_empty),
+	branch_frame_num(_branch_frame_num)
 {
 	ENTER();
 
@@ -24,29 +58,99 @@ DistributePipeline::DistributePipeline(const int &_max_buffer_num, const int &in
 DistributePipeline::~DistributePipeline() {
 	ENTER();
 
+	// stop handler thread before releasing branches that it accesses
+	release();
 	Mutex::Autolock lock(pipeline_mutex);
 
-	pipelines.clear();
+	for (auto iter = branches.begin(); iter != branches.end(); iter++) {
+		delete *iter;
+	}
+	branches.clear();
 
 	EXIT();
 }
 
 void DistributePipeline::on_start() {
 	ENTER();
+
+	Mutex::Autolock lock(pipeline_mutex);
+
+	for (auto iter = branches.begin(); iter != branches.end(); iter++) {
+		(*iter)->start();
+	}
+
 	EXIT();
 }
 
 void DistributePipeline::on_stop() {
 	ENTER();
+
+	Mutex::Autolock lock(pipeline_mutex);
+
+	int i = 0;
+	for (auto iter = branches.begin(); iter != branches.end(); iter++, i++) {
+		(*iter)->stop();
+		pipeline_queue_stats_t stats;
+		(*iter)->getQueueStats(&stats);
+		LOGI("branch%d(%p):delivered=%u,dropped=%u,max wait=%uus", i, (*iter)->getTarget(),
+			stats.dequeued, stats.dropped_newest + stats.dropped_oldest, stats.dequeue_max_us);
+	}
+
 	EXIT();
 }
 
+/**
+ * copy the frame only once into the shared frame, all children receive its reference
+ * so that the cost of distribution does not increase with the number of children
+ */
+/*public*/
+int DistributePipeline::queueFrame(uvc_frame_t *frame) {
+	ENTER();
+
+	int ret = UVC_ERROR_OTHER;
+	if (LIKELY(frame && isRunning())) {
+		uvc_frame_t *copy = FramePool::getInstance()->obtain(frame->data_bytes);
+		if (UNLIKELY(!copy)) {
+			RETURN(UVC_ERROR_NO_MEM, int);
+		}
+		ret = uvc_duplicate_frame(frame, copy);
+		if (LIKELY(!ret)) {
+			SharedFrame *shared = SharedFrame::create(copy);
+			if (LIKELY(shared)) {
+				ret = queueSharedFrame(shared);
+				shared->release();
+			} else {
+				ret = UVC_ERROR_NO_MEM;
+			}
+		} else {
+			LOGW("uvc_duplicate_frame failed:%d", ret);
+			FramePool::getInstance()->recycle(copy);
+		}
+	}
+
+	RETURN(ret, int);
+}
+
+/* override protected */
+int DistributePipeline::handle_shared_frame(SharedFrame *frame) {
+	ENTER();
+
+	Mutex::Autolock lock(pipeline_mutex);
+
+	// this never blocks, each branch drops frames if its queue is full
+	for (auto iter = branches.begin(); iter != branches.end(); iter++) {
+		(*iter)->queueSharedFrame(frame);
+	}
+
+	RETURN(0, int);
+}
+
 int DistributePipeline::handle_frame(uvc_frame_t *frame) {
 	ENTER();
 
 	Mutex::Autolock lock(pipeline_mutex);
 
-	for (auto iter = pipelines.begin(); iter != pipelines.end(); iter++) {
+	for (auto iter = branches.begin(); iter != branches.end(); iter++) {
 		(*iter)->queueFrame(frame);
 	}
 
@@ -57,8 +161,12 @@ int DistributePipeline::addPipeline(IPipeline *pipeline) {
 	ENTER();
 
 	if (pipeline) {
+		DistributeBranch *branch = new DistributeBranch(pipeline, branch_frame_num);
 		Mutex::Autolock lock(pipeline_mutex);
-		pipelines.push_back(pipeline);
+		if (isRunning()) {
+			branch->start();
+		}
+		branches.push_back(branch);
 	}
 
 	RETURN(0, int);
@@ -68,20 +176,50 @@ int DistributePipeline::removePipeline(IPipeline *pipeline) {
 	ENTER();
 
 	if (pipeline) {
-		Mutex::Autolock lock(pipeline_mutex);
-
-		for (auto iter = pipelines.begin(); iter != pipelines.end(); ) {
-			if (*iter == pipeline) {
-				iter = pipelines.erase(iter);
-			} else {
-				iter++;
+		std::list<DistributeBranch *> removed;
+		pipeline_mutex.lock();
+		{
+			for (auto iter = branches.begin(); iter != branches.end(); ) {
+				if ((*iter)->getTarget() == pipeline) {
+					removed.push_back(*iter);
+					iter = branches.erase(iter);
+				} else {
+					iter++;
+				}
 			}
 		}
+		pipeline_mutex.unlock();
+		// stop branch threads without holding the lock so that other branches keep receiving frames
+		for (auto iter = removed.begin(); iter != removed.end(); iter++) {
+			delete *iter;
+		}
 	}
 
 	RETURN(0, int);
 }
 
+/**
+ * get queue statistics of the branch for the pipeline,
+ * dropped_newest/dropped_oldest show how many frames the pipeline could not receive
+ * @return 0 if the pipeline was found
+ */
+int DistributePipeline::getBranchStats(IPipeline *pipeline, pipeline_queue_stats_t *stats) {
+	ENTER();
+
+	int result = -1;
+	Mutex::Autolock lock(pipeline_mutex);
+
+	for (auto iter = branches.begin(); iter != branches.end(); iter++) {
+		if ((*iter)->getTarget() == pipeline) {
+			(*iter)->getQueueStats(stats);
+			result = 0;
+			break;
+		}
+	}
+
+	RETURN(result, int);
+}
+
 //**********************************************************************
 //
 //**********************************************************************
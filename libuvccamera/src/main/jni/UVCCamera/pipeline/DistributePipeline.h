@@ -9,19 +9,34 @@
 
 #pragma interface
 
+// number of frames that each branch can keep while its pipeline is busy
+#define DEFAULT_BRANCH_FRAME_NUM 4
+
+class DistributeBranch;
+
+/**
+ * distribute frames to multiple pipelines.
+ * each child pipeline has its own branch(bounded queue and dedicated thread),
+ * so slow child only drops its own frames and never blocks other children.
+ */
 class DistributePipeline : virtual public AbstractBufferedPipeline {
 private:
-	std::list<IPipeline *> pipelines;
+	const int branch_frame_num;
+	std::list<DistributeBranch *> branches;
 protected:
 	virtual void on_start();
 	virtual void on_stop();
 	virtual int handle_frame(uvc_frame_t *frame);
+	virtual int handle_shared_frame(SharedFrame *frame);
 public:
 	DistributePipeline(const int &_max_buffer_num = DEFAULT_MAX_FRAME_NUM, const int &init_pool_num = DEFAULT_INIT_FRAME_POOL_SZ,
-			const size_t &default_frame_size = DEFAULT_FRAME_SZ, const bool &drop_frames_when_buffer_empty = true);
+			const size_t &default_frame_size = DEFAULT_FRAME_SZ, const bool &drop_frames_when_buffer_empty = true,
+			const int &branch_frame_num = DEFAULT_BRANCH_FRAME_NUM);
 	virtual ~DistributePipeline();
 	virtual int addPipeline(IPipeline *pipeline);
 	virtual int removePipeline(IPipeline *pipeline);
+	virtual int queueFrame(uvc_frame_t *frame);
+	int getBranchStats(IPipeline *pipeline, pipeline_queue_stats_t *stats);
 };
 
 #endif //PUPILMOBILE_DISTRIBUTEPIPELINE_H
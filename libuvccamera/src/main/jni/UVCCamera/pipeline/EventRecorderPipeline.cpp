@@ -0,0 +1,564 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: EventRecorderPipeline.cpp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#if 1	// set 1 if you don't need debug message
+	#ifndef LOG_NDEBUG
+		#define	LOG_NDEBUG		// ignore LOGV/LOGD/MARK
+	#endif
+	#undef USE_LOGALL
+#else
+	#define USE_LOGALL
+	#undef LOG_NDEBUG
+	#undef NDEBUG		// depends on definition in Android.mk and Application.mk
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "utilbase.h"
+#include "common_utils.h"
+
+#include "libUVCCamera.h"
+#include "pipeline_helper.h"
+#include "EventRecorderPipeline.h"
+
+#define INIT_FRAME_POOL_SZ 2
+#define MAX_FRAME_NUM 8
+#define MIN_RING_FRAMES 2
+// how long on_stop waits for the next pipeline to accept pending frames
+#define FLUSH_TIMEOUT_NSEC 1000000000LL
+#define FLUSH_WAIT_USEC 1000
+#define NUM_EVENT_STATS 11
+
+/* public */
+EventRecorderPipeline::EventRecorderPipeline(const size_t &_ring_bytes,
+	const nsecs_t &_pre_event_ns, const nsecs_t &_post_event_ns,
+	const int &max_ring_frames, const size_t &_data_bytes)
+:	AbstractBufferedPipeline(MAX_FRAME_NUM, INIT_FRAME_POOL_SZ, _data_bytes),
+	ring_bytes((uint32_t)_ring_bytes),
+	max_records(max_ring_frames > MIN_RING_FRAMES ? max_ring_frames : MIN_RING_FRAMES),
+	pre_event_ns(_pre_event_ns > 0 ? _pre_event_ns : 0),
+	post_event_ns(_post_event_ns > 0 ? _post_event_ns : 0),
+	ring(NULL),
+	records(NULL),
+	head_id(0), tail_id(0), flush_id(0), event_end_id(0),
+	write_offset(0), used_bytes(0),
+	recording(false),
+	post_event_end(0),
+	pending_trigger(0),
+	triggers(0), events(0), flushed(0), evicted(0), lost(0), dropped(0)
+{
+	ENTER();
+
+	ring = (uint8_t *)malloc(ring_bytes);
+	records = new ring_record_t[max_records];
+	if (UNLIKELY(!ring)) {
+		LOGE("failed to allocate ring:%u bytes", ring_bytes);
+	}
+	setState(PIPELINE_STATE_INITIALIZED);
+
+	EXIT();
+}
+
+/* public */
+EventRecorderPipeline::~EventRecorderPipeline() {
+	ENTER();
+
+	release();
+	if (ring) {
+		free(ring);
+		ring = NULL;
+	}
+	SAFE_DELETE_ARRAY(records);
+
+	EXIT();
+}
+
+/**
+ * frames of the last pre_event_ns are passed first,
+ * then following frames are passed until post_event_ns after the last trigger
+ */
+/*public*/
+int EventRecorderPipeline::trigger() {
+	ENTER();
+
+	if (UNLIKELY(!isRunning())) {
+		RETURN(-1, int);
+	}
+	__atomic_store_n(&pending_trigger, systemTime(), __ATOMIC_RELEASE);
+	__atomic_add_fetch(&triggers, 1, __ATOMIC_RELAXED);
+
+	RETURN(0, int);
+}
+
+/*public*/
+bool EventRecorderPipeline::isRecording() const {
+	Mutex::Autolock lock(ring_mutex);
+	return recording;
+}
+
+/*public*/
+void EventRecorderPipeline::getEventStats(event_recorder_stats_t *stats) const {
+	ENTER();
+
+	Mutex::Autolock lock(ring_mutex);
+	stats->ring_frames = (uint32_t)(tail_id - head_id);
+	stats->ring_bytes = used_bytes;
+	stats->ring_span_ms = tail_id != head_id
+		? (uint32_t)((record_of(tail_id - 1).dtime - record_of(head_id).dtime) / 1000000LL) : 0;
+	stats->pending = (uint32_t)(event_end_id - flush_id);
+	stats->triggers = triggers;
+	stats->events = events;
+	stats->flushed = flushed;
+	stats->evicted = evicted;
+	stats->lost = lost;
+	stats->dropped = dropped;
+	stats->recording = recording ? 1 : 0;
+
+	EXIT();
+}
+
+//********************************************************************************
+//
+//********************************************************************************
+/* override protected */
+void EventRecorderPipeline::on_start() {
+	ENTER();
+
+	Mutex::Autolock lock(ring_mutex);
+	head_id = tail_id = flush_id = event_end_id = 0;
+	write_offset = used_bytes = 0;
+	recording = false;
+	triggers = events = flushed = evicted = lost = dropped = 0;
+
+	EXIT();
+}
+
+/* override protected */
+void EventRecorderPipeline::on_stop() {
+	ENTER();
+
+	// frames of the event that are already in the ring should not be lost by stopping
+	drain();
+	Mutex::Autolock lock(ring_mutex);
+	LOGI("triggers=%u,events=%u,flushed=%u,evicted=%u,lost=%u,dropped=%u",
+		triggers, events, flushed, evicted, lost, dropped);
+
+	EXIT();
+}
+
+/* override protected */
+int EventRecorderPipeline::handle_frame(uvc_frame_t *frame) {
+	ENTER();
+
+	if (UNLIKELY(!ring)) {
+		RETURN(1, int);
+	}
+	const nsecs_t now = systemTime();
+	const nsecs_t trigger_time = __atomic_exchange_n(&pending_trigger, 0, __ATOMIC_ACQ_REL);
+	ring_mutex.lock();
+	{
+		if (trigger_time) {
+			start_event(trigger_time);
+		}
+		if (recording && (now > post_event_end)) {
+			recording = false;
+			LOGI("event finished, pending=%u", (uint32_t)(event_end_id - flush_id));
+		}
+	}
+	ring_mutex.unlock();
+	// pass pending frames first so that storing new frame does not evict them
+	flush();
+	ring_mutex.lock();
+	{
+		store(frame, now);
+		if (recording) {
+			event_end_id = tail_id;
+		}
+	}
+	ring_mutex.unlock();
+	flush();
+	ring_mutex.lock();
+	{
+		evict_expired(now);
+	}
+	ring_mutex.unlock();
+
+	RETURN(1, int);	// frames are passed to the next pipeline only by flush
+}
+
+//********************************************************************************
+//
+//********************************************************************************
+/**
+ * check whether the frame data of specific bytes can be stored without evicting
+ */
+/*private*/
+bool EventRecorderPipeline::fits(const uint32_t &bytes) const {
+	if (head_id == tail_id) {
+		return bytes <= ring_bytes;
+	}
+	const uint32_t head_offset = record_of(head_id).offset;
+	if (write_offset > head_offset) {
+		// free space is at the end and at the beginning of the ring
+		return (write_offset + bytes <= ring_bytes) || (bytes <= head_offset);
+	} else {
+		// wrapped around, free space is between write_offset and the oldest frame
+		return write_offset + bytes <= head_offset;
+	}
+}
+
+/*private*/
+void EventRecorderPipeline::evict_oldest() {
+	const ring_record_t &rec = record_of(head_id);
+	used_bytes -= rec.bytes;
+	if ((head_id >= flush_id) && (head_id < event_end_id)) {
+		lost++;
+	}
+	head_id++;
+	if (flush_id < head_id) {
+		flush_id = head_id;
+	}
+	if (event_end_id < flush_id) {
+		event_end_id = flush_id;
+	}
+	if (head_id == tail_id) {
+		write_offset = 0;
+	}
+	evicted++;
+}
+
+/**
+ * remove frames that are older than pre-event time and not pending
+ */
+/*private*/
+void EventRecorderPipeline::evict_expired(const nsecs_t &now) {
+	const nsecs_t limit = now - pre_event_ns;
+	for ( ; (head_id != tail_id) && ((head_id < flush_id) || (head_id >= event_end_id))
+		&& (record_of(head_id).dtime < limit) ; ) {
+
+		evict_oldest();
+	}
+}
+
+/**
+ * copy the frame into the ring, the oldest frames are evicted if there is no space
+ */
+/*private*/
+int EventRecorderPipeline::store(uvc_frame_t *frame, const nsecs_t &now) {
+	const uint32_t bytes = (uint32_t)frame->actual_bytes;
+	if (UNLIKELY(!bytes || (bytes > ring_bytes))) {
+		LOGW("frame is empty or too large:%u", bytes);
+		dropped++;
+		return -1;
+	}
+	for ( ; (tail_id - head_id >= max_records) || !fits(bytes) ; ) {
+		evict_oldest();
+	}
+	const uint32_t offset = write_offset + bytes <= ring_bytes ? write_offset : 0;
+	memcpy(ring + offset, frame->data, bytes);
+	ring_record_t &rec = record_of(tail_id);
+	rec.dtime = now;
+	rec.offset = offset;
+	rec.bytes = bytes;
+	rec.format = frame->frame_format;
+	rec.width = frame->width;
+	rec.height = frame->height;
+	rec.step = frame->step;
+	rec.sequence = frame->sequence;
+	rec.capture_time = frame->capture_time;
+	tail_id++;
+	used_bytes += bytes;
+	write_offset = offset + bytes;
+	return 0;
+}
+
+/**
+ * start new event, or extend current one when frames are still taken into the event
+ */
+/*private*/
+void EventRecorderPipeline::start_event(const nsecs_t &trigger_time) {
+	const nsecs_t end = trigger_time + post_event_ns;
+	if (recording) {
+		if (end > post_event_end) {
+			post_event_end = end;
+		}
+		return;
+	}
+	if (flush_id >= event_end_id) {
+		// frames that were passed by previous event are not passed again
+		const nsecs_t start = trigger_time - pre_event_ns;
+		uint64_t id = head_id > event_end_id ? head_id : event_end_id;
+		for ( ; (id < tail_id) && (record_of(id).dtime < start); id++) {}
+		flush_id = id;
+	}	// else previous event is still draining, continue from there
+	event_end_id = tail_id;
+	post_event_end = end;
+	recording = true;
+	events++;
+	LOGI("event started, pre-event frames=%u", (uint32_t)(event_end_id - flush_id));
+}
+
+/*private*/
+void EventRecorderPipeline::pass_frame(const ring_record_t &rec) {
+	uvc_frame_t frame;
+	memset(&frame, 0, sizeof(frame));
+	frame.library_owns_data = 0;
+	frame.data = ring + rec.offset;	// the next pipeline only reads(copies) this
+	frame.data_bytes = frame.actual_bytes = rec.bytes;
+	frame.frame_format = rec.format;
+	frame.width = rec.width;
+	frame.height = rec.height;
+	frame.step = rec.step;
+	frame.sequence = rec.sequence;
+	frame.capture_time = rec.capture_time;
+	chain_frame(&frame);
+}
+
+/**
+ * pass pending frames to the next pipeline as long as it has credits and never waits.
+ * should be called from the handler thread without ring_mutex, the pending records are
+ * passed without the lock for the same reason as #drain
+ * @return number of passed frames
+ */
+/*private*/
+int EventRecorderPipeline::flush() {
+	uint64_t id, end_id;
+	ring_mutex.lock();
+	{
+		id = flush_id;
+		end_id = event_end_id;
+	}
+	ring_mutex.unlock();
+	int result = 0;
+	for (int credits = next_credits(); (credits > 0) && (id < end_id); credits--, id++, result++) {
+		pass_frame(record_of(id));
+	}
+	if (result) {
+		ring_mutex.lock();
+		{
+			flush_id = id;
+			flushed += result;
+		}
+		ring_mutex.unlock();
+	}
+	return result;
+}
+
+/**
+ * pass all pending frames on stopping, wait for credits of the next pipeline until FLUSH_TIMEOUT_NSEC.
+ * only the handler thread modifies the ring and it is calling this, so the pending records
+ * are read without ring_mutex and the lock is held only to update the counters,
+ * #getEventStats and #isRecording never wait for the next pipeline.
+ */
+/*private*/
+void EventRecorderPipeline::drain() {
+	uint64_t id, end_id;
+	ring_mutex.lock();
+	{
+		recording = false;
+		id = flush_id;
+		end_id = event_end_id;
+	}
+	ring_mutex.unlock();
+	const nsecs_t limit = systemTime() + FLUSH_TIMEOUT_NSEC;
+	for ( ; id < end_id ; ) {
+		int credits = next_credits();
+		if (credits <= 0) {
+			if (systemTime() > limit) {
+				LOGW("drain timeout, %u frames are not passed", (uint32_t)(end_id - id));
+				break;
+			}
+			usleep(FLUSH_WAIT_USEC);
+			continue;
+		}
+		uint32_t n = 0;
+		for ( ; (credits > 0) && (id < end_id); credits--, id++, n++) {
+			pass_frame(record_of(id));
+		}
+		ring_mutex.lock();
+		{
+			flush_id = id;
+			flushed += n;
+		}
+		ring_mutex.unlock();
+	}
+}
+
+//********************************************************************************
+//
+//********************************************************************************
+static ID_TYPE nativeCreate(JNIEnv *env, jobject thiz,
+	jint ring_mb, jint pre_event_ms, jint post_event_ms, jint max_ring_frames) {
+
+	ENTER();
+
+	EventRecorderPipeline *pipeline = new EventRecorderPipeline((size_t)ring_mb * 1024 * 1024,
+		pre_event_ms * 1000000LL, post_event_ms * 1000000LL, max_ring_frames);
+	setField_long(env, thiz, "mNativePtr", reinterpret_cast<ID_TYPE>(pipeline));
+
+	RETURN(reinterpret_cast<ID_TYPE>(pipeline), ID_TYPE);
+}
+
+static void nativeDestroy(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline) {
+
+	ENTER();
+	setField_long(env, thiz, "mNativePtr", 0);
+	EventRecorderPipeline *pipeline = reinterpret_cast<EventRecorderPipeline *>(id_pipeline);
+	if (LIKELY(pipeline)) {
+		pipeline->release();
+		SAFE_DELETE(pipeline);
+	}
+	EXIT();
+}
+
+static jint nativeGetState(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline) {
+
+	ENTER();
+	jint result = 0;
+	EventRecorderPipeline *pipeline = reinterpret_cast<EventRecorderPipeline *>(id_pipeline);
+	if (LIKELY(pipeline)) {
+		result = pipeline->getState();
+	}
+	RETURN(result, jint);
+}
+
+static jint nativeSetPipeline(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline, jobject pipeline_obj) {
+
+	ENTER();
+	jint result = JNI_ERR;
+	EventRecorderPipeline *pipeline = reinterpret_cast<EventRecorderPipeline *>(id_pipeline);
+	if (pipeline) {
+		IPipeline *target_pipeline = getPipeline(env, pipeline_obj);
+		result = pipeline->setPipeline(target_pipeline);
+	}
+
+	RETURN(result, jint);
+}
+
+static jint nativeStart(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline) {
+
+	ENTER();
+
+	int result = JNI_ERR;
+	EventRecorderPipeline *pipeline = reinterpret_cast<EventRecorderPipeline *>(id_pipeline);
+	if (LIKELY(pipeline)) {
+		result = pipeline->start();
+	}
+
+	RETURN(result, jint);
+}
+
+static jint nativeStop(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline) {
+
+	ENTER();
+
+	jint result = JNI_ERR;
+	EventRecorderPipeline *pipeline = reinterpret_cast<EventRecorderPipeline *>(id_pipeline);
+	if (LIKELY(pipeline)) {
+		result = pipeline->stop();
+	}
+
+	RETURN(result, jint);
+}
+
+static jint nativeTrigger(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline) {
+
+	ENTER();
+
+	jint result = JNI_ERR;
+	EventRecorderPipeline *pipeline = reinterpret_cast<EventRecorderPipeline *>(id_pipeline);
+	if (LIKELY(pipeline)) {
+		result = pipeline->trigger();
+	}
+
+	RETURN(result, jint);
+}
+
+static jboolean nativeIsRecording(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline) {
+
+	ENTER();
+
+	jboolean result = JNI_FALSE;
+	EventRecorderPipeline *pipeline = reinterpret_cast<EventRecorderPipeline *>(id_pipeline);
+	if (LIKELY(pipeline)) {
+		result = pipeline->isRecording() ? JNI_TRUE : JNI_FALSE;
+	}
+
+	RETURN(result, jboolean);
+}
+
+static jint nativeGetEventStats(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline, jintArray stats_array) {
+
+	ENTER();
+
+	jint result = JNI_ERR;
+	EventRecorderPipeline *pipeline = reinterpret_cast<EventRecorderPipeline *>(id_pipeline);
+	if (LIKELY(pipeline && stats_array && (env->GetArrayLength(stats_array) >= NUM_EVENT_STATS))) {
+		event_recorder_stats_t stats;
+		pipeline->getEventStats(&stats);
+		const jint values[NUM_EVENT_STATS] = {
+			(jint)stats.ring_frames, (jint)stats.ring_bytes, (jint)stats.ring_span_ms, (jint)stats.pending,
+			(jint)stats.triggers, (jint)stats.events, (jint)stats.flushed,
+			(jint)stats.evicted, (jint)stats.lost, (jint)stats.dropped, stats.recording,
+		};
+		env->SetIntArrayRegion(stats_array, 0, NUM_EVENT_STATS, values);
+		result = 0;
+	}
+
+	RETURN(result, jint);
+}
+
+//================================================================================
+static JNINativeMethod methods[] = {
+	{ "nativeCreate", 		"(IIII)J", (void *) nativeCreate},
+	{ "nativeDestroy",		"(J)V", (void *) nativeDestroy},
+	{ "nativeSetPipeline",	"(JLcom/serenegiant/usb/IPipeline;)I", (void *) nativeSetPipeline },
+
+	{ "nativeGetState",		"(J)I", (void *) nativeGetState },
+	{ "nativeStart",		"(J)I", (void *) nativeStart },
+	{ "nativeStop",			"(J)I", (void *) nativeStop },
+	{ "nativeTrigger",		"(J)I", (void *) nativeTrigger },
+	{ "nativeIsRecording",	"(J)Z", (void *) nativeIsRecording },
+	{ "nativeGetEventStats",	"(J[I)I", (void *) nativeGetEventStats },
+};
+
+int register_event_recorder_pipeline(JNIEnv *env) {
+	LOGV("register EventRecorderPipeline:");
+	if (registerNativeMethods(env,
+		"com/serenegiant/usb/EventRecorderPipeline",
+		methods, NUM_ARRAY_ELEMENTS(methods)) < 0) {
+		return -1;
+	}
+    return 0;
+}
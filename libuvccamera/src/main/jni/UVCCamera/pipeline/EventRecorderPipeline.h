@@ -0,0 +1,129 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: EventRecorderPipeline.h
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#ifndef PUPILMOBILE_EVENTRECORDERPIPELINE_H
+#define PUPILMOBILE_EVENTRECORDERPIPELINE_H
+
+#pragma interface
+
+#include <sys/types.h>
+#include "Mutex.h"
+#include "Timers.h"
+
+#include "AbstractBufferedPipeline.h"
+
+using namespace android;
+
+// 32MB keeps about 10 seconds of 1080p MJPEG
+#define DEFAULT_EVENT_RING_SZ (32 * 1024 * 1024)
+#define DEFAULT_EVENT_RING_FRAMES 1024
+#define DEFAULT_PRE_EVENT_NSEC (10 * 1000000000LL)
+#define DEFAULT_POST_EVENT_NSEC (10 * 1000000000LL)
+
+typedef struct event_recorder_stats {
+	uint32_t ring_frames;		// number of frames in the ring now
+	uint32_t ring_bytes;		// bytes of frame data in the ring now
+	uint32_t ring_span_ms;		// time between the oldest and the newest frame in the ring
+	uint32_t pending;			// frames that are waiting to be passed to the next pipeline
+	uint32_t triggers;
+	uint32_t events;			// triggers that started new event, others extended the current event
+	uint32_t flushed;			// frames that were passed to the next pipeline
+	uint32_t evicted;			// frames that were removed from the ring to make space
+	uint32_t lost;				// pending frames that were evicted before they were passed
+	uint32_t dropped;			// frames that were larger than the ring
+	int32_t recording;			// 1 while frames are taken into the current event
+} event_recorder_stats_t;
+
+/**
+ * keep compressed(MJPEG) frames of last pre_event_ns in fixed size memory ring
+ * and pass nothing to the next pipeline until #trigger is called.
+ * on trigger, frames from pre_event_ns before the trigger to post_event_ns after the trigger
+ * (extended by further triggers) are passed to the next pipeline(e.g. AVIRecorderPipeline).
+ * the ring is allocated on construction and bounded by both bytes and number of frames,
+ * so memory usage does not grow however long this runs.
+ * frames are passed only while the next pipeline has credits so that the handler thread
+ * never blocks, and queueFrame never waits for the ring.
+ */
+class EventRecorderPipeline : virtual public AbstractBufferedPipeline {
+private:
+	typedef struct ring_record {
+		nsecs_t dtime;				// time when the frame was taken into the ring
+		uint32_t offset;
+		uint32_t bytes;
+		uvc_frame_format format;
+		uint32_t width;
+		uint32_t height;
+		uint32_t step;
+		uint32_t sequence;
+		struct timeval capture_time;
+	} ring_record_t;
+
+	const uint32_t ring_bytes;
+	const uint32_t max_records;
+	const nsecs_t pre_event_ns;
+	const nsecs_t post_event_ns;
+	uint8_t *ring;
+	ring_record_t *records;
+	// guard the ring, this is held by the handler thread and by #getEventStats/#isRecording only,
+	// the handler thread never passes frames to the next pipeline while holding this
+	mutable Mutex ring_mutex;
+	// records are identified by serial number and stored at records[id % max_records]
+	uint64_t head_id;				// oldest record
+	uint64_t tail_id;				// next record
+	uint64_t flush_id;				// next record to pass to the next pipeline
+	uint64_t event_end_id;			// records of [flush_id, event_end_id) are pending
+	uint32_t write_offset;
+	uint32_t used_bytes;
+	bool recording;
+	nsecs_t post_event_end;
+	volatile nsecs_t pending_trigger;	// set by #trigger, taken by the handler thread
+	volatile uint32_t triggers, events, flushed, evicted, lost, dropped;
+
+	inline ring_record_t &record_of(const uint64_t &id) const { return records[id % max_records]; };
+	bool fits(const uint32_t &bytes) const;
+	void evict_oldest();
+	void evict_expired(const nsecs_t &now);
+	int store(uvc_frame_t *frame, const nsecs_t &now);
+	void start_event(const nsecs_t &trigger_time);
+	void pass_frame(const ring_record_t &rec);
+	int flush();
+	void drain();
+protected:
+	virtual void on_start();
+	virtual void on_stop();
+	virtual int handle_frame(uvc_frame_t *frame);
+public:
+	EventRecorderPipeline(const size_t &ring_bytes = DEFAULT_EVENT_RING_SZ,
+		const nsecs_t &pre_event_ns = DEFAULT_PRE_EVENT_NSEC, const nsecs_t &post_event_ns = DEFAULT_POST_EVENT_NSEC,
+		const int &max_ring_frames = DEFAULT_EVENT_RING_FRAMES, const size_t &_data_bytes = DEFAULT_FRAME_SZ);
+	virtual ~EventRecorderPipeline();
+	/**
+	 * start new event or extend the current event, this never blocks and can be called from any thread
+	 */
+	int trigger();
+	bool isRecording() const;
+	void getEventStats(event_recorder_stats_t *stats) const;
+};
+
+#endif //PUPILMOBILE_EVENTRECORDERPIPELINE_H
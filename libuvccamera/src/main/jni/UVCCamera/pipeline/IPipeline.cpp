@@ -79,3 +79,38 @@ int IPipeline::chain_frame(uvc_frame_t *frame) {
 
 	RETURN(result, int);
 }
+
+/**
+ * set reference counted frame to next_pipeline
+ */
+int IPipeline::chain_shared_frame(SharedFrame *frame) {
+	ENTER();
+
+	int result = -1;
+	Mutex::Autolock lock(pipeline_mutex);
+
+	if (next_pipeline) {
+		next_pipeline->queueSharedFrame(frame);
+		result = 0;
+	}
+
+	RETURN(result, int);
+}
+
+/*protected*/
+int IPipeline::next_credits() const {
+	Mutex::Autolock lock(pipeline_mutex);
+	return next_pipeline ? next_pipeline->getCredits() : PIPELINE_CREDITS_UNLIMITED;
+}
+
+/*public*/
+int IPipeline::queueSharedFrame(SharedFrame *frame) {
+	ENTER();
+
+	int result = UVC_ERROR_OTHER;
+	if (LIKELY(frame)) {
+		result = queueFrame(frame->get());
+	}
+
+	RETURN(result, int);
+}
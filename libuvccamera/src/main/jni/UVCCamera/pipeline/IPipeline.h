@@ -10,22 +10,28 @@
 #include "Mutex.h"
 
 #include "libUVCCamera.h"
+#include "SharedFrame.h"
 
 #pragma interface
 
 using namespace android;
 
 #define DEFAULT_FRAME_SZ 1024
+#define PIPELINE_CREDITS_UNLIMITED 0x7fffffff
 
 typedef enum pipeline_type {
 	PIPELINE_TYPE_SIMPLE_BUFFERED = 0,
 	PIPELINE_TYPE_SQLITE_BUFFERED = 10,
+	PIPELINE_TYPE_MMAP_BUFFERED = 20,
 	PIPELINE_TYPE_UVC_CONTROL = 100,
 	PIPELINE_TYPE_CALLBACK = 200,
 	PIPELINE_TYPE_CONVERT = 300,
 	PIPELINE_TYPE_PREVIEW = 400,
 	PIPELINE_TYPE_PUBLISHER = 500,
 	PIPELINE_TYPE_DISTRIBUTE = 600,
+	PIPELINE_TYPE_AVI_RECORDER = 700,
+	PIPELINE_TYPE_EVENT_RECORDER = 710,
+	PIPELINE_TYPE_GRAPH = 800,
 } pipeline_type_t;
 
 typedef enum _pipeline_state {
@@ -54,10 +60,19 @@ protected:
 	/**
 	 * if handle_frame return 0, handler_thread call this function
 	 * set frame to next pipeline
-	 * this may block caller thread while the pipeline is full
+	 * this may block caller thread or the frame may be dropped while the pipeline is full,
+	 * check next_credits before doing work for the frame to avoid it
 	 * @return 0: success queueing, other: failed
 	 */
 	virtual int chain_frame(uvc_frame_t *frame);
+	/**
+	 * same as chain_frame but pass the reference counted frame to next pipeline without copying
+	 */
+	virtual int chain_shared_frame(SharedFrame *frame);
+	/**
+	 * credits that next pipeline grants, PIPELINE_CREDITS_UNLIMITED if there is no next pipeline
+	 */
+	int next_credits() const;
 public:
 	IPipeline(const size_t &default_frame_size = DEFAULT_FRAME_SZ);
 	virtual ~IPipeline();
@@ -68,6 +83,18 @@ public:
 	virtual int start() { return 0; };
 	virtual int stop() { return 0; };
 	virtual int queueFrame(uvc_frame_t *frame) = 0;
+	/**
+	 * queue reference counted read only frame, the caller keeps its own reference
+	 * and the pipeline should call addRef if it needs the frame after returning.
+	 * default implementation just passes the source frame to queueFrame
+	 */
+	virtual int queueSharedFrame(SharedFrame *frame);
+	/**
+	 * number of frames that this pipeline can accept now without dropping or blocking.
+	 * upstream pipeline can skip or reduce its work while this returns 0
+	 * default implementation returns PIPELINE_CREDITS_UNLIMITED(synchronous pipeline)
+	 */
+	virtual int getCredits() const { return PIPELINE_CREDITS_UNLIMITED; };
 };
 
 
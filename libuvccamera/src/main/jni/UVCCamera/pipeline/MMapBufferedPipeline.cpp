@@ -0,0 +1,652 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: MMapBufferedPipeline.cpp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#if 1	// set 1 if you don't need debug message
+	#ifndef LOG_NDEBUG
+		#define	LOG_NDEBUG		// ignore LOGV/LOGD/MARK
+	#endif
+	#undef USE_LOGALL
+#else
+	#define USE_LOGALL
+	#undef LOG_NDEBUG
+	#undef NDEBUG		// depends on definition in Android.mk and Application.mk
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+#include "utilbase.h"
+#include "common_utils.h"
+
+#include "libUVCCamera.h"
+#include "pipeline_helper.h"
+#include "MMapBufferedPipeline.h"
+
+#ifndef O_LARGEFILE
+#define O_LARGEFILE 0
+#endif
+
+#define INIT_FRAME_POOL_SZ 2
+#define MAX_FRAME_NUM 8
+#define SEGMENT_MAGIC 0x53435655	// 'UVCS'
+#define RECORD_MAGIC 0x52435655		// 'UVCR'
+#define SEGMENT_VERSION 2
+#define RECORD_ALIGN 8
+// initial capacity of index of each segment, 32MB segment keeps around 100 frames of 1080p MJPEG
+#define INDEX_RESERVE 256
+#define ZERO_FILL_SZ (64 * 1024)
+#define BOOT_ID_PATH "/proc/sys/kernel/random/boot_id"
+
+static inline uint32_t align_record(const uint32_t &bytes) {
+	return (bytes + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1);
+}
+
+/**
+ * read random id that kernel generates on each boot, like "1d2c9f7e-6b1a-4a5e-9d3f-0c8e2b7a4f61"
+ * @return 0 on success, id is cleared on failure
+ */
+static int read_boot_id(uint8_t *id) {
+	memset(id, 0, BOOT_ID_BYTES);
+	char buf[64];
+	const int fd = open(BOOT_ID_PATH, O_RDONLY);
+	if (UNLIKELY(fd < 0)) {
+		LOGW("failed to open %s:errno=%d", BOOT_ID_PATH, errno);
+		return -1;
+	}
+	const ssize_t n = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	int digits = 0;
+	for (ssize_t i = 0; (i < n) && (digits < BOOT_ID_BYTES * 2); i++) {
+		const char c = buf[i];
+		int v;
+		if ((c >= '0') && (c <= '9')) v = c - '0';
+		else if ((c >= 'a') && (c <= 'f')) v = c - 'a' + 10;
+		else if ((c >= 'A') && (c <= 'F')) v = c - 'A' + 10;
+		else continue;
+		id[digits / 2] = (id[digits / 2] << 4) | v;
+		digits++;
+	}
+	if (UNLIKELY(digits != BOOT_ID_BYTES * 2)) {
+		LOGW("unexpected boot id");
+		memset(id, 0, BOOT_ID_BYTES);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * allocate file blocks so that writing to the mapping never fails with SIGBUS on full storage
+ */
+static int preallocate(const int &fd, const off64_t &bytes) {
+#if !defined(__ANDROID__) || (defined(__ANDROID_API__) && (__ANDROID_API__ >= 21))
+	if (LIKELY(!fallocate64(fd, 0, 0, bytes))) {
+		return 0;
+	}
+	LOGD("fallocate failed:errno=%d, fill with zero", errno);
+#endif
+	static const uint8_t zero[ZERO_FILL_SZ] = { 0 };
+	for (off64_t pos = 0; pos < bytes; ) {
+		const size_t n = bytes - pos < ZERO_FILL_SZ ? (size_t)(bytes - pos) : ZERO_FILL_SZ;
+		const ssize_t w = pwrite64(fd, zero, n, pos);
+		if (UNLIKELY(w < 0)) {
+			if (errno == EINTR) continue;
+			return -errno;
+		}
+		pos += w;
+	}
+	return 0;
+}
+
+/* public */
+MMapBufferedPipeline::MMapBufferedPipeline(const char *_dir_path,
+	const int &segment_num, const size_t &_segment_bytes,
+	const bool &clear, const size_t &_data_bytes)
+:	AbstractBufferedPipeline(MAX_FRAME_NUM, INIT_FRAME_POOL_SZ, _data_bytes),
+	dir_path(_dir_path),
+	segment_bytes(_segment_bytes <= MAX_SEGMENT_SZ ? align_record((uint32_t)_segment_bytes) : 0),
+	has_error(false),
+	current(0),
+	generation(0),
+	stored_frames(0), dropped_frames(0)
+{
+	ENTER();
+
+	read_boot_id(boot_id);
+	if (UNLIKELY(segment_bytes < sizeof(mmap_segment_header_t) + sizeof(mmap_record_header_t))) {
+		LOGE("invalid segment size:%zu", _segment_bytes);
+		has_error = true;
+	} else {
+		has_error = open_segments(segment_num > 1 ? segment_num : 2, clear) != 0;
+	}
+	if (UNLIKELY(has_error)) {
+		close_segments();
+	}
+	setState(PIPELINE_STATE_INITIALIZED);
+
+	EXIT();
+}
+
+/* public */
+MMapBufferedPipeline::~MMapBufferedPipeline() {
+	ENTER();
+
+	release();
+	close_segments();
+
+	EXIT();
+}
+
+/*public*/
+int MMapBufferedPipeline::getTimeRange(int64_t &oldest_dtime, int64_t &newest_dtime) const {
+	ENTER();
+
+	int result = -1;
+	Mutex::Autolock lock(segment_mutex);
+	const int n = segments.size();
+	for (int i = 1; i <= n; i++) {
+		const segment_t &seg = segments[(current + i) % n];
+		if (!seg.index.empty()) {
+			if (result) {
+				oldest_dtime = seg.index.front().dtime;
+				result = 0;
+			}
+			newest_dtime = seg.index.back().dtime;
+		}
+	}
+
+	RETURN(result, int);
+}
+
+/*public*/
+int MMapBufferedPipeline::forEachFrame(const int64_t &start_dtime, const int64_t &end_dtime,
+	mmap_frame_visitor_t visitor, void *user_data) const {
+
+	ENTER();
+
+	int result = 0;
+	Mutex::Autolock lock(segment_mutex);
+	const int n = segments.size();
+	// segments are in capture order from the next one of current segment
+	for (int i = 1; i <= n; i++) {
+		const segment_t &seg = segments[(current + i) % n];
+		if (seg.index.empty() || (seg.index.back().dtime < start_dtime)) {
+			continue;
+		}
+		if (seg.index.front().dtime >= end_dtime) {
+			continue;
+		}
+		const index_entry_t key = { start_dtime, 0 };
+		auto iter = std::lower_bound(seg.index.begin(), seg.index.end(), key, index_less);
+		for ( ; (iter != seg.index.end()) && (iter->dtime < end_dtime); iter++) {
+			const mmap_record_header_t *rec = (const mmap_record_header_t *)(seg.base + iter->offset);
+			const mmap_frame_t frame = {
+				rec->dtime, (uvc_frame_format)rec->format,
+				rec->width, rec->height, rec->sequence,
+				rec->data_bytes, (const uint8_t *)(rec + 1),
+			};
+			result++;
+			if (visitor(frame, user_data)) {
+				RETURN(result, int);
+			}
+		}
+	}
+
+	RETURN(result, int);
+}
+
+typedef struct chain_context {
+	IPipeline *next;
+	uvc_frame_t frame;
+} chain_context_t;
+
+/**
+ * wrap stored frame with uvc_frame_t without copying and pass it to the next pipeline
+ */
+static int chain_visitor(const mmap_frame_t &frame, void *user_data) {
+	chain_context_t *context = (chain_context_t *)user_data;
+	uvc_frame_t *uvc_frame = &context->frame;
+	uvc_frame->data = (void *)frame.data;	// the next pipeline only reads(copies) this
+	uvc_frame->data_bytes = uvc_frame->actual_bytes = frame.data_bytes;
+	uvc_frame->frame_format = frame.format;
+	uvc_frame->width = frame.width;
+	uvc_frame->height = frame.height;
+	uvc_frame->sequence = frame.sequence;
+	uvc_frame->capture_time.tv_sec = frame.dtime / 1000000LL;
+	uvc_frame->capture_time.tv_usec = frame.dtime % 1000000LL;
+	context->next->queueFrame(uvc_frame);
+	return 0;
+}
+
+/*public*/
+int MMapBufferedPipeline::chainFrames(const int64_t &start_dtime, const int64_t &end_dtime) {
+	ENTER();
+
+	int result = 0;
+	Mutex::Autolock lock(pipeline_mutex);
+	if (next_pipeline) {
+		chain_context_t context;
+		memset(&context, 0, sizeof(context));
+		context.next = next_pipeline;
+		context.frame.library_owns_data = 0;
+		result = forEachFrame(start_dtime, end_dtime, chain_visitor, &context);
+	}
+
+	RETURN(result, int);
+}
+
+/*public*/
+void MMapBufferedPipeline::clear() {
+	ENTER();
+
+	Mutex::Autolock lock(segment_mutex);
+	for (auto iter = segments.begin(); iter != segments.end(); iter++) {
+		header_of(*iter)->generation = 0;
+		iter->write_offset = sizeof(mmap_segment_header_t);
+		iter->index.clear();
+	}
+	// generation keeps increasing so that old records never become valid again
+	current = segments.size() - 1;
+
+	EXIT();
+}
+
+//********************************************************************************
+//
+//********************************************************************************
+/* override protected */
+void MMapBufferedPipeline::on_start() {
+	ENTER();
+
+	stored_frames = dropped_frames = 0;
+
+	EXIT();
+}
+
+/* override protected */
+void MMapBufferedPipeline::on_stop() {
+	ENTER();
+
+	Mutex::Autolock lock(segment_mutex);
+	if (LIKELY(!segments.empty())) {
+		const segment_t &seg = segments[current];
+		msync(seg.base, seg.write_offset, MS_ASYNC);
+	}
+	LOGI("stored=%u,dropped=%u", stored_frames, dropped_frames);
+
+	EXIT();
+}
+
+/* override protected */
+int MMapBufferedPipeline::handle_frame(uvc_frame_t *frame) {
+	ENTER();
+
+	if (LIKELY(!has_error)) {
+		append(frame);
+	}
+
+	RETURN(0, int);	// pass through to the next pipeline
+}
+
+//********************************************************************************
+//
+//********************************************************************************
+/*private*/
+int MMapBufferedPipeline::open_segments(const int &segment_num, const bool &clear) {
+	ENTER();
+
+	if (UNLIKELY(mkdir(dir_path.c_str(), 0770) && (errno != EEXIST))) {
+		LOGE("failed to create %s:errno=%d", dir_path.c_str(), errno);
+		RETURN(-errno, int);
+	}
+	segments.resize(segment_num);
+	for (int i = 0; i < segment_num; i++) {
+		segment_t &seg = segments[i];
+		seg.fd = -1;
+		seg.base = NULL;
+		seg.write_offset = sizeof(mmap_segment_header_t);
+		seg.index.reserve(INDEX_RESERVE);
+	}
+	uint64_t max_generation = 0;
+	int max_index = segment_num - 1;
+	char path[PATH_MAX];
+	for (int i = 0; i < segment_num; i++) {
+		segment_t &seg = segments[i];
+		snprintf(path, sizeof(path), "%s/segment%02d.dat", dir_path.c_str(), i);
+		seg.fd = open(path, O_RDWR | O_CREAT | O_LARGEFILE, 0644);
+		struct stat st;
+		if (UNLIKELY((seg.fd < 0) || fstat(seg.fd, &st))) {
+			LOGE("failed to open %s:errno=%d", path, errno);
+			RETURN(-errno, int);
+		}
+		const bool created = st.st_size != (off_t)segment_bytes;
+		if (created) {
+			if (UNLIKELY(ftruncate(seg.fd, segment_bytes) || preallocate(seg.fd, segment_bytes))) {
+				LOGE("failed to allocate %s:errno=%d", path, errno);
+				RETURN(-errno, int);
+			}
+		}
+		void *base = mmap(NULL, segment_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, seg.fd, 0);
+		if (UNLIKELY(base == MAP_FAILED)) {
+			LOGE("failed to map %s:errno=%d", path, errno);
+			RETURN(-errno, int);
+		}
+		seg.base = (uint8_t *)base;
+		mmap_segment_header_t *header = header_of(seg);
+		if (created || clear || (header->magic != SEGMENT_MAGIC)
+			|| (header->version != SEGMENT_VERSION) || (header->segment_bytes != segment_bytes)) {
+
+			memset(header, 0, sizeof(mmap_segment_header_t));
+			header->magic = SEGMENT_MAGIC;
+			header->version = SEGMENT_VERSION;
+			header->segment_bytes = segment_bytes;
+			memcpy(header->boot_id, boot_id, BOOT_ID_BYTES);
+		} else if (!is_current_boot(header)) {
+			// keep generation so that it keeps increasing,
+			// but mark the segment as full so that it is not appended to
+			LOGI("discard %s that was written before reboot", path);
+			seg.write_offset = segment_bytes;
+		} else {
+			const int n = recover_segment(seg);
+			if (n > 0) {
+				LOGI("recovered %d frame(s) from %s", n, path);
+			}
+		}
+		if (header->generation > max_generation) {
+			max_generation = header->generation;
+			max_index = i;
+		}
+	}
+	// continue appending to the newest segment
+	current = max_index;
+	generation = max_generation;
+
+	RETURN(0, int);
+}
+
+/*private*/
+void MMapBufferedPipeline::close_segments() {
+	ENTER();
+
+	Mutex::Autolock lock(segment_mutex);
+	for (auto iter = segments.begin(); iter != segments.end(); iter++) {
+		if (iter->base) {
+			msync(iter->base, segment_bytes, MS_SYNC);
+			munmap(iter->base, segment_bytes);
+			iter->base = NULL;
+		}
+		if (iter->fd >= 0) {
+			close(iter->fd);
+			iter->fd = -1;
+		}
+	}
+	segments.clear();
+	current = 0;
+
+	EXIT();
+}
+
+/**
+ * whether the segment was written in this boot, false if boot id is unknown
+ */
+/*private*/
+bool MMapBufferedPipeline::is_current_boot(const mmap_segment_header_t *header) const {
+	static const uint8_t unknown[BOOT_ID_BYTES] = { 0 };
+	return memcmp(boot_id, unknown, BOOT_ID_BYTES)
+		&& !memcmp(header->boot_id, boot_id, BOOT_ID_BYTES);
+}
+
+/**
+ * rebuild index of the segment from valid records,
+ * scanning stops at the first partially written record or a record of previous generation
+ * @return number of valid records
+ */
+/*private*/
+int MMapBufferedPipeline::recover_segment(segment_t &seg) {
+	const mmap_segment_header_t *header = header_of(seg);
+	uint32_t offset = sizeof(mmap_segment_header_t);
+	seg.index.clear();
+	if (header->generation) {
+		for ( ; offset + sizeof(mmap_record_header_t) <= segment_bytes ; ) {
+			const mmap_record_header_t *rec = (const mmap_record_header_t *)(seg.base + offset);
+			if ((rec->magic != RECORD_MAGIC) || (rec->generation != header->generation)
+				|| (rec->data_bytes > segment_bytes - offset - sizeof(mmap_record_header_t))) {
+				break;
+			}
+			const index_entry_t entry = { rec->dtime, offset };
+			seg.index.push_back(entry);
+			offset += align_record(sizeof(mmap_record_header_t) + rec->data_bytes);
+		}
+	}
+	seg.write_offset = offset;
+	return seg.index.size();
+}
+
+/**
+ * start writing to the oldest segment, should be called with segment_mutex locked
+ */
+/*private*/
+int MMapBufferedPipeline::next_segment() {
+	if (generation) {
+		// flush finished segment asynchronously
+		const segment_t &prev = segments[current];
+		msync(prev.base, prev.write_offset, MS_ASYNC);
+	}
+	current = (current + 1) % segments.size();
+	generation++;
+	segment_t &seg = segments[current];
+	mmap_segment_header_t *header = header_of(seg);
+	// records of previous generation become invalid by updating generation of the segment,
+	// clear it first so that records of previous boot never look like records of this boot
+	__atomic_store_n(&header->generation, 0, __ATOMIC_RELEASE);
+	memcpy(header->boot_id, boot_id, BOOT_ID_BYTES);
+	__atomic_store_n(&header->generation, generation, __ATOMIC_RELEASE);
+	seg.write_offset = sizeof(mmap_segment_header_t);
+	seg.index.clear();
+	return current;
+}
+
+/*private*/
+int MMapBufferedPipeline::append(uvc_frame_t *frame) {
+	const uint32_t bytes = align_record(sizeof(mmap_record_header_t) + frame->actual_bytes);
+	if (UNLIKELY(bytes > segment_bytes - sizeof(mmap_segment_header_t))) {
+		LOGW("frame is too large:%d", (int)frame->actual_bytes);
+		__atomic_add_fetch(&dropped_frames, 1, __ATOMIC_RELAXED);
+		return -1;
+	}
+	Mutex::Autolock lock(segment_mutex);
+	if (UNLIKELY(segments.empty())) {
+		return -1;
+	}
+	if (!generation
+		|| (header_of(segments[current])->generation != generation)
+		|| (segments[current].write_offset + bytes > segment_bytes)) {
+
+		next_segment();
+	}
+	segment_t &seg = segments[current];
+	mmap_record_header_t *rec = (mmap_record_header_t *)(seg.base + seg.write_offset);
+	rec->magic = 0;
+	rec->data_bytes = frame->actual_bytes;
+	rec->generation = generation;
+	rec->dtime = int64_t(frame->capture_time.tv_sec) * 1000000LL + int64_t(frame->capture_time.tv_usec);
+	rec->format = frame->frame_format;
+	rec->width = frame->width;
+	rec->height = frame->height;
+	rec->sequence = frame->sequence;
+	memcpy(rec + 1, frame->data, frame->actual_bytes);
+	// the record becomes valid when magic is written
+	__atomic_store_n(&rec->magic, RECORD_MAGIC, __ATOMIC_RELEASE);
+	const index_entry_t entry = { rec->dtime, seg.write_offset };
+	seg.index.push_back(entry);
+	seg.write_offset += bytes;
+	__atomic_add_fetch(&stored_frames, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+//********************************************************************************
+//
+//********************************************************************************
+static ID_TYPE nativeCreate(JNIEnv *env, jobject thiz,
+	jstring dir_path_str, jint segment_num, jint segment_mb, jboolean clear) {
+
+	ENTER();
+
+	const char *c_dir_path = env->GetStringUTFChars(dir_path_str, JNI_FALSE);
+	MMapBufferedPipeline *pipeline = new MMapBufferedPipeline(c_dir_path,
+		segment_num, (size_t)segment_mb * 1024 * 1024, clear);
+	env->ReleaseStringUTFChars(dir_path_str, c_dir_path);
+	setField_long(env, thiz, "mNativePtr", reinterpret_cast<ID_TYPE>(pipeline));
+
+	RETURN(reinterpret_cast<ID_TYPE>(pipeline), ID_TYPE);
+}
+
+static void nativeDestroy(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline) {
+
+	ENTER();
+	setField_long(env, thiz, "mNativePtr", 0);
+	MMapBufferedPipeline *pipeline = reinterpret_cast<MMapBufferedPipeline *>(id_pipeline);
+	if (LIKELY(pipeline)) {
+		pipeline->release();
+		SAFE_DELETE(pipeline);
+	}
+	EXIT();
+}
+
+static jint nativeGetState(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline) {
+
+	ENTER();
+	jint result = 0;
+	MMapBufferedPipeline *pipeline = reinterpret_cast<MMapBufferedPipeline *>(id_pipeline);
+	if (LIKELY(pipeline)) {
+		result = pipeline->getState();
+	}
+	RETURN(result, jint);
+}
+
+static jint nativeSetPipeline(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline, jobject pipeline_obj) {
+
+	ENTER();
+	jint result = JNI_ERR;
+	MMapBufferedPipeline *pipeline = reinterpret_cast<MMapBufferedPipeline *>(id_pipeline);
+	if (pipeline) {
+		IPipeline *target_pipeline = getPipeline(env, pipeline_obj);
+		result = pipeline->setPipeline(target_pipeline);
+	}
+
+	RETURN(result, jint);
+}
+
+static jint nativeStart(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline) {
+
+	ENTER();
+
+	int result = JNI_ERR;
+	MMapBufferedPipeline *pipeline = reinterpret_cast<MMapBufferedPipeline *>(id_pipeline);
+	if (LIKELY(pipeline)) {
+		result = pipeline->start();
+	}
+
+	RETURN(result, jint);
+}
+
+static jint nativeStop(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline) {
+
+	ENTER();
+
+	jint result = JNI_ERR;
+	MMapBufferedPipeline *pipeline = reinterpret_cast<MMapBufferedPipeline *>(id_pipeline);
+	if (LIKELY(pipeline)) {
+		result = pipeline->stop();
+	}
+
+	RETURN(result, jint);
+}
+
+static jint nativeGetTimeRange(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline, jlongArray range_array) {
+
+	ENTER();
+
+	jint result = JNI_ERR;
+	MMapBufferedPipeline *pipeline = reinterpret_cast<MMapBufferedPipeline *>(id_pipeline);
+	if (LIKELY(pipeline && range_array && (env->GetArrayLength(range_array) >= 2))) {
+		int64_t oldest, newest;
+		result = pipeline->getTimeRange(oldest, newest);
+		if (!result) {
+			const jlong range[2] = { oldest, newest };
+			env->SetLongArrayRegion(range_array, 0, 2, range);
+		}
+	}
+
+	RETURN(result, jint);
+}
+
+static jint nativeChainFrames(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline, jlong start_us, jlong end_us) {
+
+	ENTER();
+
+	jint result = JNI_ERR;
+	MMapBufferedPipeline *pipeline = reinterpret_cast<MMapBufferedPipeline *>(id_pipeline);
+	if (LIKELY(pipeline)) {
+		result = pipeline->chainFrames(start_us, end_us);
+	}
+
+	RETURN(result, jint);
+}
+
+//================================================================================
+static JNINativeMethod methods[] = {
+	{ "nativeCreate", 		"(Ljava/lang/String;IIZ)J", (void *) nativeCreate},
+	{ "nativeDestroy",		"(J)V", (void *) nativeDestroy},
+	{ "nativeSetPipeline",	"(JLcom/serenegiant/usb/IPipeline;)I", (void *) nativeSetPipeline },
+
+	{ "nativeGetState",		"(J)I", (void *) nativeGetState },
+	{ "nativeStart",		"(J)I", (void *) nativeStart },
+	{ "nativeStop",			"(J)I", (void *) nativeStop },
+	{ "nativeGetTimeRange",	"(J[J)I", (void *) nativeGetTimeRange },
+	{ "nativeChainFrames",	"(JJJ)I", (void *) nativeChainFrames },
+};
+
+int register_mmap_buffered_pipeline(JNIEnv *env) {
+	LOGV("register MMapBufferedPipeline:");
+	if (registerNativeMethods(env,
+		"com/serenegiant/usb/MMapBufferedPipeline",
+		methods, NUM_ARRAY_ELEMENTS(methods)) < 0) {
+		return -1;
+	}
+    return 0;
+}
@@ -0,0 +1,170 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: MMapBufferedPipeline.h
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#ifndef PUPILMOBILE_MMAPBUFFEREDPIPELINE_H
+#define PUPILMOBILE_MMAPBUFFEREDPIPELINE_H
+
+#pragma interface
+
+#include <sys/types.h>
+#include <string>
+#include <vector>
+#include "Mutex.h"
+#include "Timers.h"
+
+#include "AbstractBufferedPipeline.h"
+
+using namespace android;
+
+#define DEFAULT_SEGMENT_NUM 8
+// 8 x 32MB keeps about 30 seconds of 1080p MJPEG
+#define DEFAULT_SEGMENT_SZ (32 * 1024 * 1024)
+// offsets in the segment are 32 bit
+#define MAX_SEGMENT_SZ (1024 * 1024 * 1024)
+#define BOOT_ID_BYTES 16
+
+/**
+ * header at the beginning of each segment file
+ */
+typedef struct mmap_segment_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t generation;		// increases each time a segment is reused, 0 means empty segment
+	uint32_t segment_bytes;
+	uint32_t reserved;
+	// capture time is CLOCK_MONOTONIC, so records are comparable only in the same boot
+	uint8_t boot_id[BOOT_ID_BYTES];
+} mmap_segment_header_t;
+
+/**
+ * header of each frame record, frame data follows this.
+ * magic is written last, so a record whose magic or generation does not match
+ * is a partially written record or an old record of previous generation.
+ */
+typedef struct mmap_record_header {
+	uint32_t magic;
+	uint32_t data_bytes;
+	uint64_t generation;
+	int64_t dtime;				// capture time [us]
+	uint32_t format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t sequence;
+} mmap_record_header_t;
+
+/**
+ * read only view of stored frame, data points into the mapped segment
+ */
+typedef struct mmap_frame {
+	int64_t dtime;
+	uvc_frame_format format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t sequence;
+	size_t data_bytes;
+	const uint8_t *data;
+} mmap_frame_t;
+
+/**
+ * called for each stored frame in the time range
+ * @return 0 to continue, other to stop iteration
+ */
+typedef int (*mmap_frame_visitor_t)(const mmap_frame_t &frame, void *user_data);
+
+/**
+ * keep latest frames in preallocated memory mapped segment files that are used as a circular log.
+ * appending is O(1) and the oldest segment is reused without clearing it.
+ * records are found with in-memory time index that is rebuilt from segment files on construction,
+ * so frames that were stored before crash are still available.
+ * segments that were written before reboot are discarded because their capture time has another origin.
+ * frames are passed through to the next pipeline after they are stored.
+ */
+class MMapBufferedPipeline : virtual public AbstractBufferedPipeline {
+private:
+	typedef struct index_entry {
+		int64_t dtime;
+		uint32_t offset;
+	} index_entry_t;
+
+	typedef struct segment {
+		int fd;
+		uint8_t *base;
+		uint32_t write_offset;
+		std::vector<index_entry_t> index;
+	} segment_t;
+
+	const std::string dir_path;
+	const uint32_t segment_bytes;
+	bool has_error;
+	uint8_t boot_id[BOOT_ID_BYTES];	// all zero if unknown
+	// guard segments, readers hold this while visiting frames
+	mutable Mutex segment_mutex;
+	std::vector<segment_t> segments;
+	int current;					// segment that frames are appended to
+	uint64_t generation;			// generation of current segment
+	volatile uint32_t stored_frames, dropped_frames;
+
+	int open_segments(const int &segment_num, const bool &clear);
+	void close_segments();
+	bool is_current_boot(const mmap_segment_header_t *header) const;
+	int recover_segment(segment_t &seg);
+	int next_segment();
+	int append(uvc_frame_t *frame);
+	static inline mmap_segment_header_t *header_of(const segment_t &seg) {
+		return (mmap_segment_header_t *)seg.base;
+	};
+	static inline bool index_less(const index_entry_t &a, const index_entry_t &b) {
+		return a.dtime < b.dtime;
+	};
+protected:
+	virtual void on_start();
+	virtual void on_stop();
+	virtual int handle_frame(uvc_frame_t *frame);
+public:
+	MMapBufferedPipeline(const char *dir_path,
+		const int &segment_num = DEFAULT_SEGMENT_NUM, const size_t &segment_bytes = DEFAULT_SEGMENT_SZ,
+		const bool &clear = false, const size_t &_data_bytes = DEFAULT_FRAME_SZ);
+	virtual ~MMapBufferedPipeline();
+	/**
+	 * capture time of the oldest and newest stored frames [us]
+	 * @return 0 if there are stored frames
+	 */
+	int getTimeRange(int64_t &oldest_dtime, int64_t &newest_dtime) const;
+	/**
+	 * visit stored frames of start_dtime <= dtime < end_dtime in capture order without copying.
+	 * appending new frames blocks while visiting, so visitor should not take long time.
+	 * @return number of visited frames
+	 */
+	int forEachFrame(const int64_t &start_dtime, const int64_t &end_dtime,
+		mmap_frame_visitor_t visitor, void *user_data) const;
+	/**
+	 * pass stored frames in the time range to the next pipeline
+	 * @return number of passed frames
+	 */
+	int chainFrames(const int64_t &start_dtime, const int64_t &end_dtime);
+	/** invalidate all stored frames */
+	void clear();
+};
+
+#endif //PUPILMOBILE_MMAPBUFFEREDPIPELINE_H
@@ -0,0 +1,929 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: PipelineGraph.cpp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#if 1	// set 1 if you don't need debug message
+	#ifndef LOG_NDEBUG
+		#define	LOG_NDEBUG		// ignore LOGV/LOGD/MARK
+	#endif
+	#undef USE_LOGALL
+#else
+	#define USE_LOGALL
+	#undef LOG_NDEBUG
+	#undef NDEBUG		// depends on definition in Android.mk and Application.mk
+#endif
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "utilbase.h"
+#include "common_utils.h"
+
+#include "libUVCCamera.h"
+#include "rapidjson/error/en.h"
+#include "pipeline_helper.h"
+#include "SimpleBufferedPipeline.h"
+#include "SQLiteBufferedPipeline.h"
+#include "MMapBufferedPipeline.h"
+#include "ConvertPipeline.h"
+#include "PublisherPipeline.h"
+#include "AVIRecorderPipeline.h"
+#include "EventRecorderPipeline.h"
+#include "PipelineGraph.h"
+
+using namespace rapidjson;
+
+#define MAX_ERROR_MESSAGE 256
+
+typedef enum param_kind {
+	PARAM_INT = 0,
+	PARAM_BOOL,
+	PARAM_STRING,
+	PARAM_CPUS,				// array of cpu number
+} param_kind_t;
+
+typedef struct stage_param {
+	const char *name;
+	param_kind_t kind;
+	bool required;
+	int min_value;			// only for PARAM_INT
+} stage_param_t;
+
+typedef struct stage_type {
+	const char *name;
+	const stage_param_t *params;
+	bool can_distribute;	// can have multiple next stages
+} stage_type_t;
+
+// parameters of the queue and the handler thread of AbstractBufferedPipeline
+#define QUEUE_PARAMS \
+	{ "overflow", PARAM_STRING, false, 0 }, \
+	{ "block_timeout_ms", PARAM_INT, false, 0 }, \
+	{ "backpressure", PARAM_STRING, false, 0 }, \
+	{ "max_latency_ms", PARAM_INT, false, 0 }, \
+	{ "cpus", PARAM_CPUS, false, 0 }
+
+static const stage_param_t SIMPLE_PARAMS[] = {
+	{ "max_frames", PARAM_INT, false, 1 },
+	{ "init_pool", PARAM_INT, false, 0 },
+	{ "frame_size", PARAM_INT, false, 1 },
+	{ "drop", PARAM_BOOL, false, 0 },
+	QUEUE_PARAMS,
+	{ NULL },
+};
+
+static const stage_param_t DISTRIBUTE_PARAMS[] = {
+	{ "max_frames", PARAM_INT, false, 1 },
+	{ "init_pool", PARAM_INT, false, 0 },
+	{ "frame_size", PARAM_INT, false, 1 },
+	{ "drop", PARAM_BOOL, false, 0 },
+	{ "branch_frames", PARAM_INT, false, 1 },
+	QUEUE_PARAMS,
+	{ NULL },
+};
+
+static const stage_param_t CONVERT_PARAMS[] = {
+	{ "frame_size", PARAM_INT, false, 1 },
+	{ "pixel_format", PARAM_INT, false, 0 },
+	QUEUE_PARAMS,
+	{ NULL },
+};
+
+static const stage_param_t AVI_RECORDER_PARAMS[] = {
+	{ "path", PARAM_STRING, true, 0 },
+	{ "frame_size", PARAM_INT, false, 1 },
+	QUEUE_PARAMS,
+	{ NULL },
+};
+
+static const stage_param_t EVENT_RECORDER_PARAMS[] = {
+	{ "ring_mb", PARAM_INT, false, 1 },
+	{ "ring_frames", PARAM_INT, false, 2 },
+	{ "pre_event_ms", PARAM_INT, false, 0 },
+	{ "post_event_ms", PARAM_INT, false, 0 },
+	{ "frame_size", PARAM_INT, false, 1 },
+	QUEUE_PARAMS,
+	{ NULL },
+};
+
+static const stage_param_t PUBLISHER_PARAMS[] = {
+	{ "frame_size", PARAM_INT, false, 1 },
+	{ "addr", PARAM_STRING, true, 0 },
+	{ "subscription", PARAM_STRING, true, 0 },
+	{ "ack_addr", PARAM_STRING, false, 0 },
+	{ "ack_window", PARAM_INT, false, 1 },
+	{ "ack_timeout_ms", PARAM_INT, false, 1 },
+	QUEUE_PARAMS,
+	{ NULL },
+};
+
+static const stage_param_t SQLITE_PARAMS[] = {
+	{ "database", PARAM_STRING, true, 0 },
+	{ "clear", PARAM_BOOL, false, 0 },
+	{ "batch_frames", PARAM_INT, false, 1 },
+	{ "batch_interval_ms", PARAM_INT, false, 0 },
+	{ "retention_ms", PARAM_INT, false, 0 },
+	{ "retention_mb", PARAM_INT, false, 0 },
+	{ NULL },
+};
+
+static const stage_param_t MMAP_PARAMS[] = {
+	{ "directory", PARAM_STRING, true, 0 },
+	{ "segments", PARAM_INT, false, 2 },
+	{ "segment_mb", PARAM_INT, false, 1 },
+	{ "clear", PARAM_BOOL, false, 0 },
+	{ "frame_size", PARAM_INT, false, 1 },
+	QUEUE_PARAMS,
+	{ NULL },
+};
+
+static const stage_type_t STAGE_TYPES[] = {
+	{ "simple", SIMPLE_PARAMS, false },
+	{ "distribute", DISTRIBUTE_PARAMS, true },
+	{ "convert", CONVERT_PARAMS, false },
+	{ "avi_recorder", AVI_RECORDER_PARAMS, false },
+	{ "event_recorder", EVENT_RECORDER_PARAMS, false },
+	{ "publisher", PUBLISHER_PARAMS, false },
+	{ "sqlite", SQLITE_PARAMS, false },
+	{ "mmap", MMAP_PARAMS, false },
+	{ NULL },
+};
+
+static const stage_type_t *find_type(const char *name) {
+	for (const stage_type_t *type = STAGE_TYPES; type->name; type++) {
+		if (!strcmp(type->name, name)) {
+			return type;
+		}
+	}
+	return NULL;
+}
+
+static const stage_param_t *find_param(const stage_type_t *type, const char *name) {
+	for (const stage_param_t *param = type->params; param->name; param++) {
+		if (!strcmp(param->name, name)) {
+			return param;
+		}
+	}
+	return NULL;
+}
+
+// parameters are already validated when these functions are called
+static int get_int(const Value &stage, const char *name, const int &default_value) {
+	return stage.HasMember(name) ? stage[name].GetInt() : default_value;
+}
+
+static bool get_bool(const Value &stage, const char *name, const bool &default_value) {
+	return stage.HasMember(name) ? stage[name].GetBool() : default_value;
+}
+
+static const char *get_string(const Value &stage, const char *name) {
+	return stage.HasMember(name) ? stage[name].GetString() : NULL;
+}
+
+static pipeline_overflow_policy_t parse_overflow(const char *value) {
+	if (!strcmp(value, "drop_oldest")) {
+		return OVERFLOW_DROP_OLDEST;
+	} else if (!strcmp(value, "block")) {
+		return OVERFLOW_BLOCK;
+	} else if (!strcmp(value, "drop_newest")) {
+		return OVERFLOW_DROP_NEWEST;
+	}
+	return (pipeline_overflow_policy_t)-1;
+}
+
+static pipeline_backpressure_policy_t parse_backpressure(const char *value) {
+	if (!strcmp(value, "skip")) {
+		return BACKPRESSURE_SKIP;
+	} else if (!strcmp(value, "decimate")) {
+		return BACKPRESSURE_DECIMATE;
+	} else if (!strcmp(value, "off")) {
+		return BACKPRESSURE_OFF;
+	}
+	return (pipeline_backpressure_policy_t)-1;
+}
+
+//********************************************************************************
+//
+//********************************************************************************
+/*public*/
+PipelineGraph::PipelineGraph()
+:	root(NULL),
+	root_pipeline(NULL)
+{
+	ENTER();
+
+	setState(PIPELINE_STATE_INITIALIZED);
+
+	EXIT();
+}
+
+/*public*/
+PipelineGraph::~PipelineGraph() {
+	ENTER();
+
+	release();
+
+	EXIT();
+}
+
+/**
+ * build the graph from JSON, this can be called only once
+ * @return 0 on success, the reason of failure can be obtained with getLastError
+ */
+/*public*/
+int PipelineGraph::build(const char *json) {
+	ENTER();
+
+	Mutex::Autolock lock(graph_mutex);
+
+	if (UNLIKELY(!nodes.empty())) {
+		RETURN(set_error("graph is already built"), int);
+	}
+	graph_node_t *new_root = NULL;
+	int result = build_nodes(json, nodes, nodes, &new_root);
+	if (LIKELY(!result)) {
+		if (isRunning()) {
+			start_subtree(new_root);
+		}
+		root = new_root;
+		pipeline_mutex.lock();
+		{
+			root_pipeline = new_root->pipeline;
+		}
+		pipeline_mutex.unlock();
+	}
+
+	RETURN(result, int);
+}
+
+/**
+ * replace the stage and all of its downstream stages with new subgraph without stopping
+ * the upstream stages. new stages are started before they are connected
+ * and old stages are stopped after they are disconnected, so no frames are lost at upstream.
+ * @param stage_id id of the stage to replace, this can be the root stage
+ * @param json description of new subgraph, same format as #build,
+ *        ids of stages should not conflict with the stages that are kept
+ */
+/*public*/
+int PipelineGraph::replace(const char *stage_id, const char *json) {
+	ENTER();
+
+	Mutex::Autolock lock(graph_mutex);
+
+	graph_node_t *old_node = stage_id ? find_node(nodes, stage_id) : NULL;
+	if (UNLIKELY(!old_node)) {
+		RETURN(set_error("stage '%s' not found", stage_id ? stage_id : "(null)"), int);
+	}
+	node_list_t old_nodes;
+	collect_subtree(old_node, old_nodes);
+	node_list_t kept;
+	for (auto iter = nodes.begin(); iter != nodes.end(); iter++) {
+		if (std::find(old_nodes.begin(), old_nodes.end(), *iter) == old_nodes.end()) {
+			kept.push_back(*iter);
+		}
+	}
+	node_list_t new_nodes;
+	graph_node_t *new_root = NULL;
+	int result = build_nodes(json, kept, new_nodes, &new_root);
+	if (UNLIKELY(result)) {
+		RETURN(result, int);
+	}
+	if (isRunning()) {
+		start_subtree(new_root);
+	}
+	// switch connection, after this the old subgraph never receives frames
+	graph_node_t *parent = old_node->parent;
+	if (!parent) {
+		root = new_root;
+		pipeline_mutex.lock();
+		{
+			root_pipeline = new_root->pipeline;
+		}
+		pipeline_mutex.unlock();
+	} else {
+		if (parent->distribute) {
+			parent->distribute->addPipeline(new_root->pipeline);
+			parent->distribute->removePipeline(old_node->pipeline);
+		} else {
+			parent->pipeline->setPipeline(new_root->pipeline);
+		}
+		std::replace(parent->children.begin(), parent->children.end(), old_node, new_root);
+		new_root->parent = parent;
+	}
+	stop_subtree(old_node);
+	delete_nodes(old_nodes);
+	kept.insert(kept.end(), new_nodes.begin(), new_nodes.end());
+	nodes.swap(kept);
+	LOGI("stage '%s' was replaced with %d stage(s)", stage_id, (int)new_nodes.size());
+
+	RETURN(0, int);
+}
+
+/**
+ * get the pipeline of specific stage to access stage specific functions
+ * @return NULL if not found, the pipeline is deleted when the stage is replaced
+ */
+/*public*/
+IPipeline *PipelineGraph::getStage(const char *stage_id) {
+	ENTER();
+
+	Mutex::Autolock lock(graph_mutex);
+	graph_node_t *node = stage_id ? find_node(nodes, stage_id) : NULL;
+
+	RETURN(node ? node->pipeline : NULL, IPipeline *);
+}
+
+/*public*/
+std::string PipelineGraph::getLastError() const {
+	Mutex::Autolock lock(graph_mutex);
+	return last_error;
+}
+
+/*public*/
+int PipelineGraph::release() {
+	ENTER();
+
+	setState(PIPELINE_STATE_RELEASING);
+	stop();
+	Mutex::Autolock lock(graph_mutex);
+	pipeline_mutex.lock();
+	{
+		root_pipeline = NULL;
+	}
+	pipeline_mutex.unlock();
+	root = NULL;
+	delete_nodes(nodes);
+	setState(PIPELINE_STATE_UNINITIALIZED);
+
+	RETURN(0, int);
+}
+
+/*public*/
+int PipelineGraph::start() {
+	ENTER();
+
+	Mutex::Autolock lock(graph_mutex);
+	if (!isRunning()) {
+		setState(PIPELINE_STATE_STARTING);
+		if (root) {
+			start_subtree(root);
+		}
+		mIsRunning = true;
+		setState(PIPELINE_STATE_RUNNING);
+	}
+
+	RETURN(0, int);
+}
+
+/*public*/
+int PipelineGraph::stop() {
+	ENTER();
+
+	Mutex::Autolock lock(graph_mutex);
+	if (isRunning()) {
+		setState(PIPELINE_STATE_STOPPING);
+		mIsRunning = false;
+		if (root) {
+			stop_subtree(root);
+		}
+		setState(PIPELINE_STATE_INITIALIZED);
+	}
+
+	RETURN(0, int);
+}
+
+/*public*/
+int PipelineGraph::queueFrame(uvc_frame_t *frame) {
+	int result = UVC_ERROR_OTHER;
+	Mutex::Autolock lock(pipeline_mutex);
+	if (LIKELY(root_pipeline)) {
+		result = root_pipeline->queueFrame(frame);
+	}
+	return result;
+}
+
+/*public*/
+int PipelineGraph::queueSharedFrame(SharedFrame *frame) {
+	int result = UVC_ERROR_OTHER;
+	Mutex::Autolock lock(pipeline_mutex);
+	if (LIKELY(root_pipeline)) {
+		result = root_pipeline->queueSharedFrame(frame);
+	}
+	return result;
+}
+
+/**
+ * credits of the root stage
+ */
+/*public*/
+int PipelineGraph::getCredits() const {
+	Mutex::Autolock lock(pipeline_mutex);
+	return root_pipeline ? root_pipeline->getCredits() : 0;
+}
+
+//********************************************************************************
+//
+//********************************************************************************
+/**
+ * keep error message and return UVC_ERROR_INVALID_PARAM
+ * should be called with graph_mutex locked
+ */
+/*private*/
+int PipelineGraph::set_error(const char *fmt, ...) {
+	char buf[MAX_ERROR_MESSAGE];
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, args);
+	va_end(args);
+	last_error = buf;
+	LOGE("%s", buf);
+	return UVC_ERROR_INVALID_PARAM;
+}
+
+/**
+ * check id, type and parameters of the stage
+ */
+/*private*/
+int PipelineGraph::validate_stage(const Value &stage, graph_node_t *node) {
+	if (UNLIKELY(!stage.IsObject())) {
+		return set_error("stage should be an object");
+	}
+	if (UNLIKELY(!stage.HasMember("id") || !stage["id"].IsString() || !stage["id"].GetStringLength())) {
+		return set_error("stage without id");
+	}
+	node->id = stage["id"].GetString();
+	if (UNLIKELY(!stage.HasMember("type") || !stage["type"].IsString())) {
+		return set_error("stage '%s' has no type", node->id.c_str());
+	}
+	const stage_type_t *type = find_type(stage["type"].GetString());
+	if (UNLIKELY(!type)) {
+		return set_error("stage '%s' has unknown type '%s'", node->id.c_str(), stage["type"].GetString());
+	}
+	node->type = type->name;
+	for (auto iter = stage.MemberBegin(); iter != stage.MemberEnd(); ++iter) {
+		const char *name = iter->name.GetString();
+		const Value &value = iter->value;
+		if (!strcmp(name, "id") || !strcmp(name, "type")) {
+			continue;
+		} else if (!strcmp(name, "next")) {
+			if (value.IsString()) {
+				node->next_ids.push_back(value.GetString());
+			} else if (value.IsArray()) {
+				for (SizeType i = 0; i < value.Size(); i++) {
+					if (UNLIKELY(!value[i].IsString())) {
+						return set_error("stage '%s' has invalid next", node->id.c_str());
+					}
+					node->next_ids.push_back(value[i].GetString());
+				}
+			} else {
+				return set_error("stage '%s' has invalid next", node->id.c_str());
+			}
+			continue;
+		}
+		const stage_param_t *param = find_param(type, name);
+		if (UNLIKELY(!param)) {
+			return set_error("stage '%s' has unknown parameter '%s'", node->id.c_str(), name);
+		}
+		bool valid = false;
+		switch (param->kind) {
+		case PARAM_INT:
+			valid = value.IsInt() && (value.GetInt() >= param->min_value)
+				&& (strcmp(name, "segment_mb") || (value.GetInt() <= MAX_SEGMENT_SZ / (1024 * 1024)));
+			break;
+		case PARAM_BOOL:
+			valid = value.IsBool();
+			break;
+		case PARAM_STRING:
+			valid = value.IsString()
+				&& (strcmp(name, "overflow") || ((int)parse_overflow(value.GetString()) >= 0))
+				&& (strcmp(name, "backpressure") || ((int)parse_backpressure(value.GetString()) >= 0));
+			break;
+		case PARAM_CPUS:
+			valid = value.IsArray();
+			for (SizeType i = 0; valid && (i < value.Size()); i++) {
+				valid = value[i].IsInt() && (value[i].GetInt() >= 0) && (value[i].GetInt() < 32);
+			}
+			break;
+		}
+		if (UNLIKELY(!valid)) {
+			return set_error("stage '%s' has invalid value for '%s'", node->id.c_str(), name);
+		}
+	}
+	for (const stage_param_t *param = type->params; param->name; param++) {
+		if (UNLIKELY(param->required && !stage.HasMember(param->name))) {
+			return set_error("stage '%s' requires '%s'", node->id.c_str(), param->name);
+		}
+	}
+	if (UNLIKELY((node->next_ids.size() > 1) && !type->can_distribute)) {
+		return set_error("stage '%s' of type '%s' can have only one next stage",
+			node->id.c_str(), type->name);
+	}
+	return 0;
+}
+
+/**
+ * create the pipeline of validated stage
+ */
+/*private*/
+IPipeline *PipelineGraph::create_pipeline(const Value &stage, graph_node_t *node) {
+	IPipeline *result = NULL;
+	AbstractBufferedPipeline *buffered = NULL;
+	const int frame_size = get_int(stage, "frame_size", DEFAULT_FRAME_SZ);
+	if (node->type == "simple") {
+		SimpleBufferedPipeline *pipeline = new SimpleBufferedPipeline(
+			get_int(stage, "max_frames", DEFAULT_MAX_FRAME_NUM),
+			get_int(stage, "init_pool", DEFAULT_INIT_FRAME_POOL_SZ),
+			frame_size, get_bool(stage, "drop", true));
+		buffered = pipeline;
+		result = pipeline;
+	} else if (node->type == "distribute") {
+		DistributePipeline *pipeline = new DistributePipeline(
+			get_int(stage, "max_frames", DEFAULT_MAX_FRAME_NUM),
+			get_int(stage, "init_pool", DEFAULT_INIT_FRAME_POOL_SZ),
+			frame_size, get_bool(stage, "drop", true),
+			get_int(stage, "branch_frames", DEFAULT_BRANCH_FRAME_NUM));
+		node->distribute = pipeline;
+		buffered = pipeline;
+		result = pipeline;
+	} else if (node->type == "convert") {
+		ConvertPipeline *pipeline = new ConvertPipeline(frame_size,
+			get_int(stage, "pixel_format", PIXEL_FORMAT_RAW));
+		buffered = pipeline;
+		result = pipeline;
+	} else if (node->type == "avi_recorder") {
+		AVIRecorderPipeline *pipeline = new AVIRecorderPipeline(get_string(stage, "path"), frame_size);
+		buffered = pipeline;
+		result = pipeline;
+	} else if (node->type == "event_recorder") {
+		EventRecorderPipeline *pipeline = new EventRecorderPipeline(
+			(size_t)get_int(stage, "ring_mb", DEFAULT_EVENT_RING_SZ / (1024 * 1024)) * 1024 * 1024,
+			(nsecs_t)get_int(stage, "pre_event_ms", (int)(DEFAULT_PRE_EVENT_NSEC / 1000000LL)) * 1000000LL,
+			(nsecs_t)get_int(stage, "post_event_ms", (int)(DEFAULT_POST_EVENT_NSEC / 1000000LL)) * 1000000LL,
+			get_int(stage, "ring_frames", DEFAULT_EVENT_RING_FRAMES), frame_size);
+		buffered = pipeline;
+		result = pipeline;
+	} else if (node->type == "publisher") {
+		PublisherPipeline *pipeline = new PublisherPipeline(frame_size,
+			get_string(stage, "addr"), get_string(stage, "subscription"));
+		if (stage.HasMember("ack_addr")) {
+			pipeline->setFlowControl(get_string(stage, "ack_addr"),
+				get_int(stage, "ack_window", DEFAULT_ACK_WINDOW),
+				(nsecs_t)get_int(stage, "ack_timeout_ms", (int)(DEFAULT_ACK_TIMEOUT_NSEC / 1000000LL)) * 1000000LL);
+		}
+		buffered = pipeline;
+		result = pipeline;
+	} else if (node->type == "sqlite") {
+		SQLiteBufferedPipeline *pipeline = new SQLiteBufferedPipeline(get_string(stage, "database"), get_bool(stage, "clear", false));
+		pipeline->setBatch(get_int(stage, "batch_frames", DEFAULT_BATCH_FRAMES),
+			(nsecs_t)get_int(stage, "batch_interval_ms", (int)(DEFAULT_BATCH_INTERVAL_NSEC / 1000000LL)) * 1000000LL);
+		pipeline->setRetention((nsecs_t)get_int(stage, "retention_ms", (int)(DTIME_LIMIT_NSEC / 1000000LL)) * 1000000LL,
+			(int64_t)get_int(stage, "retention_mb", 0) * 1024 * 1024);
+		result = pipeline;
+	} else if (node->type == "mmap") {
+		MMapBufferedPipeline *pipeline = new MMapBufferedPipeline(get_string(stage, "directory"),
+			get_int(stage, "segments", DEFAULT_SEGMENT_NUM),
+			(size_t)get_int(stage, "segment_mb", DEFAULT_SEGMENT_SZ / (1024 * 1024)) * 1024 * 1024,
+			get_bool(stage, "clear", false), frame_size);
+		buffered = pipeline;
+		result = pipeline;
+	}
+	if (buffered) {
+		if (stage.HasMember("overflow")) {
+			buffered->setOverflowPolicy(parse_overflow(get_string(stage, "overflow")),
+				(nsecs_t)get_int(stage, "block_timeout_ms", 0) * 1000000LL);
+		}
+		if (stage.HasMember("backpressure") || stage.HasMember("max_latency_ms")) {
+			buffered->setBackpressure(
+				stage.HasMember("backpressure") ? parse_backpressure(get_string(stage, "backpressure")) : BACKPRESSURE_OFF,
+				(nsecs_t)get_int(stage, "max_latency_ms", 0) * 1000000LL);
+		}
+		if (stage.HasMember("cpus")) {
+			const Value &cpus = stage["cpus"];
+			uint32_t mask = 0;
+			for (SizeType i = 0; i < cpus.Size(); i++) {
+				mask |= (1u << cpus[i].GetInt());
+			}
+			buffered->setThreadAffinity(mask);
+		}
+	}
+	return result;
+}
+
+/**
+ * parse and validate JSON, then create and connect pipelines.
+ * nothing is created if the description has any error.
+ * should be called with graph_mutex locked
+ * @param existing stages that already exist, ids should not conflict with them
+ * @param result created stages are appended
+ * @param result_root root stage of created stages
+ */
+/*private*/
+int PipelineGraph::build_nodes(const char *json, const node_list_t &existing,
+	node_list_t &result, graph_node_t **result_root) {
+
+	if (UNLIKELY(!json)) {
+		return set_error("no graph description");
+	}
+	Document doc;
+	doc.Parse(json);
+	if (UNLIKELY(doc.HasParseError())) {
+		return set_error("JSON parse error at %u:%s",
+			(unsigned)doc.GetErrorOffset(), GetParseError_En(doc.GetParseError()));
+	}
+	if (UNLIKELY(!doc.IsObject() || !doc.HasMember("stages")
+		|| !doc["stages"].IsArray() || !doc["stages"].Size())) {
+
+		return set_error("graph description should have array of stages");
+	}
+	const Value &stages = doc["stages"];
+	node_list_t parsed;
+	int err = 0;
+	// validate all stages
+	for (SizeType i = 0; !err && (i < stages.Size()); i++) {
+		graph_node_t *node = new graph_node_t();
+		node->pipeline = NULL;
+		node->distribute = NULL;
+		node->parent = NULL;
+		parsed.push_back(node);
+		err = validate_stage(stages[i], node);
+		if (!err && (find_node(existing, node->id) || (find_node(parsed, node->id) != node))) {
+			err = set_error("duplicate stage id '%s'", node->id.c_str());
+		}
+	}
+	// connect stages
+	for (auto iter = parsed.begin(); !err && (iter != parsed.end()); iter++) {
+		graph_node_t *node = *iter;
+		for (auto id = node->next_ids.begin(); !err && (id != node->next_ids.end()); id++) {
+			graph_node_t *child = find_node(parsed, *id);
+			if (UNLIKELY(!child || (child == node))) {
+				err = set_error("stage '%s' has invalid next stage '%s'", node->id.c_str(), id->c_str());
+			} else if (UNLIKELY(child->parent)) {
+				err = set_error("stage '%s' has multiple upstream stages", child->id.c_str());
+			} else {
+				child->parent = node;
+				node->children.push_back(child);
+			}
+		}
+	}
+	graph_node_t *new_root = NULL;
+	if (!err) {
+		if (doc.HasMember("root")) {
+			new_root = doc["root"].IsString() ? find_node(parsed, doc["root"].GetString()) : NULL;
+			if (UNLIKELY(!new_root || new_root->parent)) {
+				err = set_error("invalid root stage");
+			}
+		} else {
+			for (auto iter = parsed.begin(); !err && (iter != parsed.end()); iter++) {
+				if (!(*iter)->parent) {
+					if (UNLIKELY(new_root)) {
+						err = set_error("multiple root stages '%s' and '%s'",
+							new_root->id.c_str(), (*iter)->id.c_str());
+					}
+					new_root = *iter;
+				}
+			}
+			if (UNLIKELY(!err && !new_root)) {
+				err = set_error("no root stage");
+			}
+		}
+	}
+	if (!err) {
+		// stages in a cycle can not be reached from the root because each stage has only one upstream
+		node_list_t reachable;
+		collect_subtree(new_root, reachable);
+		if (UNLIKELY(reachable.size() != parsed.size())) {
+			err = set_error("%d stage(s) can not be reached from root stage '%s'",
+				(int)(parsed.size() - reachable.size()), new_root->id.c_str());
+		}
+	}
+	// create pipelines
+	for (SizeType i = 0; !err && (i < stages.Size()); i++) {
+		parsed[i]->pipeline = create_pipeline(stages[i], parsed[i]);
+		if (UNLIKELY(!parsed[i]->pipeline)) {
+			err = set_error("failed to create stage '%s'", parsed[i]->id.c_str());
+		}
+	}
+	if (UNLIKELY(err)) {
+		delete_nodes(parsed);
+		return err;
+	}
+	for (auto iter = parsed.begin(); iter != parsed.end(); iter++) {
+		graph_node_t *node = *iter;
+		if (node->distribute) {
+			for (auto child = node->children.begin(); child != node->children.end(); child++) {
+				node->distribute->addPipeline((*child)->pipeline);
+			}
+		} else if (!node->children.empty()) {
+			node->pipeline->setPipeline(node->children.front()->pipeline);
+		}
+	}
+	result.insert(result.end(), parsed.begin(), parsed.end());
+	*result_root = new_root;
+	return 0;
+}
+
+/*private, static*/
+PipelineGraph::graph_node_t *PipelineGraph::find_node(const node_list_t &list, const std::string &id) {
+	for (auto iter = list.begin(); iter != list.end(); iter++) {
+		if ((*iter)->id == id) {
+			return *iter;
+		}
+	}
+	return NULL;
+}
+
+/*private, static*/
+void PipelineGraph::collect_subtree(graph_node_t *node, node_list_t &result) {
+	result.push_back(node);
+	for (auto iter = node->children.begin(); iter != node->children.end(); iter++) {
+		collect_subtree(*iter, result);
+	}
+}
+
+/**
+ * start downstream stages first so that they are ready when frames come
+ */
+/*private, static*/
+void PipelineGraph::start_subtree(graph_node_t *node) {
+	for (auto iter = node->children.begin(); iter != node->children.end(); iter++) {
+		start_subtree(*iter);
+	}
+	node->pipeline->start();
+}
+
+/**
+ * stop upstream stages first so that downstream stages can finish queued frames
+ */
+/*private, static*/
+void PipelineGraph::stop_subtree(graph_node_t *node) {
+	node->pipeline->stop();
+	for (auto iter = node->children.begin(); iter != node->children.end(); iter++) {
+		stop_subtree(*iter);
+	}
+}
+
+/**
+ * release and delete pipelines, they should be already disconnected from running stages
+ */
+/*private, static*/
+void PipelineGraph::delete_nodes(node_list_t &list) {
+	for (auto iter = list.begin(); iter != list.end(); iter++) {
+		graph_node_t *node = *iter;
+		if (node->pipeline) {
+			node->pipeline->release();
+			SAFE_DELETE(node->pipeline);
+		}
+		delete node;
+	}
+	list.clear();
+}
+
+//**********************************************************************
+//
+//**********************************************************************
+static ID_TYPE nativeCreate(JNIEnv *env, jobject thiz) {
+
+	ENTER();
+	PipelineGraph *pipeline = new PipelineGraph();
+	setField_long(env, thiz, "mNativePtr", reinterpret_cast<ID_TYPE>(pipeline));
+	RETURN(reinterpret_cast<ID_TYPE>(pipeline), ID_TYPE);
+}
+
+static void nativeDestroy(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline) {
+
+	ENTER();
+	setField_long(env, thiz, "mNativePtr", 0);
+	PipelineGraph *pipeline = reinterpret_cast<PipelineGraph *>(id_pipeline);
+	if (LIKELY(pipeline)) {
+		pipeline->release();
+		SAFE_DELETE(pipeline);
+	}
+	EXIT();
+}
+
+static jint nativeBuild(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline, jstring json_str) {
+
+	ENTER();
+	jint result = JNI_ERR;
+	PipelineGraph *pipeline = reinterpret_cast<PipelineGraph *>(id_pipeline);
+	if (LIKELY(pipeline && json_str)) {
+		const char *c_json = env->GetStringUTFChars(json_str, JNI_FALSE);
+		result = pipeline->build(c_json);
+		env->ReleaseStringUTFChars(json_str, c_json);
+	}
+	RETURN(result, jint);
+}
+
+static jint nativeReplace(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline, jstring stage_id_str, jstring json_str) {
+
+	ENTER();
+	jint result = JNI_ERR;
+	PipelineGraph *pipeline = reinterpret_cast<PipelineGraph *>(id_pipeline);
+	if (LIKELY(pipeline && stage_id_str && json_str)) {
+		const char *c_stage_id = env->GetStringUTFChars(stage_id_str, JNI_FALSE);
+		const char *c_json = env->GetStringUTFChars(json_str, JNI_FALSE);
+		result = pipeline->replace(c_stage_id, c_json);
+		env->ReleaseStringUTFChars(json_str, c_json);
+		env->ReleaseStringUTFChars(stage_id_str, c_stage_id);
+	}
+	RETURN(result, jint);
+}
+
+static jstring nativeGetLastError(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline) {
+
+	ENTER();
+	jstring result = NULL;
+	PipelineGraph *pipeline = reinterpret_cast<PipelineGraph *>(id_pipeline);
+	if (LIKELY(pipeline)) {
+		result = env->NewStringUTF(pipeline->getLastError().c_str());
+	}
+	RETURN(result, jstring);
+}
+
+static jint nativeGetState(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline) {
+
+	ENTER();
+	jint result = 0;
+	PipelineGraph *pipeline = reinterpret_cast<PipelineGraph *>(id_pipeline);
+	if (LIKELY(pipeline)) {
+		result = pipeline->getState();
+	}
+	RETURN(result, jint);
+}
+
+static jint nativeStart(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline) {
+
+	ENTER();
+	jint result = JNI_ERR;
+	PipelineGraph *pipeline = reinterpret_cast<PipelineGraph *>(id_pipeline);
+	if (LIKELY(pipeline)) {
+		result = pipeline->start();
+	}
+	RETURN(result, jint);
+}
+
+static jint nativeStop(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline) {
+
+	ENTER();
+	jint result = JNI_ERR;
+	PipelineGraph *pipeline = reinterpret_cast<PipelineGraph *>(id_pipeline);
+	if (LIKELY(pipeline)) {
+		result = pipeline->stop();
+	}
+	RETURN(result, jint);
+}
+
+//**********************************************************************
+//
+//**********************************************************************
+static JNINativeMethod methods[] = {
+	{ "nativeCreate",					"()J", (void *) nativeCreate },
+	{ "nativeDestroy",					"(J)V", (void *) nativeDestroy },
+
+	{ "nativeBuild",					"(JLjava/lang/String;)I", (void *) nativeBuild },
+	{ "nativeReplace",					"(JLjava/lang/String;Ljava/lang/String;)I", (void *) nativeReplace },
+	{ "nativeGetLastError",				"(J)Ljava/lang/String;", (void *) nativeGetLastError },
+
+	{ "nativeGetState",					"(J)I", (void *) nativeGetState },
+	{ "nativeStart",					"(J)I", (void *) nativeStart },
+	{ "nativeStop",						"(J)I", (void *) nativeStop },
+};
+
+int register_pipeline_graph(JNIEnv *env) {
+	LOGV("register_pipeline_graph:");
+	if (registerNativeMethods(env,
+		"com/serenegiant/usb/PipelineGraph",
+		methods, NUM_ARRAY_ELEMENTS(methods)) < 0) {
+		return -1;
+	}
+    return 0;
+}
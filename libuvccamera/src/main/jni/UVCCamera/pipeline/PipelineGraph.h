@@ -0,0 +1,114 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: PipelineGraph.h
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#ifndef PUPILMOBILE_PIPELINEGRAPH_H
+#define PUPILMOBILE_PIPELINEGRAPH_H
+
+#pragma interface
+
+#include <string>
+#include <vector>
+#include "Mutex.h"
+#include "rapidjson/document.h"
+
+#include "IPipeline.h"
+#include "AbstractBufferedPipeline.h"
+#include "DistributePipeline.h"
+
+using namespace android;
+
+/**
+ * build tree of pipelines from JSON description in one call, like
+ * {
+ *   "root": "dist",
+ *   "stages": [
+ *     { "id": "dist", "type": "distribute", "max_frames": 8, "branch_frames": 4, "next": ["rec", "pub"] },
+ *     { "id": "rec", "type": "avi_recorder", "path": "/sdcard/test.avi", "overflow": "block", "cpus": [2, 3] },
+ *     { "id": "pub", "type": "publisher", "addr": "tcp://0.0.0.0:5555", "subscription": "cam0" }
+ *   ]
+ * }
+ * types and parameters:
+ *   simple: max_frames, init_pool, frame_size, drop
+ *   distribute: max_frames, init_pool, frame_size, drop, branch_frames
+ *   convert: frame_size, pixel_format
+ *   avi_recorder: path(required), frame_size
+ *   event_recorder: ring_mb, ring_frames, pre_event_ms, post_event_ms, frame_size
+ *   publisher: frame_size, addr(required), subscription(required), ack_addr, ack_window, ack_timeout_ms
+ *   sqlite: database(required), clear, batch_frames, batch_interval_ms, retention_ms, retention_mb
+ *   mmap: directory(required), segments, segment_mb(up to 1024), clear, frame_size
+ * all types except sqlite also accept queue/thread parameters,
+ *   overflow("drop_newest", "drop_oldest" or "block"), block_timeout_ms,
+ *   backpressure("off", "skip" or "decimate"), max_latency_ms
+ *   and cpus(array of cpu number that the handler thread is bound to).
+ * "next" is id of the next stage, only distribute stage can have array of ids.
+ * each stage can have only one upstream stage, so the graph is always a tree.
+ * "root" can be omitted if only one stage does not have upstream stage.
+ * frames that are queued to this instance are passed to the root stage,
+ * and the subtree of any stage can be replaced while frames are coming.
+ */
+class PipelineGraph : virtual public IPipeline {
+private:
+	typedef struct graph_node {
+		std::string id;
+		std::string type;
+		IPipeline *pipeline;
+		DistributePipeline *distribute;		// not NULL if this is distribute stage
+		std::vector<std::string> next_ids;
+		struct graph_node *parent;
+		std::vector<struct graph_node *> children;
+	} graph_node_t;
+	typedef std::vector<graph_node_t *> node_list_t;
+
+	mutable Mutex graph_mutex;		// serialize build/replace/start/stop
+	node_list_t nodes;
+	graph_node_t *root;
+	IPipeline *root_pipeline;		// guarded by pipeline_mutex, this is accessed from queueFrame
+	std::string last_error;
+
+	int set_error(const char *fmt, ...);
+	int validate_stage(const rapidjson::Value &stage, graph_node_t *node);
+	IPipeline *create_pipeline(const rapidjson::Value &stage, graph_node_t *node);
+	int build_nodes(const char *json, const node_list_t &existing,
+		node_list_t &result, graph_node_t **result_root);
+	static graph_node_t *find_node(const node_list_t &list, const std::string &id);
+	static void collect_subtree(graph_node_t *node, node_list_t &result);
+	static void start_subtree(graph_node_t *node);
+	static void stop_subtree(graph_node_t *node);
+	static void delete_nodes(node_list_t &list);
+public:
+	PipelineGraph();
+	virtual ~PipelineGraph();
+	int build(const char *json);
+	int replace(const char *stage_id, const char *json);
+	IPipeline *getStage(const char *stage_id);
+	std::string getLastError() const;
+	virtual int release();
+	virtual int start();
+	virtual int stop();
+	virtual int queueFrame(uvc_frame_t *frame);
+	virtual int queueSharedFrame(SharedFrame *frame);
+	virtual int getCredits() const;
+};
+
+#endif //PUPILMOBILE_PIPELINEGRAPH_H
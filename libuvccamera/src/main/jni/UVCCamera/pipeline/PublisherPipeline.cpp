@@ -31,6 +31,7 @@
 #endif
 
 #include <stdlib.h>
+#include <string.h>
 #include <linux/time.h>
 #include <unistd.h>
 
@@ -45,8 +46,10 @@
 #include "pupilmobile_defs.h"
 
 #define INIT_FRAME_POOL_SZ 2
-#define MAX_FRAME_NUM 8
+#define MAX_FRAME_NUM PUBLISHER_MAX_FRAME_NUM
 #define RETRY_INTERVALS_US 25000
+// zmq releases all messages when the context is terminated on stopping, so this never expires normally
+#define SEND_RELEASE_TIMEOUT_NSEC 2000000000LL
 
 /* public */
 PublisherPipeline::PublisherPipeline(const size_t &_data_bytes, const char *addr, const char *_subscription_id)
@@ -55,10 +58,19 @@ PublisherPipeline::PublisherPipeline(const size_t &_data_bytes, const char *addr
 	subscription_id(_subscription_id),
 	data_bytes(_data_bytes),
 	context(NULL),
-	publisher(NULL)
+	publisher(NULL),
+	ack_window(DEFAULT_ACK_WINDOW),
+	ack_timeout(DEFAULT_ACK_TIMEOUT_NSEC),
+	ack_socket(NULL),
+	sent_count(0),
+	ack_decimation(1), decimation_count(0),
+	flow_subscribers(0), flow_in_flight(0), flow_sent(0), flow_skipped(0), flow_acks(0), flow_timeouts(0)
 {
 	ENTER();
 
+	memset(send_contexts, 0, sizeof(send_contexts));
+	memset(sent_sequences, 0, sizeof(sent_sequences));
+
 	setState(PIPELINE_STATE_INITIALIZED);
 
 	EXIT();
@@ -74,11 +86,27 @@ PublisherPipeline::PublisherPipeline(const char *addr, const char *_subscription
 PublisherPipeline::~PublisherPipeline() {
 	ENTER();
 
+	release();
 	LOGI("destructor finished");
 
 	EXIT();
 }
 
+/**
+ * frames that zmq still holds should return to the pool before the pool is released
+ */
+/*public*/
+int PublisherPipeline::release() {
+	ENTER();
+
+	setState(PIPELINE_STATE_RELEASING);
+	stop();
+	wait_send_contexts();
+	AbstractBufferedPipeline::release();
+
+	RETURN(0, int);
+}
+
 /*public*/
 int PublisherPipeline::queueFrame(uvc_frame_t *frame) {
 //	ENTER();
@@ -89,6 +117,59 @@ int PublisherPipeline::queueFrame(uvc_frame_t *frame) {
 	return result; // 	RETURN(result, int);
 }
 
+/*public*/
+int PublisherPipeline::queueSharedFrame(SharedFrame *frame) {
+//	ENTER();
+
+	int result = AbstractBufferedPipeline::queueSharedFrame(frame);
+	chain_shared_frame(frame);
+
+	return result; // 	RETURN(result, int);
+}
+
+/**
+ * enable flow control with acks from subscribers, this should be called before #start.
+ * subscribers connect ZMQ_DEALER socket to ack_addr and send publish_ack_t for received frames
+ * (for every frame or only for some of them, acks are cumulative).
+ * a subscriber becomes active on its first ack and is removed when it does not ack for timeout_ns.
+ * frames are not sent while the slowest active subscriber has window frames in flight.
+ * only every n-th frame is sent, n increases when the window is full on the frame to send
+ * and decreases when the window is less than half full.
+ * frames are sent without flow control while no subscriber is active.
+ * @param ack_addr address to bind the ack socket, NULL or empty string disables flow control
+ * @param window maximum number of frames in flight for each subscriber, [1, MAX_ACK_WINDOW]
+ */
+/*public*/
+int PublisherPipeline::setFlowControl(const char *_ack_addr, const int &window, const nsecs_t &timeout_ns) {
+	ENTER();
+
+	Mutex::Autolock lock(publisher_mutex);
+	if (UNLIKELY(isRunning())) {
+		RETURN(-1, int);
+	}
+	ack_addr = _ack_addr ? _ack_addr : "";
+	ack_window = window < 1 ? 1 : (window > MAX_ACK_WINDOW ? MAX_ACK_WINDOW : window);
+	ack_timeout = timeout_ns > 0 ? timeout_ns : DEFAULT_ACK_TIMEOUT_NSEC;
+
+	RETURN(0, int);
+}
+
+/*public*/
+void PublisherPipeline::getFlowStats(publisher_flow_stats_t *stats) const {
+	ENTER();
+
+	stats->subscribers = flow_subscribers;
+	stats->window = ack_window;
+	stats->max_in_flight = flow_in_flight;
+	stats->decimation = __atomic_load_n(&ack_decimation, __ATOMIC_RELAXED);
+	stats->sent = flow_sent;
+	stats->skipped = flow_skipped;
+	stats->acks = flow_acks;
+	stats->timeouts = flow_timeouts;
+
+	EXIT();
+}
+
 //********************************************************************************
 //
 //********************************************************************************
@@ -126,12 +207,18 @@ void PublisherPipeline::on_start() {
 	Mutex::Autolock lock(publisher_mutex);
 
 	context = new zmq::context_t();
-	publisher = new zmq::socket_t(*context, ZMQ_PAIR/*ZMQ_PUB*/);
-	LOGV("set timeout value");
-	publisher->setsockopt(ZMQ_SNDTIMEO, 1000);
-	publisher->setsockopt(ZMQ_LINGER, 100);
-	LOGV("bind");
-	publisher->bind(host.c_str());
+	create_publisher();
+	subscribers.clear();
+	sent_count = 0;
+	ack_decimation = 1;
+	decimation_count = 0;
+	flow_subscribers = flow_in_flight = flow_sent = flow_skipped = flow_acks = flow_timeouts = 0;
+	if (!ack_addr.empty()) {
+		ack_socket = new zmq::socket_t(*context, ZMQ_ROUTER);
+		ack_socket->setsockopt(ZMQ_LINGER, 0);
+		LOGV("bind ack socket");
+		ack_socket->bind(ack_addr.c_str());
+	}
 
 	EXIT();
 }
@@ -143,6 +230,11 @@ void PublisherPipeline::on_stop() {
 	Mutex::Autolock lock(publisher_mutex);
 	LOGI("on_stop:finished");
 	LOGI("stop publisher zmq::socket");
+	if (ack_socket) {
+		ack_socket->close();
+		SAFE_DELETE(ack_socket);
+		LOGI("flow:sent=%u,skipped=%u,acks=%u,timeouts=%u", flow_sent, flow_skipped, flow_acks, flow_timeouts);
+	}
 	if (publisher) {
 		publisher->close();
 		SAFE_DELETE(publisher);
@@ -161,19 +253,61 @@ void PublisherPipeline::on_stop() {
 int PublisherPipeline::handle_frame(uvc_frame_t *frame) {
 //	ENTER();
 
+	if (!accept_publish()) {
+		return 1;
+	}
+	publish_header_t header;
+	build_header(header, frame);
+	send_context_t *context = obtain_context(frame);
+	if (LIKELY(context)) {
+		// the frame is recycled when zmq releases the message
+		zmq::message_t body(frame->data, frame->actual_bytes, release_frame, context);
+		detach_frame();
+		if (!publish(header, body)) {
+			on_published(frame->sequence);
+		}
+	} else {
+		// never happens because contexts are enough for all frames that this pipeline owns
+		zmq::message_t body(frame->actual_bytes);
+		memcpy(body.data(), frame->data, frame->actual_bytes);
+		if (!publish(header, body)) {
+			on_published(frame->sequence);
+		}
+	}
+
+	return 1; // RETURN(1, int);
+}
+
+/* override protected */
+int PublisherPipeline::handle_shared_frame(SharedFrame *frame) {
+//	ENTER();
+
+	if (!accept_publish()) {
+		return 1;
+	}
+	uvc_frame_t *src = frame->get();
+	publish_header_t header;
+	build_header(header, src);
+	// the reference is released when zmq releases the message
+	zmq::message_t body(src->data, src->actual_bytes, release_shared_frame, frame->addRef());
+	if (!publish(header, body)) {
+		on_published(src->sequence);
+	}
+
+	return 1; // RETURN(1, int);
+}
+
+/**
+ * send subscription id, header and frame data as multipart message
+ * header is small enough to be copied into the message without allocation,
+ * frame data is not copied and zmq owns the body after it is sent.
+ */
+/*private*/
+int PublisherPipeline::publish(const publish_header_t &header, zmq::message_t &body) {
 	// local cache
 	const int sub_sz = subscription_id.size();
 	const char *sub_str = subscription_id.c_str();
 //	LOGD("sub_str=%s,sub_sz=%d", sub_str, sub_sz);
-
-	publish_header_t header;
-	// create payload
-	zmq::message_t payload(frame->actual_bytes + sizeof(publish_header_t));
-	// copy header to payload
-	build_header(header, frame);
-	memcpy(payload.data(), &header, sizeof(publish_header_t));
-	// copy frame data to payload
-	memcpy(((uint8_t *)payload.data()) + sizeof(publish_header_t), frame->data, frame->actual_bytes);
 /*
 * zmq::socket_t#send(backed by zmq_msg_send of libzmq) just add message to the internal queue.
 * and we can't know how many entries we can send without exceeding queue
@@ -188,6 +322,7 @@ int PublisherPipeline::handle_frame(uvc_frame_t *frame) {
 * Unfortunately this way only works well if only one subscriber exist.
 * If we actually need to handle this issue, I assume it will be better to use other protocol
 * or make own protocol that supports handshake instead of using zmq.
+* => setFlowControl enables the ack channel from subscribers, see accept_publish.
 *
 * 1280x720p:
 * Nexus7(2013, Android5.1.1) => 11n(2.4GHz) => router => 11n(5Ghz) => Nexus9(Android5.1.1) : OK
@@ -198,15 +333,28 @@ int PublisherPipeline::handle_frame(uvc_frame_t *frame) {
 * GALAXY S5(Android5.0) => 11n(2.4GHz) => router => 11n(2.4Ghz) => GALAXY note2(Android4.4.2) : NG, slow, periodically drops frames.
 * saki
 */
-	for ( ; LIKELY(isRunning()) ; ) {
+	if (UNLIKELY(!publisher)) {
+		return -1;
+	}
+	// retry only the part that failed, sent parts must not be sent again
+	int part = 0;
+	for ( ; LIKELY(isRunning() && (part < 3)) ; ) {
 		try {
-			// set subscribe id
-			if ((LIKELY(publisher->send(sub_str, sub_sz, ZMQ_SNDMORE)))) {
-				// send payload
-				if (LIKELY(publisher->send(payload))) {
-					// success to send
-					break;
-				}
+			bool sent;
+			switch (part) {
+			case 0:	// set subscribe id
+				sent = publisher->send(sub_str, sub_sz, ZMQ_SNDMORE);
+				break;
+			case 1:	// send header
+				sent = publisher->send(&header, sizeof(publish_header_t), ZMQ_SNDMORE);
+				break;
+			default:	// send frame data
+				sent = publisher->send(body);
+				break;
+			}
+			if (LIKELY(sent)) {
+				part++;
+				continue;
 			}
 			LOGD("failed to send");
 			usleep(RETRY_INTERVALS_US);
@@ -220,7 +368,244 @@ int PublisherPipeline::handle_frame(uvc_frame_t *frame) {
 		}
 	}
 
-	return 1; // RETURN(1, int);
+	if (UNLIKELY((part > 0) && (part < 3))) {
+		abort_message();
+	}
+
+	return part < 3 ? -1 : 0;
+}
+
+/**
+ * terminate partially sent multipart message with empty part,
+ * otherwise the parts of the next message are appended to it.
+ * the socket is recreated if even empty part can not be sent.
+ */
+/*private*/
+void PublisherPipeline::abort_message() {
+	try {
+		zmq::message_t empty;
+		if (LIKELY(publisher->send(empty))) {
+			return;
+		}
+	} catch (...) {
+	}
+	LOGW("recreate publisher socket");
+	Mutex::Autolock lock(publisher_mutex);
+	publisher->close();
+	SAFE_DELETE(publisher);
+	create_publisher();
+}
+
+/**
+ * create and bind the publisher socket, should be called with publisher_mutex locked
+ */
+/*private*/
+int PublisherPipeline::create_publisher() {
+	publisher = new zmq::socket_t(*context, ZMQ_PAIR/*ZMQ_PUB*/);
+	try {
+		LOGV("set timeout value");
+		publisher->setsockopt(ZMQ_SNDTIMEO, 1000);
+		publisher->setsockopt(ZMQ_LINGER, 100);
+		LOGV("bind");
+		publisher->bind(host.c_str());
+	} catch (zmq::error_t e) {
+		LOGE("failed to bind %s:%d", host.c_str(), e.num());
+		publisher->close();
+		SAFE_DELETE(publisher);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * wait until zmq releases all frames that were sent without copying
+ */
+/*private*/
+void PublisherPipeline::wait_send_contexts() {
+	const nsecs_t limit = systemTime() + SEND_RELEASE_TIMEOUT_NSEC;
+	for (int i = 0; i < PUBLISHER_MAX_FRAME_NUM; ) {
+		if (!__atomic_load_n(&send_contexts[i].in_use, __ATOMIC_ACQUIRE)) {
+			i++;
+		} else if (UNLIKELY(systemTime() > limit)) {
+			LOGW("frames are still held by zmq");
+			break;
+		} else {
+			usleep(RETRY_INTERVALS_US);
+		}
+	}
+}
+
+static bool has_more(zmq::socket_t &socket) {
+	int more = 0;
+	size_t more_sz = sizeof(more);
+	socket.getsockopt(ZMQ_RCVMORE, &more, &more_sz);
+	return more != 0;
+}
+
+/**
+ * read all acks that arrived without blocking and remove subscribers that stopped acking
+ */
+/*private*/
+void PublisherPipeline::receive_acks(const nsecs_t &now) {
+	for ( ; ; ) {
+		// ZMQ_ROUTER prepends routing id of the subscriber
+		zmq::message_t id;
+		if (!ack_socket->recv(&id, ZMQ_DONTWAIT)) {
+			break;
+		}
+		zmq::message_t payload;
+		bool received = false;
+		for ( ; has_more(*ack_socket) ; ) {
+			// the last part is the ack, this also skips empty delimiter if exists
+			received = ack_socket->recv(&payload);
+		}
+		if (LIKELY(received && (payload.size() >= sizeof(publish_ack_t)))) {
+			publish_ack_t ack;
+			memcpy(&ack, payload.data(), sizeof(publish_ack_t));
+			handle_ack(std::string((const char *)id.data(), id.size()), le32toh(ack.sequence_le), now);
+		}
+	}
+	for (auto iter = subscribers.begin(); iter != subscribers.end(); ) {
+		if (now - iter->last_ack > ack_timeout) {
+			LOGW("subscriber timed out, in flight=%u", (uint32_t)(sent_count - iter->acked));
+			iter = subscribers.erase(iter);
+			flow_timeouts++;
+		} else {
+			iter++;
+		}
+	}
+}
+
+/*private*/
+void PublisherPipeline::handle_ack(const std::string &id, const uint32_t &sequence, const nsecs_t &now) {
+	flow_acks++;
+	subscriber_t *subscriber = NULL;
+	for (auto iter = subscribers.begin(); iter != subscribers.end(); iter++) {
+		if (iter->id == id) {
+			subscriber = &(*iter);
+			break;
+		}
+	}
+	if (!subscriber) {
+		if (UNLIKELY(subscribers.size() >= MAX_ACK_SUBSCRIBERS)) {
+			LOGW("too many subscribers");
+			return;
+		}
+		// frames that were sent before the first ack are not counted
+		const subscriber_t new_subscriber = { id, sent_count, now };
+		subscribers.push_back(new_subscriber);
+		LOGI("subscriber added:%d", (int)subscribers.size());
+		return;
+	}
+	subscriber->last_ack = now;
+	// find the frame from newest, acks of frames that are not in the history are ignored
+	const uint64_t oldest = sent_count > MAX_ACK_WINDOW ? sent_count - MAX_ACK_WINDOW : 0;
+	for (uint64_t n = sent_count; n > oldest; n--) {
+		if (sent_sequences[(n - 1) % MAX_ACK_WINDOW] == sequence) {
+			if (n > subscriber->acked) {
+				subscriber->acked = n;
+			}
+			break;
+		}
+	}
+}
+
+/**
+ * decide whether the current frame should be sent, called for each frame before sending
+ * @return false if the frame should be skipped to keep the window
+ */
+/*private*/
+bool PublisherPipeline::accept_publish() {
+	if (!ack_socket) {
+		return true;
+	}
+	const nsecs_t now = systemTime();
+	try {
+		receive_acks(now);
+	} catch (zmq::error_t e) {
+		LOGW("failed to receive ack:%d", e.num());
+	}
+	uint64_t in_flight = 0;
+	for (auto iter = subscribers.begin(); iter != subscribers.end(); iter++) {
+		if (sent_count - iter->acked > in_flight) {
+			in_flight = sent_count - iter->acked;
+		}
+	}
+	flow_subscribers = subscribers.size();
+	flow_in_flight = (uint32_t)in_flight;
+	bool result = true;
+	uint32_t n = 1;
+	if (!subscribers.empty()) {
+		// skip frames evenly instead of sending bursts whenever the window has room,
+		// n follows the ratio of incoming frame rate and ack rate of the slowest subscriber
+		n = ack_decimation;
+		result = !(++decimation_count % n);
+		if (result) {
+			if (in_flight >= (uint64_t)ack_window) {
+				// decimation is not enough
+				n = n < MAX_DECIMATION ? n + 1 : MAX_DECIMATION;
+				result = false;
+			} else if ((in_flight * 2 < (uint64_t)ack_window) && (n > 1)) {
+				n--;
+			}
+		}
+	}
+	__atomic_store_n(&ack_decimation, n, __ATOMIC_RELAXED);
+	if (!result) {
+		flow_skipped++;
+	}
+	return result;
+}
+
+/**
+ * keep sequence of the sent frame to find it from ack
+ */
+/*private*/
+void PublisherPipeline::on_published(const uint32_t &sequence) {
+	sent_sequences[sent_count % MAX_ACK_WINDOW] = sequence;
+	sent_count++;
+	flow_sent++;
+}
+
+/**
+ * find unused send context for the frame that this pipeline owns
+ * @return NULL if all contexts are in use
+ */
+/*private*/
+PublisherPipeline::send_context_t *PublisherPipeline::obtain_context(uvc_frame_t *frame) {
+	for (int i = 0; i < PUBLISHER_MAX_FRAME_NUM; i++) {
+		send_context_t *context = &send_contexts[i];
+		int32_t expected = 0;
+		if (__atomic_compare_exchange_n(&context->in_use, &expected, 1,
+			false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+
+			context->pipeline = this;
+			context->frame = frame;
+			return context;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * free function of zmq message of the frame that this pipeline owns,
+ * this may be called from zmq I/O thread
+ */
+/*private*/
+void PublisherPipeline::release_frame(void *data, void *hint) {
+	send_context_t *context = (send_context_t *)hint;
+	PublisherPipeline *pipeline = context->pipeline;
+	uvc_frame_t *frame = context->frame;
+	__atomic_store_n(&context->in_use, 0, __ATOMIC_RELEASE);
+	pipeline->recycle_frame(frame);
+}
+
+/**
+ * free function of zmq message of shared frame
+ */
+/*private*/
+void PublisherPipeline::release_shared_frame(void *data, void *hint) {
+	((SharedFrame *)hint)->release();
 }
 
 //********************************************************************************
@@ -308,6 +693,47 @@ static jint nativeStop(JNIEnv *env, jobject thiz,
 	RETURN(result, jint);
 }
 
+static jint nativeSetFlowControl(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline, jstring ack_addr_str, jint window, jint timeout_ms) {
+
+	ENTER();
+
+	jint result = JNI_ERR;
+	PublisherPipeline *pipeline = reinterpret_cast<PublisherPipeline *>(id_pipeline);
+	if (LIKELY(pipeline)) {
+		const char *c_addr = ack_addr_str ? env->GetStringUTFChars(ack_addr_str, JNI_FALSE) : NULL;
+		result = pipeline->setFlowControl(c_addr, window, timeout_ms * 1000000LL);
+		if (c_addr) {
+			env->ReleaseStringUTFChars(ack_addr_str, c_addr);
+		}
+	}
+
+	RETURN(result, jint);
+}
+
+#define NUM_FLOW_STATS 8
+
+static jint nativeGetFlowStats(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline, jintArray stats_array) {
+
+	ENTER();
+
+	jint result = JNI_ERR;
+	PublisherPipeline *pipeline = reinterpret_cast<PublisherPipeline *>(id_pipeline);
+	if (LIKELY(pipeline && stats_array && (env->GetArrayLength(stats_array) >= NUM_FLOW_STATS))) {
+		publisher_flow_stats_t stats;
+		pipeline->getFlowStats(&stats);
+		const jint values[NUM_FLOW_STATS] = {
+			(jint)stats.subscribers, (jint)stats.window, (jint)stats.max_in_flight, (jint)stats.decimation,
+			(jint)stats.sent, (jint)stats.skipped, (jint)stats.acks, (jint)stats.timeouts,
+		};
+		env->SetIntArrayRegion(stats_array, 0, NUM_FLOW_STATS, values);
+		result = 0;
+	}
+
+	RETURN(result, jint);
+}
+
 //================================================================================
 static JNINativeMethod methods_publisher_pipeline[] = {
 	{ "nativeCreate", 		"(Ljava/lang/String;Ljava/lang/String;)J", (void *) nativeCreate},
@@ -317,6 +743,8 @@ static JNINativeMethod methods_publisher_pipeline[] = {
 	{ "nativeGetState",		"(J)I", (void *) nativeGetState },
 	{ "nativeStart",		"(J)I", (void *) nativeStart },
 	{ "nativeStop",			"(J)I", (void *) nativeStop },
+	{ "nativeSetFlowControl",	"(JLjava/lang/String;II)I", (void *) nativeSetFlowControl },
+	{ "nativeGetFlowStats",	"(J[I)I", (void *) nativeGetFlowStats },
 };
 
 int register_publisher_pipeline(JNIEnv *env) {
@@ -8,6 +8,7 @@
 #pragma interface
 
 #include <string>
+#include <vector>
 #include "Mutex.h"
 #include "Timers.h"
 #include "zmq.hpp"
@@ -17,8 +18,76 @@
 
 using namespace android;
 
+// maximum number of frames that this pipeline owns, this is also the maximum number of frames in flight
+#define PUBLISHER_MAX_FRAME_NUM 8
+// flow control with acks from subscribers
+#define MAX_ACK_WINDOW 64
+#define MAX_ACK_SUBSCRIBERS 8
+#define DEFAULT_ACK_WINDOW 4
+#define DEFAULT_ACK_TIMEOUT_NSEC 2000000000LL
+
+/**
+ * ack that subscriber sends to the ack socket(ZMQ_DEALER to ZMQ_ROUTER),
+ * sequence of the last received frame, little endian
+ */
+typedef struct publish_ack {
+	uint32_t sequence_le;
+} publish_ack_t;
+
+typedef struct publisher_flow_stats {
+	uint32_t subscribers;		// subscribers that acked within the timeout
+	uint32_t window;
+	uint32_t max_in_flight;		// frames that the slowest subscriber has not acked yet
+	uint32_t decimation;		// 1 means all frames are sent
+	uint32_t sent;
+	uint32_t skipped;			// frames that were not sent to keep the window
+	uint32_t acks;
+	uint32_t timeouts;			// subscribers that were removed because they stopped acking
+} publisher_flow_stats_t;
+
+/**
+ * publish frames via zmq as multipart message of subscription id, publish_header_t and frame data.
+ * frame data is sent without copying and the frame is recycled when zmq releases the message.
+ * if sending fails after the first part, the message is terminated with empty part.
+ * if flow control is enabled, subscribers ack received frames via another socket
+ * and frames are skipped while the slowest subscriber has too many frames in flight.
+ */
 class PublisherPipeline : virtual public AbstractBufferedPipeline {
 private:
+	typedef struct send_context {
+		PublisherPipeline *pipeline;
+		uvc_frame_t *frame;
+		volatile int32_t in_use;
+	} send_context_t;
+
+	send_context_t send_contexts[PUBLISHER_MAX_FRAME_NUM];
+	send_context_t *obtain_context(uvc_frame_t *frame);
+	static void release_frame(void *data, void *hint);
+	static void release_shared_frame(void *data, void *hint);
+	int publish(const publish_header_t &header, zmq::message_t &body);
+	void abort_message();
+	int create_publisher();
+	void wait_send_contexts();
+// flow control, accessed only from the handler thread except setFlowControl and stats
+	typedef struct subscriber {
+		std::string id;				// routing id on the ack socket
+		uint64_t acked;				// number of sent frames that this subscriber received
+		nsecs_t last_ack;
+	} subscriber_t;
+
+	std::string ack_addr;
+	int ack_window;
+	nsecs_t ack_timeout;
+	zmq::socket_t *ack_socket;
+	std::vector<subscriber_t> subscribers;
+	uint32_t sent_sequences[MAX_ACK_WINDOW];
+	uint64_t sent_count;
+	uint32_t ack_decimation, decimation_count;
+	volatile uint32_t flow_subscribers, flow_in_flight, flow_sent, flow_skipped, flow_acks, flow_timeouts;
+	void receive_acks(const nsecs_t &now);
+	void handle_ack(const std::string &id, const uint32_t &sequence, const nsecs_t &now);
+	bool accept_publish();
+	void on_published(const uint32_t &sequence);
 protected:
 	const std::string host;
 	const std::string subscription_id;
@@ -29,11 +98,17 @@ protected:
 	virtual void on_start();
 	virtual void on_stop();
 	virtual int handle_frame(uvc_frame_t *frame);
+	virtual int handle_shared_frame(SharedFrame *frame);
 public:
 	PublisherPipeline(const size_t &_data_bytes = DEFAULT_FRAME_SZ, const char *addr = NULL, const char *subscription_id = NULL);
 	PublisherPipeline(const char *addr, const char *subscription_id);
 	virtual ~PublisherPipeline();
+	virtual int release();
 	virtual int queueFrame(uvc_frame_t *frame);
+	virtual int queueSharedFrame(SharedFrame *frame);
+	int setFlowControl(const char *ack_addr, const int &window = DEFAULT_ACK_WINDOW,
+		const nsecs_t &timeout_ns = DEFAULT_ACK_TIMEOUT_NSEC);
+	void getFlowStats(publisher_flow_stats_t *stats) const;
 };
 
 #endif //PUPILMOBILE_PUBLISHER_PIPELINE_H
@@ -22,12 +22,21 @@
 #include "pipeline_helper.h"
 #include "IPipeline.h"
 #include "Timers.h"
+#include "FramePool.h"
 #include "SQLiteBufferedPipeline.h"
 
 #define CHECK_INTERVAL_NSEC 5000000000LL	// every 5sec
 #define TABLE_NAME "backend"
 #define INSERT_FIELDS "dtime, format, width, height, sequence, data_bytes, data"
 #define ALL_FIELDS "id, dtime, format, width, height, sequence, data_bytes, data"
+// page_size takes effect only when the database file is created, larger page reduces overflow pages of frame data.
+// synchronous=NORMAL with WAL syncs only on checkpoint and the database never becomes corrupt
+#define DB_PRAGMAS \
+	"PRAGMA page_size=32768;" \
+	"PRAGMA journal_mode=WAL;" \
+	"PRAGMA synchronous=NORMAL;" \
+	"PRAGMA cache_size=-8192;" \
+	"PRAGMA journal_size_limit=67108864;"
 
 /*public*/
 SQLiteBufferedPipeline::SQLiteBufferedPipeline(const char *database_name, const bool &clear_table)
@@ -36,11 +45,24 @@ SQLiteBufferedPipeline::SQLiteBufferedPipeline(const char *database_name, const
 	sql_query_oldest_10(NULL),
 	sql_delete_one(NULL),
 	sql_delete_older(NULL),
-	sql_count(NULL)
+	sql_count(NULL),
+	sql_query_sizes(NULL),
+	pending_frames(MAX_PENDING_FRAMES),
+	batch_frames(DEFAULT_BATCH_FRAMES),
+	batch_interval(DEFAULT_BATCH_INTERVAL_NSEC),
+	retention_nsec(DTIME_LIMIT_NSEC),
+	retention_bytes(0),
+	in_batch(false),
+	batch_count(0),
+	batch_start_time(0),
+	inserted_frames(0), dropped_frames(0), commit_count(0)
 {
 	ENTER();
 
 	db = new sqlite3pp::database(database_name);
+	if (UNLIKELY(db->execute(DB_PRAGMAS))) {
+		LOGW("failed to set pragmas:%s", db->error_msg());
+	}
 	// 0:id, 1:dtime, 2:format, 3:width, 4:height, 5:sequence, 6:data_bytes, 7:data
 	sqlite3pp::command cmd(*db,
 		"CREATE TABLE IF NOT EXISTS " TABLE_NAME " ("
@@ -66,6 +88,7 @@ SQLiteBufferedPipeline::SQLiteBufferedPipeline(const char *database_name, const
 	sql_delete_one = new sqlite3pp::command(*db, "DELETE FROM " TABLE_NAME " WHERE (id=?);");
 	sql_delete_older = new sqlite3pp::command(*db, "DELETE FROM " TABLE_NAME " WHERE (dtime<?);");
 	sql_count = new sqlite3pp::query(*db, "SELECT count(id) FROM " TABLE_NAME ";");
+	sql_query_sizes = new sqlite3pp::query(*db, "SELECT dtime, data_bytes FROM " TABLE_NAME " ORDER BY dtime DESC;");
 
 	setState(PIPELINE_STATE_INITIALIZED);
 	EXIT();
@@ -75,6 +98,12 @@ SQLiteBufferedPipeline::SQLiteBufferedPipeline(const char *database_name, const
 SQLiteBufferedPipeline::~SQLiteBufferedPipeline() {
 	ENTER();
 
+	release();
+	LOGD("deleting sql_query_sizes");
+	if (sql_query_sizes) {
+		sql_query_sizes->finish();
+		SAFE_DELETE(sql_query_sizes);
+	}
 	LOGD("deleting sql_count");
 	if (sql_count) {
 		sql_count->finish();
@@ -153,6 +182,7 @@ int SQLiteBufferedPipeline::stop() {
 		}
 		LOGD("SQLiteBufferedPipeline thread finished");
 	}
+	flush_pending();
 	RETURN(0, int);
 }
 
@@ -161,26 +191,31 @@ int SQLiteBufferedPipeline::queueFrame(uvc_frame_t *frame) {
 	ENTER();
 
 	uvc_error_t ret = UVC_ERROR_OTHER;
-	Mutex::Autolock lock(handler_mutex);
 
 	if (LIKELY(frame && isRunning())) {
-		// FIXME if the number of record exceeds specific limit, need to delete old records or drop newer frames
-		// FIXME otherwise device storage will become empty at some point.
-		try {
-			sql_insert_one->reset();
-			sql_insert_one->bind(1, nsecs_t(frame->capture_time.tv_sec) * 1000000LL +
-								nsecs_t(frame->capture_time.tv_usec));
-			sql_insert_one->bind(2, (int) frame->frame_format);
-			sql_insert_one->bind(3, (int) frame->width);
-			sql_insert_one->bind(4, (int) frame->height);
-			sql_insert_one->bind(5, (int) frame->sequence);
-			sql_insert_one->bind(6, (int) frame->actual_bytes);
-			sql_insert_one->bind(7, (void *) frame->data, frame->actual_bytes, false);
-			sql_insert_one->execute();
-			ret = UVC_SUCCESS;
-		} catch (...) {
-			LOGW("failed insert frame");
+		// only copy the frame here, inserting is done on the handler thread
+		// so that the caller(camera) thread never waits for storage
+		uvc_frame_t *copy = FramePool::getInstance()->obtain(frame->data_bytes);
+		if (LIKELY(copy)) {
+			ret = uvc_duplicate_frame(frame, copy);
+			if (LIKELY(!ret)) {
+				if (LIKELY(pending_frames.put(copy))) {
+					copy = NULL;
+				} else {
+					LOGD("too many pending frames, drop frame");
+					__atomic_add_fetch(&dropped_frames, 1, __ATOMIC_RELAXED);
+					ret = UVC_ERROR_NO_MEM;
+				}
+			} else {
+				LOGW("uvc_duplicate_frame failed:%d", ret);
+			}
+			if (UNLIKELY(copy)) {
+				FramePool::getInstance()->recycle(copy);
+			}
+		} else {
+			ret = UVC_ERROR_NO_MEM;
 		}
+		Mutex::Autolock lock(handler_mutex);
 		handler_sync.broadcast();
 	}
 
@@ -191,12 +226,35 @@ int SQLiteBufferedPipeline::queueFrame(uvc_frame_t *frame) {
 void SQLiteBufferedPipeline::clear() {
 	ENTER();
 
-	sqlite3pp::command sql_truncate(*db, "TRUNCATE TABLE " TABLE_NAME ";");
+	// SQLite does not have TRUNCATE, DELETE without WHERE clause is optimized to truncate
+	sqlite3pp::command sql_truncate(*db, "DELETE FROM " TABLE_NAME ";");
 	sql_truncate.execute();
 
 	EXIT();
 }
 
+/*public*/
+void SQLiteBufferedPipeline::setBatch(const int &frames, const nsecs_t &interval_ns) {
+	ENTER();
+
+	Mutex::Autolock lock(handler_mutex);
+	batch_frames = frames > 0 ? frames : 1;
+	batch_interval = interval_ns;
+
+	EXIT();
+}
+
+/*public*/
+void SQLiteBufferedPipeline::setRetention(const nsecs_t &max_age_ns, const int64_t &max_bytes) {
+	ENTER();
+
+	Mutex::Autolock lock(handler_mutex);
+	retention_nsec = max_age_ns;
+	retention_bytes = max_bytes;
+
+	EXIT();
+}
+
 /**
  * delete record(s) older than specific dtime.
  * if you want to delete all record(s), use clear instead
@@ -232,7 +290,37 @@ int SQLiteBufferedPipeline::purge_older(const nsecs_t &limit_rel_nsec) {
 	int result = -1;
 
 	if (LIKELY(limit_rel_nsec)) {
-		result = delete_older(systemTime() - limit_rel_nsec);
+		// dtime is capture time in microseconds, same clock as systemTime
+		result = delete_older((systemTime() - limit_rel_nsec) / 1000LL);
+	}
+
+	RETURN(result, int);
+}
+
+/*protected*/
+int SQLiteBufferedPipeline::purge_larger(const int64_t &max_bytes) {
+	ENTER();
+
+	int result = -1;
+
+	if (LIKELY((max_bytes > 0) && sql_query_sizes)) {
+		int64_t total = 0;
+		nsecs_t dtime = 0;
+		try {
+			sql_query_sizes->reset();
+			// sum up from newest record and delete all records after exceeding the limit
+			for (auto iter = sql_query_sizes->begin(); iter != sql_query_sizes->end(); ++iter) {
+				total += (*iter).get<int64_t>(1);
+				if (total > max_bytes) {
+					dtime = (*iter).get<nsecs_t>(0) + 1;
+					break;
+				}
+			}
+			sql_query_sizes->reset();
+			result = dtime ? delete_older(dtime) : 0;
+		} catch (...) {
+			LOGW("failed to purge larger:%lld", max_bytes);
+		}
 	}
 
 	RETURN(result, int);
@@ -253,6 +341,92 @@ int SQLiteBufferedPipeline::getCount() {
 	RETURN(result, int);
 }
 
+/*private*/
+void SQLiteBufferedPipeline::begin_batch() {
+	if (!in_batch) {
+		if (LIKELY(!db->execute("BEGIN;"))) {
+			in_batch = true;
+			batch_count = 0;
+			batch_start_time = systemTime();
+		} else {
+			LOGW("failed to begin transaction:%s", db->error_msg());
+		}
+	}
+}
+
+/*private*/
+void SQLiteBufferedPipeline::commit_batch() {
+	if (in_batch) {
+		in_batch = false;
+		if (UNLIKELY(db->execute("COMMIT;"))) {
+			LOGW("failed to commit:%s", db->error_msg());
+			db->execute("ROLLBACK;");
+		}
+		__atomic_add_fetch(&commit_count, 1, __ATOMIC_RELAXED);
+	}
+}
+
+/*private*/
+int SQLiteBufferedPipeline::insert_one(uvc_frame_t *frame) {
+	int result = -1;
+	try {
+		sql_insert_one->reset();
+		sql_insert_one->bind(1, nsecs_t(frame->capture_time.tv_sec) * 1000000LL +
+							nsecs_t(frame->capture_time.tv_usec));
+		sql_insert_one->bind(2, (int) frame->frame_format);
+		sql_insert_one->bind(3, (int) frame->width);
+		sql_insert_one->bind(4, (int) frame->height);
+		sql_insert_one->bind(5, (int) frame->sequence);
+		sql_insert_one->bind(6, (int) frame->actual_bytes);
+		// the frame is alive until execute returns, so SQLite does not need to copy the data
+		sql_insert_one->bind(7, (void *) frame->data, frame->actual_bytes, true);
+		sql_insert_one->execute();
+		result = 0;
+	} catch (...) {
+		LOGW("failed insert frame");
+	}
+	sql_insert_one->reset();
+	return result;
+}
+
+/**
+ * insert pending frames into current transaction and commit it
+ * when the number of inserted frames or elapsed time exceeds the limit
+ * @return number of inserted frames
+ */
+/*private*/
+int SQLiteBufferedPipeline::insert_pending(const int &max_frames, const nsecs_t &interval) {
+	int result = 0;
+	uvc_frame_t *frame;
+	for ( ; pending_frames.get(frame) ; ) {
+		begin_batch();
+		if (LIKELY(!insert_one(frame))) {
+			batch_count++;
+			result++;
+		}
+		FramePool::getInstance()->recycle(frame);
+		if (batch_count >= max_frames) {
+			commit_batch();
+		}
+	}
+	if (in_batch && (systemTime() - batch_start_time >= interval)) {
+		commit_batch();
+	}
+	__atomic_add_fetch(&inserted_frames, result, __ATOMIC_RELAXED);
+	return result;
+}
+
+/**
+ * return frames that were not inserted to the frame pool
+ */
+/*private*/
+void SQLiteBufferedPipeline::flush_pending() {
+	uvc_frame_t *frame;
+	for ( ; pending_frames.get(frame) ; ) {
+		FramePool::getInstance()->recycle(frame);
+	}
+}
+
 /*private*/
 void *SQLiteBufferedPipeline::handler_thread_func(void *vptr_args) {
 
@@ -277,14 +451,24 @@ void SQLiteBufferedPipeline::do_loop() {
 	if (LIKELY(frame)) {
 		setState(PIPELINE_STATE_RUNNING);
 		nsecs_t prev_time = systemTime();
+		int max_frames = DEFAULT_BATCH_FRAMES;
+		nsecs_t interval = DEFAULT_BATCH_INTERVAL_NSEC, max_age = DTIME_LIMIT_NSEC;
+		int64_t max_bytes = 0;
 		for (; LIKELY(isRunning());) {
 			handler_mutex.lock();
 			{
 				// wait for new arriving frame data
-				handler_sync.waitRelative(handler_mutex, 3000000);
+				if (pending_frames.isEmpty()) {
+					handler_sync.waitRelative(handler_mutex, 3000000);
+				}
+				max_frames = batch_frames;
+				interval = batch_interval;
+				max_age = retention_nsec;
+				max_bytes = retention_bytes;
 			}
 			handler_mutex.unlock();
 
+			insert_pending(max_frames, interval);
 			if (LIKELY(isRunning())) {
 
 				if (next_pipeline) {
@@ -328,27 +512,31 @@ void SQLiteBufferedPipeline::do_loop() {
 							LOGW("uvc_ensure_frame_size failed:%lld,%lld,(%d,%d),actual_bytes=%d", id, dtime, width, height, actual_bytes);
 						}
 					} // end of for
-					// delete chained record(s) if exist
-					sqlite3pp::transaction xct(*db);
-					try {
-						for (auto iter = queued_ids.begin(); iter != queued_ids.end(); iter++) {
-							sql_delete_one->reset();
-							sql_delete_one->bind(1, *iter);
-							sql_delete_one->execute();
+					// delete chained record(s) if exist, they are committed with inserted frames
+					if (!queued_ids.empty()) {
+						begin_batch();
+						try {
+							for (auto iter = queued_ids.begin(); iter != queued_ids.end(); iter++) {
+								sql_delete_one->reset();
+								sql_delete_one->bind(1, *iter);
+								sql_delete_one->execute();
+							}
+						} catch (std::exception &e) {
+							LOGI("exception: failed to delate");
 						}
-						xct.commit();
-					} catch (std::exception &e) {
-						LOGI("exception: failed to delate");
-						xct.rollback();    // this may redundant
 					}
 				} // end of if (next_pipeline)
 				if (UNLIKELY(systemTime() > prev_time + CHECK_INTERVAL_NSEC)) {
 					prev_time = systemTime();
-					purge_older();
+					purge_older(max_age);
+					purge_larger(max_bytes);
 				}
 			}
 		}
 		setState(PIPELINE_STATE_STOPPING);
+		insert_pending(max_frames, 0);
+		commit_batch();
+		LOGI("inserted=%u,dropped=%u,commits=%u", inserted_frames, dropped_frames, commit_count);
 		uvc_free_frame(frame);
 	} else {
 		LOGW("uvc_allocate_frame failed");
@@ -419,6 +607,32 @@ static jint nativeSetPipeline(JNIEnv *env, jobject thiz,
 	RETURN(result, jint);
 }
 
+static jint nativeSetBatch(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline, jint frames, jint interval_ms) {
+
+	ENTER();
+	jint result = JNI_ERR;
+	SQLiteBufferedPipeline *pipeline = reinterpret_cast<SQLiteBufferedPipeline *>(id_pipeline);
+	if (LIKELY(pipeline)) {
+		pipeline->setBatch(frames, interval_ms * 1000000LL);
+		result = 0;
+	}
+	RETURN(result, jint);
+}
+
+static jint nativeSetRetention(JNIEnv *env, jobject thiz,
+	ID_TYPE id_pipeline, jlong max_age_ms, jlong max_bytes) {
+
+	ENTER();
+	jint result = JNI_ERR;
+	SQLiteBufferedPipeline *pipeline = reinterpret_cast<SQLiteBufferedPipeline *>(id_pipeline);
+	if (LIKELY(pipeline)) {
+		pipeline->setRetention(max_age_ms * 1000000LL, max_bytes);
+		result = 0;
+	}
+	RETURN(result, jint);
+}
+
 static jint nativeStart(JNIEnv *env, jobject thiz,
 	ID_TYPE id_pipeline) {
 
@@ -453,6 +667,8 @@ static JNINativeMethod methods[] = {
 
 	{ "nativeGetState",					"(J)I", (void *) nativeGetState },
 	{ "nativeSetPipeline",				"(JLcom/serenegiant/usb/IPipeline;)I", (void *) nativeSetPipeline },
+	{ "nativeSetBatch",					"(JII)I", (void *) nativeSetBatch },
+	{ "nativeSetRetention",				"(JJJ)I", (void *) nativeSetRetention },
 
 	{ "nativeStart",					"(J)I", (void *) nativeStart },
 	{ "nativeStop",						"(J)I", (void *) nativeStop },
@@ -14,6 +14,7 @@
 
 #include "libUVCCamera.h"
 #include "IPipeline.h"
+#include "mpscringbuffer.h"
 #include "sqlite3pp.h"
 
 #pragma interface
@@ -21,6 +22,9 @@
 using namespace android;
 
 #define DTIME_LIMIT_NSEC 30000000000LL		// 30sec
+#define DEFAULT_BATCH_FRAMES 30					// commit every 30 frames(1sec at 30fps)...
+#define DEFAULT_BATCH_INTERVAL_NSEC 500000000LL	// ...or every 500msec
+#define MAX_PENDING_FRAMES 32					// frames waiting for insert, newer frames are dropped when this is full
 
 class SQLiteBufferedPipeline : virtual public IPipeline {
 private:
@@ -31,6 +35,26 @@ private:
 	sqlite3pp::command *sql_delete_one;
 	sqlite3pp::command *sql_delete_older;
 	sqlite3pp::query *sql_count;
+	sqlite3pp::query *sql_query_sizes;
+
+	// frames that were queued but not inserted yet, inserting is done on the handler thread
+	MPSCRingBuffer<uvc_frame_t *> pending_frames;
+	// guarded by handler_mutex
+	int batch_frames;
+	nsecs_t batch_interval;
+	nsecs_t retention_nsec;
+	int64_t retention_bytes;
+	// batch transaction, only accessed from the handler thread
+	bool in_batch;
+	int batch_count;
+	nsecs_t batch_start_time;
+	// statistics
+	volatile uint32_t inserted_frames, dropped_frames, commit_count;
+	void begin_batch();
+	void commit_batch();
+	int insert_pending(const int &max_frames, const nsecs_t &interval);
+	int insert_one(uvc_frame_t *frame);
+	void flush_pending();
 
 	pthread_t handler_thread;
 	mutable Mutex handler_mutex;
@@ -46,6 +70,10 @@ protected:
 	int delete_older(const nsecs_t &dtime);
 	/** helper of delete_older */
 	int purge_older(const nsecs_t &limit_rel_nsec = DTIME_LIMIT_NSEC);
+	/**
+	 * delete oldest record(s) until total bytes of frame data becomes equal or less than max_bytes
+	 */
+	int purge_larger(const int64_t &max_bytes);
 public:
 	SQLiteBufferedPipeline(const char *database_name, const bool &clear = false);
 	virtual ~SQLiteBufferedPipeline();
@@ -54,6 +82,18 @@ public:
 	virtual int stop();
 	virtual int queueFrame(uvc_frame_t *frame);
 	virtual void clear();
+	/**
+	 * set when pending inserts are committed
+	 * @param frames commit when this number of frames were inserted
+	 * @param interval_ns commit when this time passed since first insert of the transaction
+	 */
+	void setBatch(const int &frames, const nsecs_t &interval_ns);
+	/**
+	 * set limit of stored frames
+	 * @param max_age_ns records older than this are deleted, 0 means no limit
+	 * @param max_bytes oldest records are deleted while total bytes of frame data exceed this, 0 means no limit
+	 */
+	void setRetention(const nsecs_t &max_age_ns, const int64_t &max_bytes);
 };
 
 
@@ -6,12 +6,16 @@
 #include "Timers.h"
 #include "SimpleBufferedPipeline.h"
 #include "SQLiteBufferedPipeline.h"
+#include "MMapBufferedPipeline.h"
 #include "UVCCameraControl.h"
 #include "CallbackPipeline.h"
 #include "ConvertPipeline.h"
 #include "PreviewPipeline.h"
 #include "PublisherPipeline.h"
 #include "DistributePipeline.h"
+#include "AVIRecorderPipeline.h"
+#include "EventRecorderPipeline.h"
+#include "PipelineGraph.h"
 #include "pipeline_helper.h"
 
 IPipeline *getPipeline(JNIEnv *env, jobject pipeline_obj) {
@@ -29,6 +33,9 @@ IPipeline *getPipeline(JNIEnv *env, jobject pipeline_obj) {
 		case PIPELINE_TYPE_SQLITE_BUFFERED:
 			result = reinterpret_cast<SQLiteBufferedPipeline *>(id_pipeline);
 			break;
+		case PIPELINE_TYPE_MMAP_BUFFERED:
+			result = reinterpret_cast<MMapBufferedPipeline *>(id_pipeline);
+			break;
 		case PIPELINE_TYPE_UVC_CONTROL:
 			result = reinterpret_cast<UVCCameraControl *>(id_pipeline);
 			break;
@@ -47,6 +54,15 @@ IPipeline *getPipeline(JNIEnv *env, jobject pipeline_obj) {
 		case PIPELINE_TYPE_DISTRIBUTE:
 			result = reinterpret_cast<DistributePipeline *>(id_pipeline);
 			break;
+		case PIPELINE_TYPE_AVI_RECORDER:
+			result = reinterpret_cast<AVIRecorderPipeline *>(id_pipeline);
+			break;
+		case PIPELINE_TYPE_EVENT_RECORDER:
+			result = reinterpret_cast<EventRecorderPipeline *>(id_pipeline);
+			break;
+		case PIPELINE_TYPE_GRAPH:
+			result = reinterpret_cast<PipelineGraph *>(id_pipeline);
+			break;
 		default:
 			result = NULL;
 			break;
@@ -0,0 +1,146 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: ringbuffer.h
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#ifndef RINGBUFFER_H_
+#define RINGBUFFER_H_
+
+#include "utilbase.h"
+
+/**
+ * fixed capacity FIFO queue, capacity is rounded up to power of two
+ * and never changes, so put/get never allocate memory and never move elements.
+ * if LOCK_FREE is false, caller should serialize all access with its own lock.
+ * if LOCK_FREE is true, one producer thread(put) and one consumer thread(get/peek)
+ * can access this without lock. size/highWaterMark can be called from any thread
+ * but returns a snapshot. clear should be called only from consumer side.
+ */
+template <class T, bool LOCK_FREE = false>
+class RingBuffer {
+private:
+	T *m_elements;
+	const uint32_t m_capacity;
+	const uint32_t m_mask;
+	// free running counters, (m_tail - m_head) is number of queued elements
+	volatile uint32_t m_head;			// read position, only changed by consumer
+	volatile uint32_t m_tail;			// write position, only changed by producer
+	volatile uint32_t m_high_water;		// only changed by producer
+
+	static uint32_t round_up(uint32_t capacity) {
+		uint32_t result = 1;
+		for ( ; result < capacity ; result <<= 1) {}
+		return result;
+	}
+	inline uint32_t load(const volatile uint32_t &v) const {
+		return LOCK_FREE ? __atomic_load_n(&v, __ATOMIC_ACQUIRE) : v;
+	}
+	inline void store(volatile uint32_t &v, const uint32_t value) {
+		if (LOCK_FREE) {
+			__atomic_store_n(&v, value, __ATOMIC_RELEASE);
+		} else {
+			v = value;
+		}
+	}
+public:
+	RingBuffer(const int capacity = 4)
+		: m_capacity(round_up(capacity > 0 ? capacity : 1)),
+		  m_mask(round_up(capacity > 0 ? capacity : 1) - 1),
+		  m_head(0),
+		  m_tail(0),
+		  m_high_water(0) {
+		m_elements = new T[m_capacity];
+	}
+
+	~RingBuffer() { SAFE_DELETE_ARRAY(m_elements); }
+
+	inline int capacity() const { return m_capacity; }
+	/** number of queued elements */
+	inline int size() const { return load(m_tail) - load(m_head); }
+	inline bool isEmpty() const { return size() <= 0; }
+	inline bool isFull() const { return size() >= (int)m_capacity; }
+	/** maximum number of queued elements since construction or last resetHighWaterMark,
+	 * resetHighWaterMark should be called while producer is not running in lock free mode */
+	inline int highWaterMark() const { return load(m_high_water); }
+	inline void resetHighWaterMark() { store(m_high_water, size()); }
+
+	/**
+	 * append object at the tail
+	 * @return false if the queue is full, object is not queued
+	 */
+	bool put(T object) {
+		const uint32_t tail = m_tail;
+		const uint32_t n = tail - load(m_head);
+		if (UNLIKELY(n >= m_capacity)) {
+			return false;
+		}
+		m_elements[tail & m_mask] = object;
+		store(m_tail, tail + 1);
+		if (n + 1 > m_high_water) {
+			store(m_high_water, n + 1);
+		}
+		return true;
+	}
+
+	/**
+	 * remove and return the object at the head
+	 * @return NULL if the queue is empty
+	 */
+	T get() {
+		const uint32_t head = m_head;
+		if (UNLIKELY(head == load(m_tail))) {
+			return NULL;
+		}
+		T obj = m_elements[head & m_mask];
+		store(m_head, head + 1);
+		return obj;
+	}
+
+	/**
+	 * remove the object at the head into object, this is for non-pointer T
+	 * @return false if the queue is empty
+	 */
+	bool get(T &object) {
+		const uint32_t head = m_head;
+		if (UNLIKELY(head == load(m_tail))) {
+			return false;
+		}
+		object = m_elements[head & m_mask];
+		store(m_head, head + 1);
+		return true;
+	}
+
+	/**
+	 * return index-th object from the head without removing
+	 */
+	inline T peek(int index = 0) const { return m_elements[(m_head + index) & m_mask]; }
+	inline T operator[](int index) const { return peek(index); }
+
+	/**
+	 * clear the queue but never delete actual T instance
+	 */
+	inline void clear() {
+		store(m_head, load(m_tail));
+	}
+};
+
+#endif	// RINGBUFFER_H_
@@ -38,6 +38,7 @@
 
 #include "libUVCCamera.h"
 #include "UVCCamera.h"
+#include "FramePool.h"
 
 /**
  * set the value into the long field
@@ -226,6 +227,37 @@ static jint nativeSetPreviewSize(JNIEnv *env, jobject thiz,
 	RETURN(JNI_ERR, jint);
 }
 
+// プレビュー中にスレッドを止めずに解像度/フォーマットを切り替える
+static jint nativeSwitchFormat(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera, jint width, jint height, jint min_fps, jint max_fps, jint mode, jfloat bandwidth) {
+
+	ENTER();
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera)) {
+		return camera->switchFormat(width, height, min_fps, max_fps, mode, bandwidth);
+	}
+	RETURN(JNI_ERR, jint);
+}
+
+static jint nativeGetSwitchTime(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera) {
+
+	jint result = -1;
+	ENTER();
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera)) {
+		result = camera->getSwitchTime();
+	}
+	RETURN(result, jint);
+}
+
+static void nativeTrimFramePool(JNIEnv *env, jclass clazz) {
+
+	ENTER();
+	FramePool::getInstance()->trim();
+	EXIT();
+}
+
 static jint nativeStartPreview(JNIEnv *env, jobject thiz,
 	ID_TYPE id_camera) {
 
@@ -264,18 +296,86 @@ static jint nativeSetPreviewDisplay(JNIEnv *env, jobject thiz,
 }
 
 static jint nativeSetFrameCallback(JNIEnv *env, jobject thiz,
-	ID_TYPE id_camera, jobject jIFrameCallback, jint pixel_format) {
+	ID_TYPE id_camera, jobject jIFrameCallback, jint pixel_format,
+	jint width, jint height, jfloat max_fps) {
 
 	jint result = JNI_ERR;
 	ENTER();
 	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
 	if (LIKELY(camera)) {
 		jobject frame_callback_obj = env->NewGlobalRef(jIFrameCallback);
-		result = camera->setFrameCallback(env, frame_callback_obj, pixel_format);
+		result = camera->setFrameCallback(env, frame_callback_obj, pixel_format, width, height, max_fps);
 	}
 	RETURN(result, jint);
 }
 
+static jobjectArray nativeSetFrameSlotCallback(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera, jobject jIFrameSlotCallback, jint pixel_format, jint num_slots,
+	jint width, jint height, jfloat max_fps) {
+
+	jobjectArray result = NULL;
+	ENTER();
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera)) {
+		jobject frame_callback_obj = env->NewGlobalRef(jIFrameSlotCallback);
+		result = camera->setFrameSlotCallback(env, frame_callback_obj, pixel_format, num_slots,
+			width, height, max_fps);
+	}
+	RET(result);
+}
+
+static jint nativeAddFrameCallback(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera, jobject jIFrameCallback, jint pixel_format,
+	jint width, jint height, jfloat max_fps) {
+
+	jint result = JNI_ERR;
+	ENTER();
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera && jIFrameCallback)) {
+		jobject frame_callback_obj = env->NewGlobalRef(jIFrameCallback);
+		result = camera->addFrameCallback(env, frame_callback_obj, pixel_format, width, height, max_fps);
+	}
+	RETURN(result, jint);
+}
+
+static jobjectArray nativeAddFrameSlotCallback(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera, jobject jIFrameSlotCallback, jint pixel_format, jint num_slots,
+	jint width, jint height, jfloat max_fps) {
+
+	jobjectArray result = NULL;
+	ENTER();
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera && jIFrameSlotCallback)) {
+		jobject frame_callback_obj = env->NewGlobalRef(jIFrameSlotCallback);
+		result = camera->addFrameSlotCallback(env, frame_callback_obj, pixel_format, num_slots,
+			width, height, max_fps);
+	}
+	RET(result);
+}
+
+static jint nativeRemoveFrameCallback(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera, jobject jCallback) {
+
+	jint result = JNI_ERR;
+	ENTER();
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera && jCallback)) {
+		result = camera->removeFrameCallback(env, jCallback);
+	}
+	RETURN(result, jint);
+}
+
+static jint nativeReleaseFrameSlot(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera, jobject jIFrameSlotCallback, jint slot) {
+
+	jint result = JNI_ERR;
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera)) {
+		result = camera->releaseFrameSlot(env, jIFrameSlotCallback, slot);
+	}
+	return result;
+}
+
 static jint nativeSetCaptureDisplay(JNIEnv *env, jobject thiz,
 	ID_TYPE id_camera, jobject jSurface) {
 
@@ -289,6 +389,116 @@ static jint nativeSetCaptureDisplay(JNIEnv *env, jobject thiz,
 	RETURN(result, jint);
 }
 
+static jint nativeCaptureStill(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera, jstring path_str, jint num_frames, jint quality) {
+
+	jint result = JNI_ERR;
+	ENTER();
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera && path_str)) {
+		const char *c_path = env->GetStringUTFChars(path_str, JNI_FALSE);
+		result = camera->captureStill(c_path, num_frames, quality);
+		env->ReleaseStringUTFChars(path_str, c_path);
+	}
+	RETURN(result, jint);
+}
+
+static jint nativeSetDecodeSkipMode(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera, jint mode) {
+
+	jint result = JNI_ERR;
+	ENTER();
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera)) {
+		result = camera->setDecodeSkipMode(mode);
+	}
+	RETURN(result, jint);
+}
+
+static jint nativeSetDecodeProfile(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera, jint profile) {
+
+	jint result = JNI_ERR;
+	ENTER();
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera)) {
+		result = camera->setDecodeProfile(profile);
+	}
+	RETURN(result, jint);
+}
+
+static jint nativeGetSkippedDecodeCount(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera) {
+
+	jint result = 0;
+	ENTER();
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera)) {
+		result = camera->getSkippedDecodeCount();
+	}
+	RETURN(result, jint);
+}
+
+static jint nativeSetLowLatencyMode(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera, jboolean enable) {
+
+	jint result = JNI_ERR;
+	ENTER();
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera)) {
+		result = camera->setLowLatencyMode(enable);
+	}
+	RETURN(result, jint);
+}
+
+static jint nativeGetPreviewLatency(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera, jint percentile) {
+
+	jint result = -1;
+	ENTER();
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera)) {
+		result = camera->getPreviewLatency(percentile);
+	}
+	RETURN(result, jint);
+}
+
+static jint nativeGetStaleDropCount(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera) {
+
+	jint result = 0;
+	ENTER();
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera)) {
+		result = camera->getStaleDropCount();
+	}
+	RETURN(result, jint);
+}
+
+static jint nativeSetPipelinedPreview(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera, jboolean enable) {
+
+	jint result = JNI_ERR;
+	ENTER();
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera)) {
+		result = camera->setPipelinedPreview(enable);
+	}
+	RETURN(result, jint);
+}
+
+static jint nativeGetPreviewStageTime(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera, jint stage, jboolean max) {
+
+	jint result = -1;
+	ENTER();
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera)) {
+		result = camera->getPreviewStageTime(stage, max);
+	}
+	RETURN(result, jint);
+}
+
 //======================================================================
 // カメラコントロールでサポートしている機能を取得する
 static jlong nativeGetCtrlSupports(JNIEnv *env, jobject thiz,
@@ -2024,12 +2234,29 @@ static JNINativeMethod methods[] = {
 
 	{ "nativeGetSupportedSize",			"(J)Ljava/lang/String;", (void *) nativeGetSupportedSize },
 	{ "nativeSetPreviewSize",			"(JIIIIIF)I", (void *) nativeSetPreviewSize },
+	{ "nativeSwitchFormat",				"(JIIIIIF)I", (void *) nativeSwitchFormat },
+	{ "nativeGetSwitchTime",			"(J)I", (void *) nativeGetSwitchTime },
+	{ "nativeTrimFramePool",			"()V", (void *) nativeTrimFramePool },
 	{ "nativeStartPreview",				"(J)I", (void *) nativeStartPreview },
 	{ "nativeStopPreview",				"(J)I", (void *) nativeStopPreview },
 	{ "nativeSetPreviewDisplay",		"(JLandroid/view/Surface;)I", (void *) nativeSetPreviewDisplay },
-	{ "nativeSetFrameCallback",			"(JLcom/serenegiant/usb/IFrameCallback;I)I", (void *) nativeSetFrameCallback },
+	{ "nativeSetFrameCallback",			"(JLcom/serenegiant/usb/IFrameCallback;IIIF)I", (void *) nativeSetFrameCallback },
+	{ "nativeSetFrameSlotCallback",		"(JLcom/serenegiant/usb/IFrameSlotCallback;IIIIF)[Ljava/nio/ByteBuffer;", (void *) nativeSetFrameSlotCallback },
+	{ "nativeAddFrameCallback",			"(JLcom/serenegiant/usb/IFrameCallback;IIIF)I", (void *) nativeAddFrameCallback },
+	{ "nativeAddFrameSlotCallback",		"(JLcom/serenegiant/usb/IFrameSlotCallback;IIIIF)[Ljava/nio/ByteBuffer;", (void *) nativeAddFrameSlotCallback },
+	{ "nativeRemoveFrameCallback",		"(JLjava/lang/Object;)I", (void *) nativeRemoveFrameCallback },
+	{ "nativeReleaseFrameSlot",			"(JLcom/serenegiant/usb/IFrameSlotCallback;I)I", (void *) nativeReleaseFrameSlot },
 
 	{ "nativeSetCaptureDisplay",		"(JLandroid/view/Surface;)I", (void *) nativeSetCaptureDisplay },
+	{ "nativeCaptureStill",				"(JLjava/lang/String;II)I", (void *) nativeCaptureStill },
+	{ "nativeSetDecodeSkipMode",		"(JI)I", (void *) nativeSetDecodeSkipMode },
+	{ "nativeGetSkippedDecodeCount",	"(J)I", (void *) nativeGetSkippedDecodeCount },
+	{ "nativeSetDecodeProfile",			"(JI)I", (void *) nativeSetDecodeProfile },
+	{ "nativeSetLowLatencyMode",		"(JZ)I", (void *) nativeSetLowLatencyMode },
+	{ "nativeGetPreviewLatency",		"(JI)I", (void *) nativeGetPreviewLatency },
+	{ "nativeGetStaleDropCount",		"(J)I", (void *) nativeGetStaleDropCount },
+	{ "nativeSetPipelinedPreview",		"(JZ)I", (void *) nativeSetPipelinedPreview },
+	{ "nativeGetPreviewStageTime",		"(JIZ)I", (void *) nativeGetPreviewStageTime },
 
 	{ "nativeGetCtrlSupports",			"(J)J", (void *) nativeGetCtrlSupports },
 	{ "nativeGetProcSupports",			"(J)J", (void *) nativeGetProcSupports },
@@ -470,7 +470,8 @@ typedef struct uvc_frame {
 	size_t step;
 	/** Frame number (may skip, but is strictly monotonically increasing) */
 	uint32_t sequence;
-	/** Estimate of system time when the device started capturing the image */
+	/** Estimate of system time when the device started capturing the image
+	 * XXX this is based on CLOCK_MONOTONIC */
 	struct timeval capture_time;
 	/** Handle on the device that produced the image.
 	 * @warning You must not call any uvc_* functions during a callback. */
@@ -482,6 +483,9 @@ typedef struct uvc_frame {
 	 * Set this field to zero if you are supplying the buffer.
 	 */
 	uint8_t library_owns_data;
+	/** XXX Allocated size of data buffer when library owns data,
+	 * data_bytes may be smaller than this when the frame is reused for smaller image */
+	size_t capacity_bytes;
 } uvc_frame_t;
 
 /** A callback function to handle incoming assembled UVC frames
@@ -786,6 +790,7 @@ uvc_frame_t *uvc_allocate_frame(size_t data_bytes);
 void uvc_free_frame(uvc_frame_t *frame);
 
 uvc_error_t uvc_duplicate_frame(uvc_frame_t *in, uvc_frame_t *out);
+uvc_error_t uvc_yuyv_scale(uvc_frame_t *in, uvc_frame_t *out, int width, int height);	// XXX
 //----------------------------------------------------------------------
 uvc_error_t uvc_yuyv2rgb(uvc_frame_t *in, uvc_frame_t *out);
 uvc_error_t uvc_uyvy2rgb(uvc_frame_t *in, uvc_frame_t *out);
@@ -796,11 +801,28 @@ uvc_error_t uvc_uyvy2bgr(uvc_frame_t *in, uvc_frame_t *out);
 uvc_error_t uvc_any2bgr(uvc_frame_t *in, uvc_frame_t *out);
 
 #ifdef LIBUVC_HAS_JPEG
+/** MJPEG decoder profile, trade image quality for decoding speed
+ * @ingroup frame
+ */
+enum uvc_mjpeg_profile {	// XXX
+	/** fast integer DCT, no fancy upsampling(merged upsampling if possible), no dithering */
+	UVC_MJPEG_PROFILE_FASTEST = 0,
+	/** fast integer DCT with fancy upsampling, default */
+	UVC_MJPEG_PROFILE_BALANCED = 1,
+	/** accurate integer DCT with fancy upsampling */
+	UVC_MJPEG_PROFILE_ACCURATE = 2,
+};
 uvc_error_t uvc_mjpeg2rgb(uvc_frame_t *in, uvc_frame_t *out);
 uvc_error_t uvc_mjpeg2bgr(uvc_frame_t *in, uvc_frame_t *out);		// XXX
 uvc_error_t uvc_mjpeg2rgb565(uvc_frame_t *in, uvc_frame_t *out);	// XXX
 uvc_error_t uvc_mjpeg2rgbx(uvc_frame_t *in, uvc_frame_t *out);		// XXX
 uvc_error_t uvc_mjpeg2yuyv(uvc_frame_t *in, uvc_frame_t *out);		// XXX
+uvc_error_t uvc_mjpeg_set_parallel(int max_threads);		// XXX
+uvc_error_t uvc_mjpeg_set_profile(enum uvc_mjpeg_profile profile);	// XXX
+uvc_error_t uvc_jpeg_set_quality(int quality);				// XXX
+uvc_error_t uvc_yuyv2jpeg(uvc_frame_t *in, uvc_frame_t *out);		// XXX
+uvc_error_t uvc_uyvy2jpeg(uvc_frame_t *in, uvc_frame_t *out);		// XXX
+uvc_error_t uvc_any2jpeg(uvc_frame_t *in, uvc_frame_t *out);		// XXX
 #endif
 
 uvc_error_t uvc_yuyv2rgb565(uvc_frame_t *in, uvc_frame_t *out);		// XXX
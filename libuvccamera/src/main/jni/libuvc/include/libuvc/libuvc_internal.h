@@ -268,6 +268,7 @@ struct uvc_stream_handle {
   uint32_t seq, hold_seq;
   uint32_t pts, hold_pts;
   uint32_t last_scr, hold_last_scr;
+  struct timeval hold_capture_time;	// XXX recovered capture time of hold buffer
   size_t got_bytes, hold_bytes;
   size_t size_buf;	// XXX add for boundary check
   uint8_t *outbuf, *holdbuf;
@@ -330,6 +331,7 @@ uvc_error_t uvc_query_stream_ctrl(
 void uvc_start_handler_thread(uvc_context_t *ctx);
 uvc_error_t uvc_claim_if(uvc_device_handle_t *devh, int idx);
 uvc_error_t uvc_release_if(uvc_device_handle_t *devh, int idx);
+void uvc_mjpeg_stop_parallel(void);	// XXX
 
 #endif // !def(LIBUVC_INTERNAL_H)
 /** @endcond */
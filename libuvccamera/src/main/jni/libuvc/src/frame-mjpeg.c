@@ -42,7 +42,11 @@
 #include "libuvc/libuvc.h"
 #include "libuvc/libuvc_internal.h"
 #include <jpeglib.h>
+#include <jerror.h>
 #include <setjmp.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
 
 extern uvc_error_t uvc_ensure_frame_size(uvc_frame_t *frame, size_t need_bytes);
 
@@ -144,11 +148,10 @@ static inline void insert_huff_tables(j_decompress_ptr dinfo) {
 }
 
 // XXX added to improve the performance of decoding
-// maximun reading lines for each call of jpeg_read_scanlines
-// when defined this macro, it's value should be common factor
-// of all available frame height.
-// (1, 2, 4, 5, 6, 8, 10, 12, 20, 40...for 720p&1080p)
-#define MAX_READLINE 8
+// maximun reading lines for each call of jpeg_read_scanlines,
+// actual number of lines is selected by decoder profile(see below)
+// and should not exceed this value.
+#define MAX_READLINE 16
 
 #ifndef MAX_READLINE
 #define MAX_READLINE 1
@@ -158,6 +161,581 @@ static inline void insert_huff_tables(j_decompress_ptr dinfo) {
 #define MAX_READLINE 1
 #endif
 
+//**********************************************************************
+// XXX decoder profiles to trade image quality for decoding speed
+// profile is kept for each thread, so each preview/consumer thread
+// can select its own profile with uvc_mjpeg_set_profile.
+// merged upsampling is selected by libjpeg-turbo itself when fancy
+// upsampling is disabled and output is RGB family with 2h1v/2h2v chroma.
+//**********************************************************************
+typedef struct mjpeg_decode_params {
+	J_DCT_METHOD dct_method;
+	boolean do_fancy_upsampling;
+	J_DITHER_MODE dither_mode;		// only affects RGB565 output
+	int readline;					// lines for each call of jpeg_read_scanlines
+} mjpeg_decode_params_t;
+
+static const mjpeg_decode_params_t decode_params[] = {
+	// UVC_MJPEG_PROFILE_FASTEST
+	{ JDCT_IFAST, FALSE, JDITHER_NONE, 16 },
+	// UVC_MJPEG_PROFILE_BALANCED, same as previous fixed settings
+	{ JDCT_IFAST, TRUE, JDITHER_FS, 8 },
+	// UVC_MJPEG_PROFILE_ACCURATE
+	{ JDCT_ISLOW, TRUE, JDITHER_FS, 8 },
+};
+
+static pthread_key_t decode_profile_key;
+static pthread_once_t decode_profile_once = PTHREAD_ONCE_INIT;
+
+static void create_decode_profile_key(void) {
+	pthread_key_create(&decode_profile_key, NULL);
+}
+
+/** @brief Set MJPEG decoder profile for the calling thread
+ * @ingroup frame
+ *
+ * @param profile UVC_MJPEG_PROFILE_FASTEST/BALANCED/ACCURATE,
+ * threads that never call this function use UVC_MJPEG_PROFILE_BALANCED
+ */
+uvc_error_t uvc_mjpeg_set_profile(enum uvc_mjpeg_profile profile) {
+	if (UNLIKELY((profile < UVC_MJPEG_PROFILE_FASTEST) || (profile > UVC_MJPEG_PROFILE_ACCURATE)))
+		return UVC_ERROR_INVALID_PARAM;
+	pthread_once(&decode_profile_once, create_decode_profile_key);
+	// store profile + 1 so that NULL means default
+	return pthread_setspecific(decode_profile_key, (void *)(intptr_t)(profile + 1))
+		? UVC_ERROR_NO_MEM : UVC_SUCCESS;
+}
+
+static const mjpeg_decode_params_t *get_decode_params(void) {
+	pthread_once(&decode_profile_once, create_decode_profile_key);
+	const intptr_t v = (intptr_t)pthread_getspecific(decode_profile_key);
+	return &decode_params[v ? v - 1 : UVC_MJPEG_PROFILE_BALANCED];
+}
+
+static inline void apply_decode_params(j_decompress_ptr dinfo, const mjpeg_decode_params_t *params) {
+	dinfo->dct_method = params->dct_method;
+	dinfo->do_fancy_upsampling = params->do_fancy_upsampling;
+	dinfo->dither_mode = params->dither_mode;
+}
+
+static inline unsigned char sat(int i) {
+	return (unsigned char) (i >= 255 ? 255 : (i < 0 ? 0 : i));
+}
+
+#define YCbCr_YUYV_2(YCbCr, yuyv) \
+	{ \
+		*(yuyv++) = *(YCbCr+0); \
+		*(yuyv++) = (*(YCbCr+1) + *(YCbCr+4)) >> 1; \
+		*(yuyv++) = *(YCbCr+3); \
+		*(yuyv++) = (*(YCbCr+2) + *(YCbCr+5)) >> 1; \
+	}
+
+//**********************************************************************
+// XXX added to reduce the latency of decoding large MJPEG frames
+// If the frame has restart markers(DRI), MCU rows that start just after
+// a restart marker can be decoded independently because the DC predictors
+// are reset there. So we split the entropy coded data at restart markers
+// that lie on MCU row boundaries and decode each range on a separate thread,
+// writing directly into the output frame.
+// Each range is fed to libjpeg as an independent JPEG image that shares
+// the header of the original frame(SOF height is patched on the fly),
+// so no compressed data is copied.
+//**********************************************************************
+// maximum number of threads including the caller thread
+#define MAX_PARALLEL_THREADS 8
+// frames smaller than this are decoded on the caller thread
+#define MIN_PARALLEL_PIXELS (1280 * 720)
+// chunks must start at the restart interval whose number is multiple of 8
+// so that the restart markers in each chunk start with RST0
+#define RST_CYCLE 8
+
+typedef struct mjpeg_parallel_job {
+	const uint8_t *data;
+	size_t header_bytes;			// SOI...end of SOS segment
+	size_t sof_height_offset;		// offset of the height field in SOF segment
+	int num_chunks;
+	size_t chunk_start[MAX_PARALLEL_THREADS];	// offset of entropy coded data
+	size_t chunk_end[MAX_PARALLEL_THREADS];
+	uint32_t chunk_y[MAX_PARALLEL_THREADS];		// first line of each chunk
+	uint32_t chunk_lines[MAX_PARALLEL_THREADS];
+	uint32_t width;
+	int max_v;						// vertical sampling factor of luminance
+	const mjpeg_decode_params_t *params;
+	J_COLOR_SPACE out_color_space;
+	int to_yuyv;					// YCbCr => yuyv while copying into output
+	uint8_t *out;
+	size_t out_step;
+	// these fields are protected by parallel_mutex
+	int next_chunk;
+	int done_chunks;
+	int failed;
+	struct mjpeg_parallel_job *next;
+} mjpeg_parallel_job_t;
+
+static pthread_mutex_t parallel_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t parallel_job_sync = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t parallel_done_sync = PTHREAD_COND_INITIALIZER;
+static mjpeg_parallel_job_t *parallel_jobs = NULL;
+static pthread_t parallel_threads[MAX_PARALLEL_THREADS];
+static int parallel_workers = 0;
+static int parallel_max_threads = 0;		// 0: not initialized yet
+static int parallel_exiting = 0;			// worker threads are being terminated
+
+/** @brief Set maximum number of threads to decode one MJPEG frame
+ * @ingroup frame
+ *
+ * Frames that have restart markers on MCU row boundaries are split into
+ * ranges of MCU rows and decoded in parallel.
+ * @param max_threads maximum number of threads including the caller thread,
+ * 1 disables parallel decoding and 0 or negative value uses number of cpu cores
+ */
+uvc_error_t uvc_mjpeg_set_parallel(int max_threads) {
+	if (max_threads <= 0) {
+		max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if (max_threads < 1)
+		max_threads = 1;
+	if (max_threads > MAX_PARALLEL_THREADS)
+		max_threads = MAX_PARALLEL_THREADS;
+	pthread_mutex_lock(&parallel_mutex);
+	{
+		parallel_max_threads = max_threads;
+	}
+	pthread_mutex_unlock(&parallel_mutex);
+	return UVC_SUCCESS;
+}
+
+/**
+ * @internal
+ * terminate worker threads of parallel decoding, called from uvc_exit.
+ * frames that are being decoded are finished before the workers exit
+ * and the workers are created again on demand.
+ */
+void uvc_mjpeg_stop_parallel(void) {
+	pthread_t threads[MAX_PARALLEL_THREADS];
+	int i, num_threads;
+
+	pthread_mutex_lock(&parallel_mutex);
+	{
+		if (parallel_exiting) {
+			// other thread is terminating workers
+			pthread_mutex_unlock(&parallel_mutex);
+			return;
+		}
+		num_threads = parallel_workers;
+		memcpy(threads, parallel_threads, sizeof(pthread_t) * num_threads);
+		parallel_workers = 0;
+		parallel_exiting = 1;
+		pthread_cond_broadcast(&parallel_job_sync);
+	}
+	pthread_mutex_unlock(&parallel_mutex);
+	for (i = 0; i < num_threads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	pthread_mutex_lock(&parallel_mutex);
+	{
+		parallel_exiting = 0;
+	}
+	pthread_mutex_unlock(&parallel_mutex);
+}
+
+typedef struct chunk_source_mgr {
+	struct jpeg_source_mgr pub;
+	const JOCTET *segments[5];
+	size_t segment_bytes[5];
+	int num_segments;
+	int segment_index;
+	JOCTET height[2];
+} chunk_source_mgr_t;
+
+static const JOCTET eoi_marker[2] = { 0xff, JPEG_EOI };
+
+static void chunk_init_source(j_decompress_ptr dinfo) {
+}
+
+static boolean chunk_fill_input_buffer(j_decompress_ptr dinfo) {
+	chunk_source_mgr_t *src = (chunk_source_mgr_t *)dinfo->src;
+	if (LIKELY(src->segment_index < src->num_segments)) {
+		src->pub.next_input_byte = src->segments[src->segment_index];
+		src->pub.bytes_in_buffer = src->segment_bytes[src->segment_index];
+		src->segment_index++;
+	} else {
+		// premature end of data, insert fake EOI marker same as jpeg_mem_src
+		src->pub.next_input_byte = eoi_marker;
+		src->pub.bytes_in_buffer = 2;
+	}
+	return TRUE;
+}
+
+static void chunk_skip_input_data(j_decompress_ptr dinfo, long num_bytes) {
+	struct jpeg_source_mgr *src = dinfo->src;
+	if (num_bytes > 0) {
+		for (; num_bytes > (long)src->bytes_in_buffer ;) {
+			num_bytes -= (long)src->bytes_in_buffer;
+			(*src->fill_input_buffer)(dinfo);
+		}
+		src->next_input_byte += (size_t)num_bytes;
+		src->bytes_in_buffer -= (size_t)num_bytes;
+	}
+}
+
+static void chunk_term_source(j_decompress_ptr dinfo) {
+}
+
+/**
+ * parse the header of MJPEG frame and find the ranges of entropy coded data
+ * that can be decoded independently
+ * @return 0 if the frame can be decoded in parallel
+ */
+static int prepare_parallel_job(const uvc_frame_t *in, mjpeg_parallel_job_t *job, const int max_chunks) {
+	const uint8_t *data = (const uint8_t *)in->data;
+	const size_t bytes = in->actual_bytes;
+	uint32_t width = 0, height = 0, restart_interval = 0;
+	int max_h = 1, max_v = 1, num_components = 0, i;
+	size_t p;
+
+	if (UNLIKELY((bytes < 4) || (data[0] != 0xff) || (data[1] != 0xd8)))
+		return -1;
+	job->header_bytes = job->sof_height_offset = 0;
+	for (p = 2; !job->header_bytes && (p + 4 <= bytes) ;) {
+		if (UNLIKELY(data[p] != 0xff))
+			return -1;
+		const uint8_t marker = data[p + 1];
+		if (marker == 0xff) {	// fill byte
+			p++;
+			continue;
+		}
+		const size_t len = (data[p + 2] << 8) | data[p + 3];
+		if (UNLIKELY((len < 2) || (p + 2 + len > bytes)))
+			return -1;
+		const uint8_t *seg = data + p + 4;
+		switch (marker) {
+		case 0xc0:	// SOF0, baseline
+		case 0xc1:	// SOF1, extended sequential, huffman
+			if (UNLIKELY(len < 8))
+				return -1;
+			job->sof_height_offset = p + 5;
+			height = (seg[1] << 8) | seg[2];
+			width = (seg[3] << 8) | seg[4];
+			num_components = seg[5];
+			if (UNLIKELY(!num_components || (len < 8 + num_components * 3)))
+				return -1;
+			for (i = 0; i < num_components; i++) {
+				const int h = seg[6 + i * 3 + 1] >> 4;
+				const int v = seg[6 + i * 3 + 1] & 0x0f;
+				if (h > max_h) max_h = h;
+				if (v > max_v) max_v = v;
+			}
+			break;
+		case 0xc2: case 0xc3: case 0xc5: case 0xc6: case 0xc7:
+		case 0xc9: case 0xca: case 0xcb: case 0xcd: case 0xce: case 0xcf:
+			// progressive, lossless, hierarchical or arithmetic coding is not supported
+			return -1;
+		case 0xdd:	// DRI
+			if (UNLIKELY(len < 4))
+				return -1;
+			restart_interval = (seg[0] << 8) | seg[1];
+			break;
+		case 0xda:	// SOS, all components should be in one scan
+			if (UNLIKELY(!num_components || (seg[0] != num_components)))
+				return -1;
+			job->header_bytes = p + 2 + len;
+			break;
+		}
+		p += 2 + len;
+	}
+	if (UNLIKELY(!job->header_bytes || !job->sof_height_offset || !restart_interval
+		|| (width != in->width) || (height != in->height)))
+		return -1;
+
+	// find restart intervals that start at the beginning of MCU rows
+	const uint32_t mcu_height = 8 * max_v;
+	const uint32_t mcus_per_row = (width + 8 * max_h - 1) / (8 * max_h);
+	const uint32_t mcu_rows = (height + mcu_height - 1) / mcu_height;
+	uint32_t a = restart_interval, b = mcus_per_row, t;
+	for (; b ;) { t = a % b; a = b; b = t; }	// a = gcd
+	uint32_t step = mcus_per_row / a;	// number of restart intervals between row aligned restart intervals
+	for (a = step, b = RST_CYCLE; b ;) { t = a % b; a = b; b = t; }
+	step = step / a * RST_CYCLE;		// also aligned to RST0
+	const uint32_t rows_per_step = step * restart_interval / mcus_per_row;
+	const uint32_t num_boundaries = (mcu_rows + rows_per_step - 1) / rows_per_step;
+	int num_chunks = num_boundaries < (uint32_t)max_chunks ? (int)num_boundaries : max_chunks;
+	if (num_chunks < 2)
+		return -1;
+
+	// chunk n starts just after the restart marker that ends interval chunk_interval[n] - 1
+	uint32_t chunk_interval[MAX_PARALLEL_THREADS];
+	for (i = 0; i < num_chunks; i++) {
+		const uint32_t boundary = (uint32_t)i * num_boundaries / num_chunks;
+		chunk_interval[i] = boundary * step;
+		job->chunk_y[i] = boundary * rows_per_step * mcu_height;
+	}
+	for (i = 0; i < num_chunks - 1; i++) {
+		job->chunk_lines[i] = job->chunk_y[i + 1] - job->chunk_y[i];
+	}
+	job->chunk_lines[num_chunks - 1] = height - job->chunk_y[num_chunks - 1];
+
+	// scan restart markers in entropy coded data
+	job->chunk_start[0] = job->header_bytes;
+	const uint8_t *end = data + bytes;
+	const uint8_t *q = data + job->header_bytes;
+	uint32_t num_markers = 0;
+	int n = 1;
+	for (; (n < num_chunks) && (q < end - 1) ;) {
+		q = (const uint8_t *)memchr(q, 0xff, end - q - 1);
+		if (UNLIKELY(!q))
+			break;
+		const uint8_t marker = q[1];
+		if ((marker >= JPEG_RST0) && (marker <= JPEG_RST0 + 7)) {
+			if (UNLIKELY((marker - JPEG_RST0) != (num_markers & 7)))
+				return -1;	// broken frame
+			num_markers++;
+			if (num_markers == chunk_interval[n]) {
+				job->chunk_end[n - 1] = q - data;
+				job->chunk_start[n] = q - data + 2;
+				n++;
+			}
+			q += 2;
+		} else if (marker == 0xff) {
+			q++;	// fill byte
+		} else if (marker == 0x00) {
+			q += 2;	// stuffed zero byte
+		} else {
+			return -1;	// EOI or unexpected marker before reaching the last chunk
+		}
+	}
+	if (UNLIKELY(n < num_chunks))
+		return -1;
+	job->chunk_end[num_chunks - 1] = bytes;
+	job->num_chunks = num_chunks;
+	job->width = width;
+	job->max_v = max_v;
+	return 0;
+}
+
+/**
+ * decode one chunk of parallel job into the output frame
+ * @return 0 on success
+ */
+static int decode_chunk(mjpeg_parallel_job_t *job, const int index) {
+	struct jpeg_decompress_struct dinfo;
+	struct error_mgr jerr;
+	chunk_source_mgr_t src;
+	unsigned char *buffer[MAX_READLINE];
+	JSAMPARRAY temp = NULL;
+	uint32_t lines_read = 0;
+	int num_scanlines, i, j;
+	const uint32_t lines = job->chunk_lines[index];
+	uint8_t *data = job->out + job->chunk_y[index] * job->out_step;
+	const size_t out_step = job->out_step;
+	const int readline = job->params->readline;
+
+	src.height[0] = (JOCTET)(lines >> 8);
+	src.height[1] = (JOCTET)(lines & 0xff);
+	src.segments[0] = job->data;
+	src.segment_bytes[0] = job->sof_height_offset;
+	src.segments[1] = src.height;
+	src.segment_bytes[1] = 2;
+	src.segments[2] = job->data + job->sof_height_offset + 2;
+	src.segment_bytes[2] = job->header_bytes - job->sof_height_offset - 2;
+	src.segments[3] = job->data + job->chunk_start[index];
+	src.segment_bytes[3] = job->chunk_end[index] - job->chunk_start[index];
+	src.segments[4] = eoi_marker;
+	src.segment_bytes[4] = 2;
+	src.num_segments = 5;
+	src.segment_index = 0;
+	src.pub.init_source = chunk_init_source;
+	src.pub.fill_input_buffer = chunk_fill_input_buffer;
+	src.pub.skip_input_data = chunk_skip_input_data;
+	src.pub.resync_to_restart = jpeg_resync_to_restart;
+	src.pub.term_source = chunk_term_source;
+	src.pub.next_input_byte = NULL;
+	src.pub.bytes_in_buffer = 0;
+
+	dinfo.err = jpeg_std_error(&jerr.super);
+	jerr.super.error_exit = _error_exit;
+
+	if (setjmp(jerr.jmp)) {
+		goto fail;
+	}
+
+	jpeg_create_decompress(&dinfo);
+	dinfo.src = &src.pub;
+	jpeg_read_header(&dinfo, TRUE);
+
+	if (dinfo.dc_huff_tbl_ptrs[0] == NULL) {
+		/* This frame is missing the Huffman tables: fill in the standard ones */
+		insert_huff_tables(&dinfo);
+	}
+
+	dinfo.out_color_space = job->out_color_space;
+	apply_decode_params(&dinfo, job->params);
+
+	jpeg_start_decompress(&dinfo);
+
+	if (LIKELY((dinfo.output_height == lines) && (dinfo.output_width == job->width))) {
+		if (job->to_yuyv) {
+			const int row_stride = dinfo.output_width * dinfo.output_components;
+			register uint8_t *yuyv, *ycbcr;
+			temp = (*dinfo.mem->alloc_sarray)
+				((j_common_ptr) &dinfo, JPOOL_IMAGE, row_stride, readline);
+			for (; dinfo.output_scanline < dinfo.output_height ;) {
+				num_scanlines = jpeg_read_scanlines(&dinfo, temp, readline);
+				for (j = 0; j < num_scanlines; j++) {
+					yuyv = data + (lines_read + j) * out_step;
+					ycbcr = temp[j];
+					for (i = 0; i < row_stride; i += 24) {	// step by YCbCr x 8 pixels = 3 x 8 bytes
+						YCbCr_YUYV_2(ycbcr + i, yuyv);
+						YCbCr_YUYV_2(ycbcr + i + 6, yuyv);
+						YCbCr_YUYV_2(ycbcr + i + 12, yuyv);
+						YCbCr_YUYV_2(ycbcr + i + 18, yuyv);
+					}
+				}
+				lines_read += num_scanlines;
+			}
+		} else {
+			for (; dinfo.output_scanline < dinfo.output_height ;) {
+				buffer[0] = data + lines_read * out_step;
+				for (i = 1; i < readline; i++)
+					buffer[i] = buffer[i-1] + out_step;
+				num_scanlines = jpeg_read_scanlines(&dinfo, buffer, readline);
+				lines_read += num_scanlines;
+			}
+		}
+	}
+	// the rest of data is just fake EOI marker, so we don't need jpeg_finish_decompress here
+	jpeg_destroy_decompress(&dinfo);
+	return lines_read == lines ? 0 : -1;
+
+fail:
+	jpeg_destroy_decompress(&dinfo);
+	return -1;
+}
+
+/** take next chunk of the job, parallel_mutex should be locked */
+static int take_chunk(mjpeg_parallel_job_t *job) {
+	int index = -1;
+	if (job->next_chunk < job->num_chunks) {
+		index = job->next_chunk++;
+		if (job->next_chunk >= job->num_chunks) {
+			// all chunks are assigned, remove the job from the queue
+			mjpeg_parallel_job_t **pp;
+			for (pp = &parallel_jobs; *pp; pp = &(*pp)->next) {
+				if (*pp == job) {
+					*pp = job->next;
+					break;
+				}
+			}
+		}
+	}
+	return index;
+}
+
+/** finish the chunk, parallel_mutex should be locked */
+static void finish_chunk(mjpeg_parallel_job_t *job, const int result) {
+	if (UNLIKELY(result))
+		job->failed++;
+	if (++job->done_chunks >= job->num_chunks)
+		pthread_cond_broadcast(&parallel_done_sync);
+}
+
+static void *parallel_worker_func(void *vptr_args) {
+	mjpeg_parallel_job_t *job;
+	int index, result;
+
+	pthread_mutex_lock(&parallel_mutex);
+	for ( ; ; ) {
+		for ( ; !parallel_jobs && !parallel_exiting ; ) {
+			pthread_cond_wait(&parallel_job_sync, &parallel_mutex);
+		}
+		if (!parallel_jobs)
+			break;	// terminating and all queued chunks are taken
+		job = parallel_jobs;
+		index = take_chunk(job);
+		pthread_mutex_unlock(&parallel_mutex);
+		result = decode_chunk(job, index);
+		pthread_mutex_lock(&parallel_mutex);
+		finish_chunk(job, result);
+	}
+	pthread_mutex_unlock(&parallel_mutex);
+	return NULL;
+}
+
+/**
+ * decode MJPEG frame in parallel if the frame has restart markers on MCU row boundaries
+ * out should be already prepared by caller
+ * @return UVC_SUCCESS if decoded, other value if the frame can not be decoded in parallel
+ * and caller should decode it as usual
+ */
+static uvc_error_t mjpeg_decode_parallel(uvc_frame_t *in, uvc_frame_t *out,
+	const J_COLOR_SPACE out_color_space, const int to_yuyv) {
+
+	mjpeg_parallel_job_t job;
+	int max_threads, index, result;
+
+	if ((in->width * in->height < MIN_PARALLEL_PIXELS) || (in->width % 16))
+		return UVC_ERROR_NOT_SUPPORTED;
+	pthread_mutex_lock(&parallel_mutex);
+	{
+		if (UNLIKELY(!parallel_max_threads)) {
+			pthread_mutex_unlock(&parallel_mutex);
+			uvc_mjpeg_set_parallel(0);
+			pthread_mutex_lock(&parallel_mutex);
+		}
+		max_threads = parallel_max_threads;
+		// worker threads are created lazily and live until uvc_mjpeg_stop_parallel is called
+		for ( ; !parallel_exiting && (parallel_workers < max_threads - 1) ; ) {
+			if (UNLIKELY(pthread_create(&parallel_threads[parallel_workers], NULL, parallel_worker_func, NULL)))
+				break;
+			parallel_workers++;
+		}
+		if (max_threads > parallel_workers + 1)
+			max_threads = parallel_workers + 1;
+	}
+	pthread_mutex_unlock(&parallel_mutex);
+	if (max_threads < 2)
+		return UVC_ERROR_NOT_SUPPORTED;
+
+	job.data = (const uint8_t *)in->data;
+	if (prepare_parallel_job(in, &job, max_threads))
+		return UVC_ERROR_NOT_SUPPORTED;
+	job.params = get_decode_params();
+	if (job.params->do_fancy_upsampling && (job.max_v >= 2))
+		// fancy upsampling of vertically subsampled chroma refers the lines of adjacent chunk,
+		// so decode on the caller thread to get the same image as the serial path.
+		// profiles without fancy upsampling(UVC_MJPEG_PROFILE_FASTEST) decode 4:2:0 frames in parallel
+		return UVC_ERROR_NOT_SUPPORTED;
+	job.out_color_space = out_color_space;
+	job.to_yuyv = to_yuyv;
+	job.out = (uint8_t *)out->data;
+	job.out_step = out->step;
+	job.next_chunk = job.done_chunks = job.failed = 0;
+	job.next = NULL;
+
+	pthread_mutex_lock(&parallel_mutex);
+	{
+		// append to the job queue
+		mjpeg_parallel_job_t **pp;
+		for (pp = &parallel_jobs; *pp; pp = &(*pp)->next) {}
+		*pp = &job;
+		pthread_cond_broadcast(&parallel_job_sync);
+		// caller thread also decodes chunks of its own job
+		for ( ; (index = take_chunk(&job)) >= 0 ; ) {
+			pthread_mutex_unlock(&parallel_mutex);
+			result = decode_chunk(&job, index);
+			pthread_mutex_lock(&parallel_mutex);
+			finish_chunk(&job, result);
+		}
+		for ( ; job.done_chunks < job.num_chunks ; ) {
+			pthread_cond_wait(&parallel_done_sync, &parallel_mutex);
+		}
+		result = job.failed;
+	}
+	pthread_mutex_unlock(&parallel_mutex);
+
+	return result ? UVC_ERROR_OTHER : UVC_SUCCESS;
+}
+
 /** @brief Convert an MJPEG frame to RGB
  * @ingroup frame
  *
@@ -169,13 +747,12 @@ LOGE("mIFrameCallback...uvc_mjpeg2rgb...转码");
 	struct jpeg_decompress_struct dinfo;
 	struct error_mgr jerr;
 	size_t lines_read;
-	// local copy
-	uint8_t *data = out->data;
-	const int out_step = out->step;
 
 	int num_scanlines, i;
 	lines_read = 0;
 	unsigned char *buffer[MAX_READLINE];
+	const mjpeg_decode_params_t *params = get_decode_params();
+	const int readline = params->readline;
 
 	out->actual_bytes = 0;	// XXX
 	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_MJPEG))
@@ -192,6 +769,12 @@ LOGE("mIFrameCallback...uvc_mjpeg2rgb...转码");
 	out->capture_time = in->capture_time;
 	out->source = in->source;
 
+	// try to decode in parallel when the frame has restart markers
+	if (mjpeg_decode_parallel(in, out, JCS_RGB, 0) == UVC_SUCCESS) {
+		out->actual_bytes = in->width * in->height * 3;	// XXX
+		return UVC_SUCCESS;
+	}
+
 	dinfo.err = jpeg_std_error(&jerr.super);
 	jerr.super.error_exit = _error_exit;
 
@@ -209,16 +792,20 @@ LOGE("mIFrameCallback...uvc_mjpeg2rgb...转码");
 	}
 
 	dinfo.out_color_space = JCS_RGB;
-	dinfo.dct_method = JDCT_IFAST;
+	apply_decode_params(&dinfo, params);
 
 	jpeg_start_decompress(&dinfo);
 
+	// local copy, out->data and out->step may be changed above
+	uint8_t *data = out->data;
+	const int out_step = out->step;
+
 	if (LIKELY(dinfo.output_height == out->height)) {
 		for (; dinfo.output_scanline < dinfo.output_height ;) {
 			buffer[0] = data + (lines_read) * out_step;
-			for (i = 1; i < MAX_READLINE; i++)
+			for (i = 1; i < readline; i++)
 				buffer[i] = buffer[i-1] + out_step;
-			num_scanlines = jpeg_read_scanlines(&dinfo, buffer, MAX_READLINE);
+			num_scanlines = jpeg_read_scanlines(&dinfo, buffer, readline);
 			lines_read += num_scanlines;
 		}
 		out->actual_bytes = in->width * in->height * 3;	// XXX
@@ -247,6 +834,8 @@ LOGE("mIFrameCallback...uvc_mjpeg2bgr...转码");
 	int num_scanlines, i;
 	lines_read = 0;
 	unsigned char *buffer[MAX_READLINE];
+	const mjpeg_decode_params_t *params = get_decode_params();
+	const int readline = params->readline;
 
 	out->actual_bytes = 0;	// XXX
 	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_MJPEG))
@@ -263,6 +852,12 @@ LOGE("mIFrameCallback...uvc_mjpeg2bgr...转码");
 	out->capture_time = in->capture_time;
 	out->source = in->source;
 
+	// try to decode in parallel when the frame has restart markers
+	if (mjpeg_decode_parallel(in, out, JCS_EXT_BGR, 0) == UVC_SUCCESS) {
+		out->actual_bytes = in->width * in->height * 3;	// XXX
+		return UVC_SUCCESS;
+	}
+
 	dinfo.err = jpeg_std_error(&jerr.super);
 	jerr.super.error_exit = _error_exit;
 
@@ -280,7 +875,7 @@ LOGE("mIFrameCallback...uvc_mjpeg2bgr...转码");
 	}
 
 	dinfo.out_color_space = JCS_EXT_BGR;
-	dinfo.dct_method = JDCT_IFAST;
+	apply_decode_params(&dinfo, params);
 
 	jpeg_start_decompress(&dinfo);
 
@@ -291,9 +886,9 @@ LOGE("mIFrameCallback...uvc_mjpeg2bgr...转码");
 	if (LIKELY(dinfo.output_height == out->height)) {
 		for (; dinfo.output_scanline < dinfo.output_height ;) {
 			buffer[0] = data + (lines_read) * out_step;
-			for (i = 1; i < MAX_READLINE; i++)
+			for (i = 1; i < readline; i++)
 				buffer[i] = buffer[i-1] + out_step;
-			num_scanlines = jpeg_read_scanlines(&dinfo, buffer, MAX_READLINE);
+			num_scanlines = jpeg_read_scanlines(&dinfo, buffer, readline);
 			lines_read += num_scanlines;
 		}
 		out->actual_bytes = in->width * in->height * 3;	// XXX
@@ -322,6 +917,8 @@ LOGE("mIFrameCallback...uvc_mjpeg2rgb565...转码");
 	int num_scanlines, i;
 	lines_read = 0;
 	unsigned char *buffer[MAX_READLINE];
+	const mjpeg_decode_params_t *params = get_decode_params();
+	const int readline = params->readline;
 
 	out->actual_bytes = 0;	// XXX
 	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_MJPEG))
@@ -338,6 +935,12 @@ LOGE("mIFrameCallback...uvc_mjpeg2rgb565...转码");
 	out->capture_time = in->capture_time;
 	out->source = in->source;
 
+	// try to decode in parallel when the frame has restart markers
+	if (mjpeg_decode_parallel(in, out, JCS_RGB565, 0) == UVC_SUCCESS) {
+		out->actual_bytes = in->width * in->height * 2;	// XXX
+		return UVC_SUCCESS;
+	}
+
 	dinfo.err = jpeg_std_error(&jerr.super);
 	jerr.super.error_exit = _error_exit;
 
@@ -355,7 +958,7 @@ LOGE("mIFrameCallback...uvc_mjpeg2rgb565...转码");
 	}
 
 	dinfo.out_color_space = JCS_RGB565;
-	dinfo.dct_method = JDCT_IFAST;
+	apply_decode_params(&dinfo, params);
 
 	jpeg_start_decompress(&dinfo);
 
@@ -366,9 +969,9 @@ LOGE("mIFrameCallback...uvc_mjpeg2rgb565...转码");
 	if (LIKELY(dinfo.output_height == out->height)) {
 		for (; dinfo.output_scanline < dinfo.output_height ;) {
 			buffer[0] = data + (lines_read) * out_step;
-			for (i = 1; i < MAX_READLINE; i++)
+			for (i = 1; i < readline; i++)
 				buffer[i] = buffer[i-1] + out_step;
-			num_scanlines = jpeg_read_scanlines(&dinfo, buffer, MAX_READLINE);
+			num_scanlines = jpeg_read_scanlines(&dinfo, buffer, readline);
 			lines_read += num_scanlines;
 		}
 		out->actual_bytes = in->width * in->height * 2;	// XXX
@@ -389,17 +992,16 @@ fail:
  * @param out RGBX frame
  */
 uvc_error_t uvc_mjpeg2rgbx(uvc_frame_t *in, uvc_frame_t *out) {
-LOGE("mIFrameCallback...uvc_mjpeg2rgbx...转码");
+//LOGE("mIFrameCallback...uvc_mjpeg2rgbx...转码");
 	struct jpeg_decompress_struct dinfo;
 	struct error_mgr jerr;
 	size_t lines_read;
-	// local copy
-	uint8_t *data = out->data;
-	const int out_step = out->step;
 
 	int num_scanlines, i;
 	lines_read = 0;
 	unsigned char *buffer[MAX_READLINE];
+	const mjpeg_decode_params_t *params = get_decode_params();
+	const int readline = params->readline;
 
 	out->actual_bytes = 0;	// XXX
 	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_MJPEG))
@@ -411,11 +1013,19 @@ LOGE("mIFrameCallback...uvc_mjpeg2rgbx...转码");
 	out->width = in->width;
 	out->height = in->height;
 	out->frame_format = UVC_FRAME_FORMAT_RGBX;	// XXX
-	out->step = in->width * 4;
+	// XXX keep step of the frame that refers external buffer(ex. locked Surface) to decode into it directly
+	if (out->library_owns_data)
+		out->step = in->width * 4;
 	out->sequence = in->sequence;
 	out->capture_time = in->capture_time;
 	out->source = in->source;
 
+	// try to decode in parallel when the frame has restart markers
+	if (mjpeg_decode_parallel(in, out, JCS_EXT_RGBA, 0) == UVC_SUCCESS) {
+		out->actual_bytes = in->width * in->height * 4;	// XXX
+		return UVC_SUCCESS;
+	}
+
 	dinfo.err = jpeg_std_error(&jerr.super);
 	jerr.super.error_exit = _error_exit;
 
@@ -433,16 +1043,20 @@ LOGE("mIFrameCallback...uvc_mjpeg2rgbx...转码");
 	}
 
 	dinfo.out_color_space = JCS_EXT_RGBA;
-	dinfo.dct_method = JDCT_IFAST;
+	apply_decode_params(&dinfo, params);
 
 	jpeg_start_decompress(&dinfo);
 
+	// local copy, out->data and out->step may be changed above
+	uint8_t *data = out->data;
+	const int out_step = out->step;
+
 	if (LIKELY(dinfo.output_height == out->height)) {
 		for (; dinfo.output_scanline < dinfo.output_height ;) {
 			buffer[0] = data + (lines_read) * out_step;
-			for (i = 1; i < MAX_READLINE; i++)
+			for (i = 1; i < readline; i++)
 				buffer[i] = buffer[i-1] + out_step;
-			num_scanlines = jpeg_read_scanlines(&dinfo, buffer, MAX_READLINE);
+			num_scanlines = jpeg_read_scanlines(&dinfo, buffer, readline);
 			lines_read += num_scanlines;
 		}
 		out->actual_bytes = in->width * in->height * 4;	// XXX
@@ -456,18 +1070,6 @@ fail:
 	return UVC_ERROR_OTHER+1;
 }
 
-static inline unsigned char sat(int i) {
-	return (unsigned char) (i >= 255 ? 255 : (i < 0 ? 0 : i));
-}
-
-#define YCbCr_YUYV_2(YCbCr, yuyv) \
-	{ \
-		*(yuyv++) = *(YCbCr+0); \
-		*(yuyv++) = (*(YCbCr+1) + *(YCbCr+4)) >> 1; \
-		*(yuyv++) = *(YCbCr+3); \
-		*(yuyv++) = (*(YCbCr+2) + *(YCbCr+5)) >> 1; \
-	}
-
 uvc_error_t uvc_mjpeg2yuyv(uvc_frame_t *in, uvc_frame_t *out) {
 
        // LOGE("mIFrameCallback...uvc_mjpeg2yuyv...转码");
@@ -482,6 +1084,8 @@ uvc_error_t uvc_mjpeg2yuyv(uvc_frame_t *in, uvc_frame_t *out) {
 	int i, j;
 	int num_scanlines;
 	register uint8_t *yuyv, *ycbcr;
+	const mjpeg_decode_params_t *params = get_decode_params();
+	const int readline = params->readline;
 
 	out->width = in->width;
 	out->height = in->height;
@@ -491,6 +1095,12 @@ uvc_error_t uvc_mjpeg2yuyv(uvc_frame_t *in, uvc_frame_t *out) {
 	out->capture_time = in->capture_time;
 	out->source = in->source;
 
+	// try to decode in parallel when the frame has restart markers
+	if (mjpeg_decode_parallel(in, out, JCS_YCbCr, 1) == UVC_SUCCESS) {
+		out->actual_bytes = in->width * in->height * 2;	// XXX
+		return UVC_SUCCESS;
+	}
+
 	struct jpeg_decompress_struct dinfo;
 	struct error_mgr jerr;
 	dinfo.err = jpeg_std_error(&jerr.super);
@@ -510,7 +1120,7 @@ uvc_error_t uvc_mjpeg2yuyv(uvc_frame_t *in, uvc_frame_t *out) {
 	}
 
 	dinfo.out_color_space = JCS_YCbCr;
-	dinfo.dct_method = JDCT_IFAST;
+	apply_decode_params(&dinfo, params);
 
 	// start decompressor
 	jpeg_start_decompress(&dinfo);
@@ -520,7 +1130,7 @@ uvc_error_t uvc_mjpeg2yuyv(uvc_frame_t *in, uvc_frame_t *out) {
 
 	// allocate buffer
 	register JSAMPARRAY buffer = (*dinfo.mem->alloc_sarray)
-		((j_common_ptr) &dinfo, JPOOL_IMAGE, row_stride, MAX_READLINE);
+		((j_common_ptr) &dinfo, JPOOL_IMAGE, row_stride, readline);
 
 	// local copy
 	uint8_t *data = out->data;
@@ -529,7 +1139,7 @@ uvc_error_t uvc_mjpeg2yuyv(uvc_frame_t *in, uvc_frame_t *out) {
 	if (LIKELY(dinfo.output_height == out->height)) {
 		for (; dinfo.output_scanline < dinfo.output_height ;) {
 			// convert lines of mjpeg data to YCbCr
-			num_scanlines = jpeg_read_scanlines(&dinfo, buffer, MAX_READLINE);
+			num_scanlines = jpeg_read_scanlines(&dinfo, buffer, readline);
 			// convert YCbCr to yuyv(YUV422)
 			for (j = 0; j < num_scanlines; j++) {
 				yuyv = data + (lines_read + j) * out_step;
@@ -555,3 +1165,389 @@ fail:
 	return lines_read == out->height ? UVC_SUCCESS : UVC_ERROR_OTHER+1;
 }
 
+
+//**********************************************************************
+// XXX JPEG encoder
+// Each thread keeps its own jpeg_compress_struct and work buffers,
+// so repeated snapshots do not need to set up the compressor every time.
+// YUYV/UYVY frames are fed as raw 4:2:2 planes(jpeg_write_raw_data)
+// to skip color conversion and downsampling inside libjpeg.
+//**********************************************************************
+#define DEFAULT_JPEG_QUALITY 90
+// initial size of output buffer, this will grow as needed
+#define MIN_JPEG_BUFFER_SZ (64 * 1024)
+
+typedef struct frame_dest_mgr {
+	struct jpeg_destination_mgr pub;
+	uvc_frame_t *frame;
+} frame_dest_mgr_t;
+
+typedef struct jpeg_encoder {
+	struct jpeg_compress_struct cinfo;
+	struct error_mgr jerr;
+	frame_dest_mgr_t dest;
+	int quality;
+	// work buffers for raw YUV input, DCTSIZE lines of Y, U and V planes
+	uint8_t *planes;
+	size_t planes_bytes;
+	JSAMPROW rows[3][DCTSIZE];
+} jpeg_encoder_t;
+
+static pthread_key_t jpeg_encoder_key;
+static pthread_once_t jpeg_encoder_once = PTHREAD_ONCE_INIT;
+
+static void frame_init_destination(j_compress_ptr cinfo) {
+	frame_dest_mgr_t *dest = (frame_dest_mgr_t *)cinfo->dest;
+	uvc_frame_t *frame = dest->frame;
+	size_t need_bytes = cinfo->image_width * cinfo->image_height;
+	if (need_bytes < MIN_JPEG_BUFFER_SZ)
+		need_bytes = MIN_JPEG_BUFFER_SZ;
+	if (!frame->data || (frame->data_bytes < need_bytes)) {
+		if (UNLIKELY(uvc_ensure_frame_size(frame, need_bytes)))
+			ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 0);
+	}
+	dest->pub.next_output_byte = frame->data;
+	dest->pub.free_in_buffer = frame->data_bytes;
+}
+
+static boolean frame_empty_output_buffer(j_compress_ptr cinfo) {
+	frame_dest_mgr_t *dest = (frame_dest_mgr_t *)cinfo->dest;
+	uvc_frame_t *frame = dest->frame;
+	// whole buffer is full, expand it and continue writing after current data
+	const size_t used_bytes = frame->data_bytes;
+	if (UNLIKELY(uvc_ensure_frame_size(frame, used_bytes * 2)))
+		ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 1);
+	dest->pub.next_output_byte = (JOCTET *)frame->data + used_bytes;
+	dest->pub.free_in_buffer = frame->data_bytes - used_bytes;
+	return TRUE;
+}
+
+static void frame_term_destination(j_compress_ptr cinfo) {
+	frame_dest_mgr_t *dest = (frame_dest_mgr_t *)cinfo->dest;
+	dest->frame->actual_bytes = dest->frame->data_bytes - dest->pub.free_in_buffer;
+}
+
+static void jpeg_encoder_destroy(void *ptr) {
+	jpeg_encoder_t *encoder = (jpeg_encoder_t *)ptr;
+	if (LIKELY(encoder)) {
+		jpeg_destroy_compress(&encoder->cinfo);
+		free(encoder->planes);
+		free(encoder);
+	}
+}
+
+static void jpeg_encoder_init_key(void) {
+	pthread_key_create(&jpeg_encoder_key, jpeg_encoder_destroy);
+}
+
+/** get the compressor of the caller thread, create it if it does not exist yet */
+static jpeg_encoder_t *get_jpeg_encoder(void) {
+	pthread_once(&jpeg_encoder_once, jpeg_encoder_init_key);
+	jpeg_encoder_t *encoder = (jpeg_encoder_t *)pthread_getspecific(jpeg_encoder_key);
+	if (UNLIKELY(!encoder)) {
+		encoder = (jpeg_encoder_t *)calloc(1, sizeof(jpeg_encoder_t));
+		if (UNLIKELY(!encoder))
+			return NULL;
+		encoder->cinfo.err = jpeg_std_error(&encoder->jerr.super);
+		encoder->jerr.super.error_exit = _error_exit;
+		if (setjmp(encoder->jerr.jmp)) {
+			free(encoder);
+			return NULL;
+		}
+		jpeg_create_compress(&encoder->cinfo);
+		encoder->dest.pub.init_destination = frame_init_destination;
+		encoder->dest.pub.empty_output_buffer = frame_empty_output_buffer;
+		encoder->dest.pub.term_destination = frame_term_destination;
+		encoder->cinfo.dest = &encoder->dest.pub;
+		encoder->quality = DEFAULT_JPEG_QUALITY;
+		pthread_setspecific(jpeg_encoder_key, encoder);
+	}
+	return encoder;
+}
+
+/** @brief Set JPEG quality of the compressor of the caller thread
+ * @ingroup frame
+ *
+ * @param quality 1-100, default is 90
+ */
+uvc_error_t uvc_jpeg_set_quality(int quality) {
+	jpeg_encoder_t *encoder = get_jpeg_encoder();
+	if (UNLIKELY(!encoder))
+		return UVC_ERROR_NO_MEM;
+	encoder->quality = quality < 1 ? 1 : (quality > 100 ? 100 : quality);
+	return UVC_SUCCESS;
+}
+
+static void prepare_output(uvc_frame_t *in, uvc_frame_t *out) {
+	out->width = in->width;
+	out->height = in->height;
+	out->frame_format = UVC_FRAME_FORMAT_MJPEG;
+	out->step = 0;
+	out->sequence = in->sequence;
+	out->capture_time = in->capture_time;
+	out->source = in->source;
+}
+
+/**
+ * compress packed 4:2:2 frame(YUYV/UYVY) as raw YCbCr data
+ * @param y_offset offset of first Y in a macro pixel, 0 for YUYV and 1 for UYVY
+ * @param u_offset offset of U in a macro pixel, 1 for YUYV and 0 for UYVY
+ */
+static uvc_error_t yuv422_to_jpeg(uvc_frame_t *in, uvc_frame_t *out, const int y_offset, const int u_offset) {
+	const uint32_t width = in->width;
+	const uint32_t height = in->height;
+	const size_t in_step = in->step ? in->step : width * 2;
+	// raw data should be padded to multiple of MCU size(16x8 for 4:2:2)
+	const size_t y_stride = (width + 15) & ~15;
+	const size_t c_stride = y_stride >> 1;
+	uint32_t i, j, x, lines;
+
+	if (UNLIKELY(!width || !height || (width & 1) || (in->actual_bytes < in_step * (height - 1) + width * 2)))
+		return UVC_ERROR_INVALID_PARAM;
+
+	jpeg_encoder_t *encoder = get_jpeg_encoder();
+	if (UNLIKELY(!encoder))
+		return UVC_ERROR_NO_MEM;
+	struct jpeg_compress_struct *cinfo = &encoder->cinfo;
+
+	const size_t planes_bytes = (y_stride + c_stride * 2) * DCTSIZE;
+	if (encoder->planes_bytes < planes_bytes) {
+		uint8_t *planes = (uint8_t *)realloc(encoder->planes, planes_bytes);
+		if (UNLIKELY(!planes))
+			return UVC_ERROR_NO_MEM;
+		encoder->planes = planes;
+		encoder->planes_bytes = planes_bytes;
+	}
+	uint8_t *y_plane = encoder->planes;
+	uint8_t *u_plane = y_plane + y_stride * DCTSIZE;
+	uint8_t *v_plane = u_plane + c_stride * DCTSIZE;
+	for (i = 0; i < DCTSIZE; i++) {
+		encoder->rows[0][i] = y_plane + y_stride * i;
+		encoder->rows[1][i] = u_plane + c_stride * i;
+		encoder->rows[2][i] = v_plane + c_stride * i;
+	}
+
+	out->actual_bytes = 0;
+	prepare_output(in, out);
+	encoder->dest.frame = out;
+
+	if (setjmp(encoder->jerr.jmp)) {
+		jpeg_abort_compress(cinfo);
+		return UVC_ERROR_OTHER;
+	}
+
+	cinfo->image_width = width;
+	cinfo->image_height = height;
+	cinfo->input_components = 3;
+	cinfo->in_color_space = JCS_YCbCr;
+	jpeg_set_defaults(cinfo);
+	jpeg_set_quality(cinfo, encoder->quality, TRUE);
+	cinfo->raw_data_in = TRUE;
+	cinfo->comp_info[0].h_samp_factor = 2;
+	cinfo->comp_info[0].v_samp_factor = 1;
+	cinfo->comp_info[1].h_samp_factor = cinfo->comp_info[2].h_samp_factor = 1;
+	cinfo->comp_info[1].v_samp_factor = cinfo->comp_info[2].v_samp_factor = 1;
+
+	jpeg_start_compress(cinfo, TRUE);
+
+	JSAMPARRAY image[3] = { encoder->rows[0], encoder->rows[1], encoder->rows[2] };
+	const uint8_t *src = (const uint8_t *)in->data;
+	for ( ; cinfo->next_scanline < height ; ) {
+		lines = height - cinfo->next_scanline;
+		if (lines > DCTSIZE)
+			lines = DCTSIZE;
+		for (j = 0; j < lines; j++) {
+			const uint8_t *yuv = src + (cinfo->next_scanline + j) * in_step;
+			uint8_t *y = encoder->rows[0][j];
+			uint8_t *u = encoder->rows[1][j];
+			uint8_t *v = encoder->rows[2][j];
+			for (x = 0; x < width; x += 2, yuv += 4) {
+				*(y++) = yuv[y_offset];
+				*(y++) = yuv[y_offset + 2];
+				*(u++) = yuv[u_offset];
+				*(v++) = yuv[u_offset + 2];
+			}
+			// replicate right edge into padding
+			for (x = width; x < y_stride; x++, y++)
+				*y = *(y - 1);
+			for (x = width >> 1; x < c_stride; x++, u++, v++) {
+				*u = *(u - 1);
+				*v = *(v - 1);
+			}
+		}
+		// replicate bottom line into padding
+		for (j = lines; j < DCTSIZE; j++) {
+			memcpy(encoder->rows[0][j], encoder->rows[0][lines - 1], y_stride);
+			memcpy(encoder->rows[1][j], encoder->rows[1][lines - 1], c_stride);
+			memcpy(encoder->rows[2][j], encoder->rows[2][lines - 1], c_stride);
+		}
+		jpeg_write_raw_data(cinfo, image, DCTSIZE);
+	}
+	jpeg_finish_compress(cinfo);
+
+	return UVC_SUCCESS;
+}
+
+/**
+ * compress packed RGB/BGR/RGBX/GRAY8 frame with color conversion of libjpeg-turbo
+ */
+static uvc_error_t packed_to_jpeg(uvc_frame_t *in, uvc_frame_t *out,
+	const J_COLOR_SPACE in_color_space, const int pixel_bytes) {
+
+	const uint32_t width = in->width;
+	const uint32_t height = in->height;
+	const size_t in_step = in->step ? in->step : width * pixel_bytes;
+	JSAMPROW buffer[MAX_READLINE];
+	int i;
+
+	if (UNLIKELY(!width || !height || (in->actual_bytes < in_step * (height - 1) + width * pixel_bytes)))
+		return UVC_ERROR_INVALID_PARAM;
+
+	jpeg_encoder_t *encoder = get_jpeg_encoder();
+	if (UNLIKELY(!encoder))
+		return UVC_ERROR_NO_MEM;
+	struct jpeg_compress_struct *cinfo = &encoder->cinfo;
+
+	out->actual_bytes = 0;
+	prepare_output(in, out);
+	encoder->dest.frame = out;
+
+	if (setjmp(encoder->jerr.jmp)) {
+		jpeg_abort_compress(cinfo);
+		return UVC_ERROR_OTHER;
+	}
+
+	cinfo->image_width = width;
+	cinfo->image_height = height;
+	cinfo->input_components = pixel_bytes;
+	cinfo->in_color_space = in_color_space;
+	jpeg_set_defaults(cinfo);
+	jpeg_set_quality(cinfo, encoder->quality, TRUE);
+
+	jpeg_start_compress(cinfo, TRUE);
+
+	uint8_t *src = (uint8_t *)in->data;
+	for ( ; cinfo->next_scanline < height ; ) {
+		buffer[0] = src + cinfo->next_scanline * in_step;
+		for (i = 1; i < MAX_READLINE; i++)
+			buffer[i] = buffer[i-1] + in_step;
+		const uint32_t remain = height - cinfo->next_scanline;
+		jpeg_write_scanlines(cinfo, buffer, remain < MAX_READLINE ? remain : MAX_READLINE);
+	}
+	jpeg_finish_compress(cinfo);
+
+	return UVC_SUCCESS;
+}
+
+// XXX MJPEG frames of UVC devices usually omit the Huffman tables(DHT),
+// many decoders can not read such frames as standalone JPEG files
+#define PUT_HUFF_TABLE(p, cls_id, name) do { \
+		*(p++) = cls_id; \
+		memcpy(p, name##_len + 1, 16); p += 16; \
+		memcpy(p, name##_val, sizeof(name##_val)); p += sizeof(name##_val); \
+	} while(0)
+
+#define DHT_SEGMENT_SZ (4 + (1 + 16) * 4 \
+	+ sizeof(dc_lumi_val) + sizeof(dc_chromi_val) + sizeof(ac_lumi_val) + sizeof(ac_chromi_val))
+
+/**
+ * copy MJPEG frame and insert the standard Huffman tables just before SOS
+ * if the frame does not have its own DHT segment
+ */
+static uvc_error_t mjpeg_to_jpeg(uvc_frame_t *in, uvc_frame_t *out) {
+	const uint8_t *data = (const uint8_t *)in->data;
+	const size_t bytes = in->actual_bytes;
+	size_t p, sos = 0;
+
+	if (UNLIKELY((bytes < 4) || (data[0] != 0xff) || (data[1] != 0xd8)))
+		return UVC_ERROR_INVALID_PARAM;
+	for (p = 2; !sos && (p + 4 <= bytes) ;) {
+		if (UNLIKELY(data[p] != 0xff))
+			break;
+		const uint8_t marker = data[p + 1];
+		if (marker == 0xff) {	// fill byte
+			p++;
+			continue;
+		}
+		if (marker == 0xc4)		// DHT, this frame is already a valid JPEG
+			return uvc_duplicate_frame(in, out);
+		if (marker == 0xda)		// SOS
+			sos = p;
+		else
+			p += 2 + ((data[p + 2] << 8) | data[p + 3]);
+	}
+	if (UNLIKELY(!sos))
+		// could not find SOS, just copy it as before
+		return uvc_duplicate_frame(in, out);
+
+	if (UNLIKELY(uvc_ensure_frame_size(out, bytes + DHT_SEGMENT_SZ) < 0))
+		return UVC_ERROR_NO_MEM;
+	prepare_output(in, out);
+	uint8_t *dst = (uint8_t *)out->data;
+	memcpy(dst, data, sos);
+	dst += sos;
+	*(dst++) = 0xff;
+	*(dst++) = 0xc4;
+	*(dst++) = (uint8_t)((DHT_SEGMENT_SZ - 2) >> 8);
+	*(dst++) = (uint8_t)((DHT_SEGMENT_SZ - 2) & 0xff);
+	PUT_HUFF_TABLE(dst, 0x00, dc_lumi);
+	PUT_HUFF_TABLE(dst, 0x01, dc_chromi);
+	PUT_HUFF_TABLE(dst, 0x10, ac_lumi);
+	PUT_HUFF_TABLE(dst, 0x11, ac_chromi);
+	memcpy(dst, data + sos, bytes - sos);
+	out->actual_bytes = bytes + DHT_SEGMENT_SZ;
+	return UVC_SUCCESS;
+}
+
+/** @brief Compress an YUYV frame to JPEG
+ * @ingroup frame
+ *
+ * @param in YUYV frame
+ * @param out JPEG(MJPEG) frame
+ */
+uvc_error_t uvc_yuyv2jpeg(uvc_frame_t *in, uvc_frame_t *out) {
+	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_YUYV))
+		return UVC_ERROR_INVALID_PARAM;
+	return yuv422_to_jpeg(in, out, 0, 1);
+}
+
+/** @brief Compress an UYVY frame to JPEG
+ * @ingroup frame
+ *
+ * @param in UYVY frame
+ * @param out JPEG(MJPEG) frame
+ */
+uvc_error_t uvc_uyvy2jpeg(uvc_frame_t *in, uvc_frame_t *out) {
+	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_UYVY))
+		return UVC_ERROR_INVALID_PARAM;
+	return yuv422_to_jpeg(in, out, 1, 0);
+}
+
+/** @brief Compress a frame to JPEG
+ * @ingroup frame
+ *
+ * MJPEG frames are copied without re-compression,
+ * the standard Huffman tables are inserted if the frame does not have them.
+ * @param in YUYV/UYVY/RGB/BGR/RGBX/GRAY8/MJPEG frame
+ * @param out JPEG(MJPEG) frame
+ */
+uvc_error_t uvc_any2jpeg(uvc_frame_t *in, uvc_frame_t *out) {
+	switch (in->frame_format) {
+	case UVC_FRAME_FORMAT_YUYV:
+		return yuv422_to_jpeg(in, out, 0, 1);
+	case UVC_FRAME_FORMAT_UYVY:
+		return yuv422_to_jpeg(in, out, 1, 0);
+	case UVC_FRAME_FORMAT_RGB:
+		return packed_to_jpeg(in, out, JCS_RGB, 3);
+	case UVC_FRAME_FORMAT_BGR:
+		return packed_to_jpeg(in, out, JCS_EXT_BGR, 3);
+	case UVC_FRAME_FORMAT_RGBX:
+		return packed_to_jpeg(in, out, JCS_EXT_RGBX, 4);
+	case UVC_FRAME_FORMAT_GRAY8:
+		return packed_to_jpeg(in, out, JCS_GRAYSCALE, 1);
+	case UVC_FRAME_FORMAT_MJPEG:
+		return mjpeg_to_jpeg(in, out);	// XXX
+	default:
+		return UVC_ERROR_NOT_SUPPORTED;
+	}
+}
@@ -57,9 +57,13 @@ uvc_error_t uvc_ensure_frame_size(uvc_frame_t *frame, size_t need_bytes) {
 
        // LOGE("mIFrameCallback...uvc_ensure_frame_size...uvc_ensure_frame_size");
 	if LIKELY(frame->library_owns_data) {
-		if UNLIKELY(!frame->data || frame->data_bytes != need_bytes) {
+		// XXX keep larger buffer to avoid realloc when the frame is reused for smaller image
+		if UNLIKELY(!frame->data || frame->capacity_bytes < need_bytes) {
+			frame->data = realloc(frame->data, need_bytes);
+			frame->capacity_bytes = frame->data ? need_bytes : 0;
+		}
+		if UNLIKELY(frame->data_bytes != need_bytes) {
 			frame->actual_bytes = frame->data_bytes = need_bytes;	// XXX
-			frame->data = realloc(frame->data, frame->data_bytes);
 		}
 		if (UNLIKELY(!frame->data || !need_bytes))
 			return UVC_ERROR_NO_MEM;
@@ -90,15 +94,19 @@ uvc_frame_t *uvc_allocate_frame(size_t data_bytes) {
 #endif
 //	frame->library_owns_data = 1;	// XXX moved to lower
 
+	frame->library_owns_data = 1;
 	if (LIKELY(data_bytes > 0)) {
-		frame->library_owns_data = 1;
-		frame->actual_bytes = frame->data_bytes = data_bytes;	// XXX
+		frame->actual_bytes = frame->data_bytes = frame->capacity_bytes = data_bytes;	// XXX
 		frame->data = malloc(data_bytes);
 
 		if (UNLIKELY(!frame->data)) {
 			free(frame);
 			return NULL ;
 		}
+	} else {
+		// XXX these fields are not cleared on Android
+		frame->data = NULL;
+		frame->actual_bytes = frame->data_bytes = frame->capacity_bytes = 0;
 	}
 
 	return frame;
@@ -110,7 +118,7 @@ uvc_frame_t *uvc_allocate_frame(size_t data_bytes) {
  * @param frame Frame to destroy
  */
 void uvc_free_frame(uvc_frame_t *frame) {
-	if ((frame->data_bytes > 0) && frame->library_owns_data)
+	if (frame->data && frame->library_owns_data)	// XXX data_bytes may be smaller than buffer
 		free(frame->data);
 
 	free(frame);
@@ -190,6 +198,57 @@ uvc_error_t uvc_duplicate_frame(uvc_frame_t *in, uvc_frame_t *out) {
 #define PIXEL4_BGR			PIXEL_BGR * 4
 #define PIXEL4_RGBX			PIXEL_RGBX * 4
 
+/** @brief Scale YUYV frame with nearest neighbor sampling, XXX
+ * @ingroup frame
+ *
+ * This is mainly for reducing the cost of color conversion for consumers
+ * that do not need full resolution, so quality is not a concern.
+ * @param in YUYV frame
+ * @param out scaled YUYV frame
+ * @param width width of scaled frame, rounded down to even number
+ * @param height height of scaled frame
+ */
+uvc_error_t uvc_yuyv_scale(uvc_frame_t *in, uvc_frame_t *out, int width, int height) {
+	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_YUYV))
+		return UVC_ERROR_INVALID_PARAM;
+	width &= ~1;	// YUYV has one U/V pair for two pixels
+	if (UNLIKELY((width <= 0) || (height <= 0) || (in->width < 2) || (in->height <= 0)))
+		return UVC_ERROR_INVALID_PARAM;
+	if (UNLIKELY(uvc_ensure_frame_size(out, width * height * PIXEL_YUYV) < 0))
+		return UVC_ERROR_NO_MEM;
+
+	out->width = width;
+	out->height = height;
+	out->frame_format = UVC_FRAME_FORMAT_YUYV;
+	if (out->library_owns_data)
+		out->step = width * PIXEL_YUYV;
+	out->sequence = in->sequence;
+	out->capture_time = in->capture_time;
+	out->source = in->source;
+
+	const int istep = in->step ? in->step : in->width * PIXEL_YUYV;
+	const int ostep = out->step ? out->step : width * PIXEL_YUYV;
+	// 16.16 fixed point source position
+	const uint32_t dx = ((uint32_t)in->width << 16) / width;
+	const uint32_t dy = ((uint32_t)in->height << 16) / height;
+	int h, w;
+	for (h = 0; h < height; h++) {
+		const uint8_t *ip = (uint8_t *)in->data + (((uint64_t)h * dy) >> 16) * istep;
+		uint8_t *op = (uint8_t *)out->data + h * ostep;
+		for (w = 0; w < width; w += 2) {
+			const uint32_t x0 = (uint32_t)(((uint64_t)w * dx) >> 16);
+			const uint32_t x1 = (uint32_t)(((uint64_t)(w + 1) * dx) >> 16);
+			const uint8_t *yuyv = ip + (x0 & ~1) * PIXEL_YUYV;	// macro pixel that has x0
+			*(op++) = ip[x0 * PIXEL_YUYV];	// y
+			*(op++) = yuyv[1];				// u
+			*(op++) = ip[x1 * PIXEL_YUYV];	// y'
+			*(op++) = yuyv[3];				// v
+		}
+	}
+	out->actual_bytes = ostep * height;
+	return UVC_SUCCESS;
+}
+
 #define PIXEL8_RGB565		PIXEL_RGB565 * 8
 #define PIXEL8_UYVY			PIXEL_UYVY * 8
 #define PIXEL8_YUYV			PIXEL_YUYV * 8
@@ -195,6 +195,8 @@ void uvc_exit(uvc_context_t *ctx) {
 	if (ctx->own_usb_ctx)
 		libusb_exit(ctx->usb_ctx);
 
+	uvc_mjpeg_stop_parallel();	// XXX terminate worker threads of parallel MJPEG decoding
+
 	free(ctx);
 }
 
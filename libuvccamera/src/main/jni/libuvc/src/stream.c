@@ -596,12 +596,38 @@ uvc_error_t uvc_probe_stream_ctrl(uvc_device_handle_t *devh,
 	return UVC_SUCCESS;
 }
 
+/** @internal XXX
+ * @brief Estimate the time when the device started capturing current frame.
+ * Elapsed time since start of capture is recovered from PTS and SCR(device clock
+ * in dwClockFrequency). If they are not available, the time when the frame
+ * completed is used.
+ */
+static void _uvc_recover_capture_time(uvc_stream_handle_t *strmh, struct timeval *tv) {
+	struct timespec ts;
+	int64_t us;
+	const uint32_t freq = strmh->cur_ctrl.dwClockFrequency;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	us = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	if (strmh->pts && strmh->last_scr && freq) {
+		// unsigned arithmetic handles wrap around of the device clock
+		const uint32_t elapsed = strmh->last_scr - strmh->pts;
+		const int64_t elapsed_us = (int64_t)elapsed * 1000000 / freq;
+		if (LIKELY(elapsed_us < 1000000))	// ignore obviously broken clock
+			us -= elapsed_us;
+	}
+	tv->tv_sec = us / 1000000;
+	tv->tv_usec = us % 1000000;
+}
+
 /** @internal
  * @brief Swap the working buffer with the presented buffer and notify consumers
  */
 static void _uvc_swap_buffers(uvc_stream_handle_t *strmh) {
 	uint8_t *tmp_buf;
+	struct timeval capture_time;
 
+	_uvc_recover_capture_time(strmh, &capture_time);
 	pthread_mutex_lock(&strmh->cb_mutex);
 	{
 		/* swap the buffers */
@@ -613,6 +639,7 @@ static void _uvc_swap_buffers(uvc_stream_handle_t *strmh) {
 		strmh->hold_last_scr = strmh->last_scr;
 		strmh->hold_pts = strmh->pts;
 		strmh->hold_seq = strmh->seq;
+		strmh->hold_capture_time = capture_time;
 
 		pthread_cond_broadcast(&strmh->cb_cond);
 	}
@@ -1714,11 +1741,12 @@ void _uvc_populate_frame(uvc_stream_handle_t *strmh) {
 	/* copy the image data from the hold buffer to the frame (unnecessary extra buf?) */
 	if (UNLIKELY(frame->data_bytes < strmh->hold_bytes)) {
 		frame->data = realloc(frame->data, strmh->hold_bytes);	// TODO add error handling when failed realloc
-		frame->data_bytes = strmh->hold_bytes;
+		frame->capacity_bytes = frame->data_bytes = strmh->hold_bytes;
 	}
 	memcpy(frame->data, strmh->holdbuf, strmh->hold_bytes/*frame->data_bytes*/);	// XXX
 
-	/** @todo set the frame time */
+	frame->sequence = strmh->hold_seq;	// XXX
+	frame->capture_time = strmh->hold_capture_time;	// XXX
 }
 
 /** Poll for a frame